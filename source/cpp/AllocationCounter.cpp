@@ -0,0 +1,168 @@
+#include "../header/AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// The replaceable global operator new/delete, forwarding to malloc/free and counting.
+
+namespace {
+
+std::atomic<unsigned long long> totalAllocations(0);
+thread_local unsigned long long threadAllocations = 0;
+
+void* CountedAllocate(size_t size)
+{
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    threadAllocations++;
+    return std::malloc(size ? size : 1);
+}
+
+#ifdef __cpp_aligned_new
+// over-aligned types (alignas above the default new alignment) come through here; the memory has to go
+// back to the matching free, which is not std::free on Windows
+void* CountedAllocateAligned(size_t size, std::align_val_t alignment)
+{
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    threadAllocations++;
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, (size_t)alignment);
+#else
+    void* memory = nullptr;
+    return posix_memalign(&memory, (size_t)alignment, size ? size : 1) == 0 ? memory : nullptr;
+#endif
+}
+
+void FreeAligned(void* memory)
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+#endif
+
+}
+
+unsigned long long AllocationCounter::Total()
+{
+    return totalAllocations.load(std::memory_order_relaxed);
+}
+
+unsigned long long AllocationCounter::ThisThread()
+{
+    return threadAllocations;
+}
+
+void* operator new(size_t size)
+{
+    void* memory = CountedAllocate(size);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* memory = CountedAllocateAligned(size, alignment);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return CountedAllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return CountedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    FreeAligned(memory);
+}
+#endif
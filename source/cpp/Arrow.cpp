@@ -1,4 +1,5 @@
 #include "../header/Arrow.h"
+#include "../header/GLState.h"
 #include "../header/Shader.h"
 
 Arrow::Arrow(float shaftLength, float shaftRadius,
@@ -69,7 +70,7 @@ Mesh Arrow::generateHead(float baseZ, float height, float radius, int segments)
     return Mesh(vertices, indices, {});
 }
 
-void Arrow::Draw(const glm::vec3& dir, Shader& shader, const glm::vec3& pos, float scale, const glm::vec3& color) {
+glm::mat4 Arrow::ModelMatrix(const glm::vec3& dir, const glm::vec3& pos, float scale) {
     glm::vec3 defaultDir(0.0f, 0.0f, -1.0f);
     glm::vec3 targetDir = glm::normalize(dir);
     glm::vec3 axis = glm::cross(defaultDir, targetDir);
@@ -85,12 +86,19 @@ void Arrow::Draw(const glm::vec3& dir, Shader& shader, const glm::vec3& pos, flo
         model = glm::rotate(model, angle, glm::normalize(axis));
     }
     model = glm::scale(model, glm::vec3(scale));
+    return model;
+}
 
+void Arrow::Draw(const glm::vec3& dir, Shader& shader, const glm::vec3& pos, float scale, const glm::vec3& color) {
     shader.use();
-    shader.setMat4("model", model);
+    shader.setMat4("model", ModelMatrix(dir, pos, scale));
     shader.setVec3("color", color);
-    glDisable(GL_CULL_FACE);
+    DrawGeometry(shader);
+}
+
+void Arrow::DrawGeometry(Shader& shader) {
+    GLState::Disable(GL_CULL_FACE);
     shaft.Draw(shader);
     head.Draw(shader);
-    glEnable(GL_CULL_FACE);
+    GLState::Enable(GL_CULL_FACE);
 }
\ No newline at end of file
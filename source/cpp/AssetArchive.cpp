@@ -0,0 +1,308 @@
+#include "../header/AssetArchive.h"
+#include "../header/Lz4.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const char ARCHIVE_MAGIC[4] = { 'R', 'P', 'A', 'K' };
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// appends the files below path, or path itself when it is a file; false when it does not exist
+#ifdef _WIN32
+bool ListFiles(const std::string& path, std::vector<std::string>& files)
+{
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES)
+        return false;
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        files.push_back(path);
+        return true;
+    }
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((path + "/*").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE)
+        return true;
+    do
+    {
+        std::string name = found.cFileName;
+        if (name != "." && name != "..")
+            ListFiles(path + "/" + name, files);
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+    return true;
+}
+#else
+bool ListFiles(const std::string& path, std::vector<std::string>& files)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+        return false;
+    if (!S_ISDIR(status.st_mode))
+    {
+        if (S_ISREG(status.st_mode))
+            files.push_back(path);
+        return true;
+    }
+    DIR* directory = opendir(path.c_str());
+    if (!directory)
+        return true;
+    while (dirent* found = readdir(directory))
+    {
+        std::string name = found->d_name;
+        if (name != "." && name != "..")
+            ListFiles(path + "/" + name, files);
+    }
+    closedir(directory);
+    return true;
+}
+#endif
+
+}
+
+std::string NormalizeAssetPath(const std::string& path)
+{
+    std::vector<std::string> segments;
+    size_t begin = 0;
+    while (begin <= path.size())
+    {
+        size_t end = path.find_first_of("/\\", begin);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string segment = path.substr(begin, end - begin);
+        if (segment == "..")
+        {
+            if (!segments.empty() && segments.back() != "..")
+                segments.pop_back();
+            else
+                segments.push_back(segment);
+        }
+        else if (!segment.empty() && segment != ".")
+            segments.push_back(segment);
+        begin = end + 1;
+    }
+
+    // absolute paths keep their leading separator
+    std::string normalized = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        if (i > 0)
+            normalized += '/';
+        normalized += segments[i];
+    }
+    return normalized;
+}
+
+uint64_t HashAssetPath(const std::string& normalizedPath)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (char c : normalizedPath)
+        hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+    return hash;
+}
+
+bool AssetArchive::Open(const std::string& path)
+{
+    header = nullptr;
+    if (!file.Open(path))
+        return false;
+
+    // everything is checked once here, so lookups and reads can trust the offsets
+    size_t size = file.Size();
+    const ArchiveHeader* candidate = (const ArchiveHeader*)file.Data();
+    bool valid = size >= sizeof(ArchiveHeader) && std::memcmp(candidate->magic, ARCHIVE_MAGIC, 4) == 0 &&
+        candidate->version == ARCHIVE_VERSION && candidate->slotCount > 0 &&
+        (candidate->slotCount & (candidate->slotCount - 1)) == 0 && candidate->slotCount > candidate->entryCount &&
+        candidate->entriesOffset % 8 == 0 && candidate->slotsOffset % 4 == 0 &&
+        candidate->entriesOffset <= size && (size - candidate->entriesOffset) / sizeof(ArchiveEntry) >= candidate->entryCount &&
+        candidate->slotsOffset <= size && (size - candidate->slotsOffset) / sizeof(uint32_t) >= candidate->slotCount &&
+        candidate->namesOffset <= size && size - candidate->namesOffset >= candidate->namesSize;
+    if (valid)
+    {
+        const ArchiveEntry* candidateEntries = (const ArchiveEntry*)(file.Data() + candidate->entriesOffset);
+        for (uint32_t i = 0; i < candidate->entryCount && valid; i++)
+        {
+            const ArchiveEntry& entry = candidateEntries[i];
+            valid = entry.offset <= size && size - entry.offset >= entry.storedSize &&
+                entry.nameOffset <= candidate->namesSize && candidate->namesSize - entry.nameOffset >= entry.nameLength &&
+                (entry.compression == ARCHIVE_LZ4 || (entry.compression == ARCHIVE_STORED && entry.storedSize == entry.size));
+        }
+        const uint32_t* candidateSlots = (const uint32_t*)(file.Data() + candidate->slotsOffset);
+        for (uint32_t i = 0; i < candidate->slotCount && valid; i++)
+            valid = candidateSlots[i] <= candidate->entryCount;
+    }
+    if (!valid)
+    {
+        std::cout << "ERROR::ARCHIVE::Not a valid asset archive: " << path << std::endl;
+        file.Close();
+        return false;
+    }
+
+    header = candidate;
+    entries = (const ArchiveEntry*)(file.Data() + header->entriesOffset);
+    slots = (const uint32_t*)(file.Data() + header->slotsOffset);
+    names = file.Data() + header->namesOffset;
+    return true;
+}
+
+int AssetArchive::Find(const std::string& normalizedPath) const
+{
+    if (!header)
+        return -1;
+    uint64_t hash = HashAssetPath(normalizedPath);
+    uint32_t mask = header->slotCount - 1;
+    // at least one slot is empty, so the probe always ends
+    for (uint32_t slot = (uint32_t)hash & mask, probes = 0; probes < header->slotCount; slot = (slot + 1) & mask, probes++)
+    {
+        if (slots[slot] == 0)
+            return -1;
+        const ArchiveEntry& entry = entries[slots[slot] - 1];
+        if (entry.hash == hash && entry.nameLength == normalizedPath.size() &&
+            std::memcmp(names + entry.nameOffset, normalizedPath.data(), entry.nameLength) == 0)
+            return (int)slots[slot] - 1;
+    }
+    return -1;
+}
+
+std::string AssetArchive::EntryName(int index) const
+{
+    return std::string(names + entries[index].nameOffset, entries[index].nameLength);
+}
+
+bool PackArchive(const std::string& archivePath, const std::vector<std::string>& inputs)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::string> paths;
+    for (const std::string& input : inputs)
+    {
+        if (!ListFiles(input, paths))
+            std::cout << "ERROR::ARCHIVE::No such file or directory: " << input << std::endl;
+    }
+    // sorted by name so the same inputs always give the same archive; the archive itself is left out
+    std::string normalizedArchive = NormalizeAssetPath(archivePath);
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const std::string& path : paths)
+    {
+        std::string name = NormalizeAssetPath(path);
+        if (name != normalizedArchive)
+            files.push_back({ name, path });
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end(),
+        [](const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b) { return a.first == b.first; }), files.end());
+    if (files.empty())
+    {
+        std::cout << "ERROR::ARCHIVE::Nothing to pack" << std::endl;
+        return false;
+    }
+
+    // the table of contents is sized up front; the data follows it
+    ArchiveHeader header = {};
+    std::memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    header.version = ARCHIVE_VERSION;
+    header.entryCount = (uint32_t)files.size();
+    header.slotCount = 1;
+    while (header.slotCount < files.size() * 2)
+        header.slotCount <<= 1;
+    std::vector<ArchiveEntry> entries(files.size());
+    std::vector<uint32_t> slots(header.slotCount, 0);
+    std::string names;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        ArchiveEntry& entry = entries[i];
+        entry = ArchiveEntry();
+        entry.hash = HashAssetPath(files[i].first);
+        entry.nameOffset = (uint32_t)names.size();
+        entry.nameLength = (uint32_t)files[i].first.size();
+        names += files[i].first;
+        uint32_t slot = (uint32_t)entry.hash & (header.slotCount - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (header.slotCount - 1);
+        slots[slot] = (uint32_t)i + 1;
+    }
+    header.entriesOffset = sizeof(ArchiveHeader);
+    header.slotsOffset = header.entriesOffset + entries.size() * sizeof(ArchiveEntry);
+    header.namesOffset = header.slotsOffset + slots.size() * sizeof(uint32_t);
+    header.namesSize = names.size();
+
+    std::ofstream out(archivePath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cout << "ERROR::ARCHIVE::Could not write " << archivePath << std::endl;
+        return false;
+    }
+    uint64_t offset = AlignUp(header.namesOffset + header.namesSize, ARCHIVE_ALIGNMENT);
+    out.seekp((std::streamoff)offset);
+
+    uint64_t totalSize = 0;
+    uint64_t storedSize = 0;
+    int compressed = 0;
+    std::vector<char> buffer;
+    const std::vector<char> padding(ARCHIVE_ALIGNMENT, 0);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        MappedFile source;
+        if (!source.Open(files[i].second))
+        {
+            std::cout << "ERROR::ARCHIVE::Could not read " << files[i].second << std::endl;
+            return false;
+        }
+        ArchiveEntry& entry = entries[i];
+        entry.offset = offset;
+        entry.size = source.Size();
+        const char* data = source.Data();
+        entry.storedSize = entry.size;
+        entry.compression = ARCHIVE_STORED;
+        // already compressed formats (jpg, png) rarely shrink, and stored entries are read in place
+        buffer.resize(Lz4CompressBound(source.Size()));
+        size_t lz4Size = source.Size() > 0 ? Lz4Compress(source.Data(), source.Size(), buffer.data(), buffer.size()) : 0;
+        if (lz4Size > 0 && lz4Size <= entry.size - entry.size / 8)
+        {
+            data = buffer.data();
+            entry.storedSize = lz4Size;
+            entry.compression = ARCHIVE_LZ4;
+            compressed++;
+        }
+        out.write(data, (std::streamsize)entry.storedSize);
+        offset += entry.storedSize;
+        uint64_t aligned = AlignUp(offset, ARCHIVE_ALIGNMENT);
+        out.write(padding.data(), (std::streamsize)(aligned - offset));
+        offset = aligned;
+        totalSize += entry.size;
+        storedSize += entry.storedSize;
+    }
+
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+    out.write((const char*)slots.data(), slots.size() * sizeof(uint32_t));
+    out.write(names.data(), names.size());
+    if (!out)
+    {
+        std::cout << "ERROR::ARCHIVE::Could not write " << archivePath << std::endl;
+        return false;
+    }
+    std::cout << "Archive: packed " << files.size() << " files, " << totalSize / (1024.0 * 1024.0) << " MB into "
+        << storedSize / (1024.0 * 1024.0) << " MB (" << compressed << " LZ4 compressed) in "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms: "
+        << archivePath << std::endl;
+    return true;
+}
@@ -0,0 +1,553 @@
+#include "../header/BVH.h"
+#include "../header/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <xmmintrin.h>
+
+namespace {
+
+const int SAH_BINS = 16;
+// cost of visiting a node relative to one primitive test
+const float TRAVERSAL_COST = 1.0f;
+// subtrees bigger than this are built as separate jobs, down to MAX_PARALLEL_DEPTH levels
+const int PARALLEL_BUILD_THRESHOLD = 4096;
+const int MAX_PARALLEL_DEPTH = 3;
+const int TRAVERSAL_STACK_SIZE = 256;
+
+const uint32_t CACHE_MAGIC = 0x34485642;  // "BVH4"
+const uint32_t CACHE_VERSION = 1;
+
+float SurfaceArea(const AABB& box)
+{
+    glm::vec3 d = box.max - box.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+struct BuildNode {
+    AABB bounds;
+    std::unique_ptr<BuildNode> children[2];
+    int first = 0;
+    int count = 0;
+
+    bool IsLeaf() const { return !children[0]; }
+};
+
+struct BuildContext {
+    const std::vector<AABB>& bounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<unsigned int>& order;
+    int maxLeafSize;
+
+    BuildContext(const std::vector<AABB>& bounds, std::vector<unsigned int>& order, int maxLeafSize)
+        : bounds(bounds), order(order), maxLeafSize(maxLeafSize)
+    {
+        centroids.reserve(bounds.size());
+        for (const AABB& box : bounds)
+            centroids.push_back(box.Center());
+    }
+};
+
+// Binned SAH split of order[first, first + count). Sibling ranges are disjoint, so subtrees can be
+// built concurrently without locking.
+std::unique_ptr<BuildNode> BuildRecursive(BuildContext& context, int first, int count, int depth)
+{
+    std::unique_ptr<BuildNode> node(new BuildNode());
+    node->first = first;
+    node->count = count;
+    AABB centroidBounds;
+    for (int i = first; i < first + count; i++)
+    {
+        node->bounds.Expand(context.bounds[context.order[i]]);
+        centroidBounds.Expand(context.centroids[context.order[i]]);
+    }
+    if (count <= 1)
+        return node;
+
+    struct Bin {
+        AABB bounds;
+        int count = 0;
+    };
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestSplit = -1;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0.0f)
+            continue;
+        float scale = SAH_BINS / extent;
+        Bin bins[SAH_BINS];
+        for (int i = first; i < first + count; i++)
+        {
+            unsigned int primitive = context.order[i];
+            int bin = std::min(SAH_BINS - 1, (int)((context.centroids[primitive][axis] - centroidBounds.min[axis]) * scale));
+            bins[bin].count++;
+            bins[bin].bounds.Expand(context.bounds[primitive]);
+        }
+
+        // sweep from the right, then from the left to price every plane between two bins
+        float rightArea[SAH_BINS - 1];
+        int rightCount[SAH_BINS - 1];
+        AABB accumulated;
+        int accumulatedCount = 0;
+        for (int b = SAH_BINS - 1; b > 0; b--)
+        {
+            accumulated.Expand(bins[b].bounds);
+            accumulatedCount += bins[b].count;
+            rightArea[b - 1] = accumulatedCount > 0 ? SurfaceArea(accumulated) : 0.0f;
+            rightCount[b - 1] = accumulatedCount;
+        }
+        accumulated = AABB();
+        accumulatedCount = 0;
+        for (int b = 0; b < SAH_BINS - 1; b++)
+        {
+            accumulated.Expand(bins[b].bounds);
+            accumulatedCount += bins[b].count;
+            if (accumulatedCount == 0 || rightCount[b] == 0)
+                continue;
+            float cost = accumulatedCount * SurfaceArea(accumulated) + rightCount[b] * rightArea[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    float nodeArea = SurfaceArea(node->bounds);
+    bool splitPays = bestAxis >= 0 && TRAVERSAL_COST * nodeArea + bestCost < count * nodeArea;
+    if (!splitPays && count <= context.maxLeafSize)
+        return node;
+
+    int mid;
+    if (bestAxis >= 0)
+    {
+        float scale = SAH_BINS / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        float axisMin = centroidBounds.min[bestAxis];
+        auto split = std::partition(context.order.begin() + first, context.order.begin() + first + count,
+            [&](unsigned int primitive) {
+                int bin = std::min(SAH_BINS - 1, (int)((context.centroids[primitive][bestAxis] - axisMin) * scale));
+                return bin <= bestSplit;
+            });
+        mid = (int)(split - context.order.begin());
+    }
+    else
+    {
+        // every centroid in the same spot: any split is as good as another
+        mid = first + count / 2;
+    }
+    if (mid == first || mid == first + count)
+        mid = first + count / 2;
+
+    if (count > PARALLEL_BUILD_THRESHOLD && depth < MAX_PARALLEL_DEPTH)
+    {
+        JobCounter left;
+        JobSystem::Run([&] { node->children[0] = BuildRecursive(context, first, mid - first, depth + 1); }, &left);
+        node->children[1] = BuildRecursive(context, mid, first + count - mid, depth + 1);
+        JobSystem::Wait(left);
+    }
+    else
+    {
+        node->children[0] = BuildRecursive(context, first, mid - first, depth + 1);
+        node->children[1] = BuildRecursive(context, mid, first + count - mid, depth + 1);
+    }
+    return node;
+}
+
+void SetSlot(BVHNode4& node, int slot, const AABB& bounds, int child, int count)
+{
+    node.minX[slot] = bounds.min.x;
+    node.minY[slot] = bounds.min.y;
+    node.minZ[slot] = bounds.min.z;
+    node.maxX[slot] = bounds.max.x;
+    node.maxY[slot] = bounds.max.y;
+    node.maxZ[slot] = bounds.max.z;
+    node.child[slot] = child;
+    node.count[slot] = count;
+}
+
+BVHNode4 EmptyNode()
+{
+    BVHNode4 node;
+    for (int i = 0; i < 4; i++)
+        SetSlot(node, i, AABB(), 0, 0);
+    return node;
+}
+
+// Pull the grandchildren with the largest boxes up until the node has four children.
+int Collapse(std::vector<BVHNode4>& nodes, const BuildNode* root)
+{
+    const BuildNode* slots[4];
+    int used = 0;
+    if (root->IsLeaf())
+        slots[used++] = root;
+    else
+    {
+        slots[used++] = root->children[0].get();
+        slots[used++] = root->children[1].get();
+    }
+    while (used < 4)
+    {
+        int open = -1;
+        float largest = -1.0f;
+        for (int i = 0; i < used; i++)
+        {
+            if (!slots[i]->IsLeaf() && SurfaceArea(slots[i]->bounds) > largest)
+            {
+                largest = SurfaceArea(slots[i]->bounds);
+                open = i;
+            }
+        }
+        if (open < 0)
+            break;
+        const BuildNode* opened = slots[open];
+        slots[open] = opened->children[0].get();
+        slots[used++] = opened->children[1].get();
+    }
+
+    int index = (int)nodes.size();
+    nodes.push_back(EmptyNode());
+    // children are appended after their parent, so the node is filled locally and stored at the end
+    BVHNode4 node = EmptyNode();
+    for (int i = 0; i < used; i++)
+    {
+        if (slots[i]->IsLeaf())
+            SetSlot(node, i, slots[i]->bounds, ~slots[i]->first, slots[i]->count);
+        else
+            SetSlot(node, i, slots[i]->bounds, Collapse(nodes, slots[i]), 0);
+    }
+    nodes[index] = node;
+    return index;
+}
+
+// Walk the four-wide tree front to back. leaf(first, count, tMax) tests a range of primitives,
+// shrinks tMax on a hit and returns true to stop the traversal.
+template <typename LeafFunc>
+void Traverse(const BVH4& bvh, const Ray& ray, float tMax, LeafFunc leaf)
+{
+    if (bvh.IsEmpty())
+        return;
+
+    // keep the reciprocal finite so 0 * inf never turns a slab test into NaN
+    glm::vec3 invDir;
+    for (int i = 0; i < 3; i++)
+    {
+        float d = std::fabs(ray.direction[i]) < 1e-12f ? (ray.direction[i] < 0.0f ? -1e-12f : 1e-12f) : ray.direction[i];
+        invDir[i] = 1.0f / d;
+    }
+    __m128 invX = _mm_set1_ps(invDir.x), invY = _mm_set1_ps(invDir.y), invZ = _mm_set1_ps(invDir.z);
+    __m128 originX = _mm_set1_ps(ray.origin.x), originY = _mm_set1_ps(ray.origin.y), originZ = _mm_set1_ps(ray.origin.z);
+    __m128 rayMin = _mm_set1_ps(ray.tMin);
+
+    struct Entry {
+        int child;
+        int count;
+        float tNear;
+    };
+    Entry stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = { 0, 0, ray.tMin };
+    while (top > 0)
+    {
+        Entry entry = stack[--top];
+        if (entry.tNear > tMax)
+            continue;
+        if (entry.count > 0)
+        {
+            if (leaf(~entry.child, entry.count, tMax))
+                return;
+            continue;
+        }
+
+        const BVHNode4& node = bvh.nodes[entry.child];
+        __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), invX);
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), invX);
+        __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), invY);
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), invY);
+        __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), invZ);
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), invZ);
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), rayMin));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+        if (mask == 0)
+            continue;
+        float nearT[4];
+        _mm_storeu_ps(nearT, tNear);
+
+        // push far to near so the nearest child is popped first
+        int order[4];
+        int hits = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if ((mask & (1 << i)) && (node.child[i] != 0 || node.count[i] > 0))
+            {
+                int j = hits++;
+                while (j > 0 && nearT[order[j - 1]] < nearT[i])
+                {
+                    order[j] = order[j - 1];
+                    j--;
+                }
+                order[j] = i;
+            }
+        }
+        for (int k = 0; k < hits; k++)
+        {
+            if (top == TRAVERSAL_STACK_SIZE)
+            {
+                std::cout << "ERROR::BVH:: Traversal stack overflow" << std::endl;
+                return;
+            }
+            int i = order[k];
+            stack[top++] = { node.child[i], node.count[i], nearT[i] };
+        }
+    }
+}
+
+template <typename T>
+void WriteVector(std::ostream& out, const std::vector<T>& data)
+{
+    uint32_t size = (uint32_t)data.size();
+    out.write((const char*)&size, sizeof(size));
+    if (size > 0)
+        out.write((const char*)data.data(), sizeof(T) * size);
+}
+
+template <typename T>
+bool ReadVector(std::istream& in, std::vector<T>& data)
+{
+    uint32_t size = 0;
+    if (!in.read((char*)&size, sizeof(size)))
+        return false;
+    data.resize(size);
+    if (size > 0)
+        in.read((char*)data.data(), sizeof(T) * size);
+    return (bool)in;
+}
+
+}
+
+void BVH4::Build(const std::vector<AABB>& primitiveBounds, int maxLeafSize)
+{
+    nodes.clear();
+    primitives.resize(primitiveBounds.size());
+    for (unsigned int i = 0; i < primitives.size(); i++)
+        primitives[i] = i;
+    bounds = AABB();
+    if (primitiveBounds.empty())
+        return;
+
+    BuildContext context(primitiveBounds, primitives, maxLeafSize);
+    std::unique_ptr<BuildNode> root = BuildRecursive(context, 0, (int)primitiveBounds.size(), 0);
+    bounds = root->bounds;
+    Collapse(nodes, root.get());
+}
+
+void MeshBVH::Build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    std::vector<AABB> triangleBounds;
+    triangleBounds.reserve(indices.size() / 3);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        AABB box;
+        box.Expand(positions[indices[i]]);
+        box.Expand(positions[indices[i + 1]]);
+        box.Expand(positions[indices[i + 2]]);
+        triangleBounds.push_back(box);
+    }
+    bvh.Build(triangleBounds);
+
+    // store the triangles in leaf order so a leaf reads one contiguous block
+    triangles.resize(bvh.primitives.size());
+    for (size_t i = 0; i < bvh.primitives.size(); i++)
+    {
+        size_t base = (size_t)bvh.primitives[i] * 3;
+        glm::vec3 v0 = positions[indices[base]];
+        triangles[i] = { v0, positions[indices[base + 1]] - v0, positions[indices[base + 2]] - v0 };
+    }
+}
+
+bool MeshBVH::Intersect(const Ray& ray, RayHit& hit) const
+{
+    bool found = false;
+    Traverse(bvh, ray, std::min(hit.t, ray.tMax), [&](int first, int count, float& tMax) {
+        for (int i = first; i < first + count; i++)
+        {
+            // Moller-Trumbore
+            const Triangle& triangle = triangles[i];
+            glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+            float det = glm::dot(triangle.edge1, p);
+            if (std::fabs(det) < 1e-12f)
+                continue;
+            float invDet = 1.0f / det;
+            glm::vec3 s = ray.origin - triangle.v0;
+            float u = glm::dot(s, p) * invDet;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+            glm::vec3 q = glm::cross(s, triangle.edge1);
+            float v = glm::dot(ray.direction, q) * invDet;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+            float t = glm::dot(triangle.edge2, q) * invDet;
+            if (t <= ray.tMin || t >= tMax)
+                continue;
+            tMax = t;
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+            hit.triangle = bvh.primitives[i];
+            found = true;
+        }
+        return false;
+    });
+    return found;
+}
+
+bool MeshBVH::Occluded(const Ray& ray) const
+{
+    bool occluded = false;
+    Traverse(bvh, ray, ray.tMax, [&](int first, int count, float& tMax) {
+        for (int i = first; i < first + count; i++)
+        {
+            const Triangle& triangle = triangles[i];
+            glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+            float det = glm::dot(triangle.edge1, p);
+            if (std::fabs(det) < 1e-12f)
+                continue;
+            float invDet = 1.0f / det;
+            glm::vec3 s = ray.origin - triangle.v0;
+            float u = glm::dot(s, p) * invDet;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+            glm::vec3 q = glm::cross(s, triangle.edge1);
+            float v = glm::dot(ray.direction, q) * invDet;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+            float t = glm::dot(triangle.edge2, q) * invDet;
+            if (t > ray.tMin && t < tMax)
+            {
+                occluded = true;
+                return true;
+            }
+        }
+        return false;
+    });
+    return occluded;
+}
+
+void MeshBVH::Save(std::ostream& out, unsigned long long sourceHash) const
+{
+    out.write((const char*)&CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    out.write((const char*)&CACHE_VERSION, sizeof(CACHE_VERSION));
+    out.write((const char*)&sourceHash, sizeof(sourceHash));
+    out.write((const char*)&bvh.bounds, sizeof(bvh.bounds));
+    WriteVector(out, bvh.nodes);
+    WriteVector(out, bvh.primitives);
+    WriteVector(out, triangles);
+}
+
+bool MeshBVH::Load(std::istream& in, unsigned long long sourceHash)
+{
+    uint32_t magic = 0, version = 0;
+    unsigned long long hash = 0;
+    in.read((char*)&magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&hash, sizeof(hash));
+    if (!in || magic != CACHE_MAGIC || version != CACHE_VERSION || hash != sourceHash)
+        return false;
+    in.read((char*)&bvh.bounds, sizeof(bvh.bounds));
+    if (!ReadVector(in, bvh.nodes) || !ReadVector(in, bvh.primitives) || !ReadVector(in, triangles) ||
+        triangles.size() != bvh.primitives.size())
+    {
+        bvh = BVH4();
+        triangles.clear();
+        return false;
+    }
+    return true;
+}
+
+unsigned long long MeshBVH::HashGeometry(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    // FNV-1a over the raw positions and indices
+    unsigned long long hash = 1469598103934665603ULL;
+    auto mix = [&](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    if (!positions.empty())
+        mix(positions.data(), positions.size() * sizeof(glm::vec3));
+    if (!indices.empty())
+        mix(indices.data(), indices.size() * sizeof(unsigned int));
+    return hash;
+}
+
+void SceneBVH::AddInstance(const MeshBVH* mesh, const glm::mat4& transform, int id)
+{
+    instances.push_back({ mesh, transform, glm::inverse(transform), id });
+}
+
+void SceneBVH::Clear()
+{
+    instances.clear();
+    bvh = BVH4();
+}
+
+void SceneBVH::Build()
+{
+    std::vector<AABB> instanceBounds;
+    for (const Instance& instance : instances)
+        instanceBounds.push_back(TransformAABB(instance.mesh->bvh.bounds, instance.transform));
+    bvh.Build(instanceBounds, 1);
+}
+
+bool SceneBVH::Intersect(const Ray& ray, RayHit& hit) const
+{
+    bool found = false;
+    Traverse(bvh, ray, std::min(hit.t, ray.tMax), [&](int first, int count, float& tMax) {
+        for (int i = first; i < first + count; i++)
+        {
+            const Instance& instance = instances[bvh.primitives[i]];
+            // the direction is not renormalized, so t means the same in both spaces
+            Ray local(glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(instance.inverse * glm::vec4(ray.direction, 0.0f)));
+            local.tMin = ray.tMin;
+            local.tMax = tMax;
+            if (instance.mesh->Intersect(local, hit))
+            {
+                hit.instance = instance.id;
+                tMax = hit.t;
+                found = true;
+            }
+        }
+        return false;
+    });
+    return found;
+}
+
+bool SceneBVH::Occluded(const Ray& ray) const
+{
+    bool occluded = false;
+    Traverse(bvh, ray, ray.tMax, [&](int first, int count, float& tMax) {
+        for (int i = first; i < first + count; i++)
+        {
+            const Instance& instance = instances[bvh.primitives[i]];
+            Ray local(glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(instance.inverse * glm::vec4(ray.direction, 0.0f)));
+            local.tMin = ray.tMin;
+            local.tMax = tMax;
+            if (instance.mesh->Occluded(local))
+            {
+                occluded = true;
+                return true;
+            }
+        }
+        return false;
+    });
+    return occluded;
+}
@@ -0,0 +1,504 @@
+#include "../header/Benchmark.h"
+#include "../header/BVH.h"
+#include "../header/JobSystem.h"
+#include "../header/MappedFile.h"
+#include "../header/ObjLoader.h"
+#include "../header/SpatialIndex.h"
+#include "../header/TangentSpace.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// positions and indices of every mesh in the file, without touching GL
+bool LoadGeometry(const std::string& path, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate);
+    if (!scene || !scene->mRootNode)
+        return false;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+    {
+        const aiMesh* mesh = scene->mMeshes[m];
+        unsigned int base = (unsigned int)positions.size();
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+            positions.push_back(glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+        {
+            if (mesh->mFaces[f].mNumIndices != 3)
+                continue;
+            for (unsigned int j = 0; j < 3; j++)
+                indices.push_back(base + mesh->mFaces[f].mIndices[j]);
+        }
+    }
+    return !indices.empty();
+}
+
+// bumpy sphere used when no model is available
+void GenerateSphere(int rings, int sectors, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices)
+{
+    for (int r = 0; r <= rings; r++)
+    {
+        float phi = glm::pi<float>() * r / rings;
+        for (int s = 0; s <= sectors; s++)
+        {
+            float theta = 2.0f * glm::pi<float>() * s / sectors;
+            float radius = 1.0f + 0.05f * std::sin(phi * 17.0f) * std::cos(theta * 13.0f);
+            positions.push_back(radius * glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+        }
+    }
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < sectors; s++)
+        {
+            unsigned int a = r * (sectors + 1) + s;
+            unsigned int b = a + sectors + 1;
+            indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+}
+
+// closest hit against every triangle, the reference the BVH has to agree with
+bool BruteForceIntersect(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const Ray& ray, float& tHit)
+{
+    bool found = false;
+    tHit = ray.tMax;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        glm::vec3 v0 = positions[indices[i]];
+        glm::vec3 edge1 = positions[indices[i + 1]] - v0;
+        glm::vec3 edge2 = positions[indices[i + 2]] - v0;
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float det = glm::dot(edge1, p);
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        float invDet = 1.0f / det;
+        glm::vec3 s = ray.origin - v0;
+        float u = glm::dot(s, p) * invDet;
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.direction, q) * invDet;
+        float t = glm::dot(edge2, q) * invDet;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > ray.tMin && t < tHit)
+        {
+            tHit = t;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void BenchmarkRayQueries(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    std::cout << "BVH: " << indices.size() / 3 << " triangles" << std::endl;
+
+    MeshBVH bvh;
+    Clock::time_point start = Clock::now();
+    bvh.Build(positions, indices);
+    std::cout << "  build: " << SecondsSince(start) * 1000.0 << " ms, " << bvh.bvh.nodes.size() << " nodes" << std::endl;
+
+    // rays from a sphere around the mesh towards random points inside its bounds
+    const int RAY_COUNT = 1 << 20;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::vec3 center = bvh.bvh.bounds.Center();
+    glm::vec3 extents = bvh.bvh.bounds.Extents();
+    float radius = 2.0f * glm::length(extents);
+    std::vector<Ray> rays(RAY_COUNT);
+    for (Ray& ray : rays)
+    {
+        float z = unit(rng) * 2.0f - 1.0f, angle = unit(rng) * 2.0f * glm::pi<float>();
+        float ring = std::sqrt(1.0f - z * z);
+        ray.origin = center + radius * glm::vec3(ring * std::cos(angle), z, ring * std::sin(angle));
+        glm::vec3 target = center + extents * glm::vec3(unit(rng) * 2.0f - 1.0f, unit(rng) * 2.0f - 1.0f, unit(rng) * 2.0f - 1.0f);
+        ray.direction = glm::normalize(target - ray.origin);
+    }
+
+    int hits = 0;
+    start = Clock::now();
+    for (const Ray& ray : rays)
+    {
+        RayHit hit;
+        hits += bvh.Intersect(ray, hit) ? 1 : 0;
+    }
+    double seconds = SecondsSince(start);
+    std::cout << "  closest hit, 1 thread: " << RAY_COUNT / seconds / 1e6 << " Mrays/s (" << hits << " hits)" << std::endl;
+
+    start = Clock::now();
+    JobSystem::ParallelFor(RAY_COUNT, 256, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            RayHit hit;
+            bvh.Intersect(rays[i], hit);
+        }
+    });
+    seconds = SecondsSince(start);
+    std::cout << "  closest hit, " << JobSystem::ThreadCount() << " threads: " << RAY_COUNT / seconds / 1e6 << " Mrays/s" << std::endl;
+
+    int occluded = 0;
+    start = Clock::now();
+    for (const Ray& ray : rays)
+        occluded += bvh.Occluded(ray) ? 1 : 0;
+    seconds = SecondsSince(start);
+    std::cout << "  any hit, 1 thread: " << RAY_COUNT / seconds / 1e6 << " Mrays/s (" << occluded << " occluded)" << std::endl;
+
+    // validate against brute force on a subset, which also shows what the BVH saves
+    const int CHECK_COUNT = std::min(RAY_COUNT, std::max(64, (int)(2e8 / std::max<size_t>(1, indices.size()))));
+    int mismatches = 0;
+    start = Clock::now();
+    for (int i = 0; i < CHECK_COUNT; i++)
+    {
+        float tReference;
+        bool reference = BruteForceIntersect(positions, indices, rays[i], tReference);
+        RayHit hit;
+        bool found = bvh.Intersect(rays[i], hit);
+        if (found != reference || (found && std::fabs(hit.t - tReference) > 1e-4f * std::max(1.0f, tReference)))
+            mismatches++;
+    }
+    seconds = SecondsSince(start);
+    std::cout << "  brute force: " << CHECK_COUNT / seconds / 1e6 << " Mrays/s, " << mismatches << "/" << CHECK_COUNT
+        << " rays disagree with the BVH" << std::endl;
+}
+
+// some arithmetic per element so the loop is compute bound rather than memory bound
+float Work(int i)
+{
+    float x = (float)i;
+    for (int k = 0; k < 64; k++)
+        x = std::sqrt(x * 1.0001f + 1.0f);
+    return x;
+}
+
+void BenchmarkJobSystem()
+{
+    std::cout << "Job system: " << JobSystem::ThreadCount() << " threads" << std::endl;
+
+    // cost of scheduling a job that does nothing, including the wait
+    const int JOB_COUNT = 100000;
+    JobCounter counter;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < JOB_COUNT; i++)
+        JobSystem::Run([] {}, &counter);
+    JobSystem::Wait(counter);
+    std::cout << "  empty job: " << SecondsSince(start) / JOB_COUNT * 1e9 << " ns" << std::endl;
+
+    // latency of a dependency: every job only starts once the previous one finished
+    const int CHAIN_LENGTH = 10000;
+    std::vector<std::unique_ptr<JobCounter>> chain;
+    for (int i = 0; i < CHAIN_LENGTH; i++)
+        chain.emplace_back(new JobCounter());
+    std::atomic<int> order(0);
+    int outOfOrder = 0;
+    start = Clock::now();
+    JobSystem::Run([&] { order++; }, chain[0].get());
+    for (int i = 1; i < CHAIN_LENGTH; i++)
+    {
+        JobSystem::RunAfter(*chain[i - 1], [&, i] {
+            if (order.load() != i)
+                outOfOrder++;
+            order++;
+        }, chain[i].get());
+    }
+    JobSystem::Wait(*chain.back());
+    std::cout << "  dependency hop: " << SecondsSince(start) / CHAIN_LENGTH * 1e9 << " ns (" << outOfOrder << " out of order)" << std::endl;
+
+    // fixed cost of a parallel_for whose batches do nothing
+    const int LOOP_COUNT = 10000;
+    start = Clock::now();
+    for (int i = 0; i < LOOP_COUNT; i++)
+        JobSystem::ParallelFor(JobSystem::ThreadCount() * 16, 1, [](int, int) {});
+    std::cout << "  empty parallel_for: " << SecondsSince(start) / LOOP_COUNT * 1e6 << " us" << std::endl;
+
+    // scaling of a compute bound parallel_for with the number of workers
+    const int ELEMENT_COUNT = 1 << 20;
+    std::vector<float> results(ELEMENT_COUNT);
+    int maxWorkers = JobSystem::ThreadCount() - 1;
+    double baseline = 0.0;
+    for (int workers = 0; workers <= maxWorkers; workers = workers == maxWorkers ? workers + 1 : std::min(maxWorkers, workers * 2 + 1))
+    {
+        JobSystem::Initialize(workers);
+        start = Clock::now();
+        JobSystem::ParallelFor(ELEMENT_COUNT, 1024, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                results[i] = Work(i);
+        });
+        double seconds = SecondsSince(start);
+        if (workers == 0)
+            baseline = seconds;
+        std::cout << "  parallel_for, " << workers + 1 << " threads: " << seconds * 1000.0 << " ms (" << baseline / seconds << "x)" << std::endl;
+    }
+}
+
+// per-triangle tangents summed into the vertices, the generator models used before GenerateTangents;
+// triangles with degenerate UVs divide by zero and leave NaNs in their vertices
+void ScalarTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        Vertex& v0 = vertices[indices[i]];
+        Vertex& v1 = vertices[indices[i + 1]];
+        Vertex& v2 = vertices[indices[i + 2]];
+        glm::vec3 edge1 = v1.Position - v0.Position;
+        glm::vec3 edge2 = v2.Position - v0.Position;
+        glm::vec2 deltaUV1 = v1.TexCoords - v0.TexCoords;
+        glm::vec2 deltaUV2 = v2.TexCoords - v0.TexCoords;
+        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+        glm::vec3 tangent = glm::normalize(f * (deltaUV2.y * edge1 - deltaUV1.y * edge2));
+        glm::vec3 bitangent = glm::normalize(f * (-deltaUV2.x * edge1 + deltaUV1.x * edge2));
+        v0.Tangent += tangent;
+        v1.Tangent += tangent;
+        v2.Tangent += tangent;
+        v0.Bitangent += bitangent;
+        v1.Bitangent += bitangent;
+        v2.Bitangent += bitangent;
+    }
+    for (Vertex& vertex : vertices)
+    {
+        vertex.Tangent = glm::normalize(vertex.Tangent);
+        vertex.Bitangent = glm::normalize(vertex.Bitangent);
+    }
+}
+
+void BenchmarkTangents()
+{
+    // a UV mapped sphere with a band left unmapped, where every UV is the same
+    const int RINGS = 512, SECTORS = 1024;
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    GenerateSphere(RINGS, SECTORS, positions, indices);
+    std::vector<Vertex> vertices(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        int ring = (int)i / (SECTORS + 1), sector = (int)i % (SECTORS + 1);
+        bool unmapped = ring >= RINGS / 2 && ring < RINGS / 2 + 8;
+        vertices[i].Position = positions[i];
+        vertices[i].Normal = glm::vec3(0.0f);
+        vertices[i].TexCoords = unmapped ? glm::vec2(0.0f) : glm::vec2((float)sector / SECTORS, (float)ring / RINGS);
+        vertices[i].Tangent = glm::vec3(0.0f);
+        vertices[i].Bitangent = glm::vec3(0.0f);
+    }
+    // area weighted face normals, turned outwards
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+        for (int k = 0; k < 3; k++)
+            vertices[indices[i + k]].Normal += normal;
+    }
+    for (Vertex& vertex : vertices)
+        vertex.Normal = glm::dot(vertex.Normal, vertex.Position) < 0.0f ? -glm::normalize(vertex.Normal) : glm::normalize(vertex.Normal);
+    std::cout << "Tangents: " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles" << std::endl;
+
+    auto countNaNs = [](const std::vector<Vertex>& result) {
+        int count = 0;
+        for (const Vertex& vertex : result)
+            count += std::isnan(vertex.Tangent.x + vertex.Tangent.y + vertex.Tangent.z + vertex.Bitangent.x + vertex.Bitangent.y + vertex.Bitangent.z);
+        return count;
+    };
+    const int RUNS = 3;
+    std::vector<Vertex> scalar, generated;
+    Clock::time_point start = Clock::now();
+    for (int run = 0; run < RUNS; run++)
+    {
+        scalar = vertices;
+        ScalarTangents(scalar, indices);
+    }
+    double scalarSeconds = SecondsSince(start) / RUNS;
+    start = Clock::now();
+    for (int run = 0; run < RUNS; run++)
+    {
+        generated = vertices;
+        GenerateTangents(generated, indices);
+    }
+    double generatedSeconds = SecondsSince(start) / RUNS;
+
+    // the two only differ in weighting where both are defined
+    double angle = 0.0;
+    int compared = 0;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        float cosAngle = glm::dot(scalar[i].Tangent, generated[i].Tangent);
+        if (std::isnan(cosAngle))
+            continue;
+        angle += std::acos(glm::clamp(cosAngle, -1.0f, 1.0f));
+        compared++;
+    }
+    std::cout << "  scalar: " << scalarSeconds * 1000.0 << " ms, " << countNaNs(scalar) << " NaN vertices" << std::endl;
+    std::cout << "  SIMD, " << JobSystem::ThreadCount() << " threads: " << generatedSeconds * 1000.0 << " ms ("
+        << scalarSeconds / generatedSeconds << "x), " << countNaNs(generated) << " NaN vertices, mean difference "
+        << glm::degrees(angle / std::max(compared, 1)) << " degrees" << std::endl;
+}
+
+// OBJ text of the bumpy sphere with UVs and normals, in quads, the way exporters write it
+std::string GenerateObjText(int rings, int sectors)
+{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    GenerateSphere(rings, sectors, positions, indices);
+    std::string text = "# generated\no sphere\n";
+    char line[160];
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        const glm::vec3& p = positions[i];
+        glm::vec3 n = glm::normalize(p);
+        glm::vec2 uv((float)(i % (sectors + 1)) / sectors, (float)(i / (sectors + 1)) / rings);
+        text.append(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.4f %.4f %.4f\n", p.x, p.y, p.z, uv.x, uv.y, n.x, n.y, n.z));
+    }
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < sectors; s++)
+        {
+            unsigned int a = r * (sectors + 1) + s + 1, b = a + sectors + 1;
+            text.append(line, std::snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1));
+        }
+    }
+    return text;
+}
+
+void BenchmarkObjParsing(const std::string& path)
+{
+    std::string text = GenerateObjText(512, 1024);
+    std::cout << "OBJ parsing: " << text.size() / (1024 * 1024) << " MB generated" << std::endl;
+    const int RUNS = 3;
+    ObjScene scene;
+    Clock::time_point start = Clock::now();
+    for (int run = 0; run < RUNS; run++)
+        ParseObj(text.data(), text.size(), scene);
+    double seconds = SecondsSince(start) / RUNS;
+    std::cout << "  parse, " << JobSystem::ThreadCount() << " threads: " << seconds * 1000.0 << " ms, "
+        << text.size() / seconds / 1e6 << " MB/s" << std::endl;
+
+    // the model on disk, against the Assimp path it replaces
+    if (path.size() < 4 || path.compare(path.size() - 4, 4, ".obj") != 0)
+        return;
+    MappedFile file;
+    if (!file.Open(path))
+        return;
+    double megabytes = file.Size() / 1e6;
+    file.Close();
+    start = Clock::now();
+    bool loaded = LoadObj(path, scene);
+    seconds = SecondsSince(start);
+    if (loaded)
+        std::cout << "  " << path << ": " << seconds * 1000.0 << " ms, " << megabytes / seconds << " MB/s" << std::endl;
+    start = Clock::now();
+    Assimp::Importer importer;
+    if (importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs))
+    {
+        seconds = SecondsSince(start);
+        std::cout << "  Assimp: " << seconds * 1000.0 << " ms, " << megabytes / seconds << " MB/s" << std::endl;
+    }
+}
+
+void BenchmarkSpatialIndex()
+{
+    // boxes scattered over a flat 1 km square, like a large open scene
+    const int OBJECT_COUNT = 100000;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f), size(0.2f, 2.0f), step(-0.05f, 0.05f);
+    std::vector<AABB> boxes(OBJECT_COUNT);
+    std::vector<int> proxies(OBJECT_COUNT);
+    SpatialIndex index;
+    std::cout << "Spatial index: " << OBJECT_COUNT << " objects" << std::endl;
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < OBJECT_COUNT; i++)
+    {
+        glm::vec3 center(position(rng), position(rng) * 0.02f, position(rng));
+        boxes[i] = AABB(center - glm::vec3(size(rng)), center + glm::vec3(size(rng)));
+        proxies[i] = index.Insert(boxes[i], Entity{ (uint32_t)i, 0 });
+    }
+    std::cout << "  insert: " << SecondsSince(start) / OBJECT_COUNT * 1e9 << " ns" << std::endl;
+
+    // every object drifts a little each frame and one in a hundred jumps somewhere else
+    const int FRAMES = 10;
+    start = Clock::now();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        for (int i = 0; i < OBJECT_COUNT; i++)
+        {
+            glm::vec3 move = i % 100 == frame ? glm::vec3(position(rng), 0.0f, position(rng)) : glm::vec3(step(rng), step(rng), step(rng));
+            boxes[i] = AABB(boxes[i].min + move, boxes[i].max + move);
+            index.Move(proxies[i], boxes[i]);
+        }
+        index.Refit();
+    }
+    std::cout << "  move all and refit: " << SecondsSince(start) / FRAMES * 1000.0 << " ms per frame" << std::endl;
+
+    Frustum frustum(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f) *
+        glm::lookAt(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(100.0f, 0.0f, 50.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    const int QUERIES = 100;
+    std::vector<Entity> results;
+    start = Clock::now();
+    for (int q = 0; q < QUERIES; q++)
+    {
+        results.clear();
+        index.Query(frustum, results);
+    }
+    double treeSeconds = SecondsSince(start) / QUERIES;
+    int bruteForce = 0;
+    start = Clock::now();
+    for (int q = 0; q < QUERIES; q++)
+    {
+        bruteForce = 0;
+        for (const AABB& box : boxes)
+            bruteForce += frustum.Intersects(box);
+    }
+    double bruteSeconds = SecondsSince(start) / QUERIES;
+    std::atomic<int> parallelCount(0);
+    auto count = [&](Entity) { parallelCount++; };
+    start = Clock::now();
+    for (int q = 0; q < QUERIES; q++)
+        index.ParallelQuery(frustum, count);
+    double parallelSeconds = SecondsSince(start) / QUERIES;
+    std::cout << "  frustum query: " << results.size() << " found (brute force " << bruteForce << "), "
+        << treeSeconds * 1000.0 << " ms, parallel " << parallelSeconds * 1000.0 << " ms, brute force " << bruteSeconds * 1000.0 << " ms" << std::endl;
+
+    start = Clock::now();
+    for (int q = 0; q < QUERIES; q++)
+        index.Nearest(glm::vec3(position(rng), 0.0f, position(rng)), 16, results);
+    std::cout << "  16 nearest: " << SecondsSince(start) / QUERIES * 1e6 << " us" << std::endl;
+}
+
+}
+
+int RunBenchmarks(int argc, char** argv)
+{
+    JobSystem::Initialize();
+    BenchmarkJobSystem();
+    BenchmarkSpatialIndex();
+    BenchmarkTangents();
+
+    std::string path = argc > 2 ? argv[2] : "resources/models/backpack/backpack.obj";
+    BenchmarkObjParsing(path);
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    if (!LoadGeometry(path, positions, indices))
+    {
+        std::cout << "Could not load " << path << ", using a generated sphere" << std::endl;
+        GenerateSphere(256, 512, positions, indices);
+    }
+    BenchmarkRayQueries(positions, indices);
+    JobSystem::Shutdown();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "../header/BloomRenderer.h"
+#include "../header/GLState.h"
+#include "../header/Shader.h"
+
+#include <iostream>
+
+BloomRenderer::BloomRenderer(int width, int height, int mipCount)
+    : sourceSize(width, height)
+{
+    glGenFramebuffers(1, &FBO);
+    GLState::BindFramebuffer(FBO);
+
+    glm::ivec2 size(width, height);
+    for (int i = 0; i < mipCount; i++)
+    {
+        size /= 2;
+        if (size.x < 2 || size.y < 2)
+            break;
+        BloomMip mip;
+        mip.size = size;
+        glGenTextures(1, &mip.texture);
+        GLState::BindTexture(GL_TEXTURE_2D, mip.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, size.x, size.y, 0, GL_RGB, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mips.push_back(mip);
+    }
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mips[0].texture, 0);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Bloom framebuffer is not complete!" << std::endl;
+    GLState::BindFramebuffer(0);
+}
+
+void BloomRenderer::Render(Shader& downsampleShader, Shader& upsampleShader, unsigned int hdrTexture, unsigned int quadVAO)
+{
+    GLState::BindFramebuffer(FBO);
+    GLState::Disable(GL_DEPTH_TEST);
+    GLState::BindVertexArray(quadVAO);
+    GLState::ActiveTexture(GL_TEXTURE0);
+
+    // downsample: scene -> mip 0 (bright pass) -> mip 1 -> ...
+    downsampleShader.use();
+    downsampleShader.setInt("srcTexture", 0);
+    downsampleShader.setFloat("threshold", threshold);
+    downsampleShader.setFloat("softThreshold", softThreshold);
+    glm::ivec2 srcSize = sourceSize;
+    GLState::BindTexture(GL_TEXTURE_2D, hdrTexture);
+    for (size_t i = 0; i < mips.size(); i++)
+    {
+        const BloomMip& mip = mips[i];
+        downsampleShader.setVec2("srcResolution", glm::vec2(srcSize));
+        downsampleShader.setInt("mipLevel", (int)i);
+        GLState::Viewport(0, 0, mip.size.x, mip.size.y);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mip.texture, 0);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        srcSize = mip.size;
+        GLState::BindTexture(GL_TEXTURE_2D, mip.texture);
+    }
+
+    // upsample: blend every level onto the next larger one
+    upsampleShader.use();
+    upsampleShader.setInt("srcTexture", 0);
+    upsampleShader.setFloat("filterRadius", filterRadius);
+    GLState::Enable(GL_BLEND);
+    GLState::BlendFunc(GL_ONE, GL_ONE);
+    GLState::BlendEquation(GL_FUNC_ADD);
+    for (size_t i = mips.size() - 1; i > 0; i--)
+    {
+        const BloomMip& nextMip = mips[i - 1];
+        GLState::BindTexture(GL_TEXTURE_2D, mips[i].texture);
+        GLState::Viewport(0, 0, nextMip.size.x, nextMip.size.y);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, nextMip.texture, 0);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    GLState::Disable(GL_BLEND);
+
+    GLState::BindFramebuffer(0);
+    GLState::Viewport(0, 0, sourceSize.x, sourceSize.y);
+    GLState::Enable(GL_DEPTH_TEST);
+}
@@ -31,6 +31,15 @@ glm::mat4 Camera::GetViewMat()
 	return glm::lookAt(pos, pos + forward, up);
 }
 
+Ray Camera::GetPickRay(float ndcX, float ndcY, float aspect) const
+{
+	float tanHalfFov = tan(glm::radians(fov) * 0.5f);
+	glm::vec3 direction = forward + right * (ndcX * tanHalfFov * aspect) + up * (ndcY * tanHalfFov);
+	Ray ray(pos, glm::normalize(direction));
+	ray.tMax = far;
+	return ray;
+}
+
 void Camera::ProcessMousePan(float xOffset, float yOffset)
 {
 	yaw += xOffset;
@@ -0,0 +1,183 @@
+#include "../header/CascadedShadowMap.h"
+#include "../header/GLState.h"
+#include "../header/Shader.h"
+#include "../header/FrameArena.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+CascadedShadowMap::CascadedShadowMap(unsigned int resolution, int cascadeCount, float splitLambda, float casterExtent)
+    : resolution(resolution), cascadeCount(std::min(std::max(cascadeCount, 1), MAX_CASCADES)),
+    splitLambda(splitLambda), casterExtent(casterExtent)
+{
+    for (int i = 0; i < MAX_CASCADES; i++)
+    {
+        lightSpaceMatrices[i] = glm::mat4(1.0f);
+        cascadeSplits[i] = 0.0f;
+    }
+
+    //one depth layer per cascade
+    glGenTextures(1, &depthMapArray);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, depthMapArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, this->cascadeCount,
+        0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+    glGenFramebuffers(1, &depthMapFBO);
+    GLState::BindFramebuffer(depthMapFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMapArray, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Cascaded shadow framebuffer is not complete!" << std::endl;
+    GLState::BindFramebuffer(0);
+}
+
+void CascadedShadowMap::Update(const glm::mat4& view, float fov, float aspect, float near, float far, const glm::vec3& lightDir)
+{
+    // practical split scheme: blend the logarithmic and uniform distributions
+    float sliceNear = near;
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        float p = (float)(i + 1) / (float)cascadeCount;
+        float logSplit = near * std::pow(far / near, p);
+        float uniformSplit = near + (far - near) * p;
+        float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+        cascadeSplits[i] = sliceFar;
+        lightSpaceMatrices[i] = FitCascade(view, fov, aspect, sliceNear, sliceFar, glm::normalize(lightDir));
+        cascadeFrusta[i] = Frustum(lightSpaceMatrices[i]);
+        sliceNear = sliceFar;
+    }
+}
+
+glm::mat4 CascadedShadowMap::FitCascade(const glm::mat4& view, float fov, float aspect, float sliceNear, float sliceFar, const glm::vec3& lightDir) const
+{
+    glm::mat4 sliceProjection = glm::perspective(glm::radians(fov), aspect, sliceNear, sliceFar);
+    glm::vec3 corners[8];
+    GetFrustumCorners(sliceProjection * view, corners);
+
+    // bound the slice with a sphere so the cascade size does not change as the camera rotates
+    glm::vec3 center(0.0f);
+    for (const glm::vec3& corner : corners)
+        center += corner;
+    center /= 8.0f;
+    float radius = 0.0f;
+    for (const glm::vec3& corner : corners)
+        radius = std::max(radius, glm::length(corner - center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // pull the eye back so casters between the light and the slice are still captured
+    glm::vec3 up = std::abs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(center + lightDir * (radius + casterExtent), center, up);
+    glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + casterExtent);
+
+    // snap the projection to whole shadow map texels to stop edges crawling as the camera moves
+    glm::vec4 origin = lightProjection * lightView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    origin *= (float)resolution * 0.5f;
+    glm::vec4 offset = (glm::round(origin) - origin) * (2.0f / (float)resolution);
+    lightProjection[3][0] += offset.x;
+    lightProjection[3][1] += offset.y;
+
+    return lightProjection * lightView;
+}
+
+void CascadedShadowMap::BindCascade(int cascade)
+{
+    GLState::BindFramebuffer(depthMapFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMapArray, 0, cascade);
+    GLState::Viewport(0, 0, resolution, resolution);
+}
+
+void CascadedShadowMap::SetUniforms(Shader& shader) const
+{
+    shader.use();
+    shader.setInt("cascadeCount", cascadeCount);
+    ScratchScope scratch;
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        shader.setMat4(scratch.arena.Format("lightSpaceMatrices[%d]", i), lightSpaceMatrices[i]);
+        shader.setFloat(scratch.arena.Format("cascadePlaneDistances[%d]", i), cascadeSplits[i]);
+    }
+    shader.setFloat("evsmExponent", evsmExponent);
+}
+
+void CascadedShadowMap::CreateMomentTargets()
+{
+    glGenTextures(1, &momentsArray);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, momentsArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG32F, resolution, resolution, cascadeCount, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glGenTextures(1, &blurTexture);
+    GLState::BindTexture(GL_TEXTURE_2D, blurTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, resolution, resolution, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &blurFBO);
+    GLState::BindFramebuffer(blurFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Shadow moment blur framebuffer is not complete!" << std::endl;
+
+    glGenFramebuffers(1, &momentsFBO);
+    GLState::BindFramebuffer(momentsFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentsArray, 0, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Shadow moments framebuffer is not complete!" << std::endl;
+    GLState::BindFramebuffer(0);
+}
+
+void CascadedShadowMap::FilterMoments(Shader& warpBlurShader, Shader& blurShader, unsigned int quadVAO)
+{
+    if (filter != ShadowFilter::EVSM)
+        return;
+    if (momentsArray == 0)
+        CreateMomentTargets();
+
+    GLState::Viewport(0, 0, resolution, resolution);
+    GLState::Disable(GL_DEPTH_TEST);
+    GLState::BindVertexArray(quadVAO);
+    for (int cascade = 0; cascade < cascadeCount; cascade++)
+    {
+        // horizontal: depth layer -> warped moments, blurred along x
+        GLState::BindFramebuffer(blurFBO);
+        warpBlurShader.use();
+        warpBlurShader.setInt("image", 0);
+        warpBlurShader.setInt("layer", cascade);
+        warpBlurShader.setInt("horizontal", true);
+        warpBlurShader.setFloat("evsmExponent", evsmExponent);
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, depthMapArray);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // vertical: blurred along y into the cascade's moments layer
+        GLState::BindFramebuffer(momentsFBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentsArray, 0, cascade);
+        blurShader.use();
+        blurShader.setInt("horizontal", false);
+        GLState::BindTexture(GL_TEXTURE_2D, blurTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    GLState::BindFramebuffer(0);
+    GLState::Enable(GL_DEPTH_TEST);
+
+    // mips let distant receivers take one pre-filtered fetch
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, momentsArray);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
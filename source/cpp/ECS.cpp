@@ -0,0 +1,210 @@
+#include "../header/ECS.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+std::vector<size_t>& ComponentSizes()
+{
+    static std::vector<size_t> sizes;
+    return sizes;
+}
+
+size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+int ComponentRegistry::Register(size_t size)
+{
+    std::vector<size_t>& sizes = ComponentSizes();
+    if ((int)sizes.size() >= MAX_COMPONENT_TYPES)
+        std::cout << "ERROR::ECS:: More than " << MAX_COMPONENT_TYPES << " component types" << std::endl;
+    sizes.push_back(size);
+    return (int)sizes.size() - 1;
+}
+
+size_t ComponentRegistry::Size(int id)
+{
+    return ComponentSizes()[id];
+}
+
+Archetype::Archetype(ComponentMask mask) : mask(mask)
+{
+    size_t rowBytes = sizeof(Entity);
+    for (int id = 0; id < MAX_COMPONENT_TYPES; id++)
+    {
+        if (mask & (ComponentMask(1) << id))
+        {
+            types.push_back(id);
+            rowBytes += ComponentRegistry::Size(id);
+        }
+    }
+
+    // as many rows as fit once every array is padded to 16 bytes; very large rows get a bigger chunk
+    capacity = std::max(1, (int)(CHUNK_BYTES / rowBytes));
+    while (true)
+    {
+        size_t offset = AlignUp(sizeof(Entity) * capacity, 16);
+        offsets.clear();
+        for (int id : types)
+        {
+            offsets.push_back(offset);
+            offset = AlignUp(offset + ComponentRegistry::Size(id) * capacity, 16);
+        }
+        chunkBytes = offset;
+        if (chunkBytes <= CHUNK_BYTES || capacity == 1)
+            break;
+        capacity--;
+    }
+}
+
+int Archetype::Column(int typeId) const
+{
+    for (size_t i = 0; i < types.size(); i++)
+    {
+        if (types[i] == typeId)
+            return (int)i;
+    }
+    return -1;
+}
+
+Entity World::CreateEntity(ComponentMask mask)
+{
+    Entity entity;
+    if (!freeIndices.empty())
+    {
+        entity.index = freeIndices.back();
+        freeIndices.pop_back();
+    }
+    else
+    {
+        entity.index = (uint32_t)records.size();
+        records.push_back(Record());
+    }
+    entity.generation = records[entity.index].generation;
+    AllocateRow(FindArchetype(mask), entity);
+    return entity;
+}
+
+void World::Destroy(Entity entity)
+{
+    if (!IsAlive(entity))
+        return;
+    Record& record = records[entity.index];
+    RemoveRow(*record.archetype, record.chunk, record.row);
+    record.archetype = nullptr;
+    record.generation++;
+    freeIndices.push_back(entity.index);
+}
+
+bool World::IsAlive(Entity entity) const
+{
+    return entity.index < records.size() && records[entity.index].generation == entity.generation &&
+        records[entity.index].archetype != nullptr;
+}
+
+void* World::GetComponent(Entity entity, int typeId)
+{
+    if (!IsAlive(entity))
+        return nullptr;
+    const Record& record = records[entity.index];
+    int column = record.archetype->Column(typeId);
+    if (column < 0)
+        return nullptr;
+    return record.archetype->ColumnData(record.chunk, column) + ComponentRegistry::Size(typeId) * record.row;
+}
+
+void World::Move(Entity entity, ComponentMask mask)
+{
+    if (!IsAlive(entity) || records[entity.index].archetype->mask == mask)
+        return;
+    Record old = records[entity.index];
+    Archetype& target = FindArchetype(mask);
+    AllocateRow(target, entity);
+    const Record& moved = records[entity.index];
+    for (size_t i = 0; i < old.archetype->types.size(); i++)
+    {
+        int id = old.archetype->types[i];
+        int column = target.Column(id);
+        if (column < 0)
+            continue;
+        size_t size = ComponentRegistry::Size(id);
+        memcpy(target.ColumnData(moved.chunk, column) + size * moved.row,
+            old.archetype->ColumnData(old.chunk, (int)i) + size * old.row, size);
+    }
+    RemoveRow(*old.archetype, old.chunk, old.row);
+}
+
+Archetype& World::FindArchetype(ComponentMask mask)
+{
+    for (auto& archetype : archetypes)
+    {
+        if (archetype->mask == mask)
+            return *archetype;
+    }
+    archetypes.emplace_back(new Archetype(mask));
+    return *archetypes.back();
+}
+
+void World::AllocateRow(Archetype& archetype, Entity entity)
+{
+    // rows are kept packed, so only the last chunk can have room
+    if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity)
+    {
+        Archetype::Chunk chunk;
+        chunk.data.reset(new unsigned char[archetype.chunkBytes]);
+        archetype.chunks.push_back(std::move(chunk));
+    }
+    int chunk = (int)archetype.chunks.size() - 1;
+    int row = archetype.chunks[chunk].count++;
+    archetype.Entities(chunk)[row] = entity;
+    for (size_t i = 0; i < archetype.types.size(); i++)
+    {
+        size_t size = ComponentRegistry::Size(archetype.types[i]);
+        memset(archetype.ColumnData(chunk, (int)i) + size * row, 0, size);
+    }
+
+    Record& record = records[entity.index];
+    record.archetype = &archetype;
+    record.chunk = chunk;
+    record.row = row;
+}
+
+void World::RemoveRow(Archetype& archetype, int chunk, int row)
+{
+    int lastChunk = (int)archetype.chunks.size() - 1;
+    int lastRow = archetype.chunks[lastChunk].count - 1;
+    if (chunk != lastChunk || row != lastRow)
+    {
+        Entity last = archetype.Entities(lastChunk)[lastRow];
+        archetype.Entities(chunk)[row] = last;
+        for (size_t i = 0; i < archetype.types.size(); i++)
+        {
+            size_t size = ComponentRegistry::Size(archetype.types[i]);
+            memcpy(archetype.ColumnData(chunk, (int)i) + size * row, archetype.ColumnData(lastChunk, (int)i) + size * lastRow, size);
+        }
+        records[last.index].chunk = chunk;
+        records[last.index].row = row;
+    }
+    if (--archetype.chunks[lastChunk].count == 0)
+        archetype.chunks.pop_back();
+}
+
+void World::MatchingChunks(ComponentMask mask, ArenaVector<ChunkRef>& matching)
+{
+    for (auto& archetype : archetypes)
+    {
+        if ((archetype->mask & mask) != mask)
+            continue;
+        for (int c = 0; c < (int)archetype->chunks.size(); c++)
+        {
+            if (archetype->chunks[c].count > 0)
+                matching.push_back({ archetype.get(), c });
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#include "../header/FrameArena.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+
+FrameArena::FrameArena(size_t capacity)
+{
+    AddBlock(std::max(capacity, (size_t)256));
+}
+
+void FrameArena::AddBlock(size_t size)
+{
+    Block block;
+    block.data.reset(new unsigned char[size]);
+    block.size = size;
+    blocks.push_back(std::move(block));
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    while (true)
+    {
+        Block& block = blocks[current];
+        uintptr_t base = (uintptr_t)block.data.get();
+        size_t aligned = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+        if (aligned + size <= block.size)
+        {
+            offset = aligned + size;
+            highWater = std::max(highWater, Used());
+            return block.data.get() + aligned;
+        }
+        // blocks after the current one are left over from before a Rewind
+        if (current + 1 == blocks.size())
+            AddBlock(std::max(block.size, size + alignment));
+        current++;
+        offset = 0;
+    }
+}
+
+const char* FrameArena::Format(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list measure;
+    va_copy(measure, args);
+    int length = std::vsnprintf(nullptr, 0, format, measure);
+    va_end(measure);
+    char* text = (char*)Allocate((size_t)std::max(length, 0) + 1, 1);
+    std::vsnprintf(text, (size_t)std::max(length, 0) + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+void FrameArena::Reset()
+{
+    if (blocks.size() > 1)
+    {
+        size_t total = Capacity();
+        blocks.clear();
+        AddBlock(total);
+    }
+    current = 0;
+    offset = 0;
+}
+
+void FrameArena::Rewind(const Marker& marker)
+{
+    current = marker.block;
+    offset = marker.offset;
+}
+
+size_t FrameArena::Used() const
+{
+    size_t used = offset;
+    for (size_t i = 0; i < current; i++)
+        used += blocks[i].size;
+    return used;
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t capacity = 0;
+    for (const Block& block : blocks)
+        capacity += block.size;
+    return capacity;
+}
+
+FrameArena& FrameArena::Scratch()
+{
+    thread_local FrameArena scratch(256 * 1024);
+    return scratch;
+}
@@ -0,0 +1,62 @@
+#include "../header/Frustum.h"
+
+AABB TransformAABB(const AABB& box, const glm::mat4& transform)
+{
+    // Arvo's method: transform the center and accumulate the absolute rotated extents
+    glm::vec3 center = glm::vec3(transform * glm::vec4(box.Center(), 1.0f));
+    glm::vec3 extents = box.Extents();
+    glm::vec3 newExtents(0.0f);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            newExtents[i] += glm::abs(transform[j][i]) * extents[j];
+    return AABB(center - newExtents, center + newExtents);
+}
+
+Frustum::Frustum(const glm::mat4& m)
+{
+    // Gribb/Hartmann plane extraction (glm is column major, rows are m[c][r])
+    for (int i = 0; i < 3; i++)
+    {
+        planes[i * 2 + 0] = glm::vec4(m[0][3] + m[0][i], m[1][3] + m[1][i], m[2][3] + m[2][i], m[3][3] + m[3][i]);
+        planes[i * 2 + 1] = glm::vec4(m[0][3] - m[0][i], m[1][3] - m[1][i], m[2][3] - m[2][i], m[3][3] - m[3][i]);
+    }
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool Frustum::Intersects(const AABB& box) const
+{
+    glm::vec3 center = box.Center();
+    glm::vec3 extents = box.Extents();
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 n = glm::vec3(planes[i]);
+        float r = glm::dot(extents, glm::abs(n));
+        if (glm::dot(n, center) + planes[i].w < -r)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::Intersects(const glm::vec3& center, float radius) const
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+void GetFrustumCorners(const glm::mat4& viewProjection, glm::vec3 corners[8])
+{
+    glm::mat4 inv = glm::inverse(viewProjection);
+    int n = 0;
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+            {
+                glm::vec4 p = inv * glm::vec4(2.0f * x - 1.0f, 2.0f * y - 1.0f, 2.0f * z - 1.0f, 1.0f);
+                corners[n++] = glm::vec3(p) / p.w;
+            }
+}
@@ -0,0 +1,275 @@
+#include "../header/GLState.h"
+
+namespace {
+
+const int MAX_TEXTURE_UNITS = 32;
+const unsigned int UNKNOWN = 0xFFFFFFFFu;
+
+// GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP
+const int TEXTURE_TARGETS = 3;
+// GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST
+const int CAPABILITIES = 4;
+const int UNIFORM_BUFFER_BINDINGS = 8;
+
+struct BufferRange {
+    unsigned int buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+struct CachedState {
+    unsigned int program;
+    unsigned int vao;
+    unsigned int framebuffer;
+    unsigned int activeUnit;
+    unsigned int textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+    // 0 disabled, 1 enabled, UNKNOWN
+    unsigned int capabilities[CAPABILITIES];
+    unsigned int depthFunc;
+    unsigned int depthMask;
+    unsigned int cullFace;
+    unsigned int blendSrc, blendDst;
+    unsigned int blendEquation;
+    int viewport[4];
+    int scissor[4];
+    BufferRange uniformBuffers[UNIFORM_BUFFER_BINDINGS];
+    bool viewportKnown;
+    bool scissorKnown;
+};
+
+CachedState state;
+bool stateValid = false;
+
+void EnsureValid()
+{
+    if (!stateValid)
+        GLState::Invalidate();
+}
+
+// true (and counted as issued) when value differs from the cached one
+bool Changed(unsigned int& cached, unsigned int value)
+{
+    EnsureValid();
+    if (cached == value)
+    {
+        GLState::frame.filtered++;
+        return false;
+    }
+    cached = value;
+    GLState::frame.issued++;
+    return true;
+}
+
+int TextureTargetIndex(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_2D_ARRAY: return 1;
+    case GL_TEXTURE_CUBE_MAP: return 2;
+    default: return -1;
+    }
+}
+
+int CapabilityIndex(GLenum capability)
+{
+    switch (capability)
+    {
+    case GL_DEPTH_TEST: return 0;
+    case GL_CULL_FACE: return 1;
+    case GL_BLEND: return 2;
+    case GL_SCISSOR_TEST: return 3;
+    default: return -1;
+    }
+}
+
+bool RectChanged(int cached[4], bool& known, int x, int y, int width, int height)
+{
+    EnsureValid();
+    if (known && cached[0] == x && cached[1] == y && cached[2] == width && cached[3] == height)
+    {
+        GLState::frame.filtered++;
+        return false;
+    }
+    cached[0] = x;
+    cached[1] = y;
+    cached[2] = width;
+    cached[3] = height;
+    known = true;
+    GLState::frame.issued++;
+    return true;
+}
+
+}
+
+GLState::Counters GLState::frame;
+GLState::Counters GLState::lastFrame;
+
+void GLState::UseProgram(unsigned int program)
+{
+    if (Changed(state.program, program))
+        glUseProgram(program);
+}
+
+void GLState::BindVertexArray(unsigned int vao)
+{
+    if (Changed(state.vao, vao))
+        glBindVertexArray(vao);
+}
+
+void GLState::BindFramebuffer(unsigned int fbo)
+{
+    if (Changed(state.framebuffer, fbo))
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void GLState::ActiveTexture(GLenum unit)
+{
+    if (Changed(state.activeUnit, unit))
+        glActiveTexture(unit);
+}
+
+void GLState::BindTexture(GLenum target, unsigned int texture)
+{
+    EnsureValid();
+    int targetIndex = TextureTargetIndex(target);
+    unsigned int unit = state.activeUnit == UNKNOWN ? UNKNOWN : state.activeUnit - GL_TEXTURE0;
+    if (targetIndex < 0 || unit >= (unsigned int)MAX_TEXTURE_UNITS)
+    {
+        frame.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (Changed(state.textures[unit][targetIndex], texture))
+        glBindTexture(target, texture);
+}
+
+void GLState::Enable(GLenum capability)
+{
+    int index = CapabilityIndex(capability);
+    if (index < 0)
+    {
+        frame.issued++;
+        glEnable(capability);
+        return;
+    }
+    if (Changed(state.capabilities[index], 1))
+        glEnable(capability);
+}
+
+void GLState::Disable(GLenum capability)
+{
+    int index = CapabilityIndex(capability);
+    if (index < 0)
+    {
+        frame.issued++;
+        glDisable(capability);
+        return;
+    }
+    if (Changed(state.capabilities[index], 0))
+        glDisable(capability);
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+    if (Changed(state.depthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLState::DepthMask(GLboolean flag)
+{
+    if (Changed(state.depthMask, flag))
+        glDepthMask(flag);
+}
+
+void GLState::CullFace(GLenum mode)
+{
+    if (Changed(state.cullFace, mode))
+        glCullFace(mode);
+}
+
+void GLState::BlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    EnsureValid();
+    if (state.blendSrc == sfactor && state.blendDst == dfactor)
+    {
+        frame.filtered++;
+        return;
+    }
+    state.blendSrc = sfactor;
+    state.blendDst = dfactor;
+    frame.issued++;
+    glBlendFunc(sfactor, dfactor);
+}
+
+void GLState::BlendEquation(GLenum mode)
+{
+    if (Changed(state.blendEquation, mode))
+        glBlendEquation(mode);
+}
+
+void GLState::Viewport(int x, int y, int width, int height)
+{
+    if (RectChanged(state.viewport, state.viewportKnown, x, y, width, height))
+        glViewport(x, y, width, height);
+}
+
+void GLState::Scissor(int x, int y, int width, int height)
+{
+    if (RectChanged(state.scissor, state.scissorKnown, x, y, width, height))
+        glScissor(x, y, width, height);
+}
+
+void GLState::BindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size)
+{
+    EnsureValid();
+    if (target != GL_UNIFORM_BUFFER || index >= (unsigned int)UNIFORM_BUFFER_BINDINGS)
+    {
+        frame.issued++;
+        glBindBufferRange(target, index, buffer, offset, size);
+        return;
+    }
+    BufferRange& cached = state.uniformBuffers[index];
+    if (cached.buffer == buffer && cached.offset == offset && cached.size == size)
+    {
+        frame.filtered++;
+        return;
+    }
+    cached.buffer = buffer;
+    cached.offset = offset;
+    cached.size = size;
+    frame.issued++;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::Invalidate()
+{
+    state.program = UNKNOWN;
+    state.vao = UNKNOWN;
+    state.framebuffer = UNKNOWN;
+    state.activeUnit = UNKNOWN;
+    for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+    {
+        for (int target = 0; target < TEXTURE_TARGETS; target++)
+            state.textures[unit][target] = UNKNOWN;
+    }
+    for (int i = 0; i < CAPABILITIES; i++)
+        state.capabilities[i] = UNKNOWN;
+    state.depthFunc = UNKNOWN;
+    state.depthMask = UNKNOWN;
+    state.cullFace = UNKNOWN;
+    state.blendSrc = UNKNOWN;
+    state.blendDst = UNKNOWN;
+    state.blendEquation = UNKNOWN;
+    for (int i = 0; i < UNIFORM_BUFFER_BINDINGS; i++)
+        state.uniformBuffers[i].buffer = UNKNOWN;
+    state.viewportKnown = false;
+    state.scissorKnown = false;
+    stateValid = true;
+}
+
+void GLState::BeginFrame()
+{
+    lastFrame = frame;
+    frame = Counters();
+}
@@ -0,0 +1,424 @@
+#include "../header/GltfLoader.h"
+#include "../header/Json.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;  // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;   // "BIN\0"
+
+uint32_t ReadU32(const char* bytes)
+{
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+size_t ComponentSize(unsigned int componentType)
+{
+    switch (componentType)
+    {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+int ComponentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+// an index into one of the asset's arrays, or -1 when absent or out of range
+int IndexIn(const JsonValue& value, size_t count)
+{
+    int index = value.AsInt(-1);
+    return index >= 0 && (size_t)index < count ? index : -1;
+}
+
+// the image of a texture reference ({"index": texture}), through the texture's source
+int TextureImage(const JsonValue& reference, const JsonValue& textures, size_t imageCount)
+{
+    int texture = IndexIn(reference["index"], textures.Size());
+    return texture >= 0 ? IndexIn(textures[(size_t)texture]["source"], imageCount) : -1;
+}
+
+glm::mat4 NodeTransform(const JsonValue& node)
+{
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.Size() == 16)
+    {
+        // column major, like glm
+        float values[16];
+        for (size_t i = 0; i < 16; i++)
+            values[i] = (float)matrix[i].AsNumber();
+        return glm::make_mat4(values);
+    }
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    glm::vec3 translation(t[0].AsNumber(0.0), t[1].AsNumber(0.0), t[2].AsNumber(0.0));
+    // stored x, y, z, w
+    glm::quat rotation((float)r[3].AsNumber(1.0), (float)r[0].AsNumber(0.0), (float)r[1].AsNumber(0.0), (float)r[2].AsNumber(0.0));
+    glm::vec3 scale(s[0].AsNumber(1.0), s[1].AsNumber(1.0), s[2].AsNumber(1.0));
+    return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+}
+
+template <typename T>
+void ConvertElements(const unsigned char* source, size_t stride, size_t count, int components, float scale,
+    float* out, size_t outStride)
+{
+    for (size_t i = 0; i < count; i++, source += stride, out += outStride)
+    {
+        for (int c = 0; c < components; c++)
+        {
+            T value;
+            std::memcpy(&value, source + c * sizeof(T), sizeof(T));
+            // signed normalized values clamp the extra negative step to -1
+            out[c] = scale != 0.0f ? std::max((float)value * scale, -1.0f) : (float)value;
+        }
+    }
+}
+
+}
+
+bool GltfAsset::Load(const std::string& path)
+{
+    files.clear();
+    files.emplace_back(new AssetFile());
+    AssetFile& file = *files[0];
+    if (!VirtualFileSystem::Open(path, file))
+    {
+        std::cout << "ERROR::GLTF::Could not open " << path << std::endl;
+        return false;
+    }
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    // a GLB is a JSON chunk and an optional binary chunk behind a 12 byte header
+    const char* json = file.Data();
+    size_t jsonSize = file.Size();
+    const unsigned char* binary = nullptr;
+    size_t binarySize = 0;
+    if (file.Size() >= 12 && ReadU32(file.Data()) == GLB_MAGIC)
+    {
+        size_t length = std::min((size_t)ReadU32(file.Data() + 8), file.Size());
+        if (ReadU32(file.Data() + 4) != 2)
+        {
+            std::cout << "ERROR::GLTF::Unsupported GLB version in " << path << std::endl;
+            return false;
+        }
+        json = nullptr;
+        size_t offset = 12;
+        while (offset + 8 <= length)
+        {
+            size_t chunkLength = ReadU32(file.Data() + offset);
+            uint32_t chunkType = ReadU32(file.Data() + offset + 4);
+            offset += 8;
+            if (chunkLength > length - offset)
+                break;
+            if (chunkType == GLB_CHUNK_JSON && !json)
+            {
+                json = file.Data() + offset;
+                jsonSize = chunkLength;
+            }
+            else if (chunkType == GLB_CHUNK_BIN && !binary)
+            {
+                binary = (const unsigned char*)file.Data() + offset;
+                binarySize = chunkLength;
+            }
+            // chunks are padded to four bytes
+            offset += (chunkLength + 3) & ~(size_t)3;
+        }
+        if (!json)
+        {
+            std::cout << "ERROR::GLTF::No JSON chunk in " << path << std::endl;
+            return false;
+        }
+    }
+
+    JsonValue root;
+    std::string error;
+    if (!ParseJson(json, jsonSize, root, error))
+    {
+        std::cout << "ERROR::GLTF::" << path << ": " << error << std::endl;
+        return false;
+    }
+    if (root["asset"]["version"].AsString().compare(0, 2, "2.") != 0)
+    {
+        std::cout << "ERROR::GLTF::Only glTF 2.x is supported: " << path << std::endl;
+        return false;
+    }
+
+    // buffers: the GLB's binary chunk, or mapped .bin files
+    const JsonValue& bufferList = root["buffers"];
+    std::vector<const unsigned char*> buffers(bufferList.Size(), nullptr);
+    std::vector<size_t> bufferSizes(bufferList.Size(), 0);
+    for (size_t i = 0; i < bufferList.Size(); i++)
+    {
+        const std::string& uri = bufferList[i]["uri"].AsString();
+        size_t byteLength = (size_t)bufferList[i]["byteLength"].AsNumber();
+        if (uri.empty())
+        {
+            buffers[i] = binary;
+            bufferSizes[i] = binarySize;
+        }
+        else if (uri.compare(0, 5, "data:") == 0)
+        {
+            std::cout << "ERROR::GLTF::Data URIs are not supported, buffer " << i << " in " << path << std::endl;
+            return false;
+        }
+        else
+        {
+            files.emplace_back(new AssetFile());
+            if (!VirtualFileSystem::Open(directory + uri, *files.back()))
+            {
+                std::cout << "ERROR::GLTF::Could not open buffer " << directory + uri << std::endl;
+                return false;
+            }
+            buffers[i] = (const unsigned char*)files.back()->Data();
+            bufferSizes[i] = files.back()->Size();
+        }
+        if (!buffers[i] || byteLength > bufferSizes[i])
+        {
+            std::cout << "ERROR::GLTF::Buffer " << i << " is missing or truncated in " << path << std::endl;
+            return false;
+        }
+    }
+
+    const JsonValue& viewList = root["bufferViews"];
+    bufferViews.assign(viewList.Size(), GltfBufferView());
+    for (size_t i = 0; i < viewList.Size(); i++)
+    {
+        const JsonValue& view = viewList[i];
+        int buffer = IndexIn(view["buffer"], buffers.size());
+        size_t byteOffset = (size_t)view["byteOffset"].AsNumber();
+        size_t byteLength = (size_t)view["byteLength"].AsNumber();
+        if (buffer < 0 || byteOffset > bufferSizes[buffer] || byteLength > bufferSizes[buffer] - byteOffset)
+        {
+            std::cout << "ERROR::GLTF::Buffer view " << i << " lies outside its buffer in " << path << std::endl;
+            return false;
+        }
+        bufferViews[i].data = buffers[buffer] + byteOffset;
+        bufferViews[i].byteLength = byteLength;
+        bufferViews[i].byteStride = view["byteStride"].AsInt(0);
+    }
+
+    const JsonValue& accessorList = root["accessors"];
+    accessors.assign(accessorList.Size(), GltfAccessor());
+    for (size_t i = 0; i < accessorList.Size(); i++)
+    {
+        const JsonValue& source = accessorList[i];
+        GltfAccessor& accessor = accessors[i];
+        accessor.bufferView = IndexIn(source["bufferView"], bufferViews.size());
+        accessor.byteOffset = (size_t)source["byteOffset"].AsNumber();
+        accessor.componentType = (unsigned int)source["componentType"].AsInt();
+        accessor.components = ComponentCount(source["type"].AsString());
+        accessor.normalized = source["normalized"].AsBool();
+        accessor.count = (size_t)source["count"].AsNumber();
+        size_t elementSize = ComponentSize(accessor.componentType) * accessor.components;
+        if (elementSize == 0 || !source["sparse"].IsNull())
+        {
+            std::cout << "ERROR::GLTF::Unsupported accessor " << i << " in " << path << std::endl;
+            return false;
+        }
+        if (accessor.bufferView < 0)
+            continue;
+        const GltfBufferView& view = bufferViews[accessor.bufferView];
+        accessor.stride = view.byteStride > 0 ? (size_t)view.byteStride : elementSize;
+        if (accessor.count > 0 && (accessor.byteOffset > view.byteLength || view.byteLength - accessor.byteOffset < elementSize ||
+            (view.byteLength - accessor.byteOffset - elementSize) / accessor.stride < accessor.count - 1))
+        {
+            std::cout << "ERROR::GLTF::Accessor " << i << " reads past its buffer view in " << path << std::endl;
+            return false;
+        }
+    }
+
+    const JsonValue& imageList = root["images"];
+    images.assign(imageList.Size(), GltfImage());
+    for (size_t i = 0; i < imageList.Size(); i++)
+    {
+        images[i].uri = imageList[i]["uri"].AsString();
+        images[i].bufferView = IndexIn(imageList[i]["bufferView"], bufferViews.size());
+    }
+
+    const JsonValue& textureList = root["textures"];
+    const JsonValue& materialList = root["materials"];
+    materials.assign(materialList.Size(), GltfMaterial());
+    for (size_t i = 0; i < materialList.Size(); i++)
+    {
+        const JsonValue& source = materialList[i];
+        const JsonValue& pbr = source["pbrMetallicRoughness"];
+        GltfMaterial& material = materials[i];
+        material.name = source["name"].AsString();
+        const JsonValue& factor = pbr["baseColorFactor"];
+        if (factor.Size() == 4)
+            material.baseColorFactor = glm::vec4(factor[0].AsNumber(), factor[1].AsNumber(), factor[2].AsNumber(), factor[3].AsNumber());
+        material.metallicFactor = (float)pbr["metallicFactor"].AsNumber(1.0);
+        material.roughnessFactor = (float)pbr["roughnessFactor"].AsNumber(1.0);
+        material.baseColorImage = TextureImage(pbr["baseColorTexture"], textureList, images.size());
+        material.metallicRoughnessImage = TextureImage(pbr["metallicRoughnessTexture"], textureList, images.size());
+        material.normalImage = TextureImage(source["normalTexture"], textureList, images.size());
+    }
+
+    const JsonValue& meshList = root["meshes"];
+    meshes.assign(meshList.Size(), GltfMesh());
+    for (size_t i = 0; i < meshList.Size(); i++)
+    {
+        meshes[i].name = meshList[i]["name"].AsString();
+        const JsonValue& primitives = meshList[i]["primitives"];
+        for (size_t p = 0; p < primitives.Size(); p++)
+        {
+            const JsonValue& source = primitives[p];
+            if (source["mode"].AsInt(4) != 4)
+            {
+                std::cout << "ERROR::GLTF::Skipping a primitive of mesh " << i << " that is not a triangle list" << std::endl;
+                continue;
+            }
+            const JsonValue& attributes = source["attributes"];
+            GltfPrimitive primitive;
+            primitive.position = IndexIn(attributes["POSITION"], accessors.size());
+            primitive.normal = IndexIn(attributes["NORMAL"], accessors.size());
+            primitive.texCoord = IndexIn(attributes["TEXCOORD_0"], accessors.size());
+            primitive.tangent = IndexIn(attributes["TANGENT"], accessors.size());
+            primitive.indices = IndexIn(source["indices"], accessors.size());
+            primitive.material = IndexIn(source["material"], materials.size());
+            if (primitive.position < 0 || accessors[primitive.position].bufferView < 0)
+            {
+                std::cout << "ERROR::GLTF::Skipping a primitive of mesh " << i << " without positions" << std::endl;
+                continue;
+            }
+            meshes[i].primitives.push_back(primitive);
+        }
+    }
+
+    const JsonValue& nodeList = root["nodes"];
+    nodes.assign(nodeList.Size(), GltfNode());
+    std::vector<bool> isChild(nodes.size(), false);
+    for (size_t i = 0; i < nodeList.Size(); i++)
+    {
+        nodes[i].transform = NodeTransform(nodeList[i]);
+        nodes[i].mesh = IndexIn(nodeList[i]["mesh"], meshes.size());
+        const JsonValue& children = nodeList[i]["children"];
+        for (size_t c = 0; c < children.Size(); c++)
+        {
+            int child = IndexIn(children[c], nodes.size());
+            if (child >= 0)
+            {
+                nodes[i].children.push_back(child);
+                isChild[child] = true;
+            }
+        }
+    }
+
+    // the default scene's roots, or every node nobody parents without scenes
+    roots.clear();
+    const JsonValue& scenes = root["scenes"];
+    if (scenes.Size() > 0)
+    {
+        const JsonValue& sceneNodes = scenes[(size_t)std::max(0, root["scene"].AsInt(0))]["nodes"];
+        for (size_t i = 0; i < sceneNodes.Size(); i++)
+        {
+            int node = IndexIn(sceneNodes[i], nodes.size());
+            if (node >= 0)
+                roots.push_back(node);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if (!isChild[i])
+                roots.push_back((int)i);
+        }
+    }
+    return true;
+}
+
+const unsigned char* GltfAsset::AccessorData(const GltfAccessor& accessor) const
+{
+    if (accessor.bufferView < 0)
+        return nullptr;
+    return bufferViews[accessor.bufferView].data + accessor.byteOffset;
+}
+
+void GltfAsset::ReadFloats(int accessorIndex, int components, float* out, size_t outStride) const
+{
+    const GltfAccessor& accessor = accessors[accessorIndex];
+    const unsigned char* source = AccessorData(accessor);
+    if (!source)
+        return;
+    components = std::min(components, accessor.components);
+    bool normalized = accessor.normalized;
+    switch (accessor.componentType)
+    {
+    case GL_FLOAT:
+        for (size_t i = 0; i < accessor.count; i++, source += accessor.stride, out += outStride)
+            std::memcpy(out, source, components * sizeof(float));
+        break;
+    case GL_UNSIGNED_BYTE:
+        ConvertElements<uint8_t>(source, accessor.stride, accessor.count, components, normalized ? 1.0f / 255.0f : 0.0f, out, outStride);
+        break;
+    case GL_BYTE:
+        ConvertElements<int8_t>(source, accessor.stride, accessor.count, components, normalized ? 1.0f / 127.0f : 0.0f, out, outStride);
+        break;
+    case GL_UNSIGNED_SHORT:
+        ConvertElements<uint16_t>(source, accessor.stride, accessor.count, components, normalized ? 1.0f / 65535.0f : 0.0f, out, outStride);
+        break;
+    case GL_SHORT:
+        ConvertElements<int16_t>(source, accessor.stride, accessor.count, components, normalized ? 1.0f / 32767.0f : 0.0f, out, outStride);
+        break;
+    case GL_UNSIGNED_INT:
+        ConvertElements<uint32_t>(source, accessor.stride, accessor.count, components, 0.0f, out, outStride);
+        break;
+    }
+}
+
+void GltfAsset::ReadIndices(int accessorIndex, std::vector<unsigned int>& indices) const
+{
+    const GltfAccessor& accessor = accessors[accessorIndex];
+    const unsigned char* source = AccessorData(accessor);
+    indices.resize(source ? accessor.count : 0);
+    for (size_t i = 0; i < indices.size(); i++, source += accessor.stride)
+    {
+        switch (accessor.componentType)
+        {
+        case GL_UNSIGNED_BYTE:
+            indices[i] = *source;
+            break;
+        case GL_UNSIGNED_SHORT:
+        {
+            uint16_t index;
+            std::memcpy(&index, source, sizeof(index));
+            indices[i] = index;
+            break;
+        }
+        default:
+            std::memcpy(&indices[i], source, sizeof(unsigned int));
+            break;
+        }
+    }
+}
@@ -0,0 +1,288 @@
+#include "../header/JobSystem.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+namespace {
+
+struct QueuedJob {
+    Job job;
+    JobCounter* counter;
+};
+
+struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<QueuedJob> jobs;
+};
+
+// queue 0 belongs to the main thread, queue i to worker i
+std::vector<std::unique_ptr<WorkerQueue>> queues;
+std::vector<std::thread> workers;
+std::atomic<int> queuedJobs(0);
+std::atomic<int> sleepingWorkers(0);
+std::mutex sleepMutex;
+std::condition_variable wake;
+bool quit = false;
+
+std::mutex glThreadMutex;
+std::vector<Job> glThreadJobs;
+
+// queue index of the calling thread, -1 for threads the job system did not start
+thread_local int threadIndex = -1;
+
+// tries before an idle worker goes to sleep
+const int IDLE_SPINS = 64;
+
+}
+
+void JobSystem::Initialize(int workerCount)
+{
+    if (!queues.empty())
+        Shutdown();
+    if (workerCount < 0)
+        workerCount = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+    threadIndex = 0;
+    quit = false;
+    for (int i = 0; i <= workerCount; i++)
+        queues.emplace_back(new WorkerQueue());
+    for (int i = 1; i <= workerCount; i++)
+        workers.emplace_back(WorkerLoop, i);
+}
+
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    // anything still queued runs here rather than being dropped
+    for (auto& queue : queues)
+    {
+        for (QueuedJob& queued : queue->jobs)
+        {
+            queued.job();
+            Finish(queued.counter);
+        }
+    }
+    queues.clear();
+    queuedJobs = 0;
+}
+
+int JobSystem::ThreadCount()
+{
+    return (int)workers.size() + 1;
+}
+
+void JobSystem::Run(Job job, JobCounter* counter)
+{
+    if (counter)
+        counter->pending++;
+    if (workers.empty())
+    {
+        job();
+        Finish(counter);
+        return;
+    }
+    Push(std::move(job), counter);
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, Job job, JobCounter* counter)
+{
+    if (counter)
+        counter->pending++;
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (dependency.pending.load() != 0)
+        {
+            dependency.continuations.push_back({ std::move(job), counter });
+            return;
+        }
+    }
+    if (workers.empty())
+    {
+        job();
+        Finish(counter);
+        return;
+    }
+    Push(std::move(job), counter);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    while (counter.pending.load() != 0)
+    {
+        if (!RunOne(threadIndex))
+            std::this_thread::yield();
+    }
+    // the job that finished the counter may still be releasing its continuations
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::ParallelFor(int count, int minBatch, FunctionRef<void(int, int)> func)
+{
+    if (count <= 0)
+        return;
+    minBatch = std::max(1, minBatch);
+    int threads = ThreadCount();
+    int helpers = std::min(threads - 1, (count - 1) / minBatch);
+    if (helpers == 0)
+    {
+        func(0, count);
+        return;
+    }
+
+    // every thread claims its next batch from a shared cursor; batches are a fraction of what is left
+    std::atomic<int> next(0);
+    auto work = [&] {
+        int begin = next.load();
+        while (true)
+        {
+            if (begin >= count)
+                return;
+            int batch = std::min(count - begin, std::max(minBatch, (count - begin) / (2 * threads)));
+            if (next.compare_exchange_weak(begin, begin + batch))
+            {
+                func(begin, begin + batch);
+                begin = next.load();
+            }
+        }
+    };
+    JobCounter done;
+    // by reference, so the helper jobs do not copy the closure to the heap
+    for (int i = 0; i < helpers; i++)
+        Run(std::ref(work), &done);
+    work();
+    Wait(done);
+}
+
+void JobSystem::RunOnGLThread(Job job)
+{
+    std::lock_guard<std::mutex> lock(glThreadMutex);
+    glThreadJobs.push_back(std::move(job));
+}
+
+int JobSystem::PumpGLThread()
+{
+    std::vector<Job> jobs;
+    {
+        std::lock_guard<std::mutex> lock(glThreadMutex);
+        jobs.swap(glThreadJobs);
+    }
+    for (Job& job : jobs)
+        job();
+    return (int)jobs.size();
+}
+
+bool JobSystem::IsMainThread()
+{
+    return threadIndex == 0;
+}
+
+void JobSystem::Push(Job job, JobCounter* counter)
+{
+    // threads outside the pool hand their jobs to the main thread's queue, where workers steal them
+    WorkerQueue& queue = *queues[std::max(0, threadIndex)];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back({ std::move(job), counter });
+    }
+    queuedJobs++;
+    if (sleepingWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+bool JobSystem::RunOne(int thread)
+{
+    QueuedJob queued;
+    bool found = false;
+    if (thread >= 0)
+    {
+        WorkerQueue& own = *queues[thread];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            queued = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            found = true;
+        }
+    }
+    // steal, starting after our own queue so thieves spread over the victims
+    for (size_t i = 1; !found && i <= queues.size(); i++)
+    {
+        WorkerQueue& victim = *queues[(std::max(0, thread) + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            queued = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+    queuedJobs--;
+    queued.job();
+    Finish(queued.counter);
+    return true;
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+    if (!counter)
+        return;
+    std::vector<JobCounter::Continuation> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (--counter->pending == 0)
+            released.swap(counter->continuations);
+    }
+    // counter may be gone from here on, its waiter only had to see zero
+    for (JobCounter::Continuation& continuation : released)
+    {
+        if (workers.empty())
+        {
+            continuation.job();
+            Finish(continuation.counter);
+        }
+        else
+        {
+            Push(std::move(continuation.job), continuation.counter);
+        }
+    }
+}
+
+void JobSystem::WorkerLoop(int thread)
+{
+    threadIndex = thread;
+    int idle = 0;
+    while (true)
+    {
+        if (RunOne(thread))
+        {
+            idle = 0;
+            continue;
+        }
+        if (++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers++;
+        wake.wait(lock, [] { return quit || queuedJobs.load() > 0; });
+        sleepingWorkers--;
+        if (quit)
+            return;
+        idle = 0;
+    }
+}
@@ -0,0 +1,324 @@
+#include "../header/Json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const JsonValue NULL_VALUE;
+const std::string EMPTY_STRING;
+// nesting beyond this is rejected instead of overflowing the stack
+const int MAX_DEPTH = 256;
+
+class JsonParser {
+public:
+    JsonParser(const char* text, size_t size) : cursor(text), begin(text), end(text + size) {}
+
+    bool ParseDocument(JsonValue& root)
+    {
+        SkipSpace();
+        if (!ParseValue(root, 0))
+            return false;
+        SkipSpace();
+        if (cursor != end)
+            return Fail("unexpected characters after the document");
+        return true;
+    }
+
+    std::string error;
+
+private:
+    const char* cursor;
+    const char* begin;
+    const char* end;
+
+    bool Fail(const char* message)
+    {
+        if (error.empty())
+            error = std::string(message) + " at byte " + std::to_string(cursor - begin);
+        return false;
+    }
+
+    void SkipSpace()
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+            cursor++;
+    }
+
+    bool Match(const char* literal)
+    {
+        size_t length = std::strlen(literal);
+        if ((size_t)(end - cursor) < length || std::memcmp(cursor, literal, length) != 0)
+            return false;
+        cursor += length;
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value, int depth)
+    {
+        if (cursor == end)
+            return Fail("unexpected end of input");
+        switch (*cursor)
+        {
+        case '{':
+            return ParseObject(value, depth);
+        case '[':
+            return ParseArray(value, depth);
+        case '"':
+            value.type = JsonValue::String;
+            return ParseString(value.string);
+        case 't':
+        case 'f':
+            value.type = JsonValue::Bool;
+            value.boolean = *cursor == 't';
+            return Match(value.boolean ? "true" : "false") || Fail("invalid literal");
+        case 'n':
+            value.type = JsonValue::Null;
+            return Match("null") || Fail("invalid literal");
+        default:
+            return ParseNumber(value);
+        }
+    }
+
+    bool ParseObject(JsonValue& value, int depth)
+    {
+        if (depth >= MAX_DEPTH)
+            return Fail("nesting too deep");
+        value.type = JsonValue::Object;
+        cursor++;
+        SkipSpace();
+        if (cursor < end && *cursor == '}')
+        {
+            cursor++;
+            return true;
+        }
+        while (true)
+        {
+            SkipSpace();
+            if (cursor == end || *cursor != '"')
+                return Fail("expected a member name");
+            value.keys.emplace_back();
+            if (!ParseString(value.keys.back()))
+                return false;
+            SkipSpace();
+            if (cursor == end || *cursor != ':')
+                return Fail("expected ':'");
+            cursor++;
+            SkipSpace();
+            value.elements.emplace_back();
+            if (!ParseValue(value.elements.back(), depth + 1))
+                return false;
+            SkipSpace();
+            if (cursor < end && *cursor == ',')
+            {
+                cursor++;
+                continue;
+            }
+            if (cursor < end && *cursor == '}')
+            {
+                cursor++;
+                return true;
+            }
+            return Fail("expected ',' or '}'");
+        }
+    }
+
+    bool ParseArray(JsonValue& value, int depth)
+    {
+        if (depth >= MAX_DEPTH)
+            return Fail("nesting too deep");
+        value.type = JsonValue::Array;
+        cursor++;
+        SkipSpace();
+        if (cursor < end && *cursor == ']')
+        {
+            cursor++;
+            return true;
+        }
+        while (true)
+        {
+            SkipSpace();
+            value.elements.emplace_back();
+            if (!ParseValue(value.elements.back(), depth + 1))
+                return false;
+            SkipSpace();
+            if (cursor < end && *cursor == ',')
+            {
+                cursor++;
+                continue;
+            }
+            if (cursor < end && *cursor == ']')
+            {
+                cursor++;
+                return true;
+            }
+            return Fail("expected ',' or ']'");
+        }
+    }
+
+    bool ParseHex4(unsigned int& code)
+    {
+        if (end - cursor < 4)
+            return Fail("truncated \\u escape");
+        code = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            char c = *cursor++;
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                code |= c - 'A' + 10;
+            else
+                return Fail("invalid \\u escape");
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, unsigned int code)
+    {
+        if (code < 0x80)
+            out += (char)code;
+        else if (code < 0x800)
+        {
+            out += (char)(0xC0 | code >> 6);
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += (char)(0xE0 | code >> 12);
+            out += (char)(0x80 | (code >> 6 & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += (char)(0xF0 | code >> 18);
+            out += (char)(0x80 | (code >> 12 & 0x3F));
+            out += (char)(0x80 | (code >> 6 & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ParseString(std::string& out)
+    {
+        cursor++;
+        while (true)
+        {
+            // copy the run up to the next quote or escape at once
+            const char* run = cursor;
+            while (cursor < end && *cursor != '"' && *cursor != '\\')
+            {
+                if ((unsigned char)*cursor < 0x20)
+                    return Fail("control character in string");
+                cursor++;
+            }
+            out.append(run, cursor);
+            if (cursor == end)
+                return Fail("unterminated string");
+            if (*cursor++ == '"')
+                return true;
+
+            if (cursor == end)
+                return Fail("unterminated string");
+            char escape = *cursor++;
+            switch (escape)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                unsigned int code;
+                if (!ParseHex4(code))
+                    return false;
+                // a surrogate pair spells one code point above the basic plane
+                if (code >= 0xD800 && code < 0xDC00 && end - cursor >= 6 && cursor[0] == '\\' && cursor[1] == 'u')
+                {
+                    cursor += 2;
+                    unsigned int low;
+                    if (!ParseHex4(low))
+                        return false;
+                    if (low < 0xDC00 || low >= 0xE000)
+                        return Fail("invalid surrogate pair");
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, code);
+                break;
+            }
+            default:
+                return Fail("invalid escape");
+            }
+        }
+    }
+
+    bool ParseNumber(JsonValue& value)
+    {
+        const char* start = cursor;
+        if (cursor < end && *cursor == '-')
+            cursor++;
+        if (cursor == end || *cursor < '0' || *cursor > '9')
+            return Fail("unexpected character");
+        while (cursor < end && ((*cursor >= '0' && *cursor <= '9') || *cursor == '.' || *cursor == 'e' ||
+            *cursor == 'E' || *cursor == '+' || *cursor == '-'))
+            cursor++;
+        // the text is not null terminated; numbers are short enough to copy
+        char buffer[64];
+        size_t length = cursor - start;
+        if (length >= sizeof(buffer))
+            return Fail("number too long");
+        std::memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        char* parsedEnd;
+        value.type = JsonValue::Number;
+        value.number = std::strtod(buffer, &parsedEnd);
+        if (parsedEnd != buffer + length)
+        {
+            cursor = start;
+            return Fail("invalid number");
+        }
+        return true;
+    }
+};
+
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+    return type == Array && index < elements.size() ? elements[index] : NULL_VALUE;
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+    if (type != Object)
+        return NULL_VALUE;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] == key)
+            return elements[i];
+    }
+    return NULL_VALUE;
+}
+
+const std::string& JsonValue::AsString() const
+{
+    return type == String ? string : EMPTY_STRING;
+}
+
+bool ParseJson(const char* text, size_t size, JsonValue& root, std::string& error)
+{
+    root = JsonValue();
+    JsonParser parser(text, size);
+    if (!parser.ParseDocument(root))
+    {
+        error = parser.error;
+        return false;
+    }
+    return true;
+}
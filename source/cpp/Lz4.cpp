@@ -0,0 +1,182 @@
+#include "../header/Lz4.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const int MIN_MATCH = 4;
+// the last match has to start this far before the end, and the last five bytes are always literals
+const size_t MATCH_START_LIMIT = 12;
+const size_t LAST_LITERALS = 5;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 16;
+
+uint32_t Read32(const uint8_t* bytes)
+{
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// a length of 15 or more continues in bytes of 255 and a remainder
+uint8_t* WriteLength(uint8_t* out, size_t length)
+{
+    for (length -= 15; length >= 255; length -= 255)
+        *out++ = 255;
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+// the sequence's literals and, unless it is the last one, its match; null when it does not fit
+uint8_t* WriteSequence(uint8_t* out, uint8_t* outEnd, const uint8_t* literals, size_t literalLength,
+    size_t offset, size_t matchLength)
+{
+    // token, length bytes of both lengths, the literals and the offset
+    if ((size_t)(outEnd - out) < 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1)
+        return nullptr;
+    uint8_t* token = out++;
+    *token = (uint8_t)((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15)
+        out = WriteLength(out, literalLength);
+    std::memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0)
+        return out;
+
+    *out++ = (uint8_t)(offset & 0xFF);
+    *out++ = (uint8_t)(offset >> 8);
+    size_t length = matchLength - MIN_MATCH;
+    *token |= (uint8_t)(length < 15 ? length : 15);
+    if (length >= 15)
+        out = WriteLength(out, length);
+    return out;
+}
+
+}
+
+size_t Lz4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t Lz4Compress(const char* source, size_t size, char* destination, size_t capacity)
+{
+    const uint8_t* in = (const uint8_t*)source;
+    uint8_t* out = (uint8_t*)destination;
+    uint8_t* outEnd = out + capacity;
+    size_t anchor = 0;
+
+    if (size > MATCH_START_LIMIT)
+    {
+        // last position seen for each hashed four byte sequence
+        std::vector<size_t> table((size_t)1 << HASH_BITS, 0);
+        size_t matchEndLimit = size - LAST_LITERALS;
+        size_t position = 1;
+        table[Hash(Read32(in))] = 0;
+        while (position < size - MATCH_START_LIMIT)
+        {
+            uint32_t sequence = Read32(in + position);
+            uint32_t hash = Hash(sequence);
+            size_t candidate = table[hash];
+            table[hash] = position;
+            if (position - candidate > MAX_OFFSET || Read32(in + candidate) != sequence)
+            {
+                // step faster through data that keeps not matching
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+
+            // grow the match backwards into the pending literals, then forwards
+            while (position > anchor && candidate > 0 && in[position - 1] == in[candidate - 1])
+            {
+                position--;
+                candidate--;
+            }
+            size_t length = MIN_MATCH;
+            while (position + length < matchEndLimit && in[position + length] == in[candidate + length])
+                length++;
+
+            out = WriteSequence(out, outEnd, in + anchor, position - anchor, position - candidate, length);
+            if (!out)
+                return 0;
+            position += length;
+            anchor = position;
+        }
+    }
+
+    out = WriteSequence(out, outEnd, in + anchor, size - anchor, 0, 0);
+    return out ? (size_t)(out - (uint8_t*)destination) : 0;
+}
+
+bool Lz4Decompress(const char* source, size_t sourceSize, char* destination, size_t destinationSize)
+{
+    const uint8_t* in = (const uint8_t*)source;
+    const uint8_t* inEnd = in + sourceSize;
+    uint8_t* out = (uint8_t*)destination;
+    uint8_t* outEnd = out + destinationSize;
+
+    while (in < inEnd)
+    {
+        uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15)
+        {
+            uint8_t extra;
+            do
+            {
+                if (in == inEnd)
+                    return false;
+                extra = *in++;
+                literalLength += extra;
+            } while (extra == 255);
+        }
+        if (literalLength > (size_t)(inEnd - in) || literalLength > (size_t)(outEnd - out))
+            return false;
+        std::memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+        // the last sequence ends after its literals
+        if (in == inEnd)
+            break;
+
+        if (inEnd - in < 2)
+            return false;
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+        if (offset == 0 || offset > (size_t)(out - (uint8_t*)destination))
+            return false;
+        size_t matchLength = token & 15;
+        if (matchLength == 15)
+        {
+            uint8_t extra;
+            do
+            {
+                if (in == inEnd)
+                    return false;
+                extra = *in++;
+                matchLength += extra;
+            } while (extra == 255);
+        }
+        matchLength += MIN_MATCH;
+        if (matchLength > (size_t)(outEnd - out))
+            return false;
+        const uint8_t* match = out - offset;
+        if (offset >= matchLength)
+            std::memcpy(out, match, matchLength);
+        else
+        {
+            // overlapping copies repeat the last offset bytes
+            for (size_t i = 0; i < matchLength; i++)
+                out[i] = match[i];
+        }
+        out += matchLength;
+    }
+    return out == outEnd;
+}
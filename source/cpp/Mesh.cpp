@@ -1,28 +1,110 @@
 #include "../header/Mesh.h"
+#include "../header/FrameArena.h"
+#include "../header/GLState.h"
 #include "../header/Shader.h"
+#include <algorithm>
+#include <utility>
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
 {
 	this->vertices = vertices;
 	this->indices = indices;
 	this->textures = textures;
+	for (const Vertex& vertex : this->vertices)
+		bounds.Expand(vertex.Position);
+	lods.push_back({ 0, (unsigned int)this->indices.size(), 0.0f });
 
 	SetupMesh();
 }
 
-void Mesh::Draw(Shader& shader)
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+	const VertexStreams& streams, const MeshMaterial& material)
+{
+	this->vertices = std::move(vertices);
+	this->indices = std::move(indices);
+	this->textures = std::move(textures);
+	this->material = material;
+	for (const Vertex& vertex : this->vertices)
+		bounds.Expand(vertex.Position);
+	lods.push_back({ 0, (unsigned int)this->indices.size(), 0.0f });
+
+	SetupMesh(&streams);
+}
+
+void Mesh::Draw(Shader& shader, int instanceCount, int lod) const
+{
+	BindTextures(shader);
+
+	// draw mesh
+	const MeshLOD& range = lods[std::max(0, std::min(lod, (int)lods.size() - 1))];
+	const void* offset = (const void*)(range.firstIndex * sizeof(unsigned int));
+	GLState::BindVertexArray(VAO);
+	if (instanceCount > 1)
+		glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, offset, instanceCount);
+	else
+		glDrawElements(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, offset);
+}
+
+void Mesh::DrawRanges(Shader& shader, const IndexRange* ranges, int rangeCount) const
+{
+	if (rangeCount == 0)
+		return;
+	BindTextures(shader);
+
+	ScratchScope scratch;
+	GLsizei* counts = scratch.arena.New<GLsizei>(rangeCount);
+	const void** offsets = scratch.arena.New<const void*>(rangeCount);
+	for (int i = 0; i < rangeCount; i++)
+	{
+		counts[i] = (GLsizei)ranges[i].indexCount;
+		offsets[i] = (const void*)(ranges[i].firstIndex * sizeof(unsigned int));
+	}
+	GLState::BindVertexArray(VAO);
+	glMultiDrawElements(GL_TRIANGLES, counts, GL_UNSIGNED_INT, offsets, rangeCount);
+}
+
+void Mesh::BindTextures(Shader& shader) const
+{
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		GLState::ActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
+		shader.setInt(samplerNames[i].c_str(), i);
+		GLState::BindTexture(GL_TEXTURE_2D, textures[i].id);
+	}
+	GLState::ActiveTexture(GL_TEXTURE0);
+	// uniforms outlive the draw, so every mesh sets its own, defaults included
+	shader.setVec4("material.baseColorFactor", material.baseColorFactor);
+	shader.setFloat("material.metallicFactor", material.metallicFactor);
+	shader.setFloat("material.roughnessFactor", material.roughnessFactor);
+	shader.setBool("material.metallicRoughness", material.metallicRoughness);
+}
+
+void Mesh::SetLODs(const std::vector<std::vector<unsigned int>>& lodIndices, const std::vector<float>& errors)
+{
+	lods.resize(1);
+	std::vector<unsigned int> elements = indices;
+	for (size_t i = 0; i < lodIndices.size(); i++)
+	{
+		lods.push_back({ (unsigned int)elements.size(), (unsigned int)lodIndices[i].size(), errors[i] });
+		elements.insert(elements.end(), lodIndices[i].begin(), lodIndices[i].end());
+	}
+	// the element buffer binding is part of the VAO
+	GLState::BindVertexArray(VAO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), elements.data(), GL_STATIC_DRAW);
+	GLState::BindVertexArray(0);
+}
+
+void Mesh::SetupMesh(const VertexStreams* streams)
 {
 	unsigned int diffuseNum = 1;
 	unsigned int specularNum = 1;
 	unsigned int normalNum = 1;
 	unsigned int roughnessNum = 1;
-	
-	for (unsigned int i = 0; i < textures.size(); i++)
+	for (const Texture& texture : textures)
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
 		// retrieve texture number (the N in diffuse_textureN)
 		std::string number;
-		std::string name = textures[i].type;
+		const std::string& name = texture.type;
 		if (name == "texture_diffuse")
 			number = std::to_string(diffuseNum++);
 		else if (name == "texture_specular")
@@ -31,38 +113,44 @@ void Mesh::Draw(Shader& shader)
 			number = std::to_string(normalNum++);
 		else if (name == "texture_roughness")
 			number = std::to_string(roughnessNum++);
-
-		shader.setInt(("material." + name + number).c_str(), i);
-		shader.setInt("hasNormalTexture", 1);
-		shader.setInt("hasDiffuseTexture", 1);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		samplerNames.push_back("material." + name + number);
 	}
-	glActiveTexture(GL_TEXTURE0);
-
-	// draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
-}
 
-void Mesh::SetupMesh()
-{
 	//Create Buffer Objects
 	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
 
 	//Make VAO in bound
-	glBindVertexArray(VAO);
-	//Bind VBO to VAO
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	//Allocate Memory in VBO and Initialize data in memory
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+	GLState::BindVertexArray(VAO);
 	//Bind EBO to VAO
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	//Allocate Memory in EBO and Initialize data in memory
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
+	if (streams)
+	{
+		// attribute locations in the order of the vertex shaders' inputs; the VAO keeps each buffer
+		const VertexStream* attributes[4] = { &streams->position, &streams->normal, &streams->texCoords, &streams->tangent };
+		for (unsigned int location = 0; location < 4; location++)
+		{
+			const VertexStream& stream = *attributes[location];
+			if (stream.buffer == 0)
+				continue;
+			glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+			glVertexAttribPointer(location, stream.size, stream.type, stream.normalized ? GL_TRUE : GL_FALSE,
+				stream.stride, (void*)stream.offset);
+			glEnableVertexAttribArray(location);
+		}
+		GLState::BindVertexArray(0);
+		return;
+	}
+
+	glGenBuffers(1, &VBO);
+	//Bind VBO to VAO
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	//Allocate Memory in VBO and Initialize data in memory
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+
 	// vertex positions
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -79,5 +167,5 @@ void Mesh::SetupMesh()
 	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 	glEnableVertexAttribArray(4);
 
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
@@ -0,0 +1,482 @@
+#include "../header/MeshSimplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// weight of the planes that hold open borders and seams in place, relative to surface planes
+const double BORDER_WEIGHT = 10.0;
+// a collapse may not turn a triangle's normal by more than ~75 degrees
+const float FLIP_THRESHOLD = 0.25f;
+const unsigned int NONE = 0xFFFFFFFFu;
+// stop the chain below this many triangles, or once a level removes less than a tenth of the previous one
+const size_t MIN_LOD_TRIANGLES = 64;
+const float MIN_LOD_REDUCTION = 0.9f;
+// a level may move the surface by at most this fraction of the mesh's bounds diagonal
+const float MAX_LOD_ERROR = 0.05f;
+const uint32_t CACHE_MAGIC = 0x31444F4C;  // "LOD1"
+const uint32_t CACHE_VERSION = 1;
+
+enum VertexKind : unsigned char {
+    // interior vertex, collapses in any direction
+    KIND_MANIFOLD,
+    // on an open border, collapses along the border
+    KIND_BORDER,
+    // one of two vertices sharing a position, collapses along the seam together with its twin
+    KIND_SEAM,
+    // anything more complex stays where it is
+    KIND_LOCKED
+};
+
+// plane equations summed as p^T A p + 2 b.p + c, weighted by area
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    double weight = 0;
+
+    void AddPlane(const glm::dvec3& n, double d, double w)
+    {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    // mean squared distance of p to the planes
+    double Error(const glm::vec3& point) const
+    {
+        double x = point.x, y = point.y, z = point.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+            2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+template <int N>
+struct FloatKey {
+    float values[N];
+
+    bool operator==(const FloatKey& other) const { return std::memcmp(values, other.values, sizeof(values)) == 0; }
+};
+
+template <int N>
+struct FloatKeyHash {
+    size_t operator()(const FloatKey<N>& key) const
+    {
+        uint64_t hash = 1469598103934665603ull;
+        const unsigned char* bytes = (const unsigned char*)key.values;
+        for (size_t i = 0; i < sizeof(key.values); i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return (size_t)hash;
+    }
+};
+
+uint64_t EdgeKey(unsigned int a, unsigned int b)
+{
+    return (uint64_t)a << 32 | b;
+}
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    float cost;
+};
+
+}
+
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    size_t targetIndexCount, float maxError, float& error)
+{
+    error = 0.0f;
+    size_t vertexCount = vertices.size();
+
+    // weld vertices with equal attributes, and find the first vertex of every position
+    std::vector<unsigned int> attribute(vertexCount), position(vertexCount);
+    {
+        std::unordered_map<FloatKey<8>, unsigned int, FloatKeyHash<8>> attributes;
+        std::unordered_map<FloatKey<3>, unsigned int, FloatKeyHash<3>> positions;
+        attributes.reserve(vertexCount);
+        positions.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const Vertex& vertex = vertices[v];
+            FloatKey<8> attributeKey = { { vertex.Position.x, vertex.Position.y, vertex.Position.z,
+                vertex.Normal.x, vertex.Normal.y, vertex.Normal.z, vertex.TexCoords.x, vertex.TexCoords.y } };
+            FloatKey<3> positionKey = { { vertex.Position.x, vertex.Position.y, vertex.Position.z } };
+            attribute[v] = attributes.emplace(attributeKey, (unsigned int)v).first->second;
+            position[v] = positions.emplace(positionKey, (unsigned int)v).first->second;
+        }
+    }
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        unsigned int a = attribute[indices[i]], b = attribute[indices[i + 1]], c = attribute[indices[i + 2]];
+        if (a == b || b == c || c == a)
+            continue;
+        result.push_back(a);
+        result.push_back(b);
+        result.push_back(c);
+    }
+    if (result.size() <= targetIndexCount)
+        return result;
+
+    // ring of the welded vertices that share a position; the first vertex of a position is always welded
+    std::vector<unsigned int> wedge(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        wedge[v] = (unsigned int)v;
+        unsigned int head = position[v];
+        if (attribute[v] == v && head != v)
+        {
+            wedge[v] = wedge[head];
+            wedge[head] = (unsigned int)v;
+        }
+    }
+
+    // half-edges without a twin are open: a border of the mesh or one side of a seam
+    std::vector<unsigned char> locked(vertexCount, 0);
+    std::unordered_set<uint64_t> edges;
+    edges.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+            // the same half-edge twice is non-manifold
+            if (!edges.insert(EdgeKey(a, b)).second)
+                locked[a] = locked[b] = 1;
+        }
+    }
+    std::vector<unsigned int> openNext(vertexCount, NONE), openPrev(vertexCount, NONE);
+    std::vector<unsigned char> openOut(vertexCount, 0), openIn(vertexCount, 0);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+            if (edges.count(EdgeKey(b, a)))
+                continue;
+            openNext[a] = b;
+            openPrev[b] = a;
+            openOut[a] = (unsigned char)std::min(openOut[a] + 1, 2);
+            openIn[b] = (unsigned char)std::min(openIn[b] + 1, 2);
+        }
+    }
+
+    std::vector<unsigned char> kind(vertexCount, KIND_LOCKED);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (attribute[v] != v || locked[v])
+            continue;
+        unsigned int twin = wedge[v];
+        if (twin == v)
+        {
+            if (openOut[v] == 0 && openIn[v] == 0)
+                kind[v] = KIND_MANIFOLD;
+            else if (openOut[v] == 1 && openIn[v] == 1)
+                kind[v] = KIND_BORDER;
+        }
+        else if (wedge[twin] == v && !locked[twin] && openOut[v] == 1 && openIn[v] == 1 && openOut[twin] == 1 && openIn[twin] == 1 &&
+            position[openNext[v]] == position[openPrev[twin]] && position[openPrev[v]] == position[openNext[twin]])
+        {
+            // exactly two sides whose open edges run along each other
+            kind[v] = KIND_SEAM;
+        }
+    }
+
+    // quadrics per position: the planes of the surrounding triangles, plus planes through open edges
+    // standing on their triangle, so borders and seams keep their shape
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        glm::dvec3 p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = glm::dvec3(vertices[result[i + k]].Position);
+        glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        double length = glm::length(normal);
+        if (length <= 0.0)
+            continue;
+        normal /= length;
+        for (int k = 0; k < 3; k++)
+            quadrics[position[result[i + k]]].AddPlane(normal, -glm::dot(normal, p[0]), length * 0.5);
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+            if (openNext[a] != b)
+                continue;
+            glm::dvec3 edge = p[(k + 1) % 3] - p[k];
+            glm::dvec3 borderNormal = glm::cross(edge, normal);
+            double borderLength = glm::length(borderNormal);
+            if (borderLength <= 0.0)
+                continue;
+            borderNormal /= borderLength;
+            double d = -glm::dot(borderNormal, p[k]);
+            double weight = glm::dot(edge, edge) * BORDER_WEIGHT;
+            quadrics[position[a]].AddPlane(borderNormal, d, weight);
+            quadrics[position[b]].AddPlane(borderNormal, d, weight);
+        }
+    }
+
+    // the twin collapse that has to go with from -> to, or false if the collapse is not allowed
+    auto allowed = [&](unsigned int from, unsigned int to, unsigned int& twinFrom, unsigned int& twinTo) {
+        twinFrom = twinTo = NONE;
+        if (position[from] == position[to])
+            return false;
+        switch (kind[from])
+        {
+        case KIND_MANIFOLD:
+            return true;
+        case KIND_BORDER:
+            return openNext[from] == to || openPrev[from] == to;
+        case KIND_SEAM:
+            twinFrom = wedge[from];
+            if (openNext[from] == to)
+                twinTo = openPrev[twinFrom];
+            else if (openPrev[from] == to)
+                twinTo = openNext[twinFrom];
+            return twinTo != NONE && position[twinTo] == position[to] && twinTo != to;
+        default:
+            return false;
+        }
+    };
+
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<unsigned char> touched(vertexCount);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<Collapse> candidates;
+    size_t targetTriangles = targetIndexCount / 3;
+    double maxErrorSquared = (double)maxError * maxError;
+    double worstError = 0.0;
+
+    // triangles around from that do not contain to must not flip when from moves onto to
+    auto flips = [&](unsigned int from, unsigned int to) {
+        glm::vec3 target = vertices[to].Position;
+        for (unsigned int a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++)
+        {
+            const unsigned int* triangle = &result[adjacency[a] * 3];
+            int k = triangle[0] == from ? 0 : (triangle[1] == from ? 1 : 2);
+            unsigned int next = triangle[(k + 1) % 3], prev = triangle[(k + 2) % 3];
+            if (next == to || prev == to)
+                continue;
+            glm::vec3 source = vertices[from].Position;
+            glm::vec3 pn = vertices[next].Position, pp = vertices[prev].Position;
+            glm::vec3 before = glm::cross(pn - source, pp - source);
+            glm::vec3 after = glm::cross(pn - target, pp - target);
+            float scale = glm::length(before) * glm::length(after);
+            if (scale <= 0.0f || glm::dot(before, after) < FLIP_THRESHOLD * scale)
+                return true;
+        }
+        return false;
+    };
+    auto lockRing = [&](unsigned int vertex) {
+        touched[vertex] = 1;
+        for (unsigned int a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+        {
+            const unsigned int* triangle = &result[adjacency[a] * 3];
+            touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+        }
+    };
+    auto sharedTriangles = [&](unsigned int from, unsigned int to) {
+        size_t count = 0;
+        for (unsigned int a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++)
+        {
+            const unsigned int* triangle = &result[adjacency[a] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                count++;
+        }
+        return count;
+    };
+
+    // passes of independent collapses, cheapest first, until the target is reached or nothing fits
+    while (result.size() / 3 > targetTriangles)
+    {
+        size_t triangleCount = result.size() / 3;
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int index : result)
+            adjacencyOffsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(result.size());
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+            adjacency[fill[result[i]]++] = (unsigned int)(i / 3);
+
+        candidates.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                unsigned int twinFrom, twinTo;
+                if (allowed(a, b, twinFrom, twinTo))
+                    candidates.push_back({ a, b, (float)quadrics[position[a]].Error(vertices[b].Position) });
+                if (allowed(b, a, twinFrom, twinTo))
+                    candidates.push_back({ b, a, (float)quadrics[position[b]].Error(vertices[a].Position) });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = (unsigned int)v;
+        std::fill(touched.begin(), touched.end(), 0);
+        int collapses = 0;
+        for (const Collapse& collapse : candidates)
+        {
+            if (triangleCount <= targetTriangles || collapse.cost > maxErrorSquared)
+                break;
+            unsigned int from = collapse.from, to = collapse.to, twinFrom, twinTo;
+            if (touched[from] || touched[to])
+                continue;
+            allowed(from, to, twinFrom, twinTo);
+            bool seam = twinFrom != NONE;
+            if (seam && (touched[twinFrom] || touched[twinTo]))
+                continue;
+            if (flips(from, to) || (seam && flips(twinFrom, twinTo)))
+                continue;
+
+            remap[from] = to;
+            triangleCount -= sharedTriangles(from, to);
+            lockRing(from);
+            lockRing(to);
+            if (seam)
+            {
+                remap[twinFrom] = twinTo;
+                triangleCount -= sharedTriangles(twinFrom, twinTo);
+                lockRing(twinFrom);
+                lockRing(twinTo);
+            }
+            quadrics[position[to]].Add(quadrics[position[from]]);
+            worstError = std::max(worstError, (double)collapse.cost);
+            collapses++;
+        }
+        if (collapses == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    error = (float)std::sqrt(worstError);
+    return result;
+}
+
+void MeshLODChain::Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& meshIndices)
+{
+    indices.clear();
+    errors.clear();
+    AABB bounds;
+    for (const Vertex& vertex : vertices)
+        bounds.Expand(vertex.Position);
+    float maxError = glm::length(bounds.max - bounds.min) * MAX_LOD_ERROR;
+
+    size_t previous = meshIndices.size();
+    while ((int)indices.size() < MAX_LODS - 1 && previous / 3 >= MIN_LOD_TRIANGLES * 2)
+    {
+        float error = 0.0f;
+        std::vector<unsigned int> level = SimplifyMesh(vertices, meshIndices, previous / 2 / 3 * 3, maxError, error);
+        if (level.empty() || level.size() > previous * MIN_LOD_REDUCTION)
+            break;
+        previous = level.size();
+        indices.push_back(std::move(level));
+        errors.push_back(error);
+    }
+}
+
+void MeshLODChain::Save(std::ostream& out, unsigned long long sourceHash) const
+{
+    uint32_t levels = (uint32_t)indices.size();
+    out.write((const char*)&CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    out.write((const char*)&CACHE_VERSION, sizeof(CACHE_VERSION));
+    out.write((const char*)&sourceHash, sizeof(sourceHash));
+    out.write((const char*)&levels, sizeof(levels));
+    for (uint32_t i = 0; i < levels; i++)
+    {
+        uint32_t count = (uint32_t)indices[i].size();
+        out.write((const char*)&errors[i], sizeof(float));
+        out.write((const char*)&count, sizeof(count));
+        if (count > 0)
+            out.write((const char*)indices[i].data(), count * sizeof(unsigned int));
+    }
+}
+
+bool MeshLODChain::Load(std::istream& in, unsigned long long sourceHash)
+{
+    uint32_t magic = 0, version = 0, levels = 0;
+    unsigned long long hash = 0;
+    in.read((char*)&magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&hash, sizeof(hash));
+    in.read((char*)&levels, sizeof(levels));
+    if (!in || magic != CACHE_MAGIC || version != CACHE_VERSION || hash != sourceHash || levels >= MAX_LODS)
+        return false;
+    indices.resize(levels);
+    errors.resize(levels);
+    for (uint32_t i = 0; i < levels; i++)
+    {
+        uint32_t count = 0;
+        in.read((char*)&errors[i], sizeof(float));
+        in.read((char*)&count, sizeof(count));
+        if (!in)
+            break;
+        indices[i].resize(count);
+        if (count > 0)
+            in.read((char*)indices[i].data(), count * sizeof(unsigned int));
+    }
+    if (!in)
+    {
+        indices.clear();
+        errors.clear();
+        return false;
+    }
+    return true;
+}
+
+unsigned long long MeshLODChain::HashGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& meshIndices)
+{
+    // FNV-1a, as MeshBVH::HashGeometry
+    unsigned long long hash = 1469598103934665603ULL;
+    auto mix = [&](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    for (const Vertex& vertex : vertices)
+    {
+        mix(&vertex.Position, sizeof(vertex.Position));
+        mix(&vertex.Normal, sizeof(vertex.Normal));
+        mix(&vertex.TexCoords, sizeof(vertex.TexCoords));
+    }
+    if (!meshIndices.empty())
+        mix(meshIndices.data(), meshIndices.size() * sizeof(unsigned int));
+    return hash;
+}
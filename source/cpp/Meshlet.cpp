@@ -0,0 +1,290 @@
+#include "../header/Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <xmmintrin.h>
+
+namespace {
+
+// vertices at the same position weld for adjacency, whatever their other attributes
+struct PositionKey {
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey& other) const { return std::memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const
+    {
+        return key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u;
+    }
+};
+
+PositionKey KeyOf(const glm::vec3& position)
+{
+    PositionKey key;
+    std::memcpy(key.bits, &position, sizeof(key.bits));
+    return key;
+}
+
+// cutoff of a cone that never culls
+const float NO_CONE = 2.0f;
+
+}
+
+void MeshletSet::Build(const std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices)
+{
+    meshlets.clear();
+    centerX.clear(); centerY.clear(); centerZ.clear(); radius.clear();
+    axisX.clear(); axisY.clear(); axisZ.clear(); cutoff.clear();
+    size_t triangleCount = indices.size() / 3;
+
+    std::vector<unsigned int> positionIds(positions.size());
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> ids;
+    for (size_t i = 0; i < positions.size(); i++)
+        positionIds[i] = ids.emplace(KeyOf(positions[i]), (unsigned int)ids.size()).first->second;
+    size_t positionCount = ids.size();
+
+    // triangles around every position
+    std::vector<unsigned int> firstTriangle(positionCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        firstTriangle[positionIds[indices[i]] + 1]++;
+    for (size_t p = 0; p < positionCount; p++)
+        firstTriangle[p + 1] += firstTriangle[p];
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[cursor[positionIds[indices[i]]]++] = (unsigned int)(i / 3);
+
+    std::vector<bool> emitted(triangleCount, false);
+    // the meshlet a position was last added to
+    std::vector<int> owner(positionCount, -1);
+    std::vector<unsigned int> reordered;
+    reordered.reserve(triangleCount * 3);
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> triangles;
+    int vertexCount = 0;
+    glm::vec3 centroidSum(0.0f);
+
+    auto corner = [&](unsigned int triangle, int k) { return positionIds[indices[triangle * 3 + k]]; };
+    auto centroid = [&](unsigned int triangle) {
+        return (positions[indices[triangle * 3]] + positions[indices[triangle * 3 + 1]] + positions[indices[triangle * 3 + 2]]) / 3.0f;
+    };
+    auto newVertices = [&](unsigned int triangle) {
+        int count = 0;
+        for (int k = 0; k < 3; k++)
+            count += owner[corner(triangle, k)] != (int)meshlets.size();
+        return count;
+    };
+    auto addTriangle = [&](unsigned int triangle) {
+        emitted[triangle] = true;
+        triangles.push_back(triangle);
+        centroidSum += centroid(triangle);
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int p = corner(triangle, k);
+            if (owner[p] == (int)meshlets.size())
+                continue;
+            owner[p] = (int)meshlets.size();
+            vertexCount++;
+            for (unsigned int a = firstTriangle[p]; a < firstTriangle[p + 1]; a++)
+            {
+                if (!emitted[adjacency[a]])
+                    candidates.push_back(adjacency[a]);
+            }
+        }
+    };
+    auto finish = [&]() {
+        meshlets.push_back({ (unsigned int)reordered.size(), (unsigned int)triangles.size() * 3 });
+        AABB box;
+        glm::vec3 axis(0.0f);
+        for (unsigned int triangle : triangles)
+        {
+            glm::vec3 p[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = positions[indices[triangle * 3 + k]];
+                box.Expand(p[k]);
+                reordered.push_back(indices[triangle * 3 + k]);
+            }
+            glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+                axis += normal / length;
+        }
+        glm::vec3 center = box.Center();
+        float sphereRadius = 0.0f;
+        for (unsigned int triangle : triangles)
+        {
+            for (int k = 0; k < 3; k++)
+                sphereRadius = std::max(sphereRadius, glm::length(positions[indices[triangle * 3 + k]] - center));
+        }
+
+        // the cone's half angle is the widest normal from the average; past 90 degrees it cannot cull
+        float coneCutoff = NO_CONE;
+        float axisLength = glm::length(axis);
+        if (axisLength > 1e-6f)
+        {
+            axis /= axisLength;
+            float minDot = 1.0f;
+            for (unsigned int triangle : triangles)
+            {
+                glm::vec3 p0 = positions[indices[triangle * 3]];
+                glm::vec3 normal = glm::cross(positions[indices[triangle * 3 + 1]] - p0, positions[indices[triangle * 3 + 2]] - p0);
+                float length = glm::length(normal);
+                if (length > 0.0f)
+                    minDot = std::min(minDot, glm::dot(normal / length, axis));
+            }
+            // every normal faces away once the view direction is within 90 - angle degrees of the axis
+            if (minDot > 0.0f)
+                coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+        radius.push_back(sphereRadius);
+        axisX.push_back(axis.x); axisY.push_back(axis.y); axisZ.push_back(axis.z);
+        cutoff.push_back(coneCutoff);
+
+        triangles.clear();
+        candidates.clear();
+        vertexCount = 0;
+        centroidSum = glm::vec3(0.0f);
+    };
+
+    // grow each meshlet from a seed, always taking the neighbouring triangle that adds the fewest
+    // vertices and, among those, the one nearest the meshlet's centre
+    size_t seed = 0;
+    for (;;)
+    {
+        if (triangles.empty())
+        {
+            while (seed < triangleCount && emitted[seed])
+                seed++;
+            if (seed == triangleCount)
+                break;
+            addTriangle((unsigned int)seed);
+            continue;
+        }
+        glm::vec3 center = centroidSum / (float)triangles.size();
+        int best = -1;
+        int bestNew = 4;
+        float bestDistance = 0.0f;
+        size_t kept = 0;
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            unsigned int candidate = candidates[i];
+            if (emitted[candidate])
+                continue;
+            candidates[kept++] = candidate;
+            int added = newVertices(candidate);
+            glm::vec3 offset = centroid(candidate) - center;
+            float distance = glm::dot(offset, offset);
+            if (added < bestNew || (added == bestNew && distance < bestDistance))
+            {
+                best = (int)candidate;
+                bestNew = added;
+                bestDistance = distance;
+            }
+        }
+        candidates.resize(kept);
+        if (best < 0 || vertexCount + bestNew > MAX_VERTICES || (int)triangles.size() == MAX_TRIANGLES)
+        {
+            finish();
+            continue;
+        }
+        addTriangle((unsigned int)best);
+    }
+    if (!triangles.empty())
+        finish();
+    indices.swap(reordered);
+
+    // pad the SoA arrays with spheres that are never visible; Cull() only reports real meshlets
+    while (centerX.size() % 4 != 0)
+    {
+        centerX.push_back(0.0f); centerY.push_back(0.0f); centerZ.push_back(0.0f); radius.push_back(0.0f);
+        axisX.push_back(0.0f); axisY.push_back(0.0f); axisZ.push_back(0.0f); cutoff.push_back(NO_CONE);
+    }
+}
+
+int MeshletSet::Cull(const glm::mat4& model, const MeshletView& view, IndexRange* ranges) const
+{
+    // a world space plane p becomes transpose(model) * p in model space; renormalized, distances are
+    // in model units and compare directly with the model space spheres
+    glm::mat4 toModelPlane = glm::transpose(model);
+    glm::vec4 planes[6];
+    for (int i = 0; i < 6; i++)
+    {
+        planes[i] = toModelPlane * view.frustum.planes[i];
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    // model space normals only keep their meaning under rotation and uniform scale without mirroring
+    glm::mat3 linear(model);
+    float scale0 = glm::length(linear[0]), scale1 = glm::length(linear[1]), scale2 = glm::length(linear[2]);
+    bool testCone = glm::determinant(linear) > 0.0f &&
+        std::abs(scale0 - scale1) <= scale0 * 1e-3f && std::abs(scale0 - scale2) <= scale0 * 1e-3f;
+    glm::mat4 inverse = glm::inverse(model);
+    glm::vec3 eye = glm::vec3(inverse * glm::vec4(view.position, 1.0f));
+    glm::vec3 direction = glm::normalize(glm::mat3(inverse) * view.direction);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 eyeX = _mm_set1_ps(eye.x), eyeY = _mm_set1_ps(eye.y), eyeZ = _mm_set1_ps(eye.z);
+    const __m128 dirX = _mm_set1_ps(direction.x), dirY = _mm_set1_ps(direction.y), dirZ = _mm_set1_ps(direction.z);
+    int count = (int)meshlets.size();
+    int rangeCount = 0;
+    for (int base = 0; base < count; base += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&centerX[base]);
+        __m128 cy = _mm_loadu_ps(&centerY[base]);
+        __m128 cz = _mm_loadu_ps(&centerZ[base]);
+        __m128 r = _mm_loadu_ps(&radius[base]);
+        __m128 culled = zero;
+        if (view.testFrustum)
+        {
+            __m128 negativeR = _mm_sub_ps(zero, r);
+            for (int i = 0; i < 6; i++)
+            {
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i].x), cx), _mm_mul_ps(_mm_set1_ps(planes[i].y), cy)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i].z), cz), _mm_set1_ps(planes[i].w)));
+                culled = _mm_or_ps(culled, _mm_cmplt_ps(distance, negativeR));
+            }
+        }
+        if (testCone)
+        {
+            __m128 ax = _mm_loadu_ps(&axisX[base]);
+            __m128 ay = _mm_loadu_ps(&axisY[base]);
+            __m128 az = _mm_loadu_ps(&axisZ[base]);
+            __m128 cut = _mm_loadu_ps(&cutoff[base]);
+            if (view.orthographic)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, ax), _mm_mul_ps(dirY, ay)), _mm_mul_ps(dirZ, az));
+                culled = _mm_or_ps(culled, _mm_cmpge_ps(d, cut));
+            }
+            else
+            {
+                // the whole sphere must lie in the cone of directions that see only back faces
+                __m128 dx = _mm_sub_ps(cx, eyeX), dy = _mm_sub_ps(cy, eyeY), dz = _mm_sub_ps(cz, eyeZ);
+                __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ax), _mm_mul_ps(dy, ay)), _mm_mul_ps(dz, az));
+                culled = _mm_or_ps(culled, _mm_cmpge_ps(d, _mm_add_ps(_mm_mul_ps(cut, length), r)));
+            }
+        }
+
+        int mask = _mm_movemask_ps(culled);
+        for (int k = 0; k < 4 && base + k < count; k++)
+        {
+            if (mask & (1 << k))
+                continue;
+            const IndexRange& meshlet = meshlets[base + k];
+            // meshlets are consecutive in the element buffer, so runs of visible ones draw as one range
+            if (rangeCount > 0 && ranges[rangeCount - 1].firstIndex + ranges[rangeCount - 1].indexCount == meshlet.firstIndex)
+                ranges[rangeCount - 1].indexCount += meshlet.indexCount;
+            else
+                ranges[rangeCount++] = meshlet;
+        }
+    }
+    return rangeCount;
+}
@@ -1,4 +1,10 @@
 #include "../header/Model.h"
+#include "../header/GLState.h"
+#include "../header/MeshSimplify.h"
+#include "../header/ObjLoader.h"
+#include "../header/TangentSpace.h"
+#include "../header/VertexWeld.h"
+#include "../header/VirtualFileSystem.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -6,52 +12,336 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <stb_image.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 
 #include <string>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <numeric>
 #include <vector>
 
-void Model::Draw(Shader& shader)
+namespace {
+
+// uploads an image decoded by stb_image and frees it; runs on the GL thread
+void UploadTexture(unsigned int textureID, unsigned char* data, int width, int height, int nrComponents)
+{
+    GLenum format;
+    if (nrComponents == 1)
+        format = GL_RED;
+    else if (nrComponents == 3)
+        format = GL_RGB;
+    else if (nrComponents == 4)
+        format = GL_RGBA;
+
+    GLState::BindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    stbi_image_free(data);
+}
+
+// Assimp reads the model and every file it references through the VirtualFileSystem
+class AssetIOStream : public Assimp::IOStream {
+public:
+    AssetFile file;
+
+    size_t Read(void* buffer, size_t size, size_t count) override
+    {
+        if (size == 0)
+            return 0;
+        count = std::min(count, (file.Size() - position) / size);
+        std::memcpy(buffer, file.Data() + position, size * count);
+        position += size * count;
+        return count;
+    }
+    size_t Write(const void*, size_t, size_t) override { return 0; }
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        // like Assimp's MemoryIOStream, offsets from the end count backwards
+        size_t target = origin == aiOrigin_SET ? offset : origin == aiOrigin_CUR ? position + offset : file.Size() - offset;
+        if (target > file.Size())
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+    size_t Tell() const override { return position; }
+    size_t FileSize() const override { return file.Size(); }
+    void Flush() override {}
+
+private:
+    size_t position = 0;
+};
+
+class AssetIOSystem : public Assimp::IOSystem {
+public:
+    bool Exists(const char* path) const override { return VirtualFileSystem::Exists(path); }
+    char getOsSeparator() const override { return '/'; }
+    Assimp::IOStream* Open(const char* path, const char* mode) override
+    {
+        // assets are read only
+        if (std::strchr(mode, 'w') || std::strchr(mode, 'a'))
+            return nullptr;
+        std::unique_ptr<AssetIOStream> stream(new AssetIOStream());
+        if (!VirtualFileSystem::Open(path, stream->file))
+            return nullptr;
+        return stream.release();
+    }
+    void Close(Assimp::IOStream* stream) override { delete stream; }
+};
+
+// a new GL buffer holding a vertex attribute computed at load time
+VertexStream UploadStream(const void* data, size_t bytes, int components)
+{
+    VertexStream stream;
+    glGenBuffers(1, &stream.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+    stream.size = components;
+    return stream;
+}
+
+}
+
+void Model::Draw(Shader& shader, int instanceCount)
 {
     for (unsigned int i = 0; i < meshes.size(); i++) {
-        meshes[i].Draw(shader);
+        meshes[i].Draw(shader, instanceCount);
     }
 }
 
+SceneNode Model::Instantiate(SceneGraph& graph, SceneNode parent, const glm::mat4& transform,
+    std::vector<MeshInstance>& instances) const
+{
+    SceneNode root = graph.CreateNode(parent, transform);
+    std::vector<SceneNode> created(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        created[i] = graph.CreateNode(nodes[i].parent >= 0 ? created[nodes[i].parent] : root, nodes[i].transform);
+        for (unsigned int mesh : nodes[i].meshes)
+            instances.push_back({ created[i], &meshes[mesh] });
+    }
+    return root;
+}
+
 void Model::loadModel(std::string path)
 {
-    Assimp::Importer import;
-    const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    directory = path.substr(0, path.find_last_of('/'));
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == "obj")
+    {
+        if (!loadObj(path))
+            return;
+    }
+    else if (extension == "gltf" || extension == "glb")
+    {
+        if (!loadGltf(path))
+            return;
+    }
+    else
+    {
+        Assimp::Importer import;
+        // the importer owns and deletes the handler
+        import.SetIOHandler(new AssetIOSystem());
+        const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+            return;
+        }
+        processNode(scene->mRootNode, scene, -1);
+    }
+    if (importedVertices > 0)
+    {
+        std::cout << "Model: welded " << importedVertices << " vertices to " << weldedVertices << " ("
+            << 100.0 * (importedVertices - weldedVertices) / importedVertices << "% fewer) in " << weldSeconds * 1000.0 << " ms" << std::endl;
+    }
+    buildMeshlets();
 
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    // bounds and occluder in model space, with every mesh placed by its node
+    std::vector<glm::mat4> modelTransforms(nodes.size());
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    for (size_t i = 0; i < nodes.size(); i++)
     {
-        std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+        modelTransforms[i] = nodes[i].parent >= 0 ? modelTransforms[nodes[i].parent] * nodes[i].transform : nodes[i].transform;
+        for (unsigned int meshIndex : nodes[i].meshes)
+        {
+            const Mesh& mesh = meshes[meshIndex];
+            bounds.Expand(TransformAABB(mesh.bounds, modelTransforms[i]));
+            unsigned int base = (unsigned int)positions.size();
+            for (const Vertex& vertex : mesh.vertices)
+                positions.push_back(glm::vec3(modelTransforms[i] * glm::vec4(vertex.Position, 1.0f)));
+            for (unsigned int index : mesh.indices)
+                indices.push_back(base + index);
+        }
+    }
+    occluder = SimplifyOccluder(positions, indices, bounds);
+
+    buildBVHs(path + ".bvh");
+    buildLODs(path + ".lod");
+
+    // the textures decoded meanwhile; their uploads are queued for the GL thread, this one while loading
+    JobSystem::Wait(textureDecodes);
+    JobSystem::PumpGLThread();
+}
+
+void Model::buildMeshlets()
+{
+    // reorders each mesh's indices; everything built from them later (BVHs, LODs, caches) sees the new order
+    JobSystem::ParallelFor((int)meshes.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            std::vector<glm::vec3> positions;
+            positions.reserve(meshes[i].vertices.size());
+            for (const Vertex& vertex : meshes[i].vertices)
+                positions.push_back(vertex.Position);
+            meshes[i].meshlets.Build(positions, meshes[i].indices);
+        }
+    });
+}
+
+void Model::buildBVHs(const std::string& cachePath)
+{
+    std::vector<std::vector<glm::vec3>> positions(meshes.size());
+    std::vector<unsigned long long> hashes(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        for (const Vertex& vertex : meshes[i].vertices)
+            positions[i].push_back(vertex.Position);
+        hashes[i] = MeshBVH::HashGeometry(positions[i], meshes[i].indices);
+    }
+
+    // reuse the cached trees while they match the geometry
+    std::vector<bool> loaded(meshes.size(), false);
+    std::ifstream cache(cachePath, std::ios::binary);
+    unsigned int cachedMeshes = 0;
+    if (cache && cache.read((char*)&cachedMeshes, sizeof(cachedMeshes)) && cachedMeshes == meshes.size())
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (!meshes[i].bvh.Load(cache, hashes[i]))
+                break;
+            loaded[i] = true;
+        }
+    }
+    cache.close();
+
+    // build the rest, one job per mesh
+    std::vector<int> builds;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (!loaded[i])
+            builds.push_back((int)i);
+    }
+    JobSystem::ParallelFor((int)builds.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            meshes[builds[i]].bvh.Build(positions[builds[i]], meshes[builds[i]].indices);
+    });
+    if (builds.empty())
+        return;
+
+    std::ofstream out(cachePath, std::ios::binary);
+    if (!out)
+    {
+        std::cout << "ERROR::MODEL:: Could not write BVH cache " << cachePath << std::endl;
         return;
     }
-    directory = path.substr(0, path.find_last_of('/'));
+    unsigned int meshCount = (unsigned int)meshes.size();
+    out.write((const char*)&meshCount, sizeof(meshCount));
+    for (size_t i = 0; i < meshes.size(); i++)
+        meshes[i].bvh.Save(out, hashes[i]);
+}
+
+void Model::buildLODs(const std::string& cachePath)
+{
+    std::vector<MeshLODChain> chains(meshes.size());
+    std::vector<unsigned long long> hashes(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+        hashes[i] = MeshLODChain::HashGeometry(meshes[i].vertices, meshes[i].indices);
+
+    std::vector<bool> loaded(meshes.size(), false);
+    std::ifstream cache(cachePath, std::ios::binary);
+    unsigned int cachedMeshes = 0;
+    if (cache && cache.read((char*)&cachedMeshes, sizeof(cachedMeshes)) && cachedMeshes == meshes.size())
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (!chains[i].Load(cache, hashes[i]))
+                break;
+            loaded[i] = true;
+        }
+    }
+    cache.close();
 
-    processNode(scene->mRootNode, scene);
+    std::vector<int> builds;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (!loaded[i])
+            builds.push_back((int)i);
+    }
+    JobSystem::ParallelFor((int)builds.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            chains[builds[i]].Build(meshes[builds[i]].vertices, meshes[builds[i]].indices);
+    });
+
+    // the element buffers are uploaded here, on the thread that owns the context; meshes without
+    // coarser levels still need theirs again for the meshlet order
+    for (size_t i = 0; i < meshes.size(); i++)
+        meshes[i].SetLODs(chains[i].indices, chains[i].errors);
+    if (builds.empty())
+        return;
+
+    std::ofstream out(cachePath, std::ios::binary);
+    if (!out)
+    {
+        std::cout << "ERROR::MODEL:: Could not write LOD cache " << cachePath << std::endl;
+        return;
+    }
+    unsigned int meshCount = (unsigned int)meshes.size();
+    out.write((const char*)&meshCount, sizeof(meshCount));
+    for (size_t i = 0; i < meshes.size(); i++)
+        chains[i].Save(out, hashes[i]);
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, int parent)
 {
+    // assimp matrices are row major
+    ModelNode modelNode;
+    modelNode.parent = parent;
+    modelNode.transform = glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+    int index = (int)nodes.size();
+    nodes.push_back(modelNode);
+
     // process all the node's meshes (if any)
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        nodes[index].meshes.push_back((unsigned int)meshes.size());
         meshes.push_back(processMesh(mesh, scene));
     }
     // then do the same for each of its children
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, index);
     }
 }
 
@@ -102,9 +392,6 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
             indices.push_back(face.mIndices[j]);
     }
 
-    //calculate tb
-    calculateTangentBitangent(vertices, indices);
-
     // process material
     if (mesh->mMaterialIndex >= 0)
     {
@@ -123,6 +410,263 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         textures.insert(textures.end(), roughnessMaps.begin(), roughnessMaps.end());
         
     }
+    return finishMesh(vertices, indices, textures);
+}
+
+bool Model::loadObj(const std::string& path)
+{
+    ObjScene scene;
+    if (!LoadObj(path, scene))
+        return false;
+
+    // one node holding every mesh; OBJ has no hierarchy
+    nodes.push_back(ModelNode{ -1, glm::mat4(1.0f), {} });
+    for (ObjMesh& mesh : scene.meshes)
+    {
+        std::vector<Texture> textures;
+        if (mesh.material >= 0)
+        {
+            const ObjMaterial& material = scene.materials[mesh.material];
+            const std::pair<const std::string*, const char*> maps[3] = { { &material.diffuseMap, "texture_diffuse" },
+                { &material.specularMap, "texture_specular" }, { &material.normalMap, "texture_normal" } };
+            for (const auto& map : maps)
+            {
+                if (map.first->empty())
+                    continue;
+                std::vector<Texture> loaded = manualLoadMaterialTextures(*map.first, map.second);
+                textures.insert(textures.end(), loaded.begin(), loaded.end());
+            }
+            std::vector<Texture> roughnessMaps = manualLoadMaterialTextures("roughness.jpg", "texture_roughness");
+            textures.insert(textures.end(), roughnessMaps.begin(), roughnessMaps.end());
+        }
+        nodes[0].meshes.push_back((unsigned int)meshes.size());
+        meshes.push_back(finishMesh(mesh.vertices, mesh.indices, textures));
+    }
+    return true;
+}
+
+bool Model::loadGltf(const std::string& path)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GltfAsset asset;
+    if (!asset.Load(path))
+        return false;
+
+    // every buffer view an attribute reads goes to the GPU once, straight from the mapping and in the
+    // bytes the file stores, shared by all the primitives reading it
+    std::vector<unsigned int> viewBuffers(asset.bufferViews.size(), 0);
+    size_t uploadedBytes = 0;
+    auto accessorStream = [&](int accessorIndex) {
+        VertexStream stream;
+        const GltfAccessor& accessor = asset.accessors[accessorIndex];
+        unsigned int& buffer = viewBuffers[accessor.bufferView];
+        if (buffer == 0)
+        {
+            const GltfBufferView& view = asset.bufferViews[accessor.bufferView];
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, view.byteLength, view.data, GL_STATIC_DRAW);
+            uploadedBytes += view.byteLength;
+        }
+        stream.buffer = buffer;
+        stream.size = accessor.components;
+        stream.type = accessor.componentType;
+        stream.normalized = accessor.normalized;
+        stream.stride = (int)accessor.stride;
+        stream.offset = accessor.byteOffset;
+        return stream;
+    };
+
+    // the engine meshes of each glTF mesh, one per primitive
+    std::vector<std::vector<unsigned int>> meshPrimitives(asset.meshes.size());
+    for (size_t m = 0; m < asset.meshes.size(); m++)
+    {
+        for (const GltfPrimitive& primitive : asset.meshes[m].primitives)
+        {
+            size_t vertexCount = asset.accessors[primitive.position].count;
+            int attributes[3] = { primitive.normal, primitive.texCoord, primitive.tangent };
+            bool matching = vertexCount > 0;
+            for (int attribute : attributes)
+            {
+                if (attribute >= 0 && (asset.accessors[attribute].count != vertexCount || asset.accessors[attribute].bufferView < 0))
+                    matching = false;
+            }
+
+            std::vector<unsigned int> indices;
+            if (primitive.indices >= 0)
+                asset.ReadIndices(primitive.indices, indices);
+            else
+            {
+                indices.resize(vertexCount);
+                std::iota(indices.begin(), indices.end(), 0u);
+            }
+            indices.resize(indices.size() / 3 * 3);
+            bool inRange = std::all_of(indices.begin(), indices.end(), [&](unsigned int index) { return index < vertexCount; });
+            if (!matching || !inRange || indices.empty())
+            {
+                std::cout << "ERROR::GLTF::Skipping a malformed primitive of mesh " << m << " in " << path << std::endl;
+                continue;
+            }
+
+            // the CPU keeps what bounds, BVH, meshlets and LODs read; the GPU draws the stored streams
+            std::vector<Vertex> vertices(vertexCount, Vertex{});
+            const size_t vertexFloats = sizeof(Vertex) / sizeof(float);
+            asset.ReadFloats(primitive.position, 3, &vertices[0].Position.x, vertexFloats);
+            VertexStreams streams;
+            streams.position = accessorStream(primitive.position);
+            if (primitive.texCoord >= 0)
+            {
+                asset.ReadFloats(primitive.texCoord, 2, &vertices[0].TexCoords.x, vertexFloats);
+                streams.texCoords = accessorStream(primitive.texCoord);
+            }
+            if (primitive.normal >= 0)
+            {
+                asset.ReadFloats(primitive.normal, 3, &vertices[0].Normal.x, vertexFloats);
+                streams.normal = accessorStream(primitive.normal);
+            }
+            else
+            {
+                // area weighted smooth normals; the spec asks for flat ones, which would split every vertex
+                std::vector<glm::vec3> normals(vertexCount, glm::vec3(0.0f));
+                for (size_t i = 0; i < indices.size(); i += 3)
+                {
+                    const glm::vec3& a = vertices[indices[i]].Position;
+                    glm::vec3 faceNormal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+                    for (int k = 0; k < 3; k++)
+                        normals[indices[i + k]] += faceNormal;
+                }
+                for (size_t i = 0; i < vertexCount; i++)
+                {
+                    float length = glm::length(normals[i]);
+                    normals[i] = length > 0.0f ? normals[i] / length : glm::vec3(0.0f, 1.0f, 0.0f);
+                    vertices[i].Normal = normals[i];
+                }
+                streams.normal = UploadStream(normals.data(), normals.size() * sizeof(glm::vec3), 3);
+            }
+            if (primitive.tangent >= 0)
+                streams.tangent = accessorStream(primitive.tangent);
+            else
+            {
+                // the normal map path needs a tangent frame, so generate the missing one
+                TangentStreams tangentInput;
+                std::vector<float>* components[8] = { &tangentInput.positionX, &tangentInput.positionY, &tangentInput.positionZ,
+                    &tangentInput.normalX, &tangentInput.normalY, &tangentInput.normalZ, &tangentInput.u, &tangentInput.v };
+                for (int c = 0; c < 8; c++)
+                {
+                    components[c]->resize(vertexCount);
+                    for (size_t i = 0; i < vertexCount; i++)
+                        (*components[c])[i] = (&vertices[i].Position.x)[c];
+                }
+                std::vector<glm::vec4> tangents;
+                GenerateTangents(tangentInput, indices, tangents);
+                streams.tangent = UploadStream(tangents.data(), tangents.size() * sizeof(glm::vec4), 4);
+            }
+
+            GltfMaterial gltfMaterial = primitive.material >= 0 ? asset.materials[primitive.material] : GltfMaterial();
+            MeshMaterial material;
+            material.baseColorFactor = gltfMaterial.baseColorFactor;
+            material.metallicFactor = gltfMaterial.metallicFactor;
+            material.roughnessFactor = gltfMaterial.roughnessFactor;
+            material.metallicRoughness = true;
+            std::vector<Texture> textures = gltfMaterialTextures(asset, gltfMaterial, path);
+
+            meshPrimitives[m].push_back((unsigned int)meshes.size());
+            meshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures), streams, material));
+        }
+    }
+
+    // parents first, as ModelNode wants; a node reached a second time (the file is not a tree) is dropped
+    std::vector<bool> visited(asset.nodes.size(), false);
+    std::vector<std::pair<int, int>> pending;
+    for (auto root = asset.roots.rbegin(); root != asset.roots.rend(); ++root)
+        pending.push_back({ *root, -1 });
+    while (!pending.empty())
+    {
+        int gltfNode = pending.back().first;
+        int parent = pending.back().second;
+        pending.pop_back();
+        if (visited[gltfNode])
+            continue;
+        visited[gltfNode] = true;
+        const GltfNode& node = asset.nodes[gltfNode];
+        int index = (int)nodes.size();
+        nodes.push_back(ModelNode{ parent, node.transform, {} });
+        if (node.mesh >= 0)
+            nodes[index].meshes = meshPrimitives[node.mesh];
+        for (auto child = node.children.rbegin(); child != node.children.rend(); ++child)
+            pending.push_back({ *child, index });
+    }
+
+    std::cout << "Model: loaded " << meshes.size() << " glTF primitives, " << uploadedBytes / (1024.0 * 1024.0)
+        << " MB of vertex data uploaded as stored, in "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms" << std::endl;
+    return true;
+}
+
+std::vector<Texture> Model::gltfMaterialTextures(const GltfAsset& asset, const GltfMaterial& material, const std::string& assetPath)
+{
+    // missing maps read as neutral: white base color, a flat normal, and the factors alone
+    Texture baseColor = gltfImageTexture(asset, material.baseColorImage, "texture_diffuse", assetPath);
+    Texture normal = gltfImageTexture(asset, material.normalImage, "texture_normal", assetPath);
+    Texture metallicRoughness = gltfImageTexture(asset, material.metallicRoughnessImage, "texture_roughness", assetPath);
+    std::vector<Texture> textures;
+    textures.push_back(baseColor.id != 0 ? baseColor : solidTexture(255, 255, 255, 255, "texture_diffuse"));
+    textures.push_back(normal.id != 0 ? normal : solidTexture(128, 128, 255, 255, "texture_normal"));
+    textures.push_back(metallicRoughness.id != 0 ? metallicRoughness : solidTexture(255, 255, 255, 255, "texture_roughness"));
+    return textures;
+}
+
+Texture Model::gltfImageTexture(const GltfAsset& asset, int image, const std::string& typeName, const std::string& assetPath)
+{
+    Texture texture;
+    texture.id = 0;
+    texture.type = typeName;
+    if (image < 0)
+        return texture;
+
+    // files by name, images inside the asset by their index
+    const GltfImage& source = asset.images[image];
+    texture.path = source.bufferView >= 0 ? assetPath + "#image" + std::to_string(image) : source.uri;
+    for (const Texture& loaded : textures_loaded)
+    {
+        if (loaded.path == texture.path)
+        {
+            texture.id = loaded.id;
+            return texture;
+        }
+    }
+
+    if (source.bufferView >= 0)
+    {
+        // the mapping closes when loading returns, before the decode jobs are done, so they get a copy
+        const GltfBufferView& view = asset.bufferViews[source.bufferView];
+        std::shared_ptr<std::vector<unsigned char>> encoded = std::make_shared<std::vector<unsigned char>>(view.data, view.data + view.byteLength);
+        texture.id = TextureFromMemory(encoded, texture.path);
+    }
+    else if (!source.uri.empty() && source.uri.compare(0, 5, "data:") != 0)
+        texture.id = TextureFromFile(source.uri.c_str(), directory);
+    else
+    {
+        std::cout << "ERROR::GLTF::Image " << image << " has no data the loader can read" << std::endl;
+        return texture;
+    }
+    textures_loaded.push_back(texture);
+    return texture;
+}
+
+Mesh Model::finishMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const std::vector<Texture>& textures)
+{
+    // without JoinIdenticalVertices assimp gives every face corner its own vertex, and files may repeat
+    // attributes themselves; weld them together before the tangents are summed over the shared vertices
+    std::chrono::steady_clock::time_point weldStart = std::chrono::steady_clock::now();
+    importedVertices += vertices.size();
+    WeldVertices(vertices, indices);
+    weldedVertices += vertices.size();
+    weldSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - weldStart).count();
+
+    //calculate tb
+    GenerateTangents(vertices, indices);
+
     return Mesh(vertices, indices, textures);
 }
 
@@ -195,86 +739,68 @@ unsigned int Model::TextureFromFile(const char* path, const std::string& directo
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+    JobSystem::Run([filename, textureID] {
+        int width, height, nrComponents;
+        AssetFile file;
+        unsigned char* data = VirtualFileSystem::Open(filename, file) ? stbi_load_from_memory((const stbi_uc*)file.Data(),
+            (int)file.Size(), &width, &height, &nrComponents, 0) : nullptr;
+        if (!data)
+        {
+            std::cout << "Texture failed to load at path: " << filename << std::endl;
+            return;
+        }
+        JobSystem::RunOnGLThread([=] {
+            UploadTexture(textureID, data, width, height, nrComponents);
+        });
+    }, &textureDecodes);
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    return textureID;
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+unsigned int Model::TextureFromMemory(std::shared_ptr<std::vector<unsigned char>> encoded, const std::string& name)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
 
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    JobSystem::Run([encoded, name, textureID] {
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load_from_memory(encoded->data(), (int)encoded->size(), &width, &height, &nrComponents, 0);
+        if (!data)
+        {
+            std::cout << "Texture failed to load from " << name << std::endl;
+            return;
+        }
+        JobSystem::RunOnGLThread([=] {
+            UploadTexture(textureID, data, width, height, nrComponents);
+        });
+    }, &textureDecodes);
 
     return textureID;
 }
 
-void Model::calculateTangentBitangent(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+Texture Model::solidTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a, const std::string& typeName)
 {
-    for (unsigned int i = 0; i < indices.size(); i += 3)
+    char key[32];
+    std::snprintf(key, sizeof(key), "#solid %02x%02x%02x%02x", r, g, b, a);
+    Texture texture;
+    texture.type = typeName;
+    for (const Texture& loaded : textures_loaded)
     {
-        // Get verticies
-        Vertex& v0 = vertices[indices[i]];
-        Vertex& v1 = vertices[indices[i + 1]];
-        Vertex& v2 = vertices[indices[i + 2]];
-
-        // Calc edge Vectors
-        glm::vec3 edge1 = v1.Position - v0.Position;
-        glm::vec3 edge2 = v2.Position - v0.Position;
-
-        // Calc dudv
-        glm::vec2 deltaUV1 = v1.TexCoords - v0.TexCoords;
-        glm::vec2 deltaUV2 = v2.TexCoords - v0.TexCoords;
-
-        // inverse of f
-        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        // Calc Tangent
-        glm::vec3 tangent;
-        tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-        tangent = glm::normalize(tangent);
-
-        // Calc Bitangent
-        glm::vec3 bitangent;
-        bitangent.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-        bitangent = glm::normalize(bitangent);
-
-        // Pass Tangent and Bitangent
-        v0.Tangent += tangent;
-        v1.Tangent += tangent;
-        v2.Tangent += tangent;
-
-        v0.Bitangent += bitangent;
-        v1.Bitangent += bitangent;
-        v2.Bitangent += bitangent;
+        if (loaded.path == key)
+        {
+            texture.id = loaded.id;
+            texture.path = loaded.path;
+            return texture;
+        }
     }
 
-    // Normalize Tangent and Bitangent
-    for (unsigned int i = 0; i < vertices.size(); i++)
-    {
-        vertices[i].Tangent = glm::normalize(vertices[i].Tangent);
-        vertices[i].Bitangent = glm::normalize(vertices[i].Bitangent);
-    }
+    const unsigned char pixel[4] = { r, g, b, a };
+    glGenTextures(1, &texture.id);
+    GLState::BindTexture(GL_TEXTURE_2D, texture.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    texture.path = key;
+    textures_loaded.push_back(texture);
+    return texture;
 }
@@ -0,0 +1,619 @@
+#include "../header/ObjLoader.h"
+#include "../header/JobSystem.h"
+#include "../header/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+#include <iostream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// chunks are at least this large, so small files parse on one thread
+const size_t MIN_CHUNK_SIZE = 256 * 1024;
+const int CHUNKS_PER_THREAD = 4;
+const uint32_t EMPTY = 0xFFFFFFFFu;
+
+const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+inline int LowestBit(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, (unsigned long)mask);
+    return (int)index;
+#else
+    return __builtin_ctz((unsigned int)mask);
+#endif
+}
+
+// the next '\n' at or after p, or end; sixteen bytes are compared at a time
+const char* FindLineEnd(const char* p, const char* end)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), newline));
+        if (mask)
+            return p + LowestBit(mask);
+        p += 16;
+    }
+    while (p < end && *p != '\n')
+        p++;
+    return p;
+}
+
+// func(lineBegin, lineEnd) for every line, without the line break
+template <typename Func>
+void EachLine(const char* begin, const char* end, const Func& func)
+{
+    const char* p = begin;
+    while (p < end)
+    {
+        const char* lineEnd = FindLineEnd(p, end);
+        const char* contentEnd = lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        func(p, contentEnd);
+        p = lineEnd + 1;
+    }
+}
+
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool IsDigit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+inline const char* SkipSpaces(const char* p, const char* end)
+{
+    while (p < end && IsSpace(*p))
+        p++;
+    return p;
+}
+
+std::string Trim(const char* p, const char* end)
+{
+    p = SkipSpaces(p, end);
+    while (end > p && IsSpace(end[-1]))
+        end--;
+    return std::string(p, end);
+}
+
+// the last whitespace separated token, skipping the options in front of a texture map's file name
+std::string LastToken(const char* p, const char* end)
+{
+    while (end > p && IsSpace(end[-1]))
+        end--;
+    const char* start = end;
+    while (start > p && !IsSpace(start[-1]))
+        start--;
+    return std::string(start, end);
+}
+
+// inf, nan and the like, through the C library
+bool ParseFloatSlow(const char*& p, const char* end, float& value)
+{
+    char buffer[64];
+    size_t length = std::min<size_t>(end - p, sizeof(buffer) - 1);
+    std::memcpy(buffer, p, length);
+    buffer[length] = '\0';
+    char* parsed = buffer;
+    value = std::strtof(buffer, &parsed);
+    if (parsed == buffer)
+        return false;
+    p += parsed - buffer;
+    return true;
+}
+
+// [sign] digits [. digits] [e [sign] digits]: up to 19 significant digits go into an integer, which
+// is scaled by an exact power of ten in double precision, so short OBJ numbers round correctly
+bool ParseFloat(const char*& p, const char* end, float& value)
+{
+    p = SkipSpaces(p, end);
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int exponent = 0, significant = 0;
+    bool anyDigit = false;
+    for (; p < end && IsDigit(*p); p++)
+    {
+        anyDigit = true;
+        if (significant < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            significant += mantissa != 0;
+        }
+        else
+            exponent++;
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && IsDigit(*p); p++)
+        {
+            anyDigit = true;
+            if (significant < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!anyDigit)
+    {
+        p = start;
+        return ParseFloatSlow(p, end, value);
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e < end && IsDigit(*e))
+        {
+            int digits = 0;
+            for (; e < end && IsDigit(*e); e++)
+                digits = std::min(digits * 10 + (*e - '0'), 100000);
+            exponent += negativeExponent ? -digits : digits;
+            p = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (mantissa != 0 && exponent != 0)
+    {
+        if (exponent > 0)
+            result = exponent <= 22 ? result * POW10[exponent] : result * std::pow(10.0, exponent);
+        else
+            result = exponent >= -22 ? result / POW10[-exponent] : result * std::pow(10.0, exponent);
+    }
+    value = (float)(negative ? -result : result);
+    return true;
+}
+
+bool ParseInt(const char*& p, const char* end, int& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= end || !IsDigit(*p))
+        return false;
+    int64_t result = 0;
+    for (; p < end && IsDigit(*p); p++)
+        result = std::min<int64_t>(result * 10 + (*p - '0'), INT32_MAX);
+    value = (int)(negative ? -result : result);
+    return true;
+}
+
+enum class LineType { Position, TexCoord, Normal, Face, Object, Material, Library, Other };
+
+// the keyword at the start of a line; p moves past it
+LineType Classify(const char*& p, const char* end)
+{
+    p = SkipSpaces(p, end);
+    const char* keyword = p;
+    while (p < end && !IsSpace(*p))
+        p++;
+    size_t length = p - keyword;
+    if (length == 1)
+    {
+        switch (keyword[0])
+        {
+        case 'v': return LineType::Position;
+        case 'f': return LineType::Face;
+        case 'o':
+        case 'g': return LineType::Object;
+        default: return LineType::Other;
+        }
+    }
+    if (length == 2 && keyword[0] == 'v')
+        return keyword[1] == 't' ? LineType::TexCoord : keyword[1] == 'n' ? LineType::Normal : LineType::Other;
+    if (length == 6 && std::memcmp(keyword, "usemtl", 6) == 0)
+        return LineType::Material;
+    if (length == 6 && std::memcmp(keyword, "mtllib", 6) == 0)
+        return LineType::Library;
+    return LineType::Other;
+}
+
+// zero based indices of one face corner, -1 where the face leaves the attribute out
+struct Corner {
+    int position, texCoord, normal;
+};
+
+// an o, g or usemtl line, placed by the number of triangles its chunk had before it
+struct Event {
+    size_t triangle;
+    bool material;
+    std::string name;
+};
+
+struct Chunk {
+    const char* begin;
+    const char* end;
+    // v, vt and vn lines in this chunk, and in all chunks before it
+    size_t positions = 0, texCoords = 0, normals = 0;
+    size_t positionBase = 0, texCoordBase = 0, normalBase = 0;
+    // three per triangle
+    std::vector<Corner> corners;
+    std::vector<Event> events;
+    std::vector<std::string> libraries;
+    // the first line that failed to parse
+    const char* error = nullptr;
+};
+
+// OBJ indices are one based, or negative to count back from the last attribute read so far
+inline bool Resolve(int value, size_t readSoFar, size_t total, int& index)
+{
+    int64_t resolved = value > 0 ? (int64_t)value - 1 : (int64_t)readSoFar + value;
+    index = (int)resolved;
+    return value != 0 && resolved >= 0 && resolved < (int64_t)total;
+}
+
+// one face's corners: v, v/vt, v//vn or v/vt/vn
+bool ParseFace(const char* p, const char* end, const Chunk& chunk, size_t positionCount, size_t texCoordCount,
+    size_t normalCount, size_t totalPositions, size_t totalTexCoords, size_t totalNormals, std::vector<Corner>& face)
+{
+    face.clear();
+    while (true)
+    {
+        p = SkipSpaces(p, end);
+        if (p >= end)
+            break;
+        Corner corner = { -1, -1, -1 };
+        int value;
+        if (!ParseInt(p, end, value) ||
+            !Resolve(value, chunk.positionBase + positionCount, totalPositions, corner.position))
+            return false;
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/')
+            {
+                if (!ParseInt(p, end, value) ||
+                    !Resolve(value, chunk.texCoordBase + texCoordCount, totalTexCoords, corner.texCoord))
+                    return false;
+            }
+            if (p < end && *p == '/')
+            {
+                p++;
+                if (!ParseInt(p, end, value) ||
+                    !Resolve(value, chunk.normalBase + normalCount, totalNormals, corner.normal))
+                    return false;
+            }
+        }
+        if (p < end && !IsSpace(*p))
+            return false;
+        face.push_back(corner);
+    }
+    return true;
+}
+
+struct Run {
+    int chunk;
+    size_t firstTriangle, endTriangle;
+};
+
+// the triangles of one mesh: runs of chunk triangles under the same object and material
+struct MeshRuns {
+    std::string name;
+    std::string materialName;
+    std::vector<Run> runs;
+    size_t triangleCount = 0;
+};
+
+struct CornerSlot {
+    Corner key;
+    uint32_t vertex;
+};
+
+inline uint64_t HashCorner(const Corner& corner)
+{
+    uint64_t hash = (uint64_t)(uint32_t)corner.position * 0x9E3779B97F4A7C15ull;
+    hash ^= (uint64_t)(uint32_t)corner.texCoord * 0xC2B2AE3D27D4EB4Full;
+    hash ^= (uint64_t)(uint32_t)corner.normal * 0x165667B19E3779F9ull;
+    return hash ^ hash >> 29;
+}
+
+void BuildMesh(const MeshRuns& runs, const std::vector<Chunk>& chunks, const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec2>& texCoords, const std::vector<glm::vec3>& normals, ObjMesh& mesh)
+{
+    mesh.name = runs.name;
+    mesh.materialName = runs.materialName;
+    mesh.indices.reserve(runs.triangleCount * 3);
+
+    // unique v/vt/vn combinations, in an open addressing table
+    size_t capacity = 1;
+    while (capacity < runs.triangleCount * 6)
+        capacity <<= 1;
+    std::vector<CornerSlot> table(capacity, CornerSlot{ { -1, -1, -1 }, EMPTY });
+    bool missingNormals = false;
+    for (const Run& run : runs.runs)
+    {
+        const std::vector<Corner>& corners = chunks[run.chunk].corners;
+        for (size_t i = run.firstTriangle * 3; i < run.endTriangle * 3; i++)
+        {
+            const Corner& corner = corners[i];
+            size_t slot = (size_t)HashCorner(corner) & (capacity - 1);
+            while (table[slot].vertex != EMPTY && std::memcmp(&table[slot].key, &corner, sizeof(Corner)) != 0)
+                slot = (slot + 1) & (capacity - 1);
+            if (table[slot].vertex == EMPTY)
+            {
+                table[slot] = CornerSlot{ corner, (uint32_t)mesh.vertices.size() };
+                Vertex vertex;
+                vertex.Position = positions[corner.position];
+                vertex.Normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f);
+                // flipped like aiProcess_FlipUVs, which the Assimp path loads with
+                vertex.TexCoords = corner.texCoord >= 0 ? glm::vec2(texCoords[corner.texCoord].x, 1.0f - texCoords[corner.texCoord].y) : glm::vec2(0.0f);
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+                mesh.vertices.push_back(vertex);
+                missingNormals |= corner.normal < 0;
+            }
+            mesh.indices.push_back(table[slot].vertex);
+        }
+    }
+    if (!missingNormals)
+        return;
+
+    // smooth normals, area weighted, for the vertices the file gave none
+    std::vector<bool> generated(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+        generated[i] = mesh.vertices[i].Normal == glm::vec3(0.0f);
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        Vertex* v[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+        glm::vec3 normal = glm::cross(v[1]->Position - v[0]->Position, v[2]->Position - v[0]->Position);
+        for (int k = 0; k < 3; k++)
+        {
+            if (generated[mesh.indices[i + k]])
+                v[k]->Normal += normal;
+        }
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        float length = glm::length(mesh.vertices[i].Normal);
+        if (generated[i] && length > 0.0f)
+            mesh.vertices[i].Normal /= length;
+    }
+}
+
+}
+
+bool ParseObj(const char* text, size_t size, ObjScene& scene)
+{
+    scene.meshes.clear();
+    scene.materialLibraries.clear();
+    const char* end = text + size;
+
+    // line aligned chunks: every boundary moves forward to the start of the next line
+    int chunkCount = (int)std::max<size_t>(1, std::min<size_t>((size_t)JobSystem::ThreadCount() * CHUNKS_PER_THREAD, size / MIN_CHUNK_SIZE));
+    std::vector<Chunk> chunks(chunkCount);
+    for (int c = 0; c < chunkCount; c++)
+    {
+        const char* begin = text;
+        if (c > 0)
+        {
+            const char* lineEnd = FindLineEnd(std::max(text + size * c / chunkCount, chunks[c - 1].begin), end);
+            begin = lineEnd < end ? lineEnd + 1 : end;
+        }
+        chunks[c].begin = begin;
+        if (c > 0)
+            chunks[c - 1].end = begin;
+    }
+    chunks.back().end = end;
+
+    // first pass: where every chunk's attributes go
+    JobSystem::ParallelFor(chunkCount, 1, [&](int first, int last) {
+        for (int c = first; c < last; c++)
+        {
+            Chunk& chunk = chunks[c];
+            EachLine(chunk.begin, chunk.end, [&](const char* p, const char* lineEnd) {
+                switch (Classify(p, lineEnd))
+                {
+                case LineType::Position: chunk.positions++; break;
+                case LineType::TexCoord: chunk.texCoords++; break;
+                case LineType::Normal: chunk.normals++; break;
+                default: break;
+                }
+            });
+        }
+    });
+    size_t totalPositions = 0, totalTexCoords = 0, totalNormals = 0;
+    for (Chunk& chunk : chunks)
+    {
+        chunk.positionBase = totalPositions;
+        chunk.texCoordBase = totalTexCoords;
+        chunk.normalBase = totalNormals;
+        totalPositions += chunk.positions;
+        totalTexCoords += chunk.texCoords;
+        totalNormals += chunk.normals;
+    }
+    std::vector<glm::vec3> positions(totalPositions), normals(totalNormals);
+    std::vector<glm::vec2> texCoords(totalTexCoords);
+
+    // second pass: attributes straight into place, faces as triangle fans of resolved corners
+    JobSystem::ParallelFor(chunkCount, 1, [&](int first, int last) {
+        std::vector<Corner> face;
+        for (int c = first; c < last; c++)
+        {
+            Chunk& chunk = chunks[c];
+            size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+            EachLine(chunk.begin, chunk.end, [&](const char* line, const char* lineEnd) {
+                if (chunk.error)
+                    return;
+                const char* p = line;
+                bool parsed = true;
+                switch (Classify(p, lineEnd))
+                {
+                case LineType::Position:
+                {
+                    glm::vec3& position = positions[chunk.positionBase + positionCount++];
+                    parsed = ParseFloat(p, lineEnd, position.x) && ParseFloat(p, lineEnd, position.y) && ParseFloat(p, lineEnd, position.z);
+                    break;
+                }
+                case LineType::TexCoord:
+                {
+                    glm::vec2& texCoord = texCoords[chunk.texCoordBase + texCoordCount++];
+                    parsed = ParseFloat(p, lineEnd, texCoord.x);
+                    // v is optional
+                    if (parsed && !ParseFloat(p, lineEnd, texCoord.y))
+                        texCoord.y = 0.0f;
+                    break;
+                }
+                case LineType::Normal:
+                {
+                    glm::vec3& normal = normals[chunk.normalBase + normalCount++];
+                    parsed = ParseFloat(p, lineEnd, normal.x) && ParseFloat(p, lineEnd, normal.y) && ParseFloat(p, lineEnd, normal.z);
+                    break;
+                }
+                case LineType::Face:
+                    parsed = ParseFace(p, lineEnd, chunk, positionCount, texCoordCount, normalCount,
+                        totalPositions, totalTexCoords, totalNormals, face);
+                    for (size_t k = 1; parsed && k + 1 < face.size(); k++)
+                        chunk.corners.insert(chunk.corners.end(), { face[0], face[k], face[k + 1] });
+                    break;
+                case LineType::Object:
+                    chunk.events.push_back({ chunk.corners.size() / 3, false, Trim(p, lineEnd) });
+                    break;
+                case LineType::Material:
+                    chunk.events.push_back({ chunk.corners.size() / 3, true, Trim(p, lineEnd) });
+                    break;
+                case LineType::Library:
+                    chunk.libraries.push_back(Trim(p, lineEnd));
+                    break;
+                default:
+                    break;
+                }
+                if (!parsed)
+                    chunk.error = line;
+            });
+        }
+    });
+    for (const Chunk& chunk : chunks)
+    {
+        if (chunk.error)
+        {
+            std::cout << "ERROR::OBJ::Malformed line " << std::count(text, chunk.error, '\n') + 1 << ": "
+                << std::string(chunk.error, FindLineEnd(chunk.error, end)) << std::endl;
+            return false;
+        }
+    }
+
+    // a new mesh starts wherever the object or the material changes
+    std::vector<MeshRuns> meshRuns;
+    std::string name = "default", materialName;
+    bool open = false;
+    auto addRun = [&](int chunk, size_t firstTriangle, size_t endTriangle) {
+        if (firstTriangle == endTriangle)
+            return;
+        if (!open)
+        {
+            meshRuns.push_back(MeshRuns());
+            meshRuns.back().name = name;
+            meshRuns.back().materialName = materialName;
+            open = true;
+        }
+        meshRuns.back().runs.push_back({ chunk, firstTriangle, endTriangle });
+        meshRuns.back().triangleCount += endTriangle - firstTriangle;
+    };
+    for (int c = 0; c < chunkCount; c++)
+    {
+        size_t triangle = 0;
+        for (const Event& event : chunks[c].events)
+        {
+            addRun(c, triangle, event.triangle);
+            triangle = event.triangle;
+            std::string& state = event.material ? materialName : name;
+            if (state != event.name)
+            {
+                state = event.name;
+                open = false;
+            }
+        }
+        addRun(c, triangle, chunks[c].corners.size() / 3);
+        scene.materialLibraries.insert(scene.materialLibraries.end(), chunks[c].libraries.begin(), chunks[c].libraries.end());
+    }
+
+    scene.meshes.resize(meshRuns.size());
+    JobSystem::ParallelFor((int)meshRuns.size(), 1, [&](int first, int last) {
+        for (int i = first; i < last; i++)
+            BuildMesh(meshRuns[i], chunks, positions, texCoords, normals, scene.meshes[i]);
+    });
+    return true;
+}
+
+void ParseMtl(const char* text, size_t size, std::vector<ObjMaterial>& materials)
+{
+    EachLine(text, text + size, [&](const char* p, const char* lineEnd) {
+        p = SkipSpaces(p, lineEnd);
+        const char* keyword = p;
+        while (p < lineEnd && !IsSpace(*p))
+            p++;
+        std::string key(keyword, p);
+        if (key == "newmtl")
+        {
+            materials.push_back(ObjMaterial());
+            materials.back().name = Trim(p, lineEnd);
+            return;
+        }
+        if (materials.empty())
+            return;
+        ObjMaterial& material = materials.back();
+        if (key == "map_Kd")
+            material.diffuseMap = LastToken(p, lineEnd);
+        else if (key == "map_Ks")
+            material.specularMap = LastToken(p, lineEnd);
+        else if (key == "map_Bump" || key == "map_bump" || key == "bump" || key == "norm")
+            material.normalMap = LastToken(p, lineEnd);
+    });
+}
+
+bool LoadObj(const std::string& path, ObjScene& scene)
+{
+    AssetFile file;
+    if (!VirtualFileSystem::Open(path, file))
+    {
+        std::cout << "ERROR::OBJ::Could not open " << path << std::endl;
+        return false;
+    }
+    if (!ParseObj(file.Data(), file.Size(), scene))
+    {
+        std::cout << "ERROR::OBJ::Could not parse " << path << std::endl;
+        return false;
+    }
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    scene.materials.clear();
+    for (const std::string& library : scene.materialLibraries)
+    {
+        AssetFile mtl;
+        if (!VirtualFileSystem::Open(directory + library, mtl))
+        {
+            std::cout << "ERROR::OBJ::Could not open material library " << directory + library << std::endl;
+            continue;
+        }
+        ParseMtl(mtl.Data(), mtl.Size(), scene.materials);
+    }
+    for (ObjMesh& mesh : scene.meshes)
+    {
+        for (size_t i = 0; i < scene.materials.size() && mesh.material < 0; i++)
+        {
+            if (scene.materials[i].name == mesh.materialName)
+                mesh.material = (int)i;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,431 @@
+#include "../header/OcclusionCuller.h"
+#include "../header/JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Thin wrappers so the rasterizer is written once for both vector widths.
+#if defined(__AVX2__)
+typedef __m256 SimdFloat;
+const int SIMD_WIDTH = 8;
+inline SimdFloat SimdSet(float v) { return _mm256_set1_ps(v); }
+inline SimdFloat SimdPixelCenters() { return _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f); }
+inline SimdFloat SimdLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void SimdStore(float* p, SimdFloat v) { _mm256_storeu_ps(p, v); }
+inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a, b); }
+inline SimdFloat SimdNotNegative(SimdFloat a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ); }
+inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a, b); }
+inline SimdFloat SimdSelect(SimdFloat a, SimdFloat b, SimdFloat mask) { return _mm256_blendv_ps(a, b, mask); }
+inline int SimdMask(SimdFloat mask) { return _mm256_movemask_ps(mask); }
+#else
+typedef __m128 SimdFloat;
+const int SIMD_WIDTH = 4;
+inline SimdFloat SimdSet(float v) { return _mm_set1_ps(v); }
+inline SimdFloat SimdPixelCenters() { return _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); }
+inline SimdFloat SimdLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void SimdStore(float* p, SimdFloat v) { _mm_storeu_ps(p, v); }
+inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a, b); }
+inline SimdFloat SimdNotNegative(SimdFloat a) { return _mm_cmpge_ps(a, _mm_setzero_ps()); }
+inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a, b); }
+inline SimdFloat SimdSelect(SimdFloat a, SimdFloat b, SimdFloat mask) { return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a)); }
+inline int SimdMask(SimdFloat mask) { return _mm_movemask_ps(mask); }
+#endif
+
+// Separating axis test of a triangle against a box (Akenine-Moller): the box's three axes, the
+// triangle's normal and the nine edge cross products.
+bool TriangleOverlapsBox(const glm::vec3& center, const glm::vec3& halfSize, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 v[3] = { a - center, b - center, c - center };
+    glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+    auto separated = [&](const glm::vec3& axis) {
+        float p0 = glm::dot(v[0], axis), p1 = glm::dot(v[1], axis), p2 = glm::dot(v[2], axis);
+        float radius = halfSize.x * std::fabs(axis.x) + halfSize.y * std::fabs(axis.y) + halfSize.z * std::fabs(axis.z);
+        return std::min(p0, std::min(p1, p2)) > radius || std::max(p0, std::max(p1, p2)) < -radius;
+    };
+    for (int i = 0; i < 3; i++)
+    {
+        glm::vec3 axis(0.0f);
+        axis[i] = 1.0f;
+        if (separated(axis))
+            return false;
+        for (int j = 0; j < 3; j++)
+        {
+            if (separated(glm::cross(axis, edges[j])))
+                return false;
+        }
+    }
+    return !separated(glm::cross(edges[0], edges[1]));
+}
+
+}
+
+OccluderMesh SimplifyOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+    const AABB& bounds, int gridResolution)
+{
+    OccluderMesh occluder;
+    if (!bounds.IsValid() || gridResolution < 1)
+        return occluder;
+
+    // one layer of cells around bounds is kept empty, so the outside is connected and the fill starts in a corner
+    const int size = gridResolution + 2;
+    glm::vec3 cellSize = glm::max((bounds.max - bounds.min) / (float)gridResolution, glm::vec3(1e-6f));
+    glm::vec3 origin = bounds.min - cellSize;
+    auto cellIndex = [size](int x, int y, int z) { return ((size_t)z * size + y) * size + x; };
+
+    // cells the surface passes through, boxes slightly grown so a triangle on a cell face marks both sides
+    enum { CELL_UNKNOWN, CELL_SURFACE, CELL_OUTSIDE };
+    std::vector<unsigned char> cells((size_t)size * size * size, CELL_UNKNOWN);
+    glm::vec3 halfSize = cellSize * 0.5f * 1.001f;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const glm::vec3& a = positions[indices[i]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        glm::ivec3 first = glm::clamp(glm::ivec3(glm::floor((glm::min(a, glm::min(b, c)) - origin) / cellSize)) - 1, glm::ivec3(1), glm::ivec3(size - 2));
+        glm::ivec3 last = glm::clamp(glm::ivec3(glm::floor((glm::max(a, glm::max(b, c)) - origin) / cellSize)) + 1, glm::ivec3(1), glm::ivec3(size - 2));
+        for (int z = first.z; z <= last.z; z++)
+            for (int y = first.y; y <= last.y; y++)
+                for (int x = first.x; x <= last.x; x++)
+                {
+                    unsigned char& cell = cells[cellIndex(x, y, z)];
+                    if (cell != CELL_SURFACE && TriangleOverlapsBox(origin + (glm::vec3(x, y, z) + 0.5f) * cellSize, halfSize, a, b, c))
+                        cell = CELL_SURFACE;
+                }
+    }
+
+    // flood the outside from the border; what it cannot reach is enclosed by the surface
+    std::vector<glm::ivec3> stack(1, glm::ivec3(0));
+    cells[0] = CELL_OUTSIDE;
+    while (!stack.empty())
+    {
+        glm::ivec3 cell = stack.back();
+        stack.pop_back();
+        for (int axis = 0; axis < 3; axis++)
+            for (int step = -1; step <= 1; step += 2)
+            {
+                glm::ivec3 next = cell;
+                next[axis] += step;
+                if (next[axis] < 0 || next[axis] >= size)
+                    continue;
+                unsigned char& neighbour = cells[cellIndex(next.x, next.y, next.z)];
+                if (neighbour == CELL_UNKNOWN)
+                {
+                    neighbour = CELL_OUTSIDE;
+                    stack.push_back(next);
+                }
+            }
+    }
+
+    // merge the enclosed cells greedily into boxes, growing along x, then y, then z
+    std::vector<bool> used(cells.size(), false);
+    auto available = [&](int x, int y, int z) {
+        size_t i = cellIndex(x, y, z);
+        return x < size - 1 && y < size - 1 && z < size - 1 && cells[i] == CELL_UNKNOWN && !used[i];
+    };
+    for (int z = 1; z < size - 1; z++)
+        for (int y = 1; y < size - 1; y++)
+            for (int x = 1; x < size - 1; x++)
+            {
+                if (!available(x, y, z))
+                    continue;
+                int endX = x + 1;
+                while (available(endX, y, z))
+                    endX++;
+                int endY = y + 1;
+                for (bool grow = true; grow; )
+                {
+                    for (int i = x; i < endX && grow; i++)
+                        grow = available(i, endY, z);
+                    if (grow)
+                        endY++;
+                }
+                int endZ = z + 1;
+                for (bool grow = true; grow; )
+                {
+                    for (int j = y; j < endY && grow; j++)
+                        for (int i = x; i < endX && grow; i++)
+                            grow = available(i, j, endZ);
+                    if (grow)
+                        endZ++;
+                }
+                for (int k = z; k < endZ; k++)
+                    for (int j = y; j < endY; j++)
+                        for (int i = x; i < endX; i++)
+                            used[cellIndex(i, j, k)] = true;
+
+                // corner bits are x, y, z; faces wind counter-clockwise seen from outside
+                glm::vec3 boxMin = origin + glm::vec3(x, y, z) * cellSize;
+                glm::vec3 boxMax = origin + glm::vec3(endX, endY, endZ) * cellSize;
+                unsigned int base = (unsigned int)occluder.vertices.size();
+                for (int corner = 0; corner < 8; corner++)
+                    occluder.vertices.push_back(glm::vec3(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y, corner & 4 ? boxMax.z : boxMin.z));
+                static const unsigned int faces[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+                for (const auto& face : faces)
+                {
+                    unsigned int quad[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+                    for (unsigned int corner : quad)
+                        occluder.indices.push_back(base + corner);
+                }
+            }
+    return occluder;
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+    : width(width), height(height), viewProjection(1.0f)
+{
+    if (width % SIMD_WIDTH != 0 || width % TILE_SIZE != 0 || height % TILE_SIZE != 0)
+        std::cout << "ERROR::OCCLUSION_CULLER:: Depth buffer size must be a multiple of the tile size" << std::endl;
+    tilesX = width / TILE_SIZE;
+    tilesY = height / TILE_SIZE;
+    depth.assign((size_t)width * height, 1.0f);
+    tileMaxDepth.assign((size_t)tilesX * tilesY, 1.0f);
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+{
+    this->viewProjection = viewProjection;
+    clipVertices.clear();
+    occluderTriangles = 0;
+    objectsTested = 0;
+    objectsCulled = 0;
+}
+
+void OcclusionCuller::AddOccluder(const OccluderMesh& mesh, const glm::mat4& model)
+{
+    glm::mat4 transform = viewProjection * model;
+    transformedVertices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+        transformedVertices[i] = transform * glm::vec4(mesh.vertices[i], 1.0f);
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        clipVertices.push_back(transformedVertices[mesh.indices[i]]);
+        clipVertices.push_back(transformedVertices[mesh.indices[i + 1]]);
+        clipVertices.push_back(transformedVertices[mesh.indices[i + 2]]);
+    }
+}
+
+void OcclusionCuller::Rasterize()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    size_t clipTriangles = clipVertices.size() / 3;
+    occluderTriangles = (int)clipTriangles;
+    triangles.resize(clipTriangles * 2);
+    triangleValid.assign(clipTriangles * 2, 0);
+
+    JobSystem::ParallelFor((int)clipTriangles, 64, [this](int begin, int end) { SetupTriangles(begin, end); });
+    // one tile row per batch at the least: rows near the horizon carry most of the occluders
+    JobSystem::ParallelFor(tilesY, 1, [this](int begin, int end) { RasterizeRows(begin, end); });
+
+    rasterizeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void OcclusionCuller::SetupTriangles(int begin, int end)
+{
+    for (int t = begin; t < end; t++)
+    {
+        // clip against the near plane (z >= -w); a triangle becomes a polygon of at most four corners
+        const glm::vec4* in = &clipVertices[t * 3];
+        glm::vec4 polygon[4];
+        int corners = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec4& a = in[i];
+            const glm::vec4& b = in[(i + 1) % 3];
+            float da = a.z + a.w;
+            float db = b.z + b.w;
+            if (da >= 0.0f)
+                polygon[corners++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                polygon[corners++] = a + (b - a) * (da / (da - db));
+        }
+        for (int i = 0; i + 2 < corners && i < 2; i++)
+        {
+            glm::vec4 clip[3] = { polygon[0], polygon[i + 1], polygon[i + 2] };
+            triangleValid[t * 2 + i] = SetupTriangle(clip, triangles[t * 2 + i]) ? 1 : 0;
+        }
+    }
+}
+
+bool OcclusionCuller::SetupTriangle(const glm::vec4 clip[3], ScreenTriangle& triangle) const
+{
+    glm::vec3 screen[3];
+    for (int i = 0; i < 3; i++)
+    {
+        if (clip[i].w <= 1e-6f)
+            return false;
+        glm::vec3 ndc = glm::vec3(clip[i]) / clip[i].w;
+        screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // pixels whose centers fall inside the triangle's bounds
+    float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+    float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+    float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+    float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+    if (maxX < 0.0f || maxY < 0.0f || minX > (float)width || minY > (float)height)
+        return false;
+    triangle.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+    triangle.maxX = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+    triangle.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+    triangle.maxY = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return false;
+
+    // edge functions, flipped so the inside is positive whatever the winding
+    float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+    if (std::fabs(area) < 1e-4f)
+        return false;
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec3& a = screen[i];
+        const glm::vec3& b = screen[(i + 1) % 3];
+        triangle.edgeA[i] = sign * (a.y - b.y);
+        triangle.edgeB[i] = sign * (b.x - a.x);
+        triangle.edgeC[i] = sign * (a.x * b.y - a.y * b.x);
+    }
+
+    // window depth is linear in screen space after the perspective divide
+    float dx1 = screen[1].x - screen[0].x, dy1 = screen[1].y - screen[0].y, dz1 = screen[1].z - screen[0].z;
+    float dx2 = screen[2].x - screen[0].x, dy2 = screen[2].y - screen[0].y, dz2 = screen[2].z - screen[0].z;
+    triangle.depthA = (dz1 * dy2 - dz2 * dy1) / area;
+    triangle.depthB = (dx1 * dz2 - dx2 * dz1) / area;
+    triangle.depthC = screen[0].z - triangle.depthA * screen[0].x - triangle.depthB * screen[0].y;
+    return true;
+}
+
+void OcclusionCuller::RasterizeRows(int tileBegin, int tileEnd)
+{
+    for (int tileY = tileBegin; tileY < tileEnd; tileY++)
+    {
+        int rowBegin = tileY * TILE_SIZE;
+        int rowEnd = rowBegin + TILE_SIZE;
+        std::fill(depth.begin() + (size_t)rowBegin * width, depth.begin() + (size_t)rowEnd * width, 1.0f);
+
+        for (size_t t = 0; t < triangles.size(); t++)
+        {
+            if (triangleValid[t] && triangles[t].maxY >= rowBegin && triangles[t].minY < rowEnd)
+                RasterizeTriangle(triangles[t], rowBegin, rowEnd);
+        }
+
+        for (int tileX = 0; tileX < tilesX; tileX++)
+        {
+            float farthest = 0.0f;
+            for (int y = rowBegin; y < rowEnd; y++)
+            {
+                const float* row = &depth[(size_t)y * width + tileX * TILE_SIZE];
+                for (int x = 0; x < TILE_SIZE; x++)
+                    farthest = std::max(farthest, row[x]);
+            }
+            tileMaxDepth[tileY * tilesX + tileX] = farthest;
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int rowBegin, int rowEnd)
+{
+    int y0 = std::max(triangle.minY, rowBegin);
+    int y1 = std::min(triangle.maxY, rowEnd - 1);
+    int x0 = triangle.minX - triangle.minX % SIMD_WIDTH;
+
+    SimdFloat pixelCenters = SimdPixelCenters();
+    SimdFloat edgeA[3], depthA = SimdSet(triangle.depthA);
+    for (int i = 0; i < 3; i++)
+        edgeA[i] = SimdSet(triangle.edgeA[i]);
+
+    for (int y = y0; y <= y1; y++)
+    {
+        float centerY = (float)y + 0.5f;
+        SimdFloat edgeRow[3];
+        for (int i = 0; i < 3; i++)
+            edgeRow[i] = SimdSet(triangle.edgeB[i] * centerY + triangle.edgeC[i]);
+        SimdFloat depthRow = SimdSet(triangle.depthB * centerY + triangle.depthC);
+        float* row = &depth[(size_t)y * width];
+
+        for (int x = x0; x <= triangle.maxX; x += SIMD_WIDTH)
+        {
+            SimdFloat px = SimdAdd(SimdSet((float)x), pixelCenters);
+            // pixel centers on an edge belong to the triangle, so shared edges leave no cracks
+            SimdFloat inside = SimdNotNegative(SimdAdd(SimdMul(edgeA[0], px), edgeRow[0]));
+            inside = SimdAnd(inside, SimdNotNegative(SimdAdd(SimdMul(edgeA[1], px), edgeRow[1])));
+            inside = SimdAnd(inside, SimdNotNegative(SimdAdd(SimdMul(edgeA[2], px), edgeRow[2])));
+            if (SimdMask(inside) == 0)
+                continue;
+            SimdFloat z = SimdAdd(SimdMul(depthA, px), depthRow);
+            SimdFloat current = SimdLoad(row + x);
+            SimdStore(row + x, SimdSelect(current, SimdMin(current, z), inside));
+        }
+    }
+}
+
+bool OcclusionCuller::IsVisible(const AABB& worldBounds)
+{
+    objectsTested++;
+
+    float minX = (float)width, maxX = 0.0f, minY = (float)height, maxY = 0.0f;
+    float nearestDepth = 1.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? worldBounds.max.x : worldBounds.min.x,
+            (i & 2) ? worldBounds.max.y : worldBounds.min.y,
+            (i & 4) ? worldBounds.max.z : worldBounds.min.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        // boxes reaching behind the near plane are always drawn
+        if (clip.w <= 1e-6f || clip.z < -clip.w)
+            return true;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        float x = (ndc.x * 0.5f + 0.5f) * width;
+        float y = (ndc.y * 0.5f + 0.5f) * height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+    }
+
+    // every pixel the screen rectangle touches
+    int x0 = std::max(0, (int)std::floor(minX));
+    int x1 = std::min(width - 1, (int)std::floor(maxX));
+    int y0 = std::max(0, (int)std::floor(minY));
+    int y1 = std::min(height - 1, (int)std::floor(maxY));
+    // off screen boxes are left to frustum culling
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (int tileY = y0 / TILE_SIZE; tileY <= y1 / TILE_SIZE; tileY++)
+    {
+        for (int tileX = x0 / TILE_SIZE; tileX <= x1 / TILE_SIZE; tileX++)
+        {
+            if (nearestDepth > tileMaxDepth[tileY * tilesX + tileX])
+                continue;
+            // the tile alone is not conclusive, look at the covered pixels
+            int py0 = std::max(y0, tileY * TILE_SIZE), py1 = std::min(y1, tileY * TILE_SIZE + TILE_SIZE - 1);
+            int px0 = std::max(x0, tileX * TILE_SIZE), px1 = std::min(x1, tileX * TILE_SIZE + TILE_SIZE - 1);
+            for (int y = py0; y <= py1; y++)
+            {
+                for (int x = px0; x <= px1; x++)
+                {
+                    if (nearestDepth <= depth[(size_t)y * width + x])
+                        return true;
+                }
+            }
+        }
+    }
+    objectsCulled++;
+    return false;
+}
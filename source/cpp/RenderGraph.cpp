@@ -0,0 +1,329 @@
+#include "../header/RenderGraph.h"
+#include "../header/GLState.h"
+
+#include <algorithm>
+#include <iostream>
+
+RGResource RGPassBuilder::CreateTexture(const char* name, const RGTextureDesc& desc)
+{
+    graph.resources.emplace_back(graph.arena);
+    RenderGraph::Resource& resource = graph.resources.back();
+    resource.name = name;
+    resource.desc = desc;
+    RGResource handle = (RGResource)graph.resources.size() - 1;
+    graph.AddWrite(pass, handle);
+    return handle;
+}
+
+RGResource RGPassBuilder::Read(RGResource resource)
+{
+    graph.passes[pass].reads.push_back(resource);
+    return resource;
+}
+
+RGResource RGPassBuilder::Write(RGResource resource)
+{
+    graph.AddWrite(pass, resource);
+    return resource;
+}
+
+RGResource RGPassBuilder::ColorAttachment(RGResource resource)
+{
+    graph.AddWrite(pass, resource);
+    graph.passes[pass].colorAttachments.push_back(resource);
+    return resource;
+}
+
+RGResource RGPassBuilder::DepthAttachment(RGResource resource)
+{
+    graph.AddWrite(pass, resource);
+    graph.passes[pass].depthAttachment = resource;
+    return resource;
+}
+
+RenderGraph::RenderGraph()
+    : arena(16 * 1024), resources(ArenaAllocator<Resource>(arena)), passes(ArenaAllocator<Pass>(arena))
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    for (auto& framebuffer : framebuffers)
+        glDeleteFramebuffers(1, &framebuffer.second);
+    for (PhysicalTexture& physical : pool)
+        glDeleteTextures(1, &physical.texture);
+}
+
+void RenderGraph::Reset()
+{
+    // drop last frame's passes while the arena memory they sit in is still intact
+    resources = ArenaVector<Resource>(ArenaAllocator<Resource>(arena));
+    passes = ArenaVector<Pass>(ArenaAllocator<Pass>(arena));
+    arena.Reset();
+    resources.reserve(32);
+    passes.reserve(16);
+}
+
+RGResource RenderGraph::ImportTexture(const char* name, unsigned int texture)
+{
+    resources.emplace_back(arena);
+    Resource& resource = resources.back();
+    resource.name = name;
+    resource.imported = true;
+    resource.texture = texture;
+    return (RGResource)resources.size() - 1;
+}
+
+RGResource RenderGraph::ImportBackbuffer(const char* name, int width, int height)
+{
+    RGResource handle = ImportTexture(name, 0);
+    resources[handle].output = true;
+    resources[handle].desc.width = width;
+    resources[handle].desc.height = height;
+    return handle;
+}
+
+RGPassBuilder RenderGraph::BeginPass(const char* name, void* execute, void (*invoke)(void*, RenderGraph&))
+{
+    passes.emplace_back(arena);
+    Pass& pass = passes.back();
+    pass.name = name;
+    pass.execute = execute;
+    pass.invoke = invoke;
+    return RGPassBuilder(*this, (int)passes.size() - 1);
+}
+
+void RenderGraph::AddWrite(int pass, RGResource resource)
+{
+    Pass& p = passes[pass];
+    if (std::find(p.writes.begin(), p.writes.end(), resource) != p.writes.end())
+        return;
+    p.writes.push_back(resource);
+    resources[resource].producers.push_back(pass);
+}
+
+void RenderGraph::Compile()
+{
+    // reference counts: a pass is needed by every resource it writes, a resource by every pass reading it
+    for (Pass& pass : passes)
+    {
+        pass.refCount = (int)pass.writes.size();
+        pass.culled = false;
+        for (RGResource read : pass.reads)
+            resources[read].refCount++;
+    }
+    for (Resource& resource : resources)
+    {
+        if (resource.output)
+            resource.refCount++;
+    }
+
+    // dead pass elimination: peel off producers of unreferenced resources until nothing changes
+    ArenaVector<RGResource> unreferenced{ ArenaAllocator<RGResource>(arena) };
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        if (resources[i].refCount == 0)
+            unreferenced.push_back((RGResource)i);
+    }
+    while (!unreferenced.empty())
+    {
+        RGResource resource = unreferenced.back();
+        unreferenced.pop_back();
+        for (int producer : resources[resource].producers)
+        {
+            Pass& pass = passes[producer];
+            if (pass.culled || --pass.refCount > 0)
+                continue;
+            pass.culled = true;
+            for (RGResource read : pass.reads)
+            {
+                if (--resources[read].refCount == 0)
+                    unreferenced.push_back(read);
+            }
+        }
+    }
+
+    // lifetimes of transient textures over the surviving passes
+    for (size_t p = 0; p < passes.size(); p++)
+    {
+        if (passes[p].culled)
+            continue;
+        auto touch = [&](RGResource r) {
+            Resource& resource = resources[r];
+            if (resource.firstPass < 0)
+                resource.firstPass = (int)p;
+            resource.lastPass = (int)p;
+        };
+        for (RGResource r : passes[p].writes)
+            touch(r);
+        for (RGResource r : passes[p].reads)
+            touch(r);
+    }
+
+    // place transients in pooled textures in order of first use; disjoint lifetimes share a texture
+    for (PhysicalTexture& physical : pool)
+        physical.busyUntil = -1;
+    ArenaVector<RGResource> transients{ ArenaAllocator<RGResource>(arena) };
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        if (!resources[i].imported && resources[i].firstPass >= 0)
+            transients.push_back((RGResource)i);
+    }
+    std::sort(transients.begin(), transients.end(),
+        [this](RGResource a, RGResource b) { return resources[a].firstPass < resources[b].firstPass; });
+    for (RGResource r : transients)
+    {
+        Resource& resource = resources[r];
+        resource.physical = AcquirePhysical(resource.desc, resource.firstPass, resource.lastPass);
+        resource.texture = pool[resource.physical].texture;
+    }
+}
+
+int RenderGraph::AcquirePhysical(const RGTextureDesc& desc, int firstPass, int lastPass)
+{
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        if (pool[i].desc == desc && pool[i].busyUntil < firstPass)
+        {
+            pool[i].busyUntil = lastPass;
+            return (int)i;
+        }
+    }
+
+    PhysicalTexture physical;
+    physical.desc = desc;
+    physical.busyUntil = lastPass;
+    glGenTextures(1, &physical.texture);
+    GLState::BindTexture(GL_TEXTURE_2D, physical.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, desc.format, desc.type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    pool.push_back(physical);
+    return (int)pool.size() - 1;
+}
+
+unsigned int RenderGraph::GetFramebuffer(const Pass& pass)
+{
+    // the backbuffer is never mixed with graph textures
+    if (!pass.colorAttachments.empty() && resources[pass.colorAttachments[0]].output)
+        return 0;
+
+    int colorCount = (int)pass.colorAttachments.size();
+    if (colorCount > MAX_COLOR_ATTACHMENTS)
+    {
+        std::cout << "ERROR::RENDERGRAPH:: Pass " << pass.name << " has more than " << MAX_COLOR_ATTACHMENTS << " color attachments" << std::endl;
+        colorCount = MAX_COLOR_ATTACHMENTS;
+    }
+    FramebufferKey key = {};
+    for (int i = 0; i < colorCount; i++)
+        key[i] = resources[pass.colorAttachments[i]].texture;
+    key.back() = pass.depthAttachment >= 0 ? resources[pass.depthAttachment].texture : 0;
+    auto it = framebuffers.find(key);
+    if (it != framebuffers.end())
+        return it->second;
+
+    unsigned int fbo;
+    glGenFramebuffers(1, &fbo);
+    GLState::BindFramebuffer(fbo);
+    GLenum drawBuffers[MAX_COLOR_ATTACHMENTS];
+    for (int i = 0; i < colorCount; i++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (unsigned int)i, GL_TEXTURE_2D, key[i], 0);
+        drawBuffers[i] = GL_COLOR_ATTACHMENT0 + (unsigned int)i;
+    }
+    if (pass.depthAttachment >= 0)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, key.back(), 0);
+    if (colorCount == 0)
+        glDrawBuffer(GL_NONE);
+    else
+        glDrawBuffers(colorCount, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::RENDERGRAPH:: Framebuffer of pass " << pass.name << " is not complete!" << std::endl;
+    framebuffers[key] = fbo;
+    return fbo;
+}
+
+void RenderGraph::Execute()
+{
+    for (Pass& pass : passes)
+    {
+        if (pass.culled)
+            continue;
+        if (!pass.colorAttachments.empty() || pass.depthAttachment >= 0)
+        {
+            RGResource target = pass.colorAttachments.empty() ? pass.depthAttachment : pass.colorAttachments[0];
+            GLState::BindFramebuffer(GetFramebuffer(pass));
+            GLState::Viewport(0, 0, resources[target].desc.width, resources[target].desc.height);
+        }
+        pass.invoke(pass.execute, *this);
+    }
+    GLState::BindFramebuffer(0);
+}
+
+unsigned int RenderGraph::GetTexture(RGResource resource) const
+{
+    return resources[resource].texture;
+}
+
+size_t RenderGraph::BytesPerPixel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_RGBA32F: return 16;
+    case GL_RGBA16F: case GL_RG32F: return 8;
+    case GL_RGB16F: return 6;
+    case GL_RGB8: case GL_RGB: return 3;
+    case GL_RG16F: case GL_R32F: case GL_R11F_G11F_B10F: case GL_RGBA8: case GL_RGBA:
+    case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH_COMPONENT: case GL_DEPTH24_STENCIL8: return 4;
+    default: return 4;
+    }
+}
+
+void RenderGraph::Dump(std::ostream& out) const
+{
+    out << "RenderGraph: " << passes.size() << " passes, " << resources.size() << " resources" << std::endl;
+    for (size_t p = 0; p < passes.size(); p++)
+    {
+        const Pass& pass = passes[p];
+        out << "  [" << p << "] " << pass.name << (pass.culled ? " (culled)" : "") << std::endl;
+        if (!pass.reads.empty())
+        {
+            out << "      reads:";
+            for (RGResource r : pass.reads)
+                out << " " << resources[r].name;
+            out << std::endl;
+        }
+        if (!pass.writes.empty())
+        {
+            out << "      writes:";
+            for (RGResource r : pass.writes)
+                out << " " << resources[r].name;
+            out << std::endl;
+        }
+    }
+
+    size_t virtualBytes = 0;
+    out << "Transient textures:" << std::endl;
+    for (const Resource& resource : resources)
+    {
+        if (resource.imported)
+            continue;
+        size_t bytes = (size_t)resource.desc.width * resource.desc.height * BytesPerPixel(resource.desc.internalFormat);
+        if (resource.physical < 0)
+        {
+            out << "  " << resource.name << " unused" << std::endl;
+            continue;
+        }
+        virtualBytes += bytes;
+        out << "  " << resource.name << " " << resource.desc.width << "x" << resource.desc.height
+            << " passes " << resource.firstPass << "-" << resource.lastPass
+            << " -> texture #" << resource.physical << " (" << bytes / 1024 << " KB)" << std::endl;
+    }
+    size_t physicalBytes = 0;
+    for (const PhysicalTexture& physical : pool)
+        physicalBytes += (size_t)physical.desc.width * physical.desc.height * BytesPerPixel(physical.desc.internalFormat);
+    out << "Memory: " << physicalBytes / 1024 << " KB in " << pool.size() << " pooled textures, "
+        << virtualBytes / 1024 << " KB without aliasing" << std::endl;
+}
@@ -0,0 +1,139 @@
+#include "../header/SceneGraph.h"
+
+SceneNode SceneGraph::CreateNode(SceneNode parent, const glm::mat4& localTransform)
+{
+    int parentSlot = parent >= 0 ? nodeSlots[parent] : -1;
+    // a root appended at the end keeps depth-first order, a child only when its parent is the last subtree
+    int slot = (int)parents.size();
+    if (parentSlot >= 0 && parentSlot + subtreeSizes[parentSlot] != slot)
+        orderDirty = true;
+    if (!orderDirty)
+    {
+        for (int ancestor = parentSlot; ancestor >= 0; ancestor = parents[ancestor])
+            subtreeSizes[ancestor]++;
+    }
+
+    SceneNode node = (SceneNode)nodeSlots.size();
+    nodeSlots.push_back(slot);
+    parents.push_back(parentSlot);
+    subtreeSizes.push_back(1);
+    localTransforms.push_back(localTransform);
+    worldTransforms.push_back(localTransform);
+    dirty.push_back(1);
+    slotNodes.push_back(node);
+    return node;
+}
+
+void SceneGraph::SetLocalTransform(SceneNode node, const glm::mat4& localTransform)
+{
+    int slot = nodeSlots[node];
+    localTransforms[slot] = localTransform;
+    dirty[slot] = 1;
+}
+
+const glm::mat4& SceneGraph::GetLocalTransform(SceneNode node) const
+{
+    return localTransforms[nodeSlots[node]];
+}
+
+const glm::mat4& SceneGraph::GetWorldTransform(SceneNode node) const
+{
+    return worldTransforms[nodeSlots[node]];
+}
+
+SceneNode SceneGraph::GetParent(SceneNode node) const
+{
+    int parentSlot = parents[nodeSlots[node]];
+    return parentSlot >= 0 ? slotNodes[parentSlot] : -1;
+}
+
+void SceneGraph::RebuildOrder()
+{
+    // children of every slot, bucketed by parent; siblings stay in creation order since appended
+    // slots come after the existing ones
+    int count = (int)parents.size();
+    std::vector<int> childBegin(count + 2, 0);
+    for (int slot = 0; slot < count; slot++)
+        childBegin[parents[slot] + 2]++;
+    for (int i = 1; i < count + 2; i++)
+        childBegin[i] += childBegin[i - 1];
+    std::vector<int> children(count);
+    for (int slot = 0; slot < count; slot++)
+        children[childBegin[parents[slot] + 1]++] = slot;
+    // childBegin[p + 1] is now the end of p's children and childBegin[p] their beginning; -1 holds the roots
+
+    // preorder walk giving every old slot its new one
+    std::vector<int> newSlots(count);
+    std::vector<int> stack;
+    stack.reserve(count);
+    for (int i = childBegin[0] - 1; i >= 0; i--)
+        stack.push_back(children[i]);
+    int next = 0;
+    while (!stack.empty())
+    {
+        int slot = stack.back();
+        stack.pop_back();
+        newSlots[slot] = next++;
+        for (int i = childBegin[slot + 1] - 1; i >= childBegin[slot]; i--)
+            stack.push_back(children[i]);
+    }
+
+    std::vector<int> sortedParents(count);
+    std::vector<glm::mat4> sortedLocal(count);
+    std::vector<glm::mat4> sortedWorld(count);
+    std::vector<unsigned char> sortedDirty(count);
+    std::vector<SceneNode> sortedNodes(count);
+    for (int slot = 0; slot < count; slot++)
+    {
+        int to = newSlots[slot];
+        sortedParents[to] = parents[slot] >= 0 ? newSlots[parents[slot]] : -1;
+        sortedLocal[to] = localTransforms[slot];
+        sortedWorld[to] = worldTransforms[slot];
+        sortedDirty[to] = dirty[slot];
+        sortedNodes[to] = slotNodes[slot];
+    }
+    parents.swap(sortedParents);
+    localTransforms.swap(sortedLocal);
+    worldTransforms.swap(sortedWorld);
+    dirty.swap(sortedDirty);
+    slotNodes.swap(sortedNodes);
+    for (int& slot : nodeSlots)
+        slot = newSlots[slot];
+
+    // children follow their parents, so summing backwards completes every subtree before its root
+    subtreeSizes.assign(count, 1);
+    for (int slot = count - 1; slot > 0; slot--)
+    {
+        if (parents[slot] >= 0)
+            subtreeSizes[parents[slot]] += subtreeSizes[slot];
+    }
+    orderDirty = false;
+}
+
+int SceneGraph::Update()
+{
+    if (orderDirty)
+        RebuildOrder();
+
+    int recomputed = 0;
+    int count = (int)parents.size();
+    int slot = 0;
+    while (slot < count)
+    {
+        if (!dirty[slot])
+        {
+            slot++;
+            continue;
+        }
+        // the whole subtree follows its root, and parents precede children inside it
+        int end = slot + subtreeSizes[slot];
+        for (int i = slot; i < end; i++)
+        {
+            worldTransforms[i] = parents[i] >= 0 ? worldTransforms[parents[i]] * localTransforms[i] : localTransforms[i];
+            dirty[i] = 0;
+        }
+        recomputed += end - slot;
+        slot = end;
+    }
+    return recomputed;
+}
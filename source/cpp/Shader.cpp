@@ -8,46 +8,22 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "../header/Shader.h"
+#include "../header/GLState.h"
+#include "../header/ShaderPath.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-    // 1. retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines) {
+    // 1. retrieve the vertex/fragment source code from filePath, resolving includes and defines
+    std::string vertexCode = PreprocessShaderSource(vertexPath, defines);
+    if (vertexCode.empty())
     {
-        // open files
-        vShaderFile.open(vertexPath);
-        if (!vShaderFile.is_open())
-        {
-            std::cerr << "ERROR::SHADER::VERTEX::FILE_NOT_FOUND: " << vertexPath << std::endl;
-            return;
-        }
-
-        fShaderFile.open(fragmentPath);
-        if (!fShaderFile.is_open())
-        {
-            std::cerr << "ERROR::SHADER::FRAGMENT::FILE_NOT_FOUND: " << fragmentPath << std::endl;
-            return;
-        }
-        std::stringstream vShaderStream, fShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        std::cerr << "ERROR::SHADER::VERTEX::FILE_NOT_FOUND: " << vertexPath << std::endl;
+        return;
     }
-    catch (std::ifstream::failure e)
+    std::string fragmentCode = PreprocessShaderSource(fragmentPath, defines);
+    if (fragmentCode.empty())
     {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        std::cerr << "ERROR::SHADER::FRAGMENT::FILE_NOT_FOUND: " << fragmentPath << std::endl;
+        return;
     }
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
@@ -93,52 +69,23 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
 
+    bindUniformBlocks();
+
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
 }
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath) {
-    // 1. retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const ShaderDefines& defines) {
+    // 1. retrieve the vertex/fragment source code from filePath, resolving includes and defines
+    std::string vertexCode = PreprocessShaderSource(vertexPath, defines);
+    std::string fragmentCode = PreprocessShaderSource(fragmentPath, defines);
     std::string geometryCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    std::ifstream gShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-        // if geometry shader path is present, also load a geometry shader
-        if (geometryPath != nullptr)
-        {
-            gShaderFile.open(geometryPath);
-            std::stringstream gShaderStream;
-            gShaderStream << gShaderFile.rdbuf();
-            gShaderFile.close();
-            geometryCode = gShaderStream.str();
-        }
-    }
-    catch (std::ifstream::failure& e)
-    {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-    }
+    // if geometry shader path is present, also load a geometry shader
+    if (geometryPath != nullptr)
+        geometryCode = PreprocessShaderSource(geometryPath, defines);
+    if (vertexCode.empty() || fragmentCode.empty() || (geometryPath != nullptr && geometryCode.empty()))
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << vertexPath << std::endl;
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
@@ -171,6 +118,7 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
         glAttachShader(ID, geometry);
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
+    bindUniformBlocks();
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
@@ -180,36 +128,41 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 
 void Shader::use()
 {
-    glUseProgram(ID);
+    GLState::UseProgram(ID);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setBool(const char* name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(glGetUniformLocation(ID, name), (int)value);
 }
 
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setInt(const char* name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(glGetUniformLocation(ID, name), value);
 }
 
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setFloat(const char* name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(glGetUniformLocation(ID, name), value);
 }
 
-void Shader::setVec3(const std::string& name, glm::vec3 value) const
+void Shader::setVec2(const char* name, glm::vec2 value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+    glUniform2fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
 }
 
-void Shader::setVec4(const std::string& name, glm::vec4 value) const
+void Shader::setVec3(const char* name, glm::vec3 value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+    glUniform3fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
 }
 
-void Shader::setMat4(const std::string& name, glm::mat4 value) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+void Shader::setVec4(const char* name, glm::vec4 value) const
+{
+    glUniform4fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
+}
+
+void Shader::setMat4(const char* name, glm::mat4 value) const {
+    glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::passMVP(glm::mat4 model, glm::mat4 view, glm::mat4 projection) {
@@ -222,6 +175,13 @@ void Shader::passMVP(glm::mat4 model, glm::mat4 view, glm::mat4 projection) {
     setMat4("model", model);
 }
 
+void Shader::bindUniformBlocks()
+{
+    unsigned int drawData = glGetUniformBlockIndex(ID, "DrawData");
+    if (drawData != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, drawData, DRAW_DATA_BINDING);
+}
+
 void Shader::checkCompileErrors(unsigned int shader, std::string type)
 {
     int success;
@@ -0,0 +1,146 @@
+#include "../header/ShaderPath.h"
+#include "../header/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <set>
+
+namespace {
+
+std::string DirectoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// Appends the contents of path to out, expanding #include lines recursively.
+// Each file is tagged with its own source-string number in #line directives so
+// compile errors point at the file and line they came from.
+bool ExpandIncludes(const std::string& path, std::set<std::string>& included, int& fileCount, std::string& out)
+{
+    AssetFile file;
+    if (!VirtualFileSystem::Open(path, file))
+        return false;
+    included.insert(path);
+
+    int fileIndex = fileCount++;
+    std::string line;
+    int lineNumber = 0;
+    const char* cursor = file.Data();
+    const char* end = cursor + file.Size();
+    while (cursor < end)
+    {
+        const char* lineEnd = (const char*)std::memchr(cursor, '\n', end - cursor);
+        if (!lineEnd)
+            lineEnd = end;
+        // CRLF files read like they did through a text mode stream
+        line.assign(cursor, lineEnd > cursor && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd);
+        cursor = lineEnd < end ? lineEnd + 1 : end;
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line.compare(first, 8, "#include") == 0)
+        {
+            size_t open = line.find('"', first + 8);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::MALFORMED_INCLUDE: " << path << "(" << lineNumber << ")" << std::endl;
+                continue;
+            }
+            std::string includePath = DirectoryOf(path) + line.substr(open + 1, close - open - 1);
+            if (included.count(includePath))
+                continue;
+
+            out += "#line 1 " + std::to_string(fileCount) + "\n";
+            if (!ExpandIncludes(includePath, included, fileCount, out))
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << " (from " << path << ")" << std::endl;
+            out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            continue;
+        }
+        out += line;
+        out += '\n';
+    }
+    return true;
+}
+
+}
+
+std::string PreprocessShaderSource(const std::string& path, const ShaderDefines& defines)
+{
+    std::set<std::string> included;
+    int fileCount = 0;
+    std::string source;
+    if (!ExpandIncludes(path, included, fileCount, source))
+        return std::string();
+
+    // defines have to follow #version, which must stay the first statement of the shader
+    std::string defineBlock;
+    for (const auto& define : defines)
+        defineBlock += "#define " + define.first + " " + std::to_string(define.second) + "\n";
+    if (defineBlock.empty())
+        return source;
+
+    size_t version = source.find("#version");
+    size_t insertAt = version == std::string::npos ? 0 : source.find('\n', version);
+    if (insertAt == std::string::npos)
+        insertAt = source.size();
+    else if (version != std::string::npos)
+        insertAt++;
+    // keep line numbers of the main file intact for compile errors
+    defineBlock += "#line 2 0\n";
+    source.insert(insertAt, defineBlock);
+    return source;
+}
+
+unsigned long long HashShaderDefines(const ShaderDefines& defines)
+{
+    // FNV-1a per define, combined with a commutative sum so ordering does not matter
+    unsigned long long key = 0;
+    for (const auto& define : defines)
+    {
+        unsigned long long h = 1469598103934665603ull;
+        for (char c : define.first)
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        h = (h ^ static_cast<unsigned long long>(define.second + 1)) * 1099511628211ull;
+        key += h;
+    }
+    return key;
+}
+
+bool SameShaderDefines(const ShaderDefines& a, const ShaderDefines& b)
+{
+    // define sets are a handful of entries, so a quadratic compare beats sorting copies per lookup
+    if (a.size() != b.size())
+        return false;
+    for (const auto& define : a)
+    {
+        if (std::find(b.begin(), b.end(), define) == b.end())
+            return false;
+    }
+    return true;
+}
+
+ShaderVariantCache::ShaderVariantCache(const std::string& name, bool hasGeometry)
+    : name(name), hasGeometry(hasGeometry)
+{
+}
+
+Shader& ShaderVariantCache::Get(const ShaderDefines& defines)
+{
+    unsigned long long key = HashShaderDefines(defines);
+    auto range = variants.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (SameShaderDefines(it->second.defines, defines))
+            return it->second.shader;
+    }
+    auto it = variants.emplace(key, Variant{ defines, CreateShader(name, hasGeometry, defines) });
+    return it->second.shader;
+}
+
+void ShaderVariantCache::Prewarm(const std::vector<ShaderDefines>& defineSets)
+{
+    for (const auto& defines : defineSets)
+        Get(defines);
+}
@@ -0,0 +1,380 @@
+#include "../header/ShadowAtlas.h"
+#include "../header/GLState.h"
+#include "../header/Shader.h"
+#include "../header/FrameArena.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void HashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+}
+
+struct FaceUpdate {
+    int tile;
+    int face;
+    float priority;
+    unsigned long long signature;
+};
+
+}
+
+ShadowAtlas::ShadowAtlas(unsigned int atlasSize, unsigned int maxFaceSize, unsigned int minFaceSize,
+    int maxFaceUpdatesPerFrame, float nearPlane)
+    : atlasSize(atlasSize), minFaceSize(minFaceSize), maxFaceSize(maxFaceSize),
+    maxFaceUpdatesPerFrame(maxFaceUpdatesPerFrame), nearPlane(nearPlane)
+{
+    glGenTextures(1, &depthAtlas);
+    GLState::BindTexture(GL_TEXTURE_2D, depthAtlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, atlasSize, atlasSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &atlasFBO);
+    GLState::BindFramebuffer(atlasFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthAtlas, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Shadow atlas framebuffer is not complete!" << std::endl;
+    // untouched texels read as the far plane, i.e. unshadowed
+    glClear(GL_DEPTH_BUFFER_BIT);
+    GLState::BindFramebuffer(0);
+}
+
+void ShadowAtlas::Allocate(const std::vector<glm::vec3>& positions, const std::vector<float>& radii,
+    const glm::mat4& viewProjection, const glm::vec3& cameraPos, float fov)
+{
+    int numLights = (int)positions.size();
+    for (int t = 0; t < MAX_TILES; t++)
+    {
+        if (tiles[t].light >= numLights)
+            FreeTile(t);
+    }
+    lightTiles.resize(numLights, -1);
+
+    // importance is the light's projected radius relative to the screen height
+    Frustum cameraFrustum(viewProjection);
+    float tanHalfFov = std::tan(glm::radians(fov) * 0.5f);
+    ScratchScope scratch;
+    ArenaVector<std::pair<float, int>> candidates{ ArenaAllocator<std::pair<float, int>>(scratch.arena) };
+    candidates.reserve(numLights);
+    for (int l = 0; l < numLights; l++)
+    {
+        float importance = 0.0f;
+        if (cameraFrustum.Intersects(positions[l], radii[l]))
+        {
+            float distance = std::max(glm::length(positions[l] - cameraPos) - radii[l], nearPlane);
+            importance = std::min(radii[l] / (distance * tanHalfFov), 1.0f);
+        }
+        else if (lightTiles[l] >= 0)
+        {
+            // out of view, but keep its tile cached for as long as nothing visible needs the space
+            importance = 1e-4f;
+        }
+        if (importance > 0.0f)
+            candidates.push_back(std::make_pair(importance, l));
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+
+    // lights that did not make the cut give their tiles back first
+    for (size_t c = MAX_TILES; c < candidates.size(); c++)
+    {
+        int light = candidates[c].second;
+        if (lightTiles[light] >= 0)
+            FreeTile(lightTiles[light]);
+    }
+    candidates.resize(std::min(candidates.size(), (size_t)MAX_TILES));
+    for (int l = 0; l < numLights; l++)
+    {
+        bool candidate = std::any_of(candidates.begin(), candidates.end(),
+            [l](const std::pair<float, int>& c) { return c.second == l; });
+        if (!candidate && lightTiles[l] >= 0)
+            FreeTile(lightTiles[l]);
+    }
+
+    // most important lights claim space first
+    for (const std::pair<float, int>& candidate : candidates)
+    {
+        float importance = candidate.first;
+        int light = candidate.second;
+        unsigned int desiredSize = minFaceSize;
+        while (desiredSize < maxFaceSize && (float)desiredSize < importance * (float)maxFaceSize)
+            desiredSize *= 2;
+
+        int tile = lightTiles[light];
+        if (tile >= 0)
+        {
+            // grow right away, but only shrink once the tile is well oversized to avoid thrashing
+            unsigned int currentSize = tiles[tile].block.faceSize;
+            if (desiredSize <= currentSize && desiredSize * 4 > currentSize)
+            {
+                tiles[tile].importance = importance;
+                if (tiles[tile].position != positions[light] || tiles[tile].farPlane != radii[light])
+                    SetupTile(tile, positions[light], radii[light]);
+                continue;
+            }
+            FreeTile(tile);
+        }
+
+        for (tile = 0; tile < MAX_TILES && tiles[tile].light >= 0; tile++);
+        if (tile == MAX_TILES)
+            break;
+        Block block;
+        unsigned int faceSize = desiredSize;
+        while (!AllocateBlock(faceSize, block) && faceSize > minFaceSize)
+            faceSize /= 2;
+        if (block.faceSize != faceSize)
+            continue;
+
+        tiles[tile].light = light;
+        tiles[tile].block = block;
+        tiles[tile].importance = importance;
+        lightTiles[light] = tile;
+        SetupTile(tile, positions[light], radii[light]);
+        for (int face = 0; face < 6; face++)
+        {
+            tiles[tile].faceValid[face] = false;
+            tiles[tile].faceWait[face] = 0;
+        }
+    }
+}
+
+bool ShadowAtlas::AllocateBlock(unsigned int faceSize, Block& block)
+{
+    block.faceSize = 0;
+
+    // reuse a freed block of the same size
+    for (size_t i = 0; i < freeBlocks.size(); i++)
+    {
+        if (freeBlocks[i].faceSize != faceSize)
+            continue;
+        block = freeBlocks[i];
+        freeBlocks[i] = freeBlocks.back();
+        freeBlocks.pop_back();
+        return true;
+    }
+
+    // split the smallest larger free block into quarters; freed blocks are never merged again
+    int best = -1;
+    for (size_t i = 0; i < freeBlocks.size(); i++)
+    {
+        if (freeBlocks[i].faceSize > faceSize && (best < 0 || freeBlocks[i].faceSize < freeBlocks[best].faceSize))
+            best = (int)i;
+    }
+    if (best >= 0)
+    {
+        Block parent = freeBlocks[best];
+        freeBlocks[best] = freeBlocks.back();
+        freeBlocks.pop_back();
+        while (parent.faceSize > faceSize)
+        {
+            unsigned int half = parent.faceSize / 2;
+            freeBlocks.push_back({ parent.x + 3 * half, parent.y, half });
+            freeBlocks.push_back({ parent.x, parent.y + 2 * half, half });
+            freeBlocks.push_back({ parent.x + 3 * half, parent.y + 2 * half, half });
+            parent.faceSize = half;
+        }
+        block = parent;
+        return true;
+    }
+
+    // fresh space on a shelf of blocks with the same height
+    unsigned int width = 3 * faceSize;
+    unsigned int height = 2 * faceSize;
+    for (Shelf& shelf : shelves)
+    {
+        if (shelf.height != height || shelf.cursor + width > atlasSize)
+            continue;
+        block = { shelf.cursor, shelf.y, faceSize };
+        shelf.cursor += width;
+        return true;
+    }
+    if (width > atlasSize || shelfTop + height > atlasSize)
+        return false;
+    shelves.push_back({ shelfTop, height, width });
+    block = { 0, shelfTop, faceSize };
+    shelfTop += height;
+    return true;
+}
+
+void ShadowAtlas::FreeTile(int tile)
+{
+    if (tiles[tile].light < 0)
+        return;
+    if (tiles[tile].light < (int)lightTiles.size())
+        lightTiles[tiles[tile].light] = -1;
+    freeBlocks.push_back(tiles[tile].block);
+    tiles[tile].light = -1;
+}
+
+void ShadowAtlas::SetupTile(int tile, const glm::vec3& position, float farPlane)
+{
+    static const glm::vec3 targets[6] = {
+        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+    };
+    static const glm::vec3 ups[6] = {
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+    };
+    Tile& t = tiles[tile];
+    t.position = position;
+    t.farPlane = farPlane;
+    glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+    for (int face = 0; face < 6; face++)
+    {
+        t.faceMatrices[face] = shadowProj * glm::lookAt(position, position + targets[face], ups[face]);
+        t.faceFrusta[face] = Frustum(t.faceMatrices[face]);
+    }
+}
+
+int ShadowAtlas::Render(Shader& depthShader, const std::vector<ShadowCaster>& casters,
+    FunctionRef<void(int, Shader&)> drawCaster)
+{
+    // visibility of every caster per face, and which faces changed since they were drawn
+    ScratchScope scratch;
+    unsigned char* casterMasks = scratch.arena.New<unsigned char>(MAX_TILES * casters.size());
+    ArenaVector<FaceUpdate> updates{ ArenaAllocator<FaceUpdate>(scratch.arena) };
+    updates.reserve(MAX_TILES * 6);
+    for (int t = 0; t < MAX_TILES; t++)
+    {
+        Tile& tile = tiles[t];
+        if (tile.light < 0)
+            continue;
+        unsigned long long signatures[6];
+        for (int face = 0; face < 6; face++)
+        {
+            signatures[face] = 1469598103934665603ull;
+            HashBytes(signatures[face], &tile.position, sizeof(tile.position));
+            HashBytes(signatures[face], &tile.farPlane, sizeof(tile.farPlane));
+            HashBytes(signatures[face], &tile.block, sizeof(tile.block));
+        }
+        unsigned char* masks = &casterMasks[t * casters.size()];
+        for (size_t i = 0; i < casters.size(); i++)
+        {
+            for (int face = 0; face < 6; face++)
+            {
+                if (!tile.faceFrusta[face].Intersects(casters[i].worldBounds))
+                    continue;
+                masks[i] |= 1 << face;
+                HashBytes(signatures[face], &i, sizeof(i));
+                HashBytes(signatures[face], &casters[i].transform, sizeof(glm::mat4));
+                HashBytes(signatures[face], &casters[i].shadowLod, sizeof(casters[i].shadowLod));
+            }
+        }
+        for (int face = 0; face < 6; face++)
+        {
+            if (tile.faceValid[face] && tile.faceSignatures[face] == signatures[face])
+                continue;
+            // faces that were never drawn leave the whole light unshadowed, so they go first
+            float priority = tile.importance * (float)(tile.faceWait[face] + 1) * (tile.faceValid[face] ? 1.0f : 4.0f);
+            updates.push_back({ t, face, priority, signatures[face] });
+        }
+    }
+
+    std::sort(updates.begin(), updates.end(),
+        [](const FaceUpdate& a, const FaceUpdate& b) { return a.priority > b.priority; });
+    int updateCount = std::min((int)updates.size(), maxFaceUpdatesPerFrame);
+    for (size_t u = updateCount; u < updates.size(); u++)
+        tiles[updates[u].tile].faceWait[updates[u].face]++;
+    facesDeferredLastFrame = (int)updates.size() - updateCount;
+    facesRenderedLastFrame = updateCount;
+    if (updateCount == 0)
+        return 0;
+
+    GLState::BindFramebuffer(atlasFBO);
+    GLState::Enable(GL_DEPTH_TEST);
+    GLState::Enable(GL_SCISSOR_TEST);
+    depthShader.use();
+    for (int u = 0; u < updateCount; u++)
+    {
+        Tile& tile = tiles[updates[u].tile];
+        int face = updates[u].face;
+        unsigned int size = tile.block.faceSize;
+        unsigned int x = tile.block.x + (face % 3) * size;
+        unsigned int y = tile.block.y + (face / 3) * size;
+        // the scissor keeps the clear inside this face
+        GLState::Viewport(x, y, size, size);
+        GLState::Scissor(x, y, size, size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        depthShader.setMat4("shadowMatrix", tile.faceMatrices[face]);
+        depthShader.setVec3("lightPos", tile.position);
+        depthShader.setFloat("far_plane", tile.farPlane);
+        const unsigned char* masks = &casterMasks[updates[u].tile * casters.size()];
+        for (size_t i = 0; i < casters.size(); i++)
+        {
+            if (masks[i] & (1 << face))
+                drawCaster((int)i, depthShader);
+        }
+
+        tile.faceSignatures[face] = updates[u].signature;
+        tile.faceValid[face] = true;
+        tile.faceWait[face] = 0;
+    }
+    GLState::Disable(GL_SCISSOR_TEST);
+    GLState::BindFramebuffer(0);
+    return updateCount;
+}
+
+bool ShadowAtlas::IsTileReady(int tile) const
+{
+    for (int face = 0; face < 6; face++)
+    {
+        if (!tiles[tile].faceValid[face])
+            return false;
+    }
+    return true;
+}
+
+int ShadowAtlas::GetTile(int light) const
+{
+    if (light < 0 || light >= (int)lightTiles.size())
+        return -1;
+    return lightTiles[light];
+}
+
+void ShadowAtlas::SetUniforms(Shader& shader, int numLights) const
+{
+    shader.use();
+    ScratchScope scratch;
+    float texel = 1.0f / (float)atlasSize;
+    for (int t = 0; t < MAX_TILES; t++)
+    {
+        const Tile& tile = tiles[t];
+        if (tile.light < 0)
+            continue;
+        glm::vec4 rect(tile.block.x * texel, tile.block.y * texel, tile.block.faceSize * texel, tile.farPlane);
+        shader.setVec4(scratch.arena.Format("shadowAtlasTiles[%d]", t), rect);
+    }
+    for (int l = 0; l < numLights; l++)
+    {
+        int tile = GetTile(l);
+        if (tile >= 0 && !IsTileReady(tile))
+            tile = -1;
+        shader.setInt(scratch.arena.Format("pointLights[%d].shadowTile", l), tile);
+    }
+}
+
+void ShadowAtlas::Invalidate()
+{
+    for (int t = 0; t < MAX_TILES; t++)
+    {
+        for (int face = 0; face < 6; face++)
+            tiles[t].faceValid[face] = false;
+    }
+}
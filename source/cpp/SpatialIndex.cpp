@@ -0,0 +1,522 @@
+#include "../header/SpatialIndex.h"
+#include "../header/FrameArena.h"
+#include "../header/JobSystem.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+AABB Union(const AABB& a, const AABB& b)
+{
+    return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+float SurfaceArea(const AABB& box)
+{
+    glm::vec3 size = box.max - box.min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool Contains(const AABB& outer, const AABB& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+bool Overlaps(const AABB& a, const AABB& b)
+{
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::greaterThanEqual(a.max, b.min));
+}
+
+float DistanceSquared(const glm::vec3& point, const AABB& box)
+{
+    glm::vec3 offset = glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f));
+    return glm::dot(offset, offset);
+}
+
+enum FrustumSide { OUTSIDE, INTERSECTING, INSIDE };
+
+FrustumSide Classify(const Frustum& frustum, const AABB& box)
+{
+    glm::vec3 center = box.Center();
+    glm::vec3 extents = box.Extents();
+    FrustumSide side = INSIDE;
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 normal(frustum.planes[i]);
+        float distance = glm::dot(normal, center) + frustum.planes[i].w;
+        float reach = glm::dot(glm::abs(normal), extents);
+        if (distance + reach < 0.0f)
+            return OUTSIDE;
+        if (distance - reach < 0.0f)
+            side = INTERSECTING;
+    }
+    return side;
+}
+
+// entry distance of the ray into box, or a negative value when it misses (tMin, tMax)
+float RayEnter(const Ray& ray, const glm::vec3& inverseDirection, const AABB& box, float tMax)
+{
+    glm::vec3 t0 = (box.min - ray.origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - ray.origin) * inverseDirection;
+    glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+    float enter = std::max(std::max(near.x, near.y), std::max(near.z, ray.tMin));
+    float exit = std::min(std::min(far.x, far.y), std::min(far.z, tMax));
+    return enter <= exit ? enter : -1.0f;
+}
+
+}
+
+SpatialIndex::SpatialIndex(float margin)
+    : margin(margin)
+{
+}
+
+int SpatialIndex::Insert(const AABB& box, Entity entity)
+{
+    int leaf = AllocateNode();
+    nodes[leaf].box = AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+    nodes[leaf].height = 0;
+    leafBounds[leaf] = box;
+    entities[leaf] = entity;
+    InsertLeaf(leaf);
+    leafCount++;
+    return leaf;
+}
+
+void SpatialIndex::Remove(int proxy)
+{
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+    leafCount--;
+}
+
+void SpatialIndex::Move(int proxy, const AABB& box)
+{
+    leafBounds[proxy] = box;
+    if (Contains(nodes[proxy].box, box))
+        return;
+    AABB enlarged(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+    if (Overlaps(nodes[proxy].box, enlarged))
+    {
+        // the ancestors still hold the old box; Refit() grows them for all moved leaves at once
+        nodes[proxy].box = enlarged;
+        grown.push_back(proxy);
+        return;
+    }
+    RemoveLeaf(proxy);
+    nodes[proxy].box = enlarged;
+    InsertLeaf(proxy);
+}
+
+void SpatialIndex::Refit()
+{
+    dirty.clear();
+    marked.resize(nodes.size(), false);
+    for (int leaf : grown)
+    {
+        if (nodes[leaf].height != 0)
+            continue;
+        // stop where another leaf's walk already went
+        for (int node = nodes[leaf].parent; node != NONE && !marked[node]; node = nodes[node].parent)
+        {
+            marked[node] = true;
+            dirty.push_back(node);
+        }
+    }
+    grown.clear();
+    // children are lower than their parents, so refitting by height updates every child first
+    std::sort(dirty.begin(), dirty.end(), [&](int a, int b) { return nodes[a].height < nodes[b].height; });
+    for (int node : dirty)
+    {
+        nodes[node].box = Union(nodes[nodes[node].child[0]].box, nodes[nodes[node].child[1]].box);
+        marked[node] = false;
+    }
+}
+
+void SpatialIndex::Query(const Frustum& frustum, std::vector<Entity>& results) const
+{
+    if (root != NONE)
+        QueryFrustum(root, frustum, [&](int leaf) { results.push_back(entities[leaf]); });
+}
+
+void SpatialIndex::Query(const glm::vec3& center, float radius, std::vector<Entity>& results) const
+{
+    if (root == NONE)
+        return;
+    float radiusSquared = radius * radius;
+    int stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = root;
+    while (top > 0)
+    {
+        const Node& node = nodes[stack[--top]];
+        if (DistanceSquared(center, node.box) > radiusSquared)
+            continue;
+        if (node.IsLeaf())
+        {
+            int leaf = (int)(&node - nodes.data());
+            if (DistanceSquared(center, leafBounds[leaf]) <= radiusSquared)
+                results.push_back(entities[leaf]);
+            continue;
+        }
+        if (top + 2 > TRAVERSAL_STACK_SIZE)
+        {
+            std::cout << "ERROR::SPATIAL_INDEX:: Traversal stack overflow" << std::endl;
+            return;
+        }
+        stack[top++] = node.child[0];
+        stack[top++] = node.child[1];
+    }
+}
+
+void SpatialIndex::ParallelQuery(const Frustum& frustum, FunctionRef<void(Entity)> func) const
+{
+    if (root == NONE)
+        return;
+    // open the top of the tree until there are enough subtrees to keep every thread busy
+    ScratchScope scratch;
+    ArenaVector<int> subtrees{ ArenaAllocator<int>(scratch.arena) };
+    ArenaVector<int> next{ ArenaAllocator<int>(scratch.arena) };
+    subtrees.push_back(root);
+    size_t wanted = (size_t)JobSystem::ThreadCount() * 8;
+    bool opened = true;
+    while (opened && subtrees.size() < wanted)
+    {
+        opened = false;
+        next.clear();
+        for (int node : subtrees)
+        {
+            FrustumSide side = Classify(frustum, nodes[node].box);
+            if (side == OUTSIDE)
+                continue;
+            if (side == INSIDE || nodes[node].IsLeaf())
+            {
+                next.push_back(node);
+                continue;
+            }
+            next.push_back(nodes[node].child[0]);
+            next.push_back(nodes[node].child[1]);
+            opened = true;
+        }
+        subtrees.swap(next);
+    }
+
+    auto traverse = [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            QueryFrustum(subtrees[i], frustum, [&](int leaf) { func(entities[leaf]); });
+    };
+    JobSystem::ParallelFor((int)subtrees.size(), 1, traverse);
+}
+
+void SpatialIndex::Nearest(const glm::vec3& point, int k, std::vector<Entity>& results) const
+{
+    results.clear();
+    if (root == NONE || k <= 0)
+        return;
+    typedef std::pair<float, int> Entry;
+    ScratchScope scratch;
+    // nodes still to visit, nearest on top, and the k best leaves so far, farthest on top
+    ArenaVector<Entry> open{ ArenaAllocator<Entry>(scratch.arena) };
+    ArenaVector<Entry> best{ ArenaAllocator<Entry>(scratch.arena) };
+    auto nearer = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+    open.push_back(Entry(DistanceSquared(point, nodes[root].box), root));
+    while (!open.empty())
+    {
+        std::pop_heap(open.begin(), open.end(), nearer);
+        Entry entry = open.back();
+        open.pop_back();
+        if ((int)best.size() == k && entry.first >= best.front().first)
+            break;
+        const Node& node = nodes[entry.second];
+        if (node.IsLeaf())
+        {
+            float distance = DistanceSquared(point, leafBounds[entry.second]);
+            if ((int)best.size() == k)
+            {
+                if (distance >= best.front().first)
+                    continue;
+                std::pop_heap(best.begin(), best.end());
+                best.pop_back();
+            }
+            best.push_back(Entry(distance, entry.second));
+            std::push_heap(best.begin(), best.end());
+            continue;
+        }
+        for (int c = 0; c < 2; c++)
+        {
+            open.push_back(Entry(DistanceSquared(point, nodes[node.child[c]].box), node.child[c]));
+            std::push_heap(open.begin(), open.end(), nearer);
+        }
+    }
+    std::sort_heap(best.begin(), best.end());
+    for (const Entry& entry : best)
+        results.push_back(entities[entry.second]);
+}
+
+void SpatialIndex::RayCast(const Ray& ray, FunctionRef<float(Entity, float)> func) const
+{
+    if (root == NONE)
+        return;
+    glm::vec3 inverseDirection = 1.0f / ray.direction;
+    float tMax = ray.tMax;
+    struct StackEntry {
+        int node;
+        float enter;
+    };
+    StackEntry stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    float rootEnter = RayEnter(ray, inverseDirection, nodes[root].box, tMax);
+    if (rootEnter >= 0.0f)
+        stack[top++] = { root, rootEnter };
+    while (top > 0)
+    {
+        StackEntry entry = stack[--top];
+        if (entry.enter > tMax)
+            continue;
+        const Node& node = nodes[entry.node];
+        if (node.IsLeaf())
+        {
+            if (RayEnter(ray, inverseDirection, leafBounds[entry.node], tMax) >= 0.0f)
+                tMax = func(entities[entry.node], tMax);
+            if (tMax <= ray.tMin)
+                return;
+            continue;
+        }
+        float enter0 = RayEnter(ray, inverseDirection, nodes[node.child[0]].box, tMax);
+        float enter1 = RayEnter(ray, inverseDirection, nodes[node.child[1]].box, tMax);
+        if (top + 2 > TRAVERSAL_STACK_SIZE)
+        {
+            std::cout << "ERROR::SPATIAL_INDEX:: Traversal stack overflow" << std::endl;
+            return;
+        }
+        // push the farther child first so the nearer one is visited first
+        bool firstNearer = enter0 >= 0.0f && (enter1 < 0.0f || enter0 <= enter1);
+        int nearChild = firstNearer ? 0 : 1;
+        float nearEnter = firstNearer ? enter0 : enter1, farEnter = firstNearer ? enter1 : enter0;
+        if (farEnter >= 0.0f)
+            stack[top++] = { node.child[1 - nearChild], farEnter };
+        if (nearEnter >= 0.0f)
+            stack[top++] = { node.child[nearChild], nearEnter };
+    }
+}
+
+int SpatialIndex::AllocateNode()
+{
+    int node;
+    if (freeList != NONE)
+    {
+        node = freeList;
+        freeList = nodes[node].parent;
+    }
+    else
+    {
+        node = (int)nodes.size();
+        nodes.push_back(Node());
+        leafBounds.push_back(AABB());
+        entities.push_back(Entity());
+    }
+    nodes[node].parent = NONE;
+    nodes[node].child[0] = NONE;
+    nodes[node].child[1] = NONE;
+    nodes[node].height = 0;
+    return node;
+}
+
+void SpatialIndex::FreeNode(int node)
+{
+    // free nodes are chained through their parent index
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    entities[node] = Entity();
+    freeList = node;
+}
+
+void SpatialIndex::InsertLeaf(int leaf)
+{
+    if (root == NONE)
+    {
+        root = leaf;
+        nodes[root].parent = NONE;
+        return;
+    }
+
+    // descend towards the sibling that adds the least surface area, counting the growth of every
+    // ancestor on the way
+    AABB leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].IsLeaf())
+    {
+        float area = SurfaceArea(nodes[index].box);
+        float combinedArea = SurfaceArea(Union(nodes[index].box, leafBox));
+        // cost of a new parent for this node and the leaf, and of pushing the leaf further down
+        float cost = 2.0f * combinedArea;
+        float inheritanceCost = 2.0f * (combinedArea - area);
+        float childCost[2];
+        for (int c = 0; c < 2; c++)
+        {
+            const Node& child = nodes[nodes[index].child[c]];
+            float unionArea = SurfaceArea(Union(child.box, leafBox));
+            childCost[c] = (child.IsLeaf() ? unionArea : unionArea - SurfaceArea(child.box)) + inheritanceCost;
+        }
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+        index = nodes[index].child[childCost[0] < childCost[1] ? 0 : 1];
+    }
+
+    int sibling = index;
+    int oldParent = nodes[sibling].parent;
+    int newParent = AllocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = Union(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child[0] = sibling;
+    nodes[newParent].child[1] = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    if (oldParent != NONE)
+    {
+        int c = nodes[oldParent].child[0] == sibling ? 0 : 1;
+        nodes[oldParent].child[c] = newParent;
+    }
+    else
+        root = newParent;
+
+    // walk back up, rebalancing and refitting
+    for (index = nodes[leaf].parent; index != NONE; index = nodes[index].parent)
+    {
+        index = Balance(index);
+        const Node& child0 = nodes[nodes[index].child[0]];
+        const Node& child1 = nodes[nodes[index].child[1]];
+        nodes[index].height = 1 + std::max(child0.height, child1.height);
+        nodes[index].box = Union(child0.box, child1.box);
+    }
+}
+
+void SpatialIndex::RemoveLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = NONE;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child[0] == leaf ? nodes[parent].child[1] : nodes[parent].child[0];
+    FreeNode(parent);
+    if (grandParent == NONE)
+    {
+        root = sibling;
+        nodes[sibling].parent = NONE;
+        return;
+    }
+
+    int c = nodes[grandParent].child[0] == parent ? 0 : 1;
+    nodes[grandParent].child[c] = sibling;
+    nodes[sibling].parent = grandParent;
+    for (int index = grandParent; index != NONE; index = nodes[index].parent)
+    {
+        index = Balance(index);
+        const Node& child0 = nodes[nodes[index].child[0]];
+        const Node& child1 = nodes[nodes[index].child[1]];
+        nodes[index].height = 1 + std::max(child0.height, child1.height);
+        nodes[index].box = Union(child0.box, child1.box);
+    }
+}
+
+int SpatialIndex::Balance(int a)
+{
+    if (nodes[a].IsLeaf() || nodes[a].height < 2)
+        return a;
+
+    // lift the taller child b into a's place; a keeps its other child and the shorter grandchild
+    int balance = nodes[nodes[a].child[1]].height - nodes[nodes[a].child[0]].height;
+    if (balance >= -1 && balance <= 1)
+        return a;
+    int side = balance > 1 ? 1 : 0;
+    int b = nodes[a].child[side];
+    int other = nodes[a].child[1 - side];
+    int f = nodes[b].child[0];
+    int g = nodes[b].child[1];
+
+    nodes[b].child[0] = a;
+    nodes[b].parent = nodes[a].parent;
+    nodes[a].parent = b;
+    if (nodes[b].parent != NONE)
+    {
+        int c = nodes[nodes[b].parent].child[0] == a ? 0 : 1;
+        nodes[nodes[b].parent].child[c] = b;
+    }
+    else
+        root = b;
+
+    // the taller grandchild stays under b, the shorter one moves to a
+    int keep = nodes[f].height > nodes[g].height ? f : g;
+    int give = keep == f ? g : f;
+    nodes[b].child[1] = keep;
+    nodes[a].child[side] = give;
+    nodes[give].parent = a;
+    nodes[a].box = Union(nodes[other].box, nodes[give].box);
+    nodes[a].height = 1 + std::max(nodes[other].height, nodes[give].height);
+    nodes[b].box = Union(nodes[a].box, nodes[keep].box);
+    nodes[b].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+    return b;
+}
+
+template <typename Func>
+void SpatialIndex::EachLeaf(int node, const Func& func) const
+{
+    int stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = node;
+    while (top > 0)
+    {
+        int index = stack[--top];
+        if (nodes[index].IsLeaf())
+        {
+            func(index);
+            continue;
+        }
+        if (top + 2 > TRAVERSAL_STACK_SIZE)
+        {
+            std::cout << "ERROR::SPATIAL_INDEX:: Traversal stack overflow" << std::endl;
+            return;
+        }
+        stack[top++] = nodes[index].child[0];
+        stack[top++] = nodes[index].child[1];
+    }
+}
+
+template <typename Func>
+void SpatialIndex::QueryFrustum(int node, const Frustum& frustum, const Func& func) const
+{
+    int stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = node;
+    while (top > 0)
+    {
+        int index = stack[--top];
+        FrustumSide side = Classify(frustum, nodes[index].box);
+        if (side == OUTSIDE)
+            continue;
+        if (side == INSIDE)
+        {
+            EachLeaf(index, func);
+            continue;
+        }
+        if (nodes[index].IsLeaf())
+        {
+            if (Classify(frustum, leafBounds[index]) != OUTSIDE)
+                func(index);
+            continue;
+        }
+        if (top + 2 > TRAVERSAL_STACK_SIZE)
+        {
+            std::cout << "ERROR::SPATIAL_INDEX:: Traversal stack overflow" << std::endl;
+            return;
+        }
+        stack[top++] = nodes[index].child[0];
+        stack[top++] = nodes[index].child[1];
+    }
+}
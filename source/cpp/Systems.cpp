@@ -0,0 +1,193 @@
+#include "../header/Systems.h"
+
+#include <algorithm>
+#include <cmath>
+#include "../header/JobSystem.h"
+#include "../header/Model.h"
+#include "../header/OcclusionCuller.h"
+#include "../header/SceneGraph.h"
+#include "../header/SpatialIndex.h"
+
+void UpdateTransforms(World& world, const SceneGraph& graph)
+{
+    world.ParallelEach<Transform, WorldTransform>([&](Entity, Transform& transform, WorldTransform& worldTransform) {
+        worldTransform.matrix = graph.GetWorldTransform(transform.node);
+    });
+}
+
+void UpdateBounds(World& world)
+{
+    world.ParallelEach<WorldTransform, Bounds>([](Entity, WorldTransform& transform, Bounds& bounds) {
+        bounds.world = TransformAABB(bounds.local, transform.matrix);
+    });
+}
+
+void UpdateSpatialIndex(World& world, SpatialIndex& index)
+{
+    // moves within the index's margin cost one box test
+    world.Each<Bounds, SpatialProxy>([&](Entity, Bounds& bounds, SpatialProxy& proxy) {
+        index.Move(proxy.proxy, bounds.world);
+    });
+    index.Refit();
+}
+
+void FrustumCullRenderables(World& world, const SpatialIndex& index, const Frustum& frustum)
+{
+    world.ParallelEach<Renderable>([](Entity, Renderable& renderable) { renderable.visible = false; });
+    // every entity is reported once, so the jobs never write the same component
+    auto markVisible = [&](Entity entity) {
+        if (Renderable* renderable = world.Get<Renderable>(entity))
+            renderable->visible = true;
+    };
+    index.ParallelQuery(frustum, markVisible);
+}
+
+void AddOccluders(World& world, OcclusionCuller& culler)
+{
+    world.Each<Renderable, WorldTransform>([&](Entity, Renderable& renderable, WorldTransform& transform) {
+        if (renderable.visible)
+            culler.AddOccluder(renderable.model->occluder, transform.matrix);
+    });
+}
+
+void CullRenderables(World& world, OcclusionCuller& culler)
+{
+    // the culler keeps statistics, so the tests stay on this thread
+    world.Each<Renderable, Bounds>([&](Entity, Renderable& renderable, Bounds& bounds) {
+        if (renderable.visible)
+            renderable.visible = culler.IsVisible(bounds.world);
+    });
+}
+
+bool PickEntity(World& world, const SpatialIndex& index, const std::vector<MeshInstance>& instances,
+    const SceneGraph& graph, const Ray& ray, RayHit& hit)
+{
+    bool found = false;
+    auto intersectEntity = [&](Entity entity, float tMax) {
+        Renderable* renderable = world.Get<Renderable>(entity);
+        if (renderable == nullptr)
+            return tMax;
+        for (int i = renderable->firstInstance; i < renderable->firstInstance + renderable->instanceCount; i++)
+        {
+            // the direction is not renormalized, so t means the same in both spaces
+            glm::mat4 inverse = glm::inverse(graph.GetWorldTransform(instances[i].node));
+            Ray local(glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.0f)));
+            local.tMin = ray.tMin;
+            local.tMax = tMax;
+            if (instances[i].mesh->bvh.Intersect(local, hit))
+            {
+                hit.instance = (int)entity.index;
+                tMax = hit.t;
+                found = true;
+            }
+        }
+        return tMax;
+    };
+    index.RayCast(ray, intersectEntity);
+    return found;
+}
+
+namespace {
+
+// a coarser level is only taken once its error is this much below the threshold
+const float LOD_HYSTERESIS = 0.25f;
+
+int SelectLOD(const Mesh& mesh, int current, float distanceScale, const LODView& view)
+{
+    // projected error in pixels of lod; LOD 0 has none
+    auto projected = [&](int lod) { return mesh.lods[lod].error * distanceScale * view.pixelsPerUnit; };
+    int count = (int)mesh.lods.size();
+    int lod = std::min(current, count - 1);
+    while (lod > 0 && projected(lod) > view.errorThreshold)
+        lod--;
+    while (lod + 1 < count && projected(lod + 1) <= view.errorThreshold * (1.0f - LOD_HYSTERESIS))
+        lod++;
+    return lod;
+}
+
+float DistanceToBounds(const glm::vec3& point, const AABB& bounds)
+{
+    return glm::length(glm::max(glm::max(bounds.min - point, point - bounds.max), glm::vec3(0.0f)));
+}
+
+}
+
+void SelectLODs(World& world, std::vector<MeshInstance>& instances, const SceneGraph& graph,
+    const LODView& view, const LODView& shadowView)
+{
+    // every renderable owns its range of instances, so chunks can be processed in parallel
+    world.ParallelEach<Renderable, Bounds>([&](Entity, Renderable& renderable, Bounds& bounds) {
+        float viewDistance = DistanceToBounds(view.position, bounds.world);
+        float shadowDistance = DistanceToBounds(shadowView.position, bounds.world);
+        for (int i = renderable.firstInstance; i < renderable.firstInstance + renderable.instanceCount; i++)
+        {
+            MeshInstance& instance = instances[i];
+            if (instance.mesh->lods.size() < 2)
+                continue;
+            // errors are in model units; the largest axis scale brings them into world units
+            const glm::mat4& matrix = graph.GetWorldTransform(instance.node);
+            float scale = std::sqrt(std::max(std::max(glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])),
+                glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1]))), glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2]))));
+            instance.lod = SelectLOD(*instance.mesh, instance.lod, scale / std::max(viewDistance, 1e-3f), view);
+            instance.shadowLod = SelectLOD(*instance.mesh, instance.shadowLod, scale / std::max(shadowDistance, 1e-3f), shadowView);
+        }
+    });
+}
+
+void PackPointLights(World& world, std::vector<PointLight>& lights)
+{
+    lights.clear();
+    world.EachChunk<PointLight>([&](int count, const Entity*, PointLight* chunkLights) {
+        lights.insert(lights.end(), chunkLights, chunkLights + count);
+    });
+}
+
+void AssignLights(World& world, const SpatialIndex& index, const std::vector<PointLight>& lights, LightAssignment& assignment)
+{
+    world.ParallelEach<LightList>([](Entity, LightList& list) { list.count = 0; });
+    assignment.reached.resize(lights.size());
+    auto queryLights = [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            assignment.reached[i].clear();
+            index.Query(lights[i].position, lights[i].radius, assignment.reached[i]);
+        }
+    };
+    JobSystem::ParallelFor((int)lights.size(), 1, queryLights);
+
+    // a light reaches few objects, so merging the pairs stays on this thread
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const PointLight& light = lights[i];
+        float lightMax = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+        for (Entity entity : assignment.reached[i])
+        {
+            LightList* list = world.Get<LightList>(entity);
+            Bounds* bounds = world.Get<Bounds>(entity);
+            if (list == nullptr || bounds == nullptr)
+                continue;
+            float distance = DistanceToBounds(light.position, bounds->world);
+            float strength = lightMax / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+            if (list->count == MAX_OBJECT_LIGHTS && strength <= list->strength[MAX_OBJECT_LIGHTS - 1])
+                continue;
+            // insertion into the sorted list, dropping the weakest when it is full
+            int slot = std::min(list->count, MAX_OBJECT_LIGHTS - 1);
+            while (slot > 0 && list->strength[slot - 1] < strength)
+            {
+                list->lights[slot] = list->lights[slot - 1];
+                list->strength[slot] = list->strength[slot - 1];
+                slot--;
+            }
+            list->lights[slot] = (int)i;
+            list->strength[slot] = strength;
+            list->count = std::min(list->count + 1, MAX_OBJECT_LIGHTS);
+        }
+    }
+}
+
+float CalculatePointLightRadius(const PointLight& light)
+{
+    float lightMax = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+    return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * (light.constant - (256.0f / 5.0f) * lightMax))) /
+        (2.0f * light.quadratic);
+}
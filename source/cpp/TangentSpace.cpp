@@ -0,0 +1,267 @@
+#include "../header/TangentSpace.h"
+#include "../header/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace {
+
+// blocks of four triangles per chunk, and vertices per job
+const size_t MIN_BLOCKS_PER_CHUNK = 1024;
+const int MIN_VERTICES_PER_BATCH = 4096;
+
+// one 3D vector per lane
+struct Vec3x4 {
+    __m128 x, y, z;
+};
+
+inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline Vec3x4 Sub(const Vec3x4& a, const Vec3x4& b)
+{
+    return { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+}
+
+inline Vec3x4 Scale(const Vec3x4& a, __m128 s)
+{
+    return { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) };
+}
+
+inline __m128 Dot(const Vec3x4& a, const Vec3x4& b)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+inline Vec3x4 Cross(const Vec3x4& a, const Vec3x4& b)
+{
+    return { _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+        _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+        _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)) };
+}
+
+// a without its component along the unit vector n
+inline Vec3x4 Reject(const Vec3x4& a, const Vec3x4& n)
+{
+    return Sub(a, Scale(n, Dot(a, n)));
+}
+
+// a / |a|, zero in lanes too short (or not finite) to normalize
+inline Vec3x4 NormalizeOrZero(const Vec3x4& a)
+{
+    __m128 lengthSquared = Dot(a, a);
+    __m128 valid = _mm_cmpgt_ps(lengthSquared, _mm_set1_ps(FLT_MIN));
+    // reciprocal square root estimate refined by one Newton step
+    __m128 inverse = _mm_rsqrt_ps(lengthSquared);
+    inverse = _mm_mul_ps(inverse, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), lengthSquared), _mm_mul_ps(inverse, inverse))));
+    __m128 zero = _mm_setzero_ps();
+    return { Select(valid, _mm_mul_ps(a.x, inverse), zero), Select(valid, _mm_mul_ps(a.y, inverse), zero),
+        Select(valid, _mm_mul_ps(a.z, inverse), zero) };
+}
+
+// acos within 7e-5 radians (Abramowitz and Stegun 4.4.45), x in [-1, 1]
+inline __m128 Acos(__m128 x)
+{
+    __m128 ax = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0187293f), ax), _mm_set1_ps(0.0742610f));
+    p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(-0.2121144f));
+    p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(1.5707288f));
+    __m128 r = _mm_mul_ps(p, _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), ax), _mm_setzero_ps())));
+    return Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159265f), r), r);
+}
+
+inline __m128 Gather(const std::vector<float>& stream, const unsigned int* vertex)
+{
+    return _mm_setr_ps(stream[vertex[0]], stream[vertex[1]], stream[vertex[2]], stream[vertex[3]]);
+}
+
+inline Vec3x4 Gather(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z, const unsigned int* vertex)
+{
+    return { Gather(x, vertex), Gather(y, vertex), Gather(z, vertex) };
+}
+
+// any unit vector perpendicular to n, for vertices no triangle gave a direction
+glm::vec3 Perpendicular(const glm::vec3& n)
+{
+    glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 t = glm::cross(n, axis);
+    float lengthSquared = glm::dot(t, t);
+    return lengthSquared > FLT_MIN ? t / std::sqrt(lengthSquared) : axis;
+}
+
+}
+
+void GenerateTangents(const TangentStreams& streams, const std::vector<unsigned int>& indices, std::vector<glm::vec4>& tangents)
+{
+    size_t vertexCount = streams.Size();
+    size_t triangleCount = indices.size() / 3;
+    tangents.assign(vertexCount, glm::vec4(0.0f));
+    if (vertexCount == 0)
+        return;
+
+    // one chunk of triangles per thread, each summing the weighted tangent and orientation of its corners
+    // into its own window of the vertices, so chunks never write the same memory
+    struct Chunk {
+        size_t firstTriangle, endTriangle;
+        unsigned int firstVertex, endVertex;
+        // weighted tangent xyz and orientation of every vertex in [firstVertex, endVertex)
+        std::vector<float> sums;
+    };
+    size_t blockCount = (triangleCount + 3) / 4;
+    int chunkCount = (int)std::max<size_t>(1, std::min<size_t>(JobSystem::ThreadCount(), blockCount / MIN_BLOCKS_PER_CHUNK));
+    std::vector<Chunk> chunks(chunkCount);
+    JobSystem::ParallelFor(chunkCount, 1, [&](int begin, int end) {
+        for (int c = begin; c < end; c++)
+        {
+            Chunk& chunk = chunks[c];
+            chunk.firstTriangle = blockCount * c / chunkCount * 4;
+            chunk.endTriangle = std::min(triangleCount, blockCount * (c + 1) / chunkCount * 4);
+            // meshes keep neighbouring triangles on neighbouring vertices, so windows stay small
+            chunk.firstVertex = (unsigned int)vertexCount;
+            chunk.endVertex = 0;
+            for (size_t i = chunk.firstTriangle * 3; i < chunk.endTriangle * 3; i++)
+            {
+                chunk.firstVertex = std::min(chunk.firstVertex, indices[i]);
+                chunk.endVertex = std::max(chunk.endVertex, indices[i] + 1);
+            }
+            if (chunk.endVertex <= chunk.firstVertex)
+                continue;
+            chunk.sums.assign((size_t)(chunk.endVertex - chunk.firstVertex) * 4, 0.0f);
+
+            for (size_t first = chunk.firstTriangle; first < chunk.endTriangle; first += 4)
+            {
+                int lanes = (int)std::min<size_t>(4, chunk.endTriangle - first);
+                // lanes past the last triangle repeat the first one and are not summed
+                unsigned int vertex[3][4];
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    size_t triangle = first + (lane < lanes ? lane : 0);
+                    for (int k = 0; k < 3; k++)
+                        vertex[k][lane] = indices[triangle * 3 + k];
+                }
+
+                Vec3x4 p[3];
+                __m128 u[3], v[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = Gather(streams.positionX, streams.positionY, streams.positionZ, vertex[k]);
+                    u[k] = Gather(streams.u, vertex[k]);
+                    v[k] = Gather(streams.v, vertex[k]);
+                }
+                Vec3x4 edge1 = Sub(p[1], p[0]);
+                Vec3x4 edge2 = Sub(p[2], p[0]);
+                __m128 du1 = _mm_sub_ps(u[1], u[0]), dv1 = _mm_sub_ps(v[1], v[0]);
+                __m128 du2 = _mm_sub_ps(u[2], u[0]), dv2 = _mm_sub_ps(v[2], v[0]);
+                __m128 det = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(du2, dv1));
+
+                // direction of increasing u. Dividing by det would only scale it, except for its sign, which
+                // says whether the UV mapping is mirrored and so which way the bitangent points
+                __m128 mirrored = _mm_and_ps(det, _mm_set1_ps(-0.0f));
+                Vec3x4 os = Sub(Scale(edge1, dv2), Scale(edge2, dv1));
+                os = { _mm_xor_ps(os.x, mirrored), _mm_xor_ps(os.y, mirrored), _mm_xor_ps(os.z, mirrored) };
+                __m128 orientation = _mm_xor_ps(_mm_set1_ps(1.0f), mirrored);
+
+                // triangles without area in space or in UV give no direction; NaNs fail both tests
+                Vec3x4 normal = Cross(edge1, edge2);
+                __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+                __m128 usable = _mm_and_ps(_mm_cmpgt_ps(absDet, _mm_set1_ps(FLT_MIN)), _mm_cmpgt_ps(Dot(normal, normal), _mm_set1_ps(FLT_MIN)));
+
+                // corners are weighted by their angle; the third is what the other two leave of pi
+                Vec3x4 side1 = NormalizeOrZero(edge1);
+                Vec3x4 side2 = NormalizeOrZero(edge2);
+                Vec3x4 side3 = NormalizeOrZero(Sub(p[2], p[1]));
+                __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+                __m128 angle[3];
+                angle[0] = Acos(_mm_max_ps(_mm_min_ps(Dot(side1, side2), one), minusOne));
+                angle[1] = Acos(_mm_max_ps(_mm_min_ps(_mm_sub_ps(_mm_setzero_ps(), Dot(side1, side3)), one), minusOne));
+                angle[2] = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(3.14159265f), angle[0]), angle[1]), _mm_setzero_ps());
+
+                for (int k = 0; k < 3; k++)
+                {
+                    // the direction projected into the tangent plane of the corner's normal
+                    Vec3x4 n = Gather(streams.normalX, streams.normalY, streams.normalZ, vertex[k]);
+                    Vec3x4 t = NormalizeOrZero(Reject(os, n));
+                    __m128 weight = _mm_and_ps(usable, angle[k]);
+                    __m128 x = _mm_mul_ps(t.x, weight), y = _mm_mul_ps(t.y, weight), z = _mm_mul_ps(t.z, weight);
+                    // the bitangent sign of a triangle wound against the vertex normal flips with it
+                    __m128 w = _mm_mul_ps(_mm_xor_ps(orientation, _mm_and_ps(Dot(normal, n), _mm_set1_ps(-0.0f))), weight);
+                    // one register per lane, ready to add to the lane's vertex
+                    _MM_TRANSPOSE4_PS(x, y, z, w);
+                    __m128 lanes4[4] = { x, y, z, w };
+                    for (int lane = 0; lane < lanes; lane++)
+                    {
+                        float* sum = &chunk.sums[(size_t)(vertex[k][lane] - chunk.firstVertex) * 4];
+                        _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), lanes4[lane]));
+                    }
+                }
+            }
+        }
+    });
+
+    // every vertex adds up the chunks that reached it; jobs own disjoint vertex ranges
+    JobSystem::ParallelFor((int)vertexCount, MIN_VERTICES_PER_BATCH, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            glm::vec4 sum(0.0f);
+            for (const Chunk& chunk : chunks)
+            {
+                if ((unsigned int)i < chunk.firstVertex || (unsigned int)i >= chunk.endVertex)
+                    continue;
+                const float* chunkSum = &chunk.sums[(size_t)(i - chunk.firstVertex) * 4];
+                sum += glm::vec4(chunkSum[0], chunkSum[1], chunkSum[2], chunkSum[3]);
+            }
+            glm::vec3 t(sum);
+            glm::vec3 n(streams.normalX[i], streams.normalY[i], streams.normalZ[i]);
+            float normalLengthSquared = glm::dot(n, n);
+            n = normalLengthSquared > FLT_MIN ? n / std::sqrt(normalLengthSquared) : glm::vec3(0.0f);
+
+            t -= n * glm::dot(n, t);
+            float lengthSquared = glm::dot(t, t);
+            t = lengthSquared > FLT_MIN ? t / std::sqrt(lengthSquared) : Perpendicular(n);
+            // vertices shared by mirrored and unmirrored triangles go with the larger angle
+            float handedness = sum.w < 0.0f ? -1.0f : 1.0f;
+            tangents[i] = glm::vec4(t, handedness);
+        }
+    });
+}
+
+void GenerateTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    TangentStreams streams;
+    std::vector<float>* components[8] = { &streams.positionX, &streams.positionY, &streams.positionZ,
+        &streams.normalX, &streams.normalY, &streams.normalZ, &streams.u, &streams.v };
+    for (std::vector<float>* component : components)
+        component->resize(vertices.size());
+    JobSystem::ParallelFor((int)vertices.size(), MIN_VERTICES_PER_BATCH, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            const Vertex& vertex = vertices[i];
+            streams.positionX[i] = vertex.Position.x;
+            streams.positionY[i] = vertex.Position.y;
+            streams.positionZ[i] = vertex.Position.z;
+            streams.normalX[i] = vertex.Normal.x;
+            streams.normalY[i] = vertex.Normal.y;
+            streams.normalZ[i] = vertex.Normal.z;
+            streams.u[i] = vertex.TexCoords.x;
+            streams.v[i] = vertex.TexCoords.y;
+        }
+    });
+
+    std::vector<glm::vec4> tangents;
+    GenerateTangents(streams, indices, tangents);
+    JobSystem::ParallelFor((int)vertices.size(), MIN_VERTICES_PER_BATCH, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            glm::vec3 t(tangents[i]);
+            glm::vec3 n = vertices[i].Normal;
+            float normalLengthSquared = glm::dot(n, n);
+            n = normalLengthSquared > FLT_MIN ? n / std::sqrt(normalLengthSquared) : glm::vec3(0.0f);
+            vertices[i].Tangent = t;
+            vertices[i].Bitangent = tangents[i].w * glm::cross(n, t);
+        }
+    });
+}
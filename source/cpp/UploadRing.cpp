@@ -0,0 +1,154 @@
+#include "../header/UploadRing.h"
+#include "../header/GLCaps.h"
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+UploadRing::UploadRing(GLenum target, size_t frameBytes, int frames)
+    : target(target), frames(frames), current(frames - 1)
+{
+    GLint offsetAlignment = 16;
+    if (target == GL_UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    alignment = offsetAlignment > 0 ? (size_t)offsetAlignment : 16;
+    this->frameBytes = AlignUp(frameBytes, alignment);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    // glad only loads glBufferStorage for a 4.4 context; on 3.3 the extension's entry point is fetched here
+    persistent = HasGLExtension("GL_ARB_buffer_storage");
+    if (persistent && !glBufferStorage)
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    persistent = persistent && glBufferStorage != nullptr;
+    if (persistent)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr totalBytes = (GLsizeiptr)(this->frameBytes * frames);
+        glBufferStorage(target, totalBytes, nullptr, flags);
+        memory = (unsigned char*)glMapBufferRange(target, 0, totalBytes, flags);
+        if (!memory)
+        {
+            std::cout << "ERROR::UPLOAD_RING::MAP_FAILED, falling back to orphaning" << std::endl;
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+            persistent = false;
+        }
+    }
+    if (persistent)
+    {
+        fences.assign(frames, nullptr);
+    }
+    else
+    {
+        this->frames = 1;
+        current = 0;
+        staging.resize(this->frameBytes);
+        memory = staging.data();
+        glBufferData(target, (GLsizeiptr)this->frameBytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(target, 0);
+}
+
+UploadRing::~UploadRing()
+{
+    for (GLsync fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    if (persistent)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void UploadRing::BeginFrame()
+{
+    lastFrame = frame;
+    frame = Stats();
+    head = 0;
+    flushed = 0;
+    overflowReported = false;
+
+    if (!persistent)
+    {
+        // orphan: the driver hands out fresh storage while draws of earlier frames still read the old one
+        glBindBuffer(target, buffer);
+        glBufferData(target, (GLsizeiptr)frameBytes, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(target, 0);
+        return;
+    }
+
+    current = (current + 1) % frames;
+    GLsync& fence = fences[current];
+    if (!fence)
+        return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        // the GPU is still reading the region written `frames` frames ago
+        auto start = std::chrono::high_resolution_clock::now();
+        frame.stalls++;
+        do
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        while (status == GL_TIMEOUT_EXPIRED);
+        frame.stallMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    if (status == GL_WAIT_FAILED)
+        std::cout << "ERROR::UPLOAD_RING::FENCE_WAIT_FAILED" << std::endl;
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void* UploadRing::Allocate(size_t size, size_t& offset)
+{
+    size_t allocated = AlignUp(size, alignment);
+    if (head + allocated > frameBytes)
+    {
+        if (!overflowReported)
+            std::cout << "ERROR::UPLOAD_RING::FRAME_FULL: " << frameBytes << " bytes per frame" << std::endl;
+        overflowReported = true;
+        return nullptr;
+    }
+    size_t regionStart = persistent ? current * frameBytes : 0;
+    offset = regionStart + head;
+    void* data = memory + offset;
+    head += allocated;
+    frame.bytes += allocated;
+    return data;
+}
+
+void UploadRing::Flush()
+{
+    // a coherent mapping is visible to the GPU as soon as the commands that read it are issued
+    if (persistent || flushed == head)
+        return;
+    glBindBuffer(target, buffer);
+    glBufferSubData(target, (GLintptr)flushed, (GLsizeiptr)(head - flushed), staging.data() + flushed);
+    glBindBuffer(target, 0);
+    flushed = head;
+}
+
+void UploadRing::EndFrame()
+{
+    Flush();
+    if (persistent)
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // nothing fits until the next BeginFrame
+    head = frameBytes;
+    flushed = frameBytes;
+}
@@ -0,0 +1,110 @@
+#include "../header/VertexWeld.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace {
+
+const int KEY_SIZE = 14;
+const uint32_t EMPTY = 0xFFFFFFFFu;
+
+// one grid spacing, as its inverse, per key component; zero compares exactly
+struct Grid {
+    float inverseSpacing[KEY_SIZE];
+
+    explicit Grid(const WeldTolerances& tolerances)
+    {
+        const float spacing[KEY_SIZE] = { tolerances.position, tolerances.position, tolerances.position,
+            tolerances.normal, tolerances.normal, tolerances.normal, tolerances.texCoord, tolerances.texCoord,
+            tolerances.tangent, tolerances.tangent, tolerances.tangent, tolerances.tangent, tolerances.tangent, tolerances.tangent };
+        for (int k = 0; k < KEY_SIZE; k++)
+            inverseSpacing[k] = spacing[k] > 0.0f ? 1.0f / spacing[k] : 0.0f;
+    }
+};
+
+int32_t Snap(float value, float inverseSpacing)
+{
+    float cell = value * inverseSpacing;
+    // exact comparison, or values too large (or NaN) for the grid: the bits themselves
+    if (inverseSpacing == 0.0f || !(std::fabs(cell) < 1.0e9f))
+    {
+        int32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    // nearest cell, in one instruction
+    return _mm_cvtss_si32(_mm_set_ss(cell));
+}
+
+// the components in Vertex order: position, normal, UV, tangent, bitangent
+void SnapVertex(const Vertex& vertex, const Grid& grid, int32_t* key)
+{
+    static_assert(sizeof(Vertex) == KEY_SIZE * sizeof(float), "Vertex holds exactly the welded attributes");
+    const float* components = &vertex.Position.x;
+    for (int k = 0; k < KEY_SIZE; k++)
+        key[k] = Snap(components[k], grid.inverseSpacing[k]);
+}
+
+uint32_t HashKey(const int32_t* key)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    for (int k = 0; k < KEY_SIZE; k += 2)
+    {
+        hash ^= (uint64_t)(uint32_t)key[k] | (uint64_t)(uint32_t)key[k + 1] << 32;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 29;
+    }
+    return (uint32_t)(hash ^ hash >> 32);
+}
+
+// the kept vertex a slot holds and its full hash, so most mismatches are rejected without the key
+struct Slot {
+    uint32_t vertex;
+    uint32_t hash;
+};
+
+}
+
+size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const WeldTolerances& tolerances)
+{
+    size_t vertexCount = vertices.size();
+    if (vertexCount == 0)
+        return 0;
+
+    Grid grid(tolerances);
+    // snapped keys of the kept vertices, so probes compare without snapping again
+    std::vector<int32_t> keys;
+    // power of two at least twice the vertex count, probed linearly
+    size_t capacity = 1;
+    while (capacity < vertexCount * 2)
+        capacity <<= 1;
+    std::vector<Slot> table(capacity, Slot{ EMPTY, 0 });
+
+    std::vector<unsigned int> remap(vertexCount);
+    size_t kept = 0;
+    int32_t key[KEY_SIZE];
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        SnapVertex(vertices[i], grid, key);
+        uint32_t hash = HashKey(key);
+        size_t slot = hash & (capacity - 1);
+        while (table[slot].vertex != EMPTY &&
+            (table[slot].hash != hash || std::memcmp(&keys[(size_t)table[slot].vertex * KEY_SIZE], key, sizeof(key)) != 0))
+            slot = (slot + 1) & (capacity - 1);
+        if (table[slot].vertex == EMPTY)
+        {
+            table[slot] = Slot{ (uint32_t)kept, hash };
+            keys.insert(keys.end(), key, key + KEY_SIZE);
+            // kept vertices move down in place; the slot written is never ahead of the one read
+            vertices[kept++] = vertices[i];
+        }
+        remap[i] = table[slot].vertex;
+    }
+
+    vertices.resize(kept);
+    for (unsigned int& index : indices)
+        index = remap[index];
+    return vertexCount - kept;
+}
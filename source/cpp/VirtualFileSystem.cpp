@@ -0,0 +1,77 @@
+#include "../header/VirtualFileSystem.h"
+#include "../header/Lz4.h"
+
+#include <iostream>
+
+std::vector<std::unique_ptr<AssetArchive>> VirtualFileSystem::archives;
+
+bool VirtualFileSystem::Mount(const std::string& archivePath)
+{
+    std::unique_ptr<AssetArchive> archive(new AssetArchive());
+    if (!archive->Open(archivePath))
+        return false;
+    std::cout << "VFS: mounted " << archivePath << " (" << archive->EntryCount() << " entries)" << std::endl;
+    archives.push_back(std::move(archive));
+    return true;
+}
+
+void VirtualFileSystem::UnmountAll()
+{
+    archives.clear();
+}
+
+bool VirtualFileSystem::Open(const std::string& path, AssetFile& file)
+{
+    file.data = nullptr;
+    file.size = 0;
+    file.fromArchive = false;
+    file.decompressed.clear();
+    file.loose.Close();
+
+    if (!archives.empty())
+    {
+        std::string normalized = NormalizeAssetPath(path);
+        for (auto archive = archives.rbegin(); archive != archives.rend(); ++archive)
+        {
+            int index = (*archive)->Find(normalized);
+            if (index < 0)
+                continue;
+            const ArchiveEntry& entry = (*archive)->Entry(index);
+            file.fromArchive = true;
+            file.size = (size_t)entry.size;
+            if (entry.compression == ARCHIVE_STORED)
+            {
+                file.data = (*archive)->StoredData(index);
+                return true;
+            }
+            file.decompressed.resize(file.size);
+            if (!Lz4Decompress((*archive)->StoredData(index), (size_t)entry.storedSize, file.decompressed.data(), file.size))
+            {
+                std::cout << "ERROR::VFS::Corrupt archive entry " << normalized << std::endl;
+                file.decompressed.clear();
+                file.size = 0;
+                return false;
+            }
+            file.data = file.decompressed.data();
+            return true;
+        }
+    }
+
+    if (!file.loose.Open(path))
+        return false;
+    file.data = file.loose.Data();
+    file.size = file.loose.Size();
+    return true;
+}
+
+bool VirtualFileSystem::Exists(const std::string& path)
+{
+    std::string normalized = NormalizeAssetPath(path);
+    for (const std::unique_ptr<AssetArchive>& archive : archives)
+    {
+        if (archive->Find(normalized) >= 0)
+            return true;
+    }
+    MappedFile loose;
+    return loose.Open(path);
+}
@@ -3,14 +3,35 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
 #include "../header/Shader.h"
+#include "../header/GLState.h"
 #include "../header/stb_image.h"
 #include"../header/Camera.h"
 #include "../header/Model.h"
 #include "../header/Mesh.h"
 #include "../header/Arrow.h"
 #include "../header/ShaderPath.h"
+#include "../header/CascadedShadowMap.h"
+#include "../header/ShadowAtlas.h"
+#include "../header/BloomRenderer.h"
+#include "../header/RenderGraph.h"
+#include "../header/OcclusionCuller.h"
+#include "../header/BVH.h"
+#include "../header/SceneGraph.h"
+#include "../header/ECS.h"
+#include "../header/JobSystem.h"
+#include "../header/FramePipeline.h"
+#include "../header/UploadRing.h"
+#include "../header/FrameArena.h"
+#include "../header/AllocationCounter.h"
+#include "../header/SpatialIndex.h"
+#include "../header/Systems.h"
+#include "../header/Benchmark.h"
+#include "../header/VirtualFileSystem.h"
 
 enum RenderMode {
     DEFAULT,
@@ -29,12 +50,13 @@ void generateSphere(float radius, int sectorCount, int stackCount,
     std::vector<unsigned int>& indices);
 unsigned int loadTexture(char const* path);
 unsigned int loadCubemap(std::vector<std::string> faces);
-void renderPointLights(Shader& lightShader, int numLights, unsigned int& lightVAO);
+void renderPointLights(Shader& lightShader, int numLights, unsigned int& lightVAO, FunctionRef<bool(int)> bindDrawData);
 void renderFloor(Shader& floorShader, unsigned int& planeVAO);
-void setUpMVP(glm::mat4& view, glm::mat4& projection, glm::mat4& model, glm::mat4& lightProjection, glm::mat4& lightView, glm::mat4& lightSpaceMatrix);
-void createDepthCubeMapTransforms(float near_plane, float far_plane, glm::vec3 lightPos, std::vector<glm::mat4>& shadowTransforms);
-void loadPointLightsToShader(Shader& shader, const int numLights);
-void generateObjectPositions(std::vector<glm::vec3>& objectPositions);
+void setUpMVP(glm::mat4& view, glm::mat4& projection, glm::mat4& model);
+void loadPointLightsToShader(Shader& shader, const std::vector<PointLight>& lights);
+void loadDirLightToShader(Shader& shader, const DirectionalLight& light);
+void spawnPointLights(World& world);
+void generateObjectPositions(std::vector<glm::vec3>& objectPositions, int count);
 void renderQuad(const unsigned int quadVAO);
 
 //texture paths
@@ -191,7 +213,6 @@ const unsigned int windowHeight = 600;
 const unsigned int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
 
 float windowAspect = (float)windowWidth / (float)windowHeight;
-float shadowAspect = (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT;
 
 //Camera Vars
 float fov = 45.0f;
@@ -207,55 +228,12 @@ float magnitude = 0.4f;
 float deltaTime = 0.0f;	
 float lastFrame = 0.0f;
 
-//DirLight Vars
-glm::vec3 dirLightDirection(0, 0, -1.0f);
-glm::vec3 dirLightAmbient(0.2f, 0.2f, 0.2f);
-glm::vec3 dirLightDiffuse(0.5f, 0.5f, 0.5f);
-glm::vec3 dirLightSpecular(1.0f, 1.0f, 1.0f);
-float near_plane = 0.1f;
-float far_plane = 50.0f;
-
-//PointLight Vars
-glm::vec3 pointLightPositions[] = {
-    glm::vec3(0.7f,  3.0f,  2.0f),
-    glm::vec3(2.3f, 3.0f, -4.0f),
-    glm::vec3(-4.0f,  2.0f, -12.0f),
-    glm::vec3(0.0f,  3.0f, -3.0f)
-};
-
-glm::vec3 pointLightAmbients[] = {
-    glm::vec3(0.2f,  0.2f,  0.2f),
-    glm::vec3(0.2f,  0.0f,  0.0f),
-    glm::vec3(0.0f,  0.2f,  0.0f),
-    glm::vec3(0.0f,  0.0f,  0.2f)
-};
-
-glm::vec3 pointLightDiffuses[] = {
-    glm::vec3(0.3f,  0.3f,  0.3f),  
-    glm::vec3(0.3f,  0.0f,  0.0f),
-    glm::vec3(0.0f,  0.3f,  0.0f),
-    glm::vec3(0.0f,  0.0f,  0.3f)
-};
-
-glm::vec3 pointLightSpeculars[] = {
-    glm::vec3(0.5f,  0.5f,  0.5f),  
-    glm::vec3(0.5f,  0.0f,  0.0f),
-    glm::vec3(0.0f,  0.5f,  0.0f),
-    glm::vec3(0.0f,  0.0f,  0.5f)
-};
-
-glm::vec3 pointLightHDRColors[] = {
-    glm::vec3(5.0f,  5.0f,  5.0f),    // white light with normal intensity
-    glm::vec3(10.0f,  0.0f,  0.0f),    // bright red
-    glm::vec3(0.0f,  15.0f,  0.0f),    // bright green
-    glm::vec3(0.0f,  0.0f,  15.0f)     // bright blue
-};
+//distance from the camera covered by the shadow cascades
+float shadowDistance = 50.0f;
 
-float pointLightConstants[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-float pointLightLinears[] = { 0.14f, 0.14f, 0.14f, 0.14f };
-float pointLightQuadratics[] = { 0.07f, 0.07f, 0.07f, 0.07f };
-
-std::vector<glm::vec3> objectPositions;
+//world bounds of the floor plane drawn by renderFloor
+const AABB floorBounds(glm::vec3(-25.0f, -2.0f, -25.0f), glm::vec3(25.0f, -2.0f, 25.0f));
+const glm::mat4 floorModel = glm::translate(glm::mat4(1.0f), glm::vec3(0, -1.5f, 0));
 
 std::vector<float> sphereVertices;
 std::vector<unsigned int> sphereIndices;
@@ -267,20 +245,137 @@ bool firstMouse = true;
 //Render Mode
 RenderMode mRenderMode = DEFAULT;
 bool shadows = true;
+ShadowFilter shadowFilter = ShadowFilter::EVSM;
+bool dumpRenderGraph = false;
+bool occlusionCulling = true;
+//Shade the objects in a forward pass with per-object light lists instead of through the G-buffer
+bool forwardShading = false;
+bool pickRequested = false;
+bool wireframe = false;
 float exposure = 0.3f;
+//set by framebuffer_size_callback, applied by the render thread
+int framebufferWidth = windowWidth, framebufferHeight = windowHeight;
+
+//Frames the game thread may run ahead of the render thread, "--pipeline-depth N"
+int pipelineDepth = 2;
+//Objects in the scene, "--objects N", laid out on a square grid
+int objectCount = 9;
+//Largest simplification error allowed on screen in pixels, "--lod-error N"; shadow maps allow more
+float lodErrorPixels = 1.0f;
+const float shadowLodErrorScale = 4.0f;
+
+//One mesh to draw with its world matrix and the levels of detail picked for the camera and for shadows.
+//At full resolution the meshlets that survived culling for the camera and for the sun are
+//meshletRanges[firstRange, firstRange + rangeCount) and [firstSunRange, firstSunRange + sunRangeCount);
+//-1 draws the whole level of detail
+struct DrawPacket {
+    const Mesh* mesh;
+    glm::mat4 model;
+    int lod;
+    int shadowLod;
+    int firstRange;
+    int rangeCount;
+    int firstSunRange;
+    int sunRangeCount;
+};
+
+//The views a mesh is drawn for; each picks its level of detail and meshlet ranges
+enum class DrawView { Camera, SunShadow, PointShadow };
+
+//One object; its meshes are draws[firstDraw, firstDraw + drawCount)
+struct ObjectPacket {
+    AABB bounds;
+    glm::mat4 transform;
+    int firstDraw;
+    int drawCount;
+    bool visible;
+    //point lights reaching the object, for forward shading
+    LightList lights;
+};
+
+struct ArrowPacket {
+    glm::vec3 direction;
+    glm::vec3 position;
+    float length;
+    glm::vec3 color;
+};
+
+//Per-draw constants in the upload ring, std140 layout of the DrawData block (include/drawData.glsl)
+struct DrawData {
+    glm::mat4 model;
+    glm::vec4 color;
+    //forward shading: indices into pointLights[] and how many, -1 for all of them
+    glm::ivec4 lights[MAX_OBJECT_LIGHTS / 4];
+    int lightCount;
+    int padding[3];
+};
+
+//Measured by the render thread
+struct FrameStats {
+    float renderMs = 0.0f;
+    unsigned int stateCallsIssued = 0;
+    unsigned int stateCallsFiltered = 0;
+    size_t drawDataBytes = 0;
+    unsigned int drawDataStalls = 0;
+    float drawDataStallMs = 0.0f;
+    //heap allocations made by the render thread during the frame; zero once everything is warmed up
+    unsigned long long allocations = 0;
+};
+
+//Everything the render thread needs for one frame, copied out of the game state once it is simulated
+struct FrameSnapshot {
+    glm::mat4 view, projection, model;
+    glm::vec3 cameraPos;
+    float fov, near, far, aspect;
+    DirectionalLight sun;
+    std::vector<PointLight> pointLights;
+    std::vector<ObjectPacket> objects;
+    std::vector<DrawPacket> draws;
+    std::vector<IndexRange> meshletRanges;
+    std::vector<ArrowPacket> arrows;
+    RenderMode renderMode;
+    bool forwardShading;
+    bool shadows;
+    ShadowFilter shadowFilter;
+    float exposure;
+    bool wireframe;
+    bool dumpRenderGraph;
+    int framebufferWidth, framebufferHeight;
+    //tells the render thread to stop
+    bool quit = false;
+    FrameStats stats;
+};
 
 //Matricies
 glm::mat4 view = glm::mat4(1.0f);
 glm::mat4 projection = glm::mat4(1.0f);
 glm::mat4 model = glm::mat4(1.0f);
-glm::mat4 lightProjection = glm::mat4(1.0f);
-glm::mat4 lightView = glm::mat4(1.0f);
-glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
 
-std::vector<glm::mat4> shadowTransforms;
-
-int main()
+int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+        return RunBenchmarks(argc, argv);
+    //--pack <archive> [files or directories...], the resources directory by default
+    if (argc > 2 && std::string(argv[1]) == "--pack")
+    {
+        std::vector<std::string> inputs(argv + 3, argv + argc);
+        if (inputs.empty())
+            inputs.push_back("resources");
+        return PackArchive(argv[2], inputs) ? 0 : 1;
+    }
+    std::string archivePath = "resources.pak";
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--pipeline-depth")
+            pipelineDepth = std::max(1, std::atoi(argv[i + 1]));
+        if (std::string(argv[i]) == "--objects")
+            objectCount = std::max(1, std::atoi(argv[i + 1]));
+        if (std::string(argv[i]) == "--lod-error")
+            lodErrorPixels = (float)std::atof(argv[i + 1]);
+        if (std::string(argv[i]) == "--archive")
+            archivePath = argv[i + 1];
+    }
+    //assets come from the archive when there is one, loose files otherwise
+    VirtualFileSystem::Mount(archivePath);
 
     generateSphere(1.0f, 36, 18, sphereVertices, sphereIndices);
 
@@ -317,6 +412,9 @@ int main()
         return -1;
     }
 
+    //Workers for loading, culling and system updates; GL stays on this thread
+    JobSystem::Initialize();
+
     //Load SkyBox
     unsigned int cubemapTexture = loadCubemap(faces);
 
@@ -324,16 +422,41 @@ int main()
     stbi_set_flip_vertically_on_load(true);
     //Load Model
     Model ourModel(backpackPath);
-    //Generate Model positions
-    generateObjectPositions(objectPositions);
+    //Scene entities: objects, lights and the debug arrow
+    World world;
+    //Scene graph: a node per object with the model's own hierarchy below it
+    SceneGraph sceneGraph;
+    std::vector<MeshInstance> meshInstances;
+    std::vector<glm::vec3> objectPositions;
+    generateObjectPositions(objectPositions, objectCount);
+    for (const glm::vec3& position : objectPositions)
+    {
+        int firstInstance = (int)meshInstances.size();
+        SceneNode node = ourModel.Instantiate(sceneGraph, -1, glm::translate(glm::mat4(1.0f), position), meshInstances);
+        Renderable renderable = { &ourModel, firstInstance, (int)meshInstances.size() - firstInstance, true };
+        world.Create(Transform{ node }, WorldTransform{ glm::mat4(1.0f) }, Bounds{ ourModel.bounds, AABB() }, renderable, SpatialProxy{ -1 }, LightList{});
+    }
+    spawnPointLights(world);
+    Entity sun = world.Create(
+        DirectionalLight{ glm::vec3(0, 0, -1.0f), glm::vec3(0.2f, 0.2f, 0.2f), glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(1.0f, 1.0f, 1.0f) },
+        DebugArrow{ glm::vec3(2, 5, -5), 2.0f, glm::vec3(1, 0, 0) });
+    sceneGraph.Update();
+    UpdateTransforms(world, sceneGraph);
+    UpdateBounds(world);
+    //Spatial index over the objects' world bounds, used for culling and picking
+    SpatialIndex spatialIndex;
+    world.Each<Bounds, SpatialProxy>([&](Entity entity, Bounds& bounds, SpatialProxy& proxy) {
+        proxy.proxy = spatialIndex.Insert(bounds.world, entity);
+    });
+    //Per-object light lists for forward shading, from the index
+    LightAssignment lightAssignment;
 
 
     //Enable z-test and face culling
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    GLState::Enable(GL_DEPTH_TEST);
+    GLState::Enable(GL_CULL_FACE);
 
     //Init Shaders
-    Shader ourShader = CreateShader("3.3.shader");
     Shader lightShader = CreateShader("lightShader");
     Shader arrowShader = CreateShader("arrowShader");
     Shader screenShader = CreateShader("screenShader");
@@ -342,64 +465,51 @@ int main()
     Shader normalDisplayShader = CreateShader("normalDisplay", true);  // true for geometry shader
     Shader simpleDepthShader = CreateShader("simpleDepthShader");
     Shader debugQuadShader = CreateShader("debugQuad");
-    Shader floorShader = CreateShader("floorShader");
-    Shader pointShadowDepthShader = CreateShader("pointShadowDepth", true);  // true for geometry shader
     Shader blurShader = CreateShader("blur");
-    Shader gBufferShader = CreateShader("gBuffer");
-    Shader deferredShader = CreateShader("deferredShading");
-
-    //GBuffer for Deferred rendering
-    unsigned int gBuffer;
-    glGenFramebuffers(1, &gBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-    unsigned int gPosition, gNormal, gAlbedoSpec;
-
-    // - position color buffer
-    glGenTextures(1, &gPosition);
-    glBindTexture(GL_TEXTURE_2D, gPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, windowWidth, windowHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-
-    // - normal color buffer
-    glGenTextures(1, &gNormal);
-    glBindTexture(GL_TEXTURE_2D, gNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, windowWidth, windowHeight, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-
-    // - color + specular color buffer
-    glGenTextures(1, &gAlbedoSpec);
-    glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedoSpec, 0);
-
-    // - tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
-    unsigned int gBufferAttachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-    glDrawBuffers(3, gBufferAttachments);
-
-    // Add depth buffer to gBuffer
-    unsigned int gDepth;
-    glGenRenderbuffers(1, &gDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, gDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, windowWidth, windowHeight);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gDepth);
-
-    // Check if framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    Shader evsmBlurShader = CreateShader("blur", false, { {"SOURCE_ARRAY", 1}, {"EVSM_WARP", 1} });
+    Shader bloomDownsampleShader = CreateShader("bloomDownsample");
+    Shader bloomUpsampleShader = CreateShader("bloomUpsample");
+
+    //Shader permutations, compiled up front and picked per draw instead of branching in the shader
+    const std::vector<ShaderDefines> shadowVariants = { {{"SHADOWS", 0}}, {{"SHADOWS", 1}}, {{"SHADOWS", 1}, {"SHADOW_EVSM", 1}} };
+    const ShaderDefines gBufferTexturedDefines = { {"NORMAL_MAP", 1}, {"DIFFUSE_MAP", 1} };
+    const ShaderDefines gBufferFloorDefines = { {"NORMAL_MAP", 0}, {"DIFFUSE_MAP", 1} };
+    const ShaderDefines gBufferFlatDefines = { {"NORMAL_MAP", 0}, {"DIFFUSE_MAP", 0} };
+    ShaderVariantCache ourShaders("3.3.shader");
+    ShaderVariantCache floorShaders("floorShader");
+    ShaderVariantCache deferredShaders("deferredShading");
+    ShaderVariantCache gBufferShaders("gBuffer");
+    ourShaders.Prewarm(shadowVariants);
+    floorShaders.Prewarm(shadowVariants);
+    deferredShaders.Prewarm(shadowVariants);
+    gBufferShaders.Prewarm({ gBufferTexturedDefines, gBufferFloorDefines, gBufferFlatDefines });
+
+    //Frame render graph; the gBuffer and lighting targets are transient textures owned by it
+    RenderGraph renderGraph;
+    RGTextureDesc gPositionDesc;
+    gPositionDesc.width = windowWidth;
+    gPositionDesc.height = windowHeight;
+    gPositionDesc.internalFormat = GL_RGBA16F;
+    gPositionDesc.format = GL_RGBA;
+    gPositionDesc.type = GL_FLOAT;
+    RGTextureDesc gNormalDesc = gPositionDesc;
+    gNormalDesc.internalFormat = GL_RGB16F;
+    gNormalDesc.format = GL_RGB;
+    RGTextureDesc gAlbedoSpecDesc = gPositionDesc;
+    gAlbedoSpecDesc.internalFormat = GL_RGBA;
+    gAlbedoSpecDesc.type = GL_UNSIGNED_BYTE;
+    RGTextureDesc depthDesc = gPositionDesc;
+    depthDesc.internalFormat = GL_DEPTH_COMPONENT24;
+    depthDesc.format = GL_DEPTH_COMPONENT;
+    RGTextureDesc sceneColorDesc = gPositionDesc;
+    sceneColorDesc.filter = GL_LINEAR;
 
     //Light Buffers
     unsigned int lightVAO, lightVBO, lightEBO;
     glGenVertexArrays(1, &lightVAO);
     glGenBuffers(1, &lightVBO);
     glGenBuffers(1, &lightEBO);
-    glBindVertexArray(lightVAO);
+    GLState::BindVertexArray(lightVAO);
     glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
     glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), &sphereVertices[0], GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lightEBO);
@@ -414,7 +524,7 @@ int main()
     unsigned int quadVAO, quadVBO;
     glGenVertexArrays(1, &quadVAO);
     glGenBuffers(1, &quadVBO);
-    glBindVertexArray(quadVAO);
+    GLState::BindVertexArray(quadVAO);
     glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -426,7 +536,7 @@ int main()
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    GLState::BindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -437,7 +547,7 @@ int main()
     unsigned int planeVBO;
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
+    GLState::BindVertexArray(planeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -446,113 +556,71 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // configure second post-processing framebuffer
-    unsigned int intermediateFBO;
-    glGenFramebuffers(1, &intermediateFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-    // create a color attachment texture
-    unsigned int screenTextures[2];
-    glGenTextures(2, screenTextures);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, screenTextures[i]);
-        glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGBA16F, windowWidth, windowHeight, 0, GL_RGBA, GL_FLOAT, NULL
-        );
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        // attach texture to framebuffer
-        glFramebufferTexture2D(
-            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, screenTextures[i], 0
-        );
-    }
-    unsigned int intermediateAttachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, intermediateAttachments);
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, windowWidth, windowHeight);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // ping-pong-framebuffer for blurring
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, windowWidth, windowHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
-        // also check if framebuffers are complete (no need for depth buffer)
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    //Shadow Buffer
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 
-                 SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    //Tell openGL to use our shader
-    ourShader.use();
-    ourShader.setVec3("dirLight.direction", dirLightDirection);
-    ourShader.setVec3("dirLight.ambient", dirLightAmbient);
-    ourShader.setVec3("dirLight.diffuse", dirLightDiffuse);
-    ourShader.setVec3("dirLight.specular", dirLightSpecular);
-    floorShader.use();
-    floorShader.setVec3("dirLight.direction", dirLightDirection);
-    floorShader.setVec3("dirLight.ambient", dirLightAmbient);
-    floorShader.setVec3("dirLight.diffuse", dirLightDiffuse);
-    floorShader.setVec3("dirLight.specular", dirLightSpecular);
+    GLState::BindVertexArray(0);
+
+    // bloom mip chain, from half resolution down
+    BloomRenderer bloom(windowWidth, windowHeight);
+
+    //Shadow Buffer: one array layer per cascade
+    CascadedShadowMap cascadedShadowMap(SHADOW_WIDTH);
+
+    //Point light shadows: every shadowed light gets six face tiles in one atlas, refreshed within a per-frame budget
+    ShadowAtlas shadowAtlas;
+    Shader pointShadowDepthShader = CreateShader("pointShadowDepth");
+    std::vector<ShadowCaster> shadowCasters;
+
+    //CPU occlusion culling: the floor and the simplified backpacks hide objects from the gBuffer pass
+    OcclusionCuller occlusionCuller;
+    OccluderMesh floorOccluder;
+    floorOccluder.vertices = {
+        glm::vec3(floorBounds.min.x, floorBounds.min.y, floorBounds.min.z),
+        glm::vec3(floorBounds.max.x, floorBounds.min.y, floorBounds.min.z),
+        glm::vec3(floorBounds.max.x, floorBounds.min.y, floorBounds.max.z),
+        glm::vec3(floorBounds.min.x, floorBounds.min.y, floorBounds.max.z)
+    };
+    floorOccluder.indices = { 0, 1, 2, 0, 2, 3 };
 
     //load floor texture
     unsigned int woodTexture = loadTexture(floorDiffusePathCstr);
 
-    //Load Point Lights
-    int numLights = sizeof(pointLightPositions) / sizeof(pointLightPositions[0]);
-    loadPointLightsToShader(ourShader, numLights);
-    loadPointLightsToShader(floorShader, numLights);
-    loadPointLightsToShader(deferredShader, numLights);
+    //Point lights packed for the static uniforms
+    std::vector<PointLight> pointLights;
+    PackPointLights(world, pointLights);
 
     //Create Arrow
     Arrow arrow = Arrow();
 
-    //Set texture sampler indicies
-    ourShader.use();
-    ourShader.setInt("shadowMap", 4);
-    ourShader.setInt("shadowCubeMap", 5);
+    //Static uniforms and texture sampler indicies, applied to every compiled permutation
+    ourShaders.ForEach([&](Shader& ourShader) {
+        loadDirLightToShader(ourShader, *world.Get<DirectionalLight>(sun));
+        loadPointLightsToShader(ourShader, pointLights);
+        ourShader.use();
+        ourShader.setInt("shadowMap", 4);
+        ourShader.setInt("shadowAtlas", 5);
+        ourShader.setInt("shadowMoments", 6);
+    });
+
+    floorShaders.ForEach([&](Shader& floorShader) {
+        loadDirLightToShader(floorShader, *world.Get<DirectionalLight>(sun));
+        loadPointLightsToShader(floorShader, pointLights);
+        floorShader.use();
+        floorShader.setInt("diffuseTexture", 0);
+        floorShader.setInt("shadowMap", 1);
+        floorShader.setInt("shadowAtlas", 2);
+        floorShader.setInt("shadowMoments", 3);
+    });
+
+    deferredShaders.ForEach([&](Shader& deferredShader) {
+        loadDirLightToShader(deferredShader, *world.Get<DirectionalLight>(sun));
+        loadPointLightsToShader(deferredShader, pointLights);
+        deferredShader.use();
+        deferredShader.setInt("gPosition", 0);
+        deferredShader.setInt("gNormal", 1);
+        deferredShader.setInt("gAlbedoSpec", 2);
+        deferredShader.setInt("shadowMap", 3);
+        deferredShader.setInt("shadowAtlas", 4);
+        deferredShader.setInt("shadowMoments", 5);
+    });
 
     screenShader.use();
     screenShader.setInt("screenTexture", 0);
@@ -564,285 +632,615 @@ int main()
     debugQuadShader.use();
     debugQuadShader.setInt("screenTexture", 0);
 
-    floorShader.use();
-    floorShader.setInt("diffuseTexture", 0);
-    floorShader.setInt("shadowMap", 1);
-    floorShader.setInt("shadowCubeMap", 2);
-
     blurShader.use();
     blurShader.setInt("image", 0);
 
-    deferredShader.use();
-    deferredShader.setInt("gPosition", 0);
-    deferredShader.setInt("gNormal", 1);
-    deferredShader.setInt("gAlbedoSpec", 2);
-    deferredShader.setInt("shadowMap", 3);
-    deferredShader.setVec3("dirLight.direction", dirLightDirection);
-    deferredShader.setVec3("dirLight.ambient", dirLightAmbient);
-    deferredShader.setVec3("dirLight.diffuse", dirLightDiffuse);
-    deferredShader.setVec3("dirLight.specular", dirLightSpecular);
-
     
-    //Render loop
-    while (!glfwWindowShouldClose(window))
-    {
-        //Calculate deltaTime
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+    //Record the GL commands of one snapshot; runs on the render thread
+    glm::vec2 lastViewport(0.0f);
+    bool lastWireframe = false;
+    std::vector<glm::vec3> shadowLightPositions;
+    std::vector<float> shadowLightRadii;
+    //Per-draw constants of the frames in flight; 2 MB is room for ~8000 draws at 256 byte alignment
+    UploadRing drawDataRing(GL_UNIFORM_BUFFER, 2 * 1024 * 1024);
+    //where each draw's constants went this frame: the draws, the floor, the point lights, the arrows
+    std::vector<size_t> drawDataOffsets;
+    std::vector<bool> drawDataValid;
+    auto renderFrame = [&](const FrameSnapshot& frame) {
+        GLState::BeginFrame();
+        //GL work queued by jobs since the last frame
+        JobSystem::PumpGLThread();
+
+        //Write the constants of every draw once; every pass then only binds their range
+        drawDataRing.BeginFrame();
+        drawDataOffsets.clear();
+        drawDataValid.clear();
+        auto writeDrawData = [&](const glm::mat4& model, const glm::vec3& color, const LightList* lights) {
+            size_t offset = 0;
+            DrawData* data = (DrawData*)drawDataRing.Allocate(sizeof(DrawData), offset);
+            if (data)
+            {
+                data->model = model;
+                data->color = glm::vec4(color, 1.0f);
+                data->lightCount = lights ? lights->count : -1;
+                for (int i = 0; lights && i < lights->count; i++)
+                    data->lights[i / 4][i % 4] = lights->lights[i];
+            }
+            drawDataOffsets.push_back(offset);
+            drawDataValid.push_back(data != nullptr);
+        };
+        const int floorDrawData = (int)frame.draws.size();
+        const int firstLightDrawData = floorDrawData + 1;
+        const int firstArrowDrawData = firstLightDrawData + (int)frame.pointLights.size();
+        //objects store their draws in order, so this writes the draws in order too
+        for (const ObjectPacket& object : frame.objects)
+        {
+            for (int i = object.firstDraw; i < object.firstDraw + object.drawCount; i++)
+                writeDrawData(frame.draws[i].model, glm::vec3(0.0f), &object.lights);
+        }
+        //the floor reaches every light, so it is shaded with all of them
+        writeDrawData(floorModel, glm::vec3(0.0f), nullptr);
+        for (const PointLight& light : frame.pointLights)
+            writeDrawData(glm::scale(glm::translate(glm::mat4(1.0f), light.position), glm::vec3(0.1f)), light.hdrColor, nullptr);
+        for (const ArrowPacket& debugArrow : frame.arrows)
+            writeDrawData(Arrow::ModelMatrix(debugArrow.direction, debugArrow.position, debugArrow.length), debugArrow.color, nullptr);
+        drawDataRing.Flush();
+        //false when the ring ran out of space and the draw has to be skipped
+        auto bindDrawData = [&](int index) {
+            if (!drawDataValid[index])
+                return false;
+            GLState::BindBufferRange(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, drawDataRing.GetBuffer(), drawDataOffsets[index], sizeof(DrawData));
+            return true;
+        };
+
+        if (lastViewport != glm::vec2(frame.framebufferWidth, frame.framebufferHeight)) {
+            lastViewport = glm::vec2(frame.framebufferWidth, frame.framebufferHeight);
+            GLState::Viewport(0, 0, frame.framebufferWidth, frame.framebufferHeight);
+        }
+        if (lastWireframe != frame.wireframe) {
+            lastWireframe = frame.wireframe;
+            glPolygonMode(GL_FRONT_AND_BACK, frame.wireframe ? GL_LINE : GL_FILL);
+        }
+
+        //draw every mesh of an object with the world matrices it had when the frame was simulated,
+        //at the level of detail and with the meshlets picked for the view
+        auto drawObject = [&](const ObjectPacket& object, Shader& shader, DrawView drawView) {
+            for (int i = object.firstDraw; i < object.firstDraw + object.drawCount; i++)
+            {
+                const DrawPacket& draw = frame.draws[i];
+                if (!bindDrawData(i))
+                    continue;
+                if (drawView == DrawView::Camera && draw.firstRange >= 0)
+                    draw.mesh->DrawRanges(shader, frame.meshletRanges.data() + draw.firstRange, draw.rangeCount);
+                else if (drawView == DrawView::SunShadow && draw.firstSunRange >= 0)
+                    draw.mesh->DrawRanges(shader, frame.meshletRanges.data() + draw.firstSunRange, draw.sunRangeCount);
+                else
+                    draw.mesh->Draw(shader, 1, drawView == DrawView::Camera ? draw.lod : draw.shadowLod);
+            }
+        };
+
+        //Select shader permutations for this frame
+        cascadedShadowMap.filter = frame.shadowFilter;
+        const ShaderDefines& shadowDefines = shadowVariants[frame.shadows ? (cascadedShadowMap.filter == ShadowFilter::EVSM ? 2 : 1) : 0];
+        Shader& ourShader = ourShaders.Get(shadowDefines);
+        Shader& floorShader = floorShaders.Get(shadowDefines);
+        Shader& deferredShader = deferredShaders.Get(shadowDefines);
+        Shader& gBufferTexturedShader = gBufferShaders.Get(gBufferTexturedDefines);
+        Shader& gBufferFloorShader = gBufferShaders.Get(gBufferFloorDefines);
+        Shader& gBufferFlatShader = gBufferShaders.Get(gBufferFlatDefines);
 
-        float time = static_cast<float>(glfwGetTime());
-        float radius = 5.0f;
-        dirLightDirection = glm::normalize(glm::vec3(
-            sin(time) * radius,  
-            4.0f,                
-            cos(time) * radius   
-        ));
         ourShader.use();
-        ourShader.setVec3("dirLight.direction", dirLightDirection);
+        ourShader.setVec3("dirLight.direction", frame.sun.direction);
         floorShader.use();
-        floorShader.setVec3("dirLight.direction", dirLightDirection);
+        floorShader.setVec3("dirLight.direction", frame.sun.direction);
         screenShader.use();
-        screenShader.setFloat("exposure", exposure);
-
-        //Handle input
-        processInput(window);
-
-        //Clear and create a new set of cubmaps for depth cube map
-        createDepthCubeMapTransforms(near_plane, far_plane, pointLightPositions[0], shadowTransforms);
+        screenShader.setFloat("exposure", frame.exposure);
 
         /*Set up shaders*/
-        setUpMVP(view, projection, model, lightProjection, lightView, lightSpaceMatrix);
+        cascadedShadowMap.Update(frame.view, frame.fov, frame.aspect, frame.near, std::min(frame.far, shadowDistance), frame.sun.direction);
         //ourShader------------------------------------------
-        ourShader.passMVP(model, view, projection);
-        ourShader.setVec3("cameraPos", mCamera.pos);
-        ourShader.setFloat("far_plane", far_plane);
-        ourShader.setInt("shadows", shadows);
+        ourShader.passMVP(frame.model, frame.view, frame.projection);
+        ourShader.setVec3("cameraPos", frame.cameraPos);
+        cascadedShadowMap.SetUniforms(ourShader);
         //reflectiveShader-----------------------------------
-        reflectiveShader.passMVP(model, view, projection);
-        reflectiveShader.setVec3("cameraPos", mCamera.pos);
+        reflectiveShader.passMVP(frame.model, frame.view, frame.projection);
+        reflectiveShader.setVec3("cameraPos", frame.cameraPos);
         //normalDisplayShader--------------------------------
-        normalDisplayShader.passMVP(model, view, projection);
-        normalDisplayShader.setVec3("cameraPos", mCamera.pos);
+        normalDisplayShader.passMVP(frame.model, frame.view, frame.projection);
+        normalDisplayShader.setVec3("cameraPos", frame.cameraPos);
         normalDisplayShader.setFloat("MAGNITUDE", magnitude);
         //arrowShader
-        arrowShader.passMVP(model, view, projection);
+        arrowShader.passMVP(frame.model, frame.view, frame.projection);
         //lightShader-----------------------------------------
-        lightShader.passMVP(model, view, projection);
-        //skyBoxShader----------------------------------------
-        skyBoxShader.use();
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-
-        glDepthMask(GL_TRUE);    // re-enable writing to depth buffer
-        glDepthFunc(GL_LESS);    // set depth function back to default
-
-        //simpleDepthShader-----------------------------------
-        simpleDepthShader.use();
-        simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        simpleDepthShader.setMat4("model", model);
+        lightShader.passMVP(frame.model, frame.view, frame.projection);
         //floorShader------------------------------------------
         floorShader.use();
-        floorShader.setVec3("viewPos", mCamera.pos);
-        floorShader.passMVP(model, view, projection);
-        floorShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        floorShader.setFloat("far_plane", far_plane);
-        floorShader.setInt("shadows", shadows);
-        //pointShadowDepthShader--------------------------------
-        pointShadowDepthShader.use();
-        for (unsigned int i = 0; i < 6; ++i)
-            pointShadowDepthShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-        pointShadowDepthShader.setFloat("far_plane", far_plane);
-        pointShadowDepthShader.setVec3("lightPos", pointLightPositions[0]);
+        floorShader.setVec3("viewPos", frame.cameraPos);
+        floorShader.passMVP(frame.model, frame.view, frame.projection);
+        cascadedShadowMap.SetUniforms(floorShader);
         //deferredShader--------------------------------
-        deferredShader.use();
-        deferredShader.setVec3("dirLight.direction", dirLightDirection);
-        deferredShader.setVec3("dirLight.ambient", dirLightAmbient);
-        deferredShader.setVec3("dirLight.diffuse", dirLightDiffuse);
-        deferredShader.setVec3("dirLight.specular", dirLightSpecular);
-        deferredShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        deferredShader.setInt("shadows", shadows);
-        deferredShader.setFloat("far_plane", far_plane);
-        deferredShader.setVec3("cameraPos", mCamera.pos);
-        
-
-        // ─────────────── Pass 1: render shadow depth map (only depth) ───────────────
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-
-        //*Render scene to depthMap*/
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-        // render the loaded model
-        glCullFace(GL_BACK);
-        simpleDepthShader.use();
-        simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        for (unsigned int i = 0; i < objectPositions.size(); i++)
+        loadDirLightToShader(deferredShader, frame.sun);
+        deferredShader.setMat4("view", frame.view);
+        cascadedShadowMap.SetUniforms(deferredShader);
+        deferredShader.setVec3("cameraPos", frame.cameraPos);
+
+        shadowLightPositions.clear();
+        shadowLightRadii.clear();
+        for (const PointLight& light : frame.pointLights)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, objectPositions[i]);
-            simpleDepthShader.setMat4("model", model);
-            ourModel.Draw(simpleDepthShader);
+            shadowLightPositions.push_back(light.position);
+            shadowLightRadii.push_back(light.radius);
         }
-        //render floor
-        simpleDepthShader.use();
-        renderFloor(simpleDepthShader, planeVAO);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        
-        // reset viewport
-        glCullFace(GL_BACK);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, windowWidth, windowHeight);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        
+
+        // ─────────────── Build the frame graph: passes declare their reads and writes ───────────────
+        renderGraph.Reset();
+        RGResource backbuffer = renderGraph.ImportBackbuffer("backbuffer", windowWidth, windowHeight);
+        RGResource shadowCascades = renderGraph.ImportTexture("shadowCascades", cascadedShadowMap.depthMapArray);
+        RGResource shadowMoments = renderGraph.ImportTexture("shadowMoments", cascadedShadowMap.momentsArray);
+        RGResource pointShadows = renderGraph.ImportTexture("shadowAtlas", shadowAtlas.depthAtlas);
+        RGResource bloomChain = renderGraph.ImportTexture("bloomChain", bloom.GetBloomTexture());
+        RGResource gPosition = -1, gNormal = -1, gAlbedoSpec = -1, gDepth = -1, sceneColor = -1;
+        bool evsm = cascadedShadowMap.filter == ShadowFilter::EVSM;
+
+        // ─────────────── Pass 1: render cascaded shadow depth maps (only depth) ───────────────
+        renderGraph.AddPass("CascadedShadows",
+            [&](RGPassBuilder& builder) { builder.Write(shadowCascades); },
+            [&](RenderGraph&) {
+                GLState::Enable(GL_DEPTH_TEST);
+                GLState::CullFace(GL_BACK);
+                simpleDepthShader.use();
+                for (int cascade = 0; cascade < cascadedShadowMap.cascadeCount; cascade++)
+                {
+                    cascadedShadowMap.BindCascade(cascade);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    simpleDepthShader.setMat4("lightSpaceMatrix", cascadedShadowMap.lightSpaceMatrices[cascade]);
+                    // render only the casters that can reach this cascade
+                    for (const ObjectPacket& object : frame.objects)
+                    {
+                        if (cascadedShadowMap.IsCasterVisible(cascade, object.bounds))
+                            drawObject(object, simpleDepthShader, DrawView::SunShadow);
+                    }
+                    //render floor
+                    if (cascadedShadowMap.IsCasterVisible(cascade, floorBounds) && bindDrawData(floorDrawData))
+                        renderFloor(simpleDepthShader, planeVAO);
+                }
+            });
+
+        //pre-filter the cascades once at shadow map resolution so lighting takes a single fetch
+        renderGraph.AddPass("ShadowMomentFilter",
+            [&](RGPassBuilder& builder) {
+                builder.Read(shadowCascades);
+                builder.Write(shadowMoments);
+            },
+            [&](RenderGraph&) { cascadedShadowMap.FilterMoments(evsmBlurShader, blurShader, quadVAO); });
+
+        // ─────────────── Pass 1b: point light shadows, only the most important out of date atlas faces ───────────────
+        renderGraph.AddPass("PointShadows",
+            [&](RGPassBuilder& builder) { builder.Write(pointShadows); },
+            [&](RenderGraph&) {
+                shadowCasters.clear();
+                for (const ObjectPacket& object : frame.objects)
+                {
+                    //the levels of detail drawCaster draws the object's meshes at, hashed into one key
+                    unsigned long long shadowLod = 1469598103934665603ull;
+                    for (int i = object.firstDraw; i < object.firstDraw + object.drawCount; i++)
+                        shadowLod = (shadowLod ^ (unsigned int)frame.draws[i].shadowLod) * 1099511628211ull;
+                    shadowCasters.push_back({ object.bounds, object.transform, shadowLod });
+                }
+                shadowCasters.push_back({ floorBounds, floorModel, 0 });
+                shadowAtlas.Allocate(shadowLightPositions, shadowLightRadii, frame.projection * frame.view, frame.cameraPos, frame.fov);
+                auto drawCaster = [&](int caster, Shader& shader) {
+                    if (caster < (int)frame.objects.size())
+                    {
+                        drawObject(frame.objects[caster], shader, DrawView::PointShadow);
+                        return;
+                    }
+                    if (bindDrawData(floorDrawData))
+                        renderFloor(shader, planeVAO);
+                };
+                shadowAtlas.Render(pointShadowDepthShader, shadowCasters, drawCaster);
+                shadowAtlas.SetUniforms(ourShader, (int)frame.pointLights.size());
+                shadowAtlas.SetUniforms(floorShader, (int)frame.pointLights.size());
+                shadowAtlas.SetUniforms(deferredShader, (int)frame.pointLights.size());
+            });
+
         // ─────────────── Pass 2: render scene to gBuffer framebuffer ───────────────
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-        glEnable(GL_DEPTH_TEST);
-        //clear color and depth
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderGraph.AddPass("GBuffer",
+            [&](RGPassBuilder& builder) {
+                gPosition = builder.ColorAttachment(builder.CreateTexture("gPosition", gPositionDesc));
+                gNormal = builder.ColorAttachment(builder.CreateTexture("gNormal", gNormalDesc));
+                gAlbedoSpec = builder.ColorAttachment(builder.CreateTexture("gAlbedoSpec", gAlbedoSpecDesc));
+                gDepth = builder.DepthAttachment(builder.CreateTexture("gDepth", depthDesc));
+            },
+            [&](RenderGraph&) {
+                GLState::Enable(GL_DEPTH_TEST);
+                GLState::CullFace(GL_BACK);
+                //clear color and depth
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                gBufferShaders.ForEach([&](Shader& gBufferShader) {
+                    gBufferShader.use();
+                    gBufferShader.setMat4("view", frame.view);
+                    gBufferShader.setMat4("projection", frame.projection);
+                });
+
+                // render the loaded model
+                gBufferTexturedShader.use();
+                for (const ObjectPacket& object : frame.objects)
+                {
+                    if (object.visible && !frame.forwardShading)
+                        drawObject(object, gBufferTexturedShader, DrawView::Camera);
+                }
+
+                //render floor (diffuse only)
+                gBufferFloorShader.use();
+                GLState::ActiveTexture(GL_TEXTURE0);
+                GLState::BindTexture(GL_TEXTURE_2D, woodTexture);
+                gBufferFloorShader.setInt("material.texture_diffuse1", 0);
+                gBufferFloorShader.setInt("material.texture_specular1", 0);
+                gBufferFloorShader.setInt("material.texture_normal1", 0);
+                gBufferFloorShader.setInt("material.texture_roughness1", 0);
+                if (bindDrawData(floorDrawData))
+                    renderFloor(gBufferFloorShader, planeVAO);
+
+                //render lights (flat color)
+                auto bindLightDrawData = [&](int light) { return bindDrawData(firstLightDrawData + light); };
+                renderPointLights(gBufferFlatShader, (int)frame.pointLights.size(), lightVAO, bindLightDrawData);
+                //render debug arrows (flat color)
+                gBufferFlatShader.use();
+                for (int i = 0; i < (int)frame.arrows.size(); i++)
+                {
+                    if (bindDrawData(firstArrowDrawData + i))
+                        arrow.DrawGeometry(gBufferFlatShader);
+                }
+            });
+
+        //─────────────── Pass 3: calculate lighting using the gbuffer's content, then the skybox ───────────────
+        renderGraph.AddPass("DeferredLighting",
+            [&](RGPassBuilder& builder) {
+                builder.Read(gPosition);
+                builder.Read(gNormal);
+                builder.Read(gAlbedoSpec);
+                // only the shadow maps the selected shader permutation samples keep their passes alive
+                if (frame.shadows)
+                {
+                    builder.Read(evsm ? shadowMoments : shadowCascades);
+                    builder.Read(pointShadows);
+                }
+                sceneColor = builder.ColorAttachment(builder.CreateTexture("sceneColor", sceneColorDesc));
+                builder.DepthAttachment(builder.CreateTexture("sceneDepth", depthDesc));
+            },
+            [&](RenderGraph& graph) {
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Set clear color to black
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                GLState::Enable(GL_DEPTH_TEST);
+
+                //render scene
+                deferredShader.use();
+                GLState::ActiveTexture(GL_TEXTURE0);
+                GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(gPosition));
+                GLState::ActiveTexture(GL_TEXTURE1);
+                GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(gNormal));
+                GLState::ActiveTexture(GL_TEXTURE2);
+                GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(gAlbedoSpec));
+                GLState::ActiveTexture(GL_TEXTURE3);
+                GLState::BindTexture(GL_TEXTURE_2D_ARRAY, cascadedShadowMap.depthMapArray);
+                GLState::ActiveTexture(GL_TEXTURE4);
+                GLState::BindTexture(GL_TEXTURE_2D, shadowAtlas.depthAtlas);
+                GLState::ActiveTexture(GL_TEXTURE5);
+                GLState::BindTexture(GL_TEXTURE_2D_ARRAY, cascadedShadowMap.momentsArray);
+                renderQuad(quadVAO);
+
+                //render skyBox
+                GLState::DepthFunc(GL_GEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+                GLState::DepthMask(GL_FALSE);   // disable writing to depth buffer
+
+                // skybox cube
+                skyBoxShader.use();
+                GLState::BindVertexArray(skyboxVAO);
+                GLState::ActiveTexture(GL_TEXTURE0);
+                GLState::BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+
+                GLState::DepthMask(GL_TRUE);    // re-enable writing to depth buffer
+                GLState::DepthFunc(GL_LESS);    // set depth function back to default
+            });
+
+        // ─────────────── Pass 4(Optional): forward shade the objects over the lit scene, each with its own lights ───────────────
+        if (frame.forwardShading) {
+            renderGraph.AddPass("ForwardObjects",
+                [&](RGPassBuilder& builder) {
+                    if (frame.shadows)
+                    {
+                        builder.Read(evsm ? shadowMoments : shadowCascades);
+                        builder.Read(pointShadows);
+                    }
+                    //drawn over the deferred result, depth tested against the floor in the G-buffer depth
+                    sceneColor = builder.ColorAttachment(sceneColor);
+                    builder.DepthAttachment(gDepth);
+                },
+                [&](RenderGraph&) {
+                    GLState::Enable(GL_DEPTH_TEST);
+                    GLState::CullFace(GL_BACK);
+                    GLState::ActiveTexture(GL_TEXTURE4);
+                    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, cascadedShadowMap.depthMapArray);
+                    GLState::ActiveTexture(GL_TEXTURE5);
+                    GLState::BindTexture(GL_TEXTURE_2D, shadowAtlas.depthAtlas);
+                    GLState::ActiveTexture(GL_TEXTURE6);
+                    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, cascadedShadowMap.momentsArray);
+                    ourShader.use();
+                    for (const ObjectPacket& object : frame.objects)
+                    {
+                        if (object.visible)
+                            drawObject(object, ourShader, DrawView::Camera);
+                    }
+                });
+        }
 
-        gBufferShader.use();
-        gBufferShader.setMat4("view", view);
-        gBufferShader.setMat4("projection", projection);
+        // ─────────────── Pass 5: bloom, bright pass + 13-tap downsample and tent upsample over the mip chain ───────────────
+        renderGraph.AddPass("Bloom",
+            [&](RGPassBuilder& builder) {
+                builder.Read(sceneColor);
+                builder.Write(bloomChain);
+            },
+            [&](RenderGraph& graph) { bloom.Render(bloomDownsampleShader, bloomUpsampleShader, graph.GetTexture(sceneColor), quadVAO); });
 
-        // render the loaded model
-        for (unsigned int i = 0; i < objectPositions.size(); i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, objectPositions[i]);
-            gBufferShader.setMat4("model", model);
-            ourModel.Draw(gBufferShader);
+        // ─────────────── Pass 6: Render screen Quad ──────────────
+        renderGraph.AddPass("Composite",
+            [&](RGPassBuilder& builder) {
+                builder.Read(sceneColor);
+                builder.Read(bloomChain);
+                builder.ColorAttachment(backbuffer);
+            },
+            [&](RenderGraph& graph) {
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Set clear color to black
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                GLState::Disable(GL_DEPTH_TEST);
+
+                //draw screen
+                screenShader.use();
+                GLState::ActiveTexture(GL_TEXTURE0);
+                GLState::BindTexture(GL_TEXTURE_2D, graph.GetTexture(sceneColor));
+                GLState::ActiveTexture(GL_TEXTURE1);
+                GLState::BindTexture(GL_TEXTURE_2D, bloom.GetBloomTexture());
+
+                renderQuad(quadVAO);
+            });
+
+        //─────────────── Pass 7(Optional): Debug screen Quad ──────────────
+        if (frame.renderMode == DEBUG) {
+            renderGraph.AddPass("DebugView",
+                [&](RGPassBuilder& builder) {
+                    builder.Read(bloomChain);
+                    builder.ColorAttachment(backbuffer);
+                },
+                [&](RenderGraph&) {
+                    // clear all relevant buffers
+                    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    GLState::Disable(GL_DEPTH_TEST);
+
+                    //draw debug quad
+                    debugQuadShader.use();
+                    debugQuadShader.setInt("debugMode", 1); // 0: position, 1: normal, 2: albedo
+
+                    // Display bloom buffer
+                    GLState::ActiveTexture(GL_TEXTURE0);
+                    GLState::BindTexture(GL_TEXTURE_2D, bloom.GetBloomTexture());
+                    debugQuadShader.setInt("screenTexture", 0);
+                    renderQuad(quadVAO);
+                });
         }
 
-        //render floor
-        gBufferShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        gBufferShader.setInt("material.texture_diffuse1", 0);
-        gBufferShader.setInt("material.texture_specular1", 0);
-        gBufferShader.setInt("material.texture_normal1", 0);
-        gBufferShader.setInt("material.texture_roughness1", 0);
-        gBufferShader.setInt("hasNormalTexture", 0);
-        renderFloor(gBufferShader, planeVAO);
-
-        //render lights
-        gBufferShader.use();
-        gBufferShader.setInt("hasNormalTexture", 0);
-        gBufferShader.setInt("hasDiffuseTexture", 0);
-        renderPointLights(gBufferShader, numLights, lightVAO);
-        //render arrow
-        gBufferShader.use();
-        gBufferShader.setInt("hasNormalTexture", 0);
-        gBufferShader.setInt("hasDiffuseTexture", 0);
-        arrow.Draw(dirLightDirection, gBufferShader, glm::vec3(2, 5, -5), 2.0f, glm::vec3(1, 0, 0));
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        //─────────────── Pass 3: calculate lighting using the gbuffer's content and render to intermediateFrameBuffer ───────────────
-        glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Set clear color to black
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-
-        //render scene
-        deferredShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, gNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        renderQuad(quadVAO);
-
-
-        //render skyBox
-        glDepthFunc(GL_GEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        glDepthMask(GL_FALSE);   // disable writing to depth buffer
-
-        // skybox cube
-        skyBoxShader.use();
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-
-        glDepthMask(GL_TRUE);    // re-enable writing to depth buffer
-        glDepthFunc(GL_LESS);    // set depth function back to default
-
-        glEnable(GL_DEPTH_TEST);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // ─────────────── Pass 5: blur bright fragments with two-pass Gaussian Blur ───────────────
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 2;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
+
+        renderGraph.Compile();
+        if (frame.dumpRenderGraph)
+            renderGraph.Dump(std::cout);
+        renderGraph.Execute();
+        drawDataRing.EndFrame();
+    };
+
+    //Game thread simulates frame N + 1 while the render thread submits frame N
+    FramePipeline<FrameSnapshot> framePipeline(pipelineDepth);
+    //stats of the newest frame the render thread finished
+    FrameStats renderStats;
+
+    //Render thread: owns the GL context from here on and only reads snapshots
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread([&] {
+        glfwMakeContextCurrent(window);
+        while (true)
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            glViewport(0, 0, windowWidth, windowHeight);
-            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Set clear color to black
-            glClear(GL_COLOR_BUFFER_BIT);
-            
-            blurShader.setInt("horizontal", horizontal);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? screenTextures[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-            renderQuad(quadVAO);
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+            FrameSnapshot& frame = framePipeline.BeginRead();
+            if (frame.quit) {
+                framePipeline.EndRead();
+                break;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            unsigned long long allocationsBefore = AllocationCounter::ThisThread();
+            renderFrame(frame);
+            frame.stats.allocations = AllocationCounter::ThisThread() - allocationsBefore;
+            glfwSwapBuffers(window);
+            frame.stats.renderMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            frame.stats.stateCallsIssued = GLState::frame.issued;
+            frame.stats.stateCallsFiltered = GLState::frame.filtered;
+            frame.stats.drawDataBytes = drawDataRing.frame.bytes;
+            frame.stats.drawDataStalls = drawDataRing.frame.stalls;
+            frame.stats.drawDataStallMs = drawDataRing.frame.stallMs;
+            framePipeline.EndRead();
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, windowWidth, windowHeight);
+        glfwMakeContextCurrent(NULL);
+    });
 
-        // ─────────────── Pass 6: Render screen Quad ──────────────
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Set clear color to black
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDisable(GL_DEPTH_TEST);
+    //Game loop
+    unsigned long long gameAllocations = 0;
+    while (!glfwWindowShouldClose(window))
+    {
+        unsigned long long allocationsBefore = AllocationCounter::ThisThread();
+        //Calculate deltaTime
+        float currentFrame = static_cast<float>(glfwGetTime());
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
 
-        //draw screen
-        screenShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, screenTextures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+        //Handle input
+        glfwPollEvents();
+        processInput(window);
 
-        renderQuad(quadVAO);
+        float time = static_cast<float>(glfwGetTime());
+        float radius = 5.0f;
+        DirectionalLight& sunLight = *world.Get<DirectionalLight>(sun);
+        sunLight.direction = glm::normalize(glm::vec3(
+            sin(time) * radius,  
+            4.0f,                
+            cos(time) * radius   
+        ));
 
-        //─────────────── Pass 7(Optional): Debug screen Quad ──────────────
-        if (mRenderMode == DEBUG) {
-            // clear all relevant buffers
-            glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glDisable(GL_DEPTH_TEST);
-
-            //draw debug quad
-            debugQuadShader.use();
-            debugQuadShader.setInt("debugMode", 1); // 0: position, 1: normal, 2: albedo
-            
-            // Display normal buffer
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[0]);
-            debugQuadShader.setInt("screenTexture", 0);
-            renderQuad(quadVAO);
+        setUpMVP(view, projection, model);
+
+        //World matrices of moved subtrees, then the systems that depend on them
+        sceneGraph.Update();
+        UpdateTransforms(world, sceneGraph);
+        UpdateBounds(world);
+        UpdateSpatialIndex(world, spatialIndex);
+        //Shadow maps are sampled through filtering and rarely at a higher resolution than the screen, so
+        //their casters are judged from the camera against a looser threshold
+        float pixelsPerUnit = framebufferHeight / (2.0f * std::tan(glm::radians(mCamera.fov) * 0.5f));
+        SelectLODs(world, meshInstances, sceneGraph, { mCamera.pos, pixelsPerUnit, lodErrorPixels },
+            { mCamera.pos, pixelsPerUnit, lodErrorPixels * shadowLodErrorScale });
+
+        //Pick the object under the crosshair
+        if (pickRequested) {
+            pickRequested = false;
+            RayHit hit;
+            if (PickEntity(world, spatialIndex, meshInstances, sceneGraph, mCamera.GetPickRay(0.0f, 0.0f, windowAspect), hit))
+                std::cout << "Picked entity " << hit.instance << " (triangle " << hit.triangle << ", distance " << hit.t << ")" << std::endl;
+            else
+                std::cout << "Picked nothing" << std::endl;
         }
 
-        // check and call events and swap the buffers
-        glfwPollEvents();
-        glfwSwapBuffers(window);
+        //Frustum culling through the spatial index, then occlusion: rasterize the visible occluders on the CPU
+        //and test every visible object's bounds before it is drawn
+        FrustumCullRenderables(world, spatialIndex, Frustum(projection * view));
+        if (occlusionCulling) {
+            occlusionCuller.BeginFrame(projection * view);
+            occlusionCuller.AddOccluder(floorOccluder, glm::mat4(1.0f));
+            AddOccluders(world, occlusionCuller);
+            occlusionCuller.Rasterize();
+            CullRenderables(world, occlusionCuller);
+        }
+
+        //Snapshot for the render thread; waits while it is pipelineDepth frames behind
+        FrameSnapshot& frame = framePipeline.BeginWrite();
+        //the render thread left the stats of this slot's last frame in it
+        if (frame.stats.renderMs > 0.0f)
+            renderStats = frame.stats;
+        frame.view = view;
+        frame.projection = projection;
+        frame.model = model;
+        frame.cameraPos = mCamera.pos;
+        frame.fov = mCamera.fov;
+        frame.near = mCamera.near;
+        frame.far = mCamera.far;
+        frame.aspect = windowAspect;
+        frame.sun = sunLight;
+        PackPointLights(world, frame.pointLights);
+        AssignLights(world, spatialIndex, frame.pointLights, lightAssignment);
+        frame.objects.clear();
+        frame.draws.clear();
+        unsigned int trianglesDrawn = 0;
+        int meshletSlots = 0;
+        world.Each<Renderable, WorldTransform, Bounds, LightList>([&](Entity, Renderable& renderable, WorldTransform& transform, Bounds& bounds, LightList& lights) {
+            frame.objects.push_back({ bounds.world, transform.matrix, (int)frame.draws.size(), renderable.instanceCount, renderable.visible, lights });
+            for (int i = renderable.firstInstance; i < renderable.firstInstance + renderable.instanceCount; i++)
+            {
+                //room for every meshlet in each view that draws the full resolution mesh
+                const MeshInstance& instance = meshInstances[i];
+                int firstRange = -1, firstSunRange = -1;
+                if (renderable.visible && instance.lod == 0) {
+                    firstRange = meshletSlots;
+                    meshletSlots += instance.mesh->meshlets.Count();
+                }
+                else if (renderable.visible) {
+                    trianglesDrawn += instance.mesh->lods[instance.lod].indexCount / 3;
+                }
+                if (shadows && instance.shadowLod == 0) {
+                    firstSunRange = meshletSlots;
+                    meshletSlots += instance.mesh->meshlets.Count();
+                }
+                frame.draws.push_back({ instance.mesh, sceneGraph.GetWorldTransform(instance.node), instance.lod, instance.shadowLod,
+                    firstRange, 0, firstSunRange, 0 });
+            }
+        });
+
+        //Meshlet culling: clusters outside the camera frustum or facing away from the camera, and clusters
+        //facing away from the sun for the cascades (the casters were already culled per cascade)
+        MeshletView cameraMeshletView;
+        cameraMeshletView.frustum = Frustum(projection * view);
+        cameraMeshletView.position = mCamera.pos;
+        MeshletView sunMeshletView;
+        sunMeshletView.testFrustum = false;
+        sunMeshletView.orthographic = true;
+        sunMeshletView.direction = -sunLight.direction;
+        frame.meshletRanges.resize(meshletSlots);
+        auto cullMeshlets = [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+            {
+                DrawPacket& draw = frame.draws[i];
+                if (draw.firstRange >= 0)
+                    draw.rangeCount = draw.mesh->meshlets.Cull(draw.model, cameraMeshletView, frame.meshletRanges.data() + draw.firstRange);
+                if (draw.firstSunRange >= 0)
+                    draw.sunRangeCount = draw.mesh->meshlets.Cull(draw.model, sunMeshletView, frame.meshletRanges.data() + draw.firstSunRange);
+            }
+        };
+        JobSystem::ParallelFor((int)frame.draws.size(), 8, cullMeshlets);
+        for (const DrawPacket& draw : frame.draws)
+        {
+            for (int i = draw.firstRange; i >= 0 && i < draw.firstRange + draw.rangeCount; i++)
+                trianglesDrawn += frame.meshletRanges[i].indexCount / 3;
+        }
+        frame.arrows.clear();
+        world.Each<DirectionalLight, DebugArrow>([&](Entity, DirectionalLight& light, DebugArrow& debugArrow) {
+            frame.arrows.push_back({ light.direction, debugArrow.position, debugArrow.length, debugArrow.color });
+        });
+        frame.renderMode = mRenderMode;
+        frame.forwardShading = forwardShading;
+        frame.shadows = shadows;
+        frame.shadowFilter = shadowFilter;
+        frame.exposure = exposure;
+        frame.wireframe = wireframe;
+        frame.dumpRenderGraph = dumpRenderGraph;
+        dumpRenderGraph = false;
+        frame.framebufferWidth = framebufferWidth;
+        frame.framebufferHeight = framebufferHeight;
+        frame.quit = false;
+        framePipeline.EndWrite();
 
         //Update fps display
         float fps = 1.0f / deltaTime;  // FPS = 1/deltaTime
-        std::string title = "OpenGL - FPS: " + std::to_string((int)fps);
-        glfwSetWindowTitle(window, title.c_str());
+        ScratchScope scratch;
+        const char* title = scratch.arena.Format(
+            "OpenGL - FPS: %d - render: %.2f ms - GL state calls: %u issued, %u filtered"
+            " - draw data: %u KB, %u stalls (%.2f ms) - heap allocs: game %llu, render %llu - triangles: %u",
+            (int)fps, renderStats.renderMs, renderStats.stateCallsIssued, renderStats.stateCallsFiltered,
+            (unsigned int)(renderStats.drawDataBytes / 1024), renderStats.drawDataStalls, renderStats.drawDataStallMs,
+            gameAllocations, renderStats.allocations, trianglesDrawn);
+        if (occlusionCulling)
+            title = scratch.arena.Format("%s - occluded: %d/%d (%.2f ms)", title,
+                occlusionCuller.objectsCulled, occlusionCuller.objectsTested, occlusionCuller.rasterizeMs);
+        glfwSetWindowTitle(window, title);
+        //counted up to the title, so it shows in the next frame's title
+        gameAllocations = AllocationCounter::ThisThread() - allocationsBefore;
         
     }
 
+    //Stop the render thread after the frames in flight and take the context back
+    FrameSnapshot& lastSnapshot = framePipeline.BeginWrite();
+    lastSnapshot.quit = true;
+    framePipeline.EndWrite();
+    renderThread.join();
+    glfwMakeContextCurrent(window);
+
     //de-allocate all resources once they've outlived their purpose:
     glDeleteVertexArrays(1, &lightVAO);
     glDeleteBuffers(1, &lightVBO);
@@ -851,15 +1249,12 @@ int main()
     glDeleteBuffers(1, &quadVBO);
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &skyboxVBO);
-    glDeleteBuffers(1, &intermediateFBO);
     glDeleteBuffers(1, &planeVAO);
     glDeleteBuffers(1, &planeVBO);
-    glDeleteBuffers(1, &rboDepth);
-    glDeleteBuffers(1, &depthMapFBO);
-    for (unsigned int fbo : pingpongFBO) {
-        glDeleteBuffers(1, &fbo);
-    }
 
+    JobSystem::Shutdown();
+    //after the workers, which may still be reading assets
+    VirtualFileSystem::UnmountAll();
     glfwTerminate();
 
     return 0;
@@ -868,7 +1263,8 @@ int main()
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -922,9 +1318,9 @@ void processInput(GLFWwindow* window)
 
     //Toggle render polygon mode
     if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);  // wireframe
+        wireframe = true;
     if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);  // fill
+        wireframe = false;
 
     //Render Mode Control
     if (glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS) {
@@ -936,6 +1332,46 @@ void processInput(GLFWwindow* window)
     if(glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS) {
         mRenderMode = DEFAULT;
     }
+
+    //Shadow filtering
+    if (glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS) {
+        shadowFilter = ShadowFilter::PCF;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS) {
+        shadowFilter = ShadowFilter::EVSM;
+    }
+
+    //Print the compiled render graph once per key press
+    static bool dumpKeyDown = false;
+    bool dumpKeyPressed = glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS;
+    if (dumpKeyPressed && !dumpKeyDown) {
+        dumpRenderGraph = true;
+    }
+    dumpKeyDown = dumpKeyPressed;
+
+    //Toggle CPU occlusion culling
+    static bool occlusionKeyDown = false;
+    bool occlusionKeyPressed = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+    if (occlusionKeyPressed && !occlusionKeyDown) {
+        occlusionCulling = !occlusionCulling;
+    }
+    occlusionKeyDown = occlusionKeyPressed;
+
+    //Toggle forward shading of the objects
+    static bool forwardKeyDown = false;
+    bool forwardKeyPressed = glfwGetKey(window, GLFW_KEY_F10) == GLFW_PRESS;
+    if (forwardKeyPressed && !forwardKeyDown) {
+        forwardShading = !forwardShading;
+    }
+    forwardKeyDown = forwardKeyPressed;
+
+    //Pick with the left mouse button
+    static bool pickButtonDown = false;
+    bool pickButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pickButtonPressed && !pickButtonDown) {
+        pickRequested = true;
+    }
+    pickButtonDown = pickButtonPressed;
     if (glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS) {
         mRenderMode = DEBUG;
     }
@@ -1005,12 +1441,14 @@ unsigned int loadCubemap(std::vector<std::string> faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrComponents;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
+        AssetFile file;
+        unsigned char* data = VirtualFileSystem::Open(faces[i], file) ? stbi_load_from_memory((const stbi_uc*)file.Data(),
+            (int)file.Size(), &width, &height, &nrComponents, 0) : nullptr;
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
@@ -1031,40 +1469,25 @@ unsigned int loadCubemap(std::vector<std::string> faces)
     return textureID;
 }
 
-void renderPointLights(Shader& lightShader, int numLights, unsigned int& lightVAO) {
-    //Render Point Lights
+void renderPointLights(Shader& lightShader, int numLights, unsigned int& lightVAO, FunctionRef<bool(int)> bindDrawData) {
+    //Render Point Lights, model matrices and colors come from their DrawData
+    lightShader.use();
+    GLState::BindVertexArray(lightVAO);
     for (int i = 0; i < numLights; i++)
     {
-        //Tell OpenGL to use light shader   
-        lightShader.use();
-        //Calculate pointLights' Model Matricies
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, pointLightPositions[i]);
-        model = glm::scale(model, glm::vec3(0.1f));
-        //pass model Matrices
-        lightShader.setMat4("model", model);
-        //set light colors
-        lightShader.setVec3("color", pointLightHDRColors[i]);
-
-        //Make lightVAO in Bound and Draw spheres
-        glBindVertexArray(lightVAO);
-        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(sphereIndices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        if (bindDrawData(i))
+            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(sphereIndices.size()), GL_UNSIGNED_INT, 0);
     }
-    
 }
 
+//draws the floor plane with the bound DrawData (floorModel)
 void renderFloor(Shader& floorShader, unsigned int& planeVAO) {
     floorShader.use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0, -1.5f, 0));
-    floorShader.setMat4("model", model);
-    glBindVertexArray(planeVAO);
+    GLState::BindVertexArray(planeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
 }
 
-void setUpMVP(glm::mat4& view, glm::mat4& projection, glm::mat4& model, glm::mat4& lightProjection, glm::mat4& lightView, glm::mat4& lightSpaceMatrix) {
+void setUpMVP(glm::mat4& view, glm::mat4& projection, glm::mat4& model) {
     //Calculate View Matrix
     view = mCamera.GetViewMat();
     //Calculate Projection Matrix
@@ -1072,19 +1495,6 @@ void setUpMVP(glm::mat4& view, glm::mat4& projection, glm::mat4& model, glm::mat
     //Calculate Model Matrix
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate to origin
     model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// unit scale
-
-    // Calculate light space matrix with better coverage
-    glm::vec3 lightDir = glm::normalize(dirLightDirection);
-    glm::vec3 lightPos = lightDir * 20.0f;  // Move light further away
-    
-    // orthographic frustum
-    float orthoSize = 10.0f; 
-    lightProjection = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, near_plane, far_plane);
-    
-    // Center the light view on the scene
-    glm::vec3 center = glm::vec3(0.0f, -0.5f, 0.0f);  // Center of your scene
-    lightView = glm::lookAt(lightPos, center, glm::vec3(0.0, 1.0, 0.0));
-    lightSpaceMatrix = lightProjection * lightView;
 }
 
 unsigned int loadTexture(char const* path)
@@ -1093,7 +1503,9 @@ unsigned int loadTexture(char const* path)
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+    AssetFile file;
+    unsigned char* data = VirtualFileSystem::Open(path, file) ? stbi_load_from_memory((const stbi_uc*)file.Data(),
+        (int)file.Size(), &width, &height, &nrComponents, 0) : nullptr;
     if (data)
     {
         GLenum format;
@@ -1104,7 +1516,7 @@ unsigned int loadTexture(char const* path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -1124,62 +1536,58 @@ unsigned int loadTexture(char const* path)
     return textureID;
 }
 
-void createDepthCubeMapTransforms(float near_plane, float far_plane, glm::vec3 lightPos, std::vector<glm::mat4>& shadowTransforms) {
-    shadowTransforms.clear();
-    glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), shadowAspect, near_plane, far_plane);
-    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
-    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)));
-    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+void loadPointLightsToShader(Shader& shader, const std::vector<PointLight>& lights) {
+    shader.use();
+    shader.setInt("NumPointLights", (int)lights.size());
+    //uniform names are formatted into the thread's scratch arena and dropped together
+    ScratchScope scratch;
+    for (int i = 0; i < (int)lights.size(); i++) {
+        shader.setVec3(scratch.arena.Format("pointLights[%d].position", i), lights[i].position);
+        shader.setVec3(scratch.arena.Format("pointLights[%d].ambient", i), lights[i].ambient);
+        shader.setVec3(scratch.arena.Format("pointLights[%d].diffuse", i), lights[i].diffuse);
+        shader.setVec3(scratch.arena.Format("pointLights[%d].specular", i), lights[i].specular);
+        shader.setFloat(scratch.arena.Format("pointLights[%d].constant", i), lights[i].constant);
+        shader.setFloat(scratch.arena.Format("pointLights[%d].linear", i), lights[i].linear);
+        shader.setFloat(scratch.arena.Format("pointLights[%d].quadratic", i), lights[i].quadratic);
+    }
 }
 
-void loadPointLightsToShader(Shader& shader, const int numLights) {
+void loadDirLightToShader(Shader& shader, const DirectionalLight& light) {
     shader.use();
-    shader.setInt("NumPointLights", numLights);
-    for (int i = 0; i < numLights; i++) {
-        std::string varName = "";
-        std::string prefix = "pointLights[";
-        std::string postfix = "].";
-        std::string resultPrefix = prefix + std::to_string(i) + postfix;
-        varName = resultPrefix + "position";
-        shader.setVec3(varName, pointLightPositions[i]);
-
-        varName = resultPrefix + "ambient";
-        shader.setVec3(varName, pointLightAmbients[i]);
-
-        varName = resultPrefix + "diffuse";
-        shader.setVec3(varName, pointLightDiffuses[i]);
-
-        varName = resultPrefix + "specular";
-        shader.setVec3(varName, pointLightSpeculars[i]);
-
-        varName = resultPrefix + "constant";
-        shader.setFloat(varName, pointLightConstants[i]);
-
-        varName = resultPrefix + "linear";
-        shader.setFloat(varName, pointLightLinears[i]);
+    shader.setVec3("dirLight.direction", light.direction);
+    shader.setVec3("dirLight.ambient", light.ambient);
+    shader.setVec3("dirLight.diffuse", light.diffuse);
+    shader.setVec3("dirLight.specular", light.specular);
+}
 
-        varName = resultPrefix + "quadratic";
-        shader.setFloat(varName, pointLightQuadratics[i]);
+void spawnPointLights(World& world) {
+    //position, ambient, diffuse, specular, HDR color, constant, linear, quadratic
+    PointLight lights[] = {
+        { glm::vec3(0.7f, 3.0f, 2.0f), glm::vec3(0.2f, 0.2f, 0.2f), glm::vec3(0.3f, 0.3f, 0.3f), glm::vec3(0.5f, 0.5f, 0.5f),
+            glm::vec3(5.0f, 5.0f, 5.0f), 1.0f, 0.14f, 0.07f, 0.0f },      // white light with normal intensity
+        { glm::vec3(2.3f, 3.0f, -4.0f), glm::vec3(0.2f, 0.0f, 0.0f), glm::vec3(0.3f, 0.0f, 0.0f), glm::vec3(0.5f, 0.0f, 0.0f),
+            glm::vec3(10.0f, 0.0f, 0.0f), 1.0f, 0.14f, 0.07f, 0.0f },     // bright red
+        { glm::vec3(-4.0f, 2.0f, -12.0f), glm::vec3(0.0f, 0.2f, 0.0f), glm::vec3(0.0f, 0.3f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f),
+            glm::vec3(0.0f, 15.0f, 0.0f), 1.0f, 0.14f, 0.07f, 0.0f },     // bright green
+        { glm::vec3(0.0f, 3.0f, -3.0f), glm::vec3(0.0f, 0.0f, 0.2f), glm::vec3(0.0f, 0.0f, 0.3f), glm::vec3(0.0f, 0.0f, 0.5f),
+            glm::vec3(0.0f, 0.0f, 15.0f), 1.0f, 0.14f, 0.07f, 0.0f }      // bright blue
+    };
+    for (PointLight& light : lights)
+    {
+        light.radius = CalculatePointLightRadius(light);
+        world.Create(light);
     }
 }
 
 void renderQuad(const unsigned int quadVAO) {
-    glBindVertexArray(quadVAO);
+    GLState::BindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
 }
 
-void generateObjectPositions(std::vector<glm::vec3>& objectPositions) {
-    objectPositions.push_back(glm::vec3(-3.0, -0.5, -3.0));
-    objectPositions.push_back(glm::vec3(0.0, -0.5, -3.0));
-    objectPositions.push_back(glm::vec3(3.0, -0.5, -3.0));
-    objectPositions.push_back(glm::vec3(-3.0, -0.5, 0.0));
-    objectPositions.push_back(glm::vec3(0.0, -0.5, 0.0));
-    objectPositions.push_back(glm::vec3(3.0, -0.5, 0.0));
-    objectPositions.push_back(glm::vec3(-3.0, -0.5, 3.0));
-    objectPositions.push_back(glm::vec3(0.0, -0.5, 3.0));
-    objectPositions.push_back(glm::vec3(3.0, -0.5, 3.0));
+void generateObjectPositions(std::vector<glm::vec3>& objectPositions, int count) {
+    //rows of side objects 3 units apart, centred on the origin; nine gives the original 3x3 layout
+    int side = (int)std::ceil(std::sqrt((float)count));
+    float offset = (side - 1) * 1.5f;
+    for (int i = 0; i < count; i++)
+        objectPositions.push_back(glm::vec3((i % side) * 3.0f - offset, -0.5f, (i / side) * 3.0f - offset));
 }
\ No newline at end of file
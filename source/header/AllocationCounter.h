@@ -0,0 +1,12 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+// Counts every heap allocation made through operator new, for all threads and for the calling
+// thread. Take the difference around a piece of code to see how often it allocates.
+class AllocationCounter {
+public:
+    static unsigned long long Total();
+    static unsigned long long ThisThread();
+};
+
+#endif
@@ -20,6 +20,11 @@ public:
         int segments = 20);
 
     void Draw(const glm::vec3& dir, Shader& shader, const glm::vec3& pos = glm::vec3(0.0f), float scale = 1.0f, const glm::vec3& color = glm::vec3(0.0f));
+    // only the geometry; the caller provides the model matrix and color, e.g. through DrawData
+    void DrawGeometry(Shader& shader);
+
+    // turns the arrow (pointing down -z) towards dir and places it at pos
+    static glm::mat4 ModelMatrix(const glm::vec3& dir, const glm::vec3& pos = glm::vec3(0.0f), float scale = 1.0f);
 
 private:
     Mesh generateShaft(float length, float radius, int segments);
@@ -0,0 +1,73 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Archive layout: header, entry table, hash slots and names up front, so opening an archive touches
+// one contiguous range; then the entry data, every entry starting on a 4 KB boundary so stored
+// entries are page aligned inside the mapping and no page holds two entries.
+const uint32_t ARCHIVE_VERSION = 1;
+const uint64_t ARCHIVE_ALIGNMENT = 4096;
+
+enum ArchiveCompression : uint32_t {
+    ARCHIVE_STORED = 0,
+    ARCHIVE_LZ4 = 1,
+};
+
+struct ArchiveHeader {
+    char magic[4];  // "RPAK"
+    uint32_t version;
+    uint32_t entryCount;
+    // hash slots, a power of two
+    uint32_t slotCount;
+    uint64_t entriesOffset;
+    uint64_t slotsOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+struct ArchiveEntry {
+    // FNV-1a of the normalized path
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t compression;
+    uint32_t reserved;
+};
+
+// '/' separators, no "." or empty segments, ".." folded into the segment before it
+std::string NormalizeAssetPath(const std::string& path);
+uint64_t HashAssetPath(const std::string& normalizedPath);
+
+// A mapped archive. The slots are an open addressing table of entry index + 1 (0 is empty), probed
+// linearly from the path's hash, so a lookup reads a few slots and one name.
+class AssetArchive {
+public:
+    bool Open(const std::string& path);
+    // entry index for a normalized path, or -1
+    int Find(const std::string& normalizedPath) const;
+    size_t EntryCount() const { return header ? header->entryCount : 0; }
+    const ArchiveEntry& Entry(int index) const { return entries[index]; }
+    std::string EntryName(int index) const;
+    // the entry's bytes as stored in the mapping, compressed or not
+    const char* StoredData(int index) const { return file.Data() + entries[index].offset; }
+
+private:
+    MappedFile file;
+    const ArchiveHeader* header = nullptr;
+    const ArchiveEntry* entries = nullptr;
+    const uint32_t* slots = nullptr;
+    const char* names = nullptr;
+};
+
+// Writes every file below the given directories (or the given files) into an archive, named by their
+// normalized paths. Entries are LZ4 compressed where that saves at least an eighth, stored otherwise.
+bool PackArchive(const std::string& archivePath, const std::vector<std::string>& inputs);
+
+#endif
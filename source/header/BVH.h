@@ -0,0 +1,104 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+#include "Frustum.h"
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMin = 0.0f;
+    float tMax = std::numeric_limits<float>::max();
+
+    Ray() {}
+    Ray(const glm::vec3& origin, const glm::vec3& direction) : origin(origin), direction(direction) {}
+};
+
+struct RayHit {
+    float t = std::numeric_limits<float>::max();
+    // index of the triangle in the mesh's index buffer (first index / 3)
+    unsigned int triangle = 0xFFFFFFFFu;
+    // id of the instance that was hit, set by SceneBVH
+    int instance = -1;
+    // barycentrics of the hit point relative to the triangle's second and third vertex
+    float u = 0.0f, v = 0.0f;
+
+    bool IsHit() const { return triangle != 0xFFFFFFFFu; }
+};
+
+// Four children per node with their boxes stored as SoA, so one SSE slab test covers the whole node.
+struct BVHNode4 {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    // >= 0 inner node index, < 0 leaf starting at primitive ~child
+    int child[4];
+    // primitives in a leaf, 0 for inner nodes and empty slots
+    int count[4];
+};
+
+// Binned SAH BVH over primitive bounds, collapsed to four-wide nodes. The top of the tree is built
+// as parallel jobs; primitives end up reordered so every leaf is a contiguous range.
+class BVH4 {
+public:
+    std::vector<BVHNode4> nodes;
+    // original primitive index of every leaf slot
+    std::vector<unsigned int> primitives;
+    AABB bounds;
+
+    void Build(const std::vector<AABB>& primitiveBounds, int maxLeafSize = 4);
+    bool IsEmpty() const { return nodes.empty(); }
+};
+
+// Triangle BVH of one mesh, in the mesh's local space.
+class MeshBVH {
+public:
+    BVH4 bvh;
+
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+    // nearest hit with t in (ray.tMin, hit.t); hit is only updated when something closer is found
+    bool Intersect(const Ray& ray, RayHit& hit) const;
+    // true as soon as any triangle is hit in (ray.tMin, ray.tMax)
+    bool Occluded(const Ray& ray) const;
+
+    // cache: the hash of the source geometry is stored so stale files are detected on load
+    void Save(std::ostream& out, unsigned long long sourceHash) const;
+    bool Load(std::istream& in, unsigned long long sourceHash);
+    static unsigned long long HashGeometry(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+private:
+    // triangles in leaf order, stored for Moller-Trumbore: v0, v1 - v0, v2 - v0
+    struct Triangle {
+        glm::vec3 v0, edge1, edge2;
+    };
+    std::vector<Triangle> triangles;
+};
+
+// Top level BVH over transformed mesh instances.
+class SceneBVH {
+public:
+    // the instance's id is reported in RayHit::instance; several instances may share an id
+    void AddInstance(const MeshBVH* mesh, const glm::mat4& transform, int id);
+    void Clear();
+    // call after adding or moving instances
+    void Build();
+
+    bool Intersect(const Ray& ray, RayHit& hit) const;
+    bool Occluded(const Ray& ray) const;
+
+private:
+    struct Instance {
+        const MeshBVH* mesh;
+        glm::mat4 transform;
+        glm::mat4 inverse;
+        int id;
+    };
+    std::vector<Instance> instances;
+    BVH4 bvh;
+};
+
+#endif
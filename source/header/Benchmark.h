@@ -0,0 +1,7 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// CPU benchmarks that need no window or GL context, run with "--bench [model path]".
+int RunBenchmarks(int argc, char** argv);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef BLOOM_RENDERER_H
+#define BLOOM_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+class Shader;
+
+struct BloomMip {
+    glm::ivec2 size;
+    unsigned int texture;
+};
+
+// Progressive bloom over a mip pyramid that starts at half resolution.
+// The scene is bright-passed and downsampled with a 13-tap filter, then the chain is walked back up
+// with a tent filter, each level blended additively onto the next larger one. Because every level
+// is a quarter of the one above, the cost stays fixed no matter how wide the bloom gets.
+class BloomRenderer {
+public:
+    std::vector<BloomMip> mips;
+    unsigned int FBO;
+    float threshold = 0.2f;
+    // width of the ramp above threshold over which pixels fade into the bloom
+    float softThreshold = 0.1f;
+    // upsample tent radius in texture coordinates
+    float filterRadius = 0.005f;
+
+    BloomRenderer(int width, int height, int mipCount = 6);
+
+    void Render(Shader& downsampleShader, Shader& upsampleShader, unsigned int hdrTexture, unsigned int quadVAO);
+    // half resolution bloom, valid after Render
+    unsigned int GetBloomTexture() const { return mips[0].texture; }
+
+private:
+    glm::ivec2 sourceSize;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "BVH.h"
 
 enum MoveDirection {
 	FORWARD,
@@ -43,6 +44,8 @@ public:
 	void ProcessKeyBoard(MoveDirection direction, float deltaTime);
 
 	glm::mat4 GetViewMat();
+	// world space ray through a point given in normalized device coordinates
+	Ray GetPickRay(float ndcX, float ndcY, float aspect) const;
 
 private:
 	void UpdateCamera();
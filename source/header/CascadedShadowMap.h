@@ -0,0 +1,65 @@
+#ifndef CASCADED_SHADOW_MAP_H
+#define CASCADED_SHADOW_MAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+class Shader;
+
+enum class ShadowFilter {
+    PCF,    // 3x3 depth comparisons per lookup
+    EVSM    // exponential variance moments, blurred once at shadow map resolution and mipmapped
+};
+
+// Directional light shadows split into view-frustum slices. Every cascade gets its own layer of a
+// GL_TEXTURE_2D_ARRAY and an orthographic light frustum fitted to its slice of the camera frustum.
+class CascadedShadowMap {
+public:
+    static const int MAX_CASCADES = 4;
+
+    unsigned int depthMapFBO;
+    unsigned int depthMapArray;
+    unsigned int resolution;
+    int cascadeCount;
+    // blend between logarithmic (1) and uniform (0) split distances
+    float splitLambda;
+    // how far behind a slice (towards the light) casters are still captured
+    float casterExtent;
+
+    glm::mat4 lightSpaceMatrices[MAX_CASCADES];
+    // view space far distance of every cascade
+    float cascadeSplits[MAX_CASCADES];
+    Frustum cascadeFrusta[MAX_CASCADES];
+
+    ShadowFilter filter = ShadowFilter::EVSM;
+    // positive EVSM warp exponent; 40 keeps the squared moment inside fp32 range
+    float evsmExponent = 40.0f;
+    // RG32F moments per cascade, created the first time they are filtered
+    unsigned int momentsArray = 0;
+
+    CascadedShadowMap(unsigned int resolution = 2048, int cascadeCount = MAX_CASCADES, float splitLambda = 0.75f, float casterExtent = 30.0f);
+
+    // refit every cascade to the current camera; lightDir points towards the light
+    void Update(const glm::mat4& view, float fov, float aspect, float near, float far, const glm::vec3& lightDir);
+    // bind the framebuffer with the cascade's layer attached and set the viewport
+    void BindCascade(int cascade);
+    // upload cascade matrices and split distances to a lighting shader
+    void SetUniforms(Shader& shader) const;
+    // EVSM only: warp every cascade's depth into moments and blur them with a separable Gaussian.
+    // warpBlurShader is blur.fs with SOURCE_ARRAY and EVSM_WARP, blurShader the plain 2D variant.
+    void FilterMoments(Shader& warpBlurShader, Shader& blurShader, unsigned int quadVAO);
+    // true if a caster with the given world bounds can throw a shadow into the cascade
+    bool IsCasterVisible(int cascade, const AABB& worldBounds) const { return cascadeFrusta[cascade].Intersects(worldBounds); }
+
+private:
+    unsigned int momentsFBO = 0;
+    // horizontally blurred moments of the cascade being filtered
+    unsigned int blurTexture = 0;
+    unsigned int blurFBO = 0;
+
+    void CreateMomentTargets();
+    glm::mat4 FitCascade(const glm::mat4& view, float fov, float aspect, float sliceNear, float sliceFar, const glm::vec3& lightDir) const;
+};
+
+#endif
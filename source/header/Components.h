@@ -0,0 +1,80 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <glm/glm.hpp>
+#include "Frustum.h"
+#include "SceneGraph.h"
+
+class Model;
+
+// Scene object components stored in the ECS World. All of them are plain data.
+
+// the scene graph node whose world matrix the entity follows
+struct Transform {
+    SceneNode node;
+};
+
+// copy of the node's world matrix, refreshed every frame by UpdateTransforms()
+struct WorldTransform {
+    glm::mat4 matrix;
+};
+
+struct Bounds {
+    AABB local;
+    AABB world;
+};
+
+// the entity's entry in the scene's SpatialIndex, kept at Bounds::world by UpdateSpatialIndex()
+struct SpatialProxy {
+    int proxy;
+};
+
+// a drawable object: instanceCount MeshInstances starting at firstInstance of the scene's instance list
+struct Renderable {
+    const Model* model;
+    int firstInstance;
+    int instanceCount;
+    // set by frustum culling, cleared again by occlusion culling
+    bool visible;
+};
+
+const int MAX_OBJECT_LIGHTS = 8;
+
+// the point lights whose radius reaches the entity's bounds, strongest first, as indices into the
+// packed light array; filled by AssignLights() for forward shading
+struct LightList {
+    int count;
+    int lights[MAX_OBJECT_LIGHTS];
+    // light intensity at the nearest point of the bounds
+    float strength[MAX_OBJECT_LIGHTS];
+};
+
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    // color of the light's sphere in the HDR buffer
+    glm::vec3 hdrColor;
+    float constant;
+    float linear;
+    float quadratic;
+    // distance at which the light stops contributing, see CalculatePointLightRadius()
+    float radius;
+};
+
+struct DirectionalLight {
+    glm::vec3 direction;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// flat colored arrow drawn along the direction of the entity's DirectionalLight
+struct DebugArrow {
+    glm::vec3 position;
+    float length;
+    glm::vec3 color;
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+// Entity handle; the generation tells a recycled index apart from the entity that used it before.
+struct Entity {
+    uint32_t index = 0xFFFFFFFFu;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+typedef uint64_t ComponentMask;
+const int MAX_COMPONENT_TYPES = 64;
+
+// Component ids are handed out on first use of a type. Components are plain data: they are moved
+// between chunks with memcpy and start zeroed.
+class ComponentRegistry {
+public:
+    template <typename T>
+    static int Id()
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "components must be trivially copyable");
+        static_assert(alignof(T) <= 16, "components may be aligned to at most 16 bytes");
+        static const int id = Register(sizeof(T));
+        return id;
+    }
+    static size_t Size(int id);
+
+private:
+    static int Register(size_t size);
+};
+
+template <typename... Ts>
+ComponentMask MaskOf()
+{
+    ComponentMask mask = 0;
+    int expand[] = { 0, (mask |= ComponentMask(1) << ComponentRegistry::Id<Ts>(), 0)... };
+    (void)expand;
+    return mask;
+}
+
+// All entities with exactly the same component set. Their components live in fixed size chunks,
+// one tightly packed array per component type (SoA), so a query streams through memory.
+class Archetype {
+public:
+    static const size_t CHUNK_BYTES = 16 * 1024;
+
+    struct Chunk {
+        std::unique_ptr<unsigned char[]> data;
+        int count = 0;
+    };
+
+    ComponentMask mask;
+    // component ids in ascending order, with the byte offset of each array inside a chunk
+    std::vector<int> types;
+    std::vector<size_t> offsets;
+    size_t chunkBytes;
+    int capacity;
+    std::vector<Chunk> chunks;
+
+    explicit Archetype(ComponentMask mask);
+
+    int Column(int typeId) const;
+    Entity* Entities(int chunk) { return (Entity*)chunks[chunk].data.get(); }
+    unsigned char* ColumnData(int chunk, int column) { return chunks[chunk].data.get() + offsets[column]; }
+    template <typename T>
+    T* Components(int chunk) { return (T*)ColumnData(chunk, Column(ComponentRegistry::Id<T>())); }
+};
+
+// Archetype based entity component store.
+class World {
+public:
+    template <typename... Ts>
+    Entity Create(const Ts&... components)
+    {
+        Entity entity = CreateEntity(MaskOf<Ts...>());
+        int expand[] = { 0, (*Get<Ts>(entity) = components, 0)... };
+        (void)expand;
+        return entity;
+    }
+    void Destroy(Entity entity);
+    bool IsAlive(Entity entity) const;
+
+    // nullptr when the entity does not have the component; valid until the entity changes archetype
+    // or another entity of its archetype is destroyed
+    template <typename T>
+    T* Get(Entity entity) { return (T*)GetComponent(entity, ComponentRegistry::Id<T>()); }
+    template <typename T>
+    bool Has(Entity entity) const { return IsAlive(entity) && (records[entity.index].archetype->mask & MaskOf<T>()) != 0; }
+    template <typename T>
+    void Add(Entity entity, const T& component)
+    {
+        Move(entity, records[entity.index].archetype->mask | MaskOf<T>());
+        *Get<T>(entity) = component;
+    }
+    template <typename T>
+    void Remove(Entity entity) { Move(entity, records[entity.index].archetype->mask & ~MaskOf<T>()); }
+
+    // func(count, entities, T1* column1, T2* column2, ...) once per chunk holding all of Ts
+    template <typename... Ts, typename Func>
+    void EachChunk(Func func)
+    {
+        ComponentMask mask = MaskOf<Ts...>();
+        for (auto& archetype : archetypes)
+        {
+            if ((archetype->mask & mask) != mask)
+                continue;
+            for (int c = 0; c < (int)archetype->chunks.size(); c++)
+            {
+                if (archetype->chunks[c].count > 0)
+                    func(archetype->chunks[c].count, archetype->Entities(c), archetype->template Components<Ts>(c)...);
+            }
+        }
+    }
+
+    // func(entity, T1&, T2&, ...) for every entity holding all of Ts
+    template <typename... Ts, typename Func>
+    void Each(Func func)
+    {
+        EachChunk<Ts...>([&](int count, const Entity* entities, Ts*... columns) {
+            for (int i = 0; i < count; i++)
+                func(entities[i], columns[i]...);
+        });
+    }
+
+    // Each() with the matching chunks spread over the job system. func must only touch its own entity's
+    // components; entities must not be created, destroyed or change archetype meanwhile.
+    template <typename... Ts, typename Func>
+    void ParallelEach(Func func)
+    {
+        ScratchScope scratch;
+        ArenaVector<ChunkRef> matching{ ArenaAllocator<ChunkRef>(scratch.arena) };
+        MatchingChunks(MaskOf<Ts...>(), matching);
+        JobSystem::ParallelFor((int)matching.size(), 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+            {
+                Archetype& archetype = *matching[i].archetype;
+                int c = matching[i].chunk;
+                const Entity* entities = archetype.Entities(c);
+                for (int row = 0; row < archetype.chunks[c].count; row++)
+                    func(entities[row], archetype.template Components<Ts>(c)[row]...);
+            }
+        });
+    }
+
+    template <typename... Ts>
+    int Count()
+    {
+        int count = 0;
+        EachChunk<Ts...>([&](int chunkCount, const Entity*, Ts*...) { count += chunkCount; });
+        return count;
+    }
+
+private:
+    struct Record {
+        Archetype* archetype = nullptr;
+        int chunk = 0;
+        int row = 0;
+        uint32_t generation = 0;
+    };
+    struct ChunkRef {
+        Archetype* archetype;
+        int chunk;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::vector<Record> records;
+    std::vector<uint32_t> freeIndices;
+
+    Entity CreateEntity(ComponentMask mask);
+    void* GetComponent(Entity entity, int typeId);
+    // move the entity into the archetype of mask, keeping the components both have
+    void Move(Entity entity, ComponentMask mask);
+    Archetype& FindArchetype(ComponentMask mask);
+    // append a zeroed row for entity at the end of the archetype
+    void AllocateRow(Archetype& archetype, Entity entity);
+    // fill the hole with the archetype's last row
+    void RemoveRow(Archetype& archetype, int chunk, int row);
+    void MatchingChunks(ComponentMask mask, ArenaVector<ChunkRef>& matching);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for memory that lives at most one frame. Allocate() bumps a pointer and Reset()
+// hands everything back at once. When a block runs out another one is chained on, and the next
+// Reset() merges them into one block big enough for the whole frame, so after the first few frames
+// the arena no longer touches the heap.
+// Nothing in the arena is ever destroyed; only put trivially destructible objects into it.
+class FrameArena {
+public:
+    // position to Rewind() to
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    explicit FrameArena(size_t capacity = 64 * 1024);
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    // count default constructed objects
+    template <typename T>
+    T* New(size_t count = 1)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        T* objects = (T*)Allocate(sizeof(T) * count, alignof(T));
+        for (size_t i = 0; i < count; i++)
+            new (objects + i) T();
+        return objects;
+    }
+    // printf into the arena; the string is valid until the arena is reset or rewound past it
+    const char* Format(const char* format, ...);
+
+    void Reset();
+    Marker Mark() const { return { current, offset }; }
+    void Rewind(const Marker& marker);
+
+    size_t Used() const;
+    size_t Capacity() const;
+    // most bytes in use at once since the arena was created
+    size_t HighWater() const { return highWater; }
+
+    // the calling thread's arena for temporaries of a single function; use through ScratchScope
+    static FrameArena& Scratch();
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t highWater = 0;
+
+    void AddBlock(size_t size);
+};
+
+// Gives back everything allocated from the thread's scratch arena when it goes out of scope.
+class ScratchScope {
+public:
+    ScratchScope() : arena(FrameArena::Scratch()), marker(arena.Mark()) {}
+    ~ScratchScope()
+    {
+        // the outermost scope also merges the blocks the scratch arena grew by
+        if (marker.block == 0 && marker.offset == 0)
+            arena.Reset();
+        else
+            arena.Rewind(marker);
+    }
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+    FrameArena& arena;
+
+private:
+    FrameArena::Marker marker;
+};
+
+// STL allocator on top of an arena; deallocate() is a no-op, the memory goes with the arena.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return (T*)arena->Allocate(count * sizeof(T), alignof(T)); }
+    void deallocate(T*, size_t) {}
+
+    FrameArena* arena = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Lock-free hand-off of per-frame data from one producer thread to one consumer thread.
+// There are depth slots: the producer fills frame N + 1 while the consumer still works on frame N,
+// and blocks once it is depth frames ahead. Slots are reused, so their vectors keep their capacity.
+template <typename T>
+class FramePipeline {
+public:
+    explicit FramePipeline(int depth = 2) : slots(depth < 1 ? 1 : depth), written(0), read(0) {}
+
+    int Depth() const { return (int)slots.size(); }
+
+    // producer: the slot to fill next, once the consumer is done with its previous frame
+    T& BeginWrite()
+    {
+        uint64_t frame = written.load(std::memory_order_relaxed);
+        while (frame - read.load(std::memory_order_acquire) >= slots.size())
+            std::this_thread::yield();
+        return slots[frame % slots.size()];
+    }
+    // producer: publish the slot returned by BeginWrite()
+    void EndWrite() { written.fetch_add(1, std::memory_order_release); }
+
+    // consumer: the oldest published frame
+    T& BeginRead()
+    {
+        uint64_t frame = read.load(std::memory_order_relaxed);
+        while (written.load(std::memory_order_acquire) == frame)
+            std::this_thread::yield();
+        return slots[frame % slots.size()];
+    }
+    // consumer: hand the slot returned by BeginRead() back to the producer
+    void EndRead() { read.fetch_add(1, std::memory_order_release); }
+
+private:
+    std::vector<T> slots;
+    // frames published and frames consumed so far; each is only written by one side
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> read;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <limits>
+
+// Axis aligned bounding box, used for culling and spatial queries.
+struct AABB {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    AABB() {}
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    bool IsValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extents() const { return (max - min) * 0.5f; }
+    void Expand(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+    void Expand(const AABB& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+};
+
+// Returns the world space box enclosing box after transform.
+AABB TransformAABB(const AABB& box, const glm::mat4& transform);
+
+// Six clip planes (left, right, bottom, top, near, far) extracted from a view-projection matrix.
+// Plane normals point inwards, so a point is inside when dot(plane.xyz, p) + plane.w >= 0.
+class Frustum {
+public:
+    glm::vec4 planes[6];
+
+    Frustum() {}
+    explicit Frustum(const glm::mat4& viewProjection);
+
+    bool Intersects(const AABB& box) const;
+    bool Intersects(const glm::vec3& center, float radius) const;
+};
+
+// World space corners of the frustum described by the inverse of a view-projection matrix.
+void GetFrustumCorners(const glm::mat4& viewProjection, glm::vec3 corners[8]);
+
+#endif
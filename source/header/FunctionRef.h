@@ -0,0 +1,37 @@
+#ifndef FUNCTION_REF_H
+#define FUNCTION_REF_H
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class FunctionRef;
+
+// Non-owning reference to a callable, for parameters that are only called before the function returns
+// (JobSystem::ParallelFor, the SpatialIndex queries, ShadowAtlas::Render). A lambda bound to a
+// const std::function& is wrapped in a temporary std::function, which copies the closure to the heap
+// once it outgrows the small buffer, so per frame callers would allocate every frame. FunctionRef only
+// keeps the closure's address, so lambdas are passed as they are and must outlive the call.
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)> {
+public:
+    template <typename Callable, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<Callable>::type, FunctionRef>::value>::type>
+    FunctionRef(Callable&& callable)
+        : object((void*)std::addressof(callable)), invoke(&Invoke<typename std::remove_reference<Callable>::type>) {}
+
+    Result operator()(Args... args) const { return invoke(object, std::forward<Args>(args)...); }
+
+private:
+    template <typename Callable>
+    static Result Invoke(void* object, Args... args)
+    {
+        return (*(Callable*)object)(std::forward<Args>(args)...);
+    }
+
+    void* object;
+    Result (*invoke)(void*, Args...);
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Thin cache in front of the GL state the renderer changes every frame.
+// Calls that would not change anything are dropped before they reach the driver; every call is
+// counted as issued or filtered so the effect can be watched per frame.
+// All binds in the renderer must go through here, otherwise the cache goes stale; call
+// Invalidate() after code that changes state behind its back.
+class GLState {
+public:
+    struct Counters {
+        unsigned int issued = 0;
+        unsigned int filtered = 0;
+    };
+
+    static void UseProgram(unsigned int program);
+    static void BindVertexArray(unsigned int vao);
+    // GL_FRAMEBUFFER, i.e. both draw and read bindings
+    static void BindFramebuffer(unsigned int fbo);
+    static void ActiveTexture(GLenum unit);
+    // binds to the active unit, like glBindTexture
+    static void BindTexture(GLenum target, unsigned int texture);
+    static void Enable(GLenum capability);
+    static void Disable(GLenum capability);
+    static void DepthFunc(GLenum func);
+    static void DepthMask(GLboolean flag);
+    static void CullFace(GLenum mode);
+    static void BlendFunc(GLenum sfactor, GLenum dfactor);
+    static void BlendEquation(GLenum mode);
+    static void Viewport(int x, int y, int width, int height);
+    static void Scissor(int x, int y, int width, int height);
+    // indexed GL_UNIFORM_BUFFER binding, like glBindBufferRange
+    static void BindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size);
+
+    // forget all cached values; the next call of each kind is always issued
+    static void Invalidate();
+    // finish the frame's counters into lastFrame and start counting again
+    static void BeginFrame();
+
+    static Counters frame;
+    static Counters lastFrame;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "VirtualFileSystem.h"
+
+// A byte range of one of the asset's buffers, pointing into the mapped file.
+struct GltfBufferView {
+    const unsigned char* data = nullptr;
+    size_t byteLength = 0;
+    // 0 for tightly packed elements
+    int byteStride = 0;
+};
+
+// Typed elements inside a buffer view. glTF spells component types with the GL enums (GL_FLOAT,
+// GL_UNSIGNED_SHORT, ...), so they go to glVertexAttribPointer as they are.
+struct GltfAccessor {
+    int bufferView = -1;
+    size_t byteOffset = 0;
+    unsigned int componentType = 0;
+    // 1 for SCALAR up to 4 for VEC4, 16 for MAT4
+    int components = 0;
+    bool normalized = false;
+    size_t count = 0;
+    // bytes from one element to the next: the view's stride, or the packed element size
+    size_t stride = 0;
+};
+
+// One indexed triangle list; attributes and indices are accessor indices, -1 where absent.
+struct GltfPrimitive {
+    int position = -1;
+    int normal = -1;
+    int texCoord = -1;
+    // vec4, the bitangent's handedness in w
+    int tangent = -1;
+    int indices = -1;
+    int material = -1;
+};
+
+struct GltfMesh {
+    std::string name;
+    std::vector<GltfPrimitive> primitives;
+};
+
+// An image either stored in a buffer view (GLB) or in a file next to the asset.
+struct GltfImage {
+    std::string uri;
+    int bufferView = -1;
+};
+
+// The metallic-roughness PBR parameters; maps are image indices, -1 where absent.
+struct GltfMaterial {
+    std::string name;
+    glm::vec4 baseColorFactor = glm::vec4(1.0f);
+    float metallicFactor = 1.0f;
+    float roughnessFactor = 1.0f;
+    int baseColorImage = -1;
+    // roughness in green, metalness in blue
+    int metallicRoughnessImage = -1;
+    int normalImage = -1;
+};
+
+struct GltfNode {
+    // relative to the parent node
+    glm::mat4 transform = glm::mat4(1.0f);
+    int mesh = -1;
+    std::vector<int> children;
+};
+
+// A glTF 2.0 asset, binary (.glb) or JSON with external buffers (.gltf). The files are opened through
+// the VirtualFileSystem, mapped rather than read: buffer views point straight into the mapping, so
+// vertex data can go to the GPU in the bytes it was stored in. Triangle primitives only; sparse
+// accessors, data URIs and extensions are not supported.
+class GltfAsset {
+public:
+    std::vector<GltfBufferView> bufferViews;
+    std::vector<GltfAccessor> accessors;
+    std::vector<GltfMesh> meshes;
+    std::vector<GltfMaterial> materials;
+    std::vector<GltfImage> images;
+    std::vector<GltfNode> nodes;
+    // root nodes of the default scene
+    std::vector<int> roots;
+
+    // maps the file and its buffers and reads the JSON; on failure prints why and returns false
+    bool Load(const std::string& path);
+    // the first element of an accessor, inside its buffer view
+    const unsigned char* AccessorData(const GltfAccessor& accessor) const;
+    // up to four components of every element converted to float (normalized integers scaled to
+    // [0, 1] or [-1, 1]), written outStride floats apart
+    void ReadFloats(int accessor, int components, float* out, size_t outStride) const;
+    // an index accessor of any unsigned type, widened
+    void ReadIndices(int accessor, std::vector<unsigned int>& indices) const;
+
+private:
+    // the GLB itself, or the .gltf's external .bin buffers; kept mapped while the views are used
+    std::vector<std::unique_ptr<AssetFile>> files;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "FunctionRef.h"
+
+typedef std::function<void()> Job;
+
+class JobSystem;
+
+// Counts unfinished jobs. Jobs started with a counter increment it and decrement it when they
+// finish; JobSystem::Wait() and JobSystem::RunAfter() key off it reaching zero.
+class JobCounter {
+public:
+    JobCounter() : pending(0) {}
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    // polling only; use JobSystem::Wait() before the counter goes out of scope
+    bool IsDone() const { return pending.load() == 0; }
+
+private:
+    friend class JobSystem;
+    struct Continuation {
+        Job job;
+        JobCounter* counter;
+    };
+
+    std::atomic<int> pending;
+    std::mutex mutex;
+    std::vector<Continuation> continuations;
+};
+
+// Work stealing job scheduler. Every worker owns a deque: it pushes and pops its own jobs at the
+// back (newest first, still warm in cache) and idle workers steal from the front of the others
+// (oldest first, usually the biggest pieces of work). The main thread owns deque 0 and runs jobs
+// while it waits. Without Initialize() or without workers every job runs inline.
+class JobSystem {
+public:
+    // workerCount < 0 starts one worker per core besides the main thread; call from the main thread
+    static void Initialize(int workerCount = -1);
+    static void Shutdown();
+    // workers plus the main thread
+    static int ThreadCount();
+
+    static void Run(Job job, JobCounter* counter = nullptr);
+    // start job once dependency has reached zero
+    static void RunAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+    // run other jobs until counter reaches zero
+    static void Wait(JobCounter& counter);
+
+    // func(begin, end) over [0, count) in batches of at least minBatch. Batches start large and
+    // shrink as the range runs out, so uneven work still finishes together. Returns when done.
+    static void ParallelFor(int count, int minBatch, FunctionRef<void(int, int)> func);
+
+    // GL calls must come from the thread that owns the context: jobs queue that work here and
+    // the context's thread runs it in PumpGLThread(), while loading and then once per frame
+    static void RunOnGLThread(Job job);
+    // returns how many jobs ran
+    static int PumpGLThread();
+    static bool IsMainThread();
+
+private:
+    static void Push(Job job, JobCounter* counter);
+    static bool RunOne(int thread);
+    static void Finish(JobCounter* counter);
+    static void WorkerLoop(int thread);
+};
+
+#endif
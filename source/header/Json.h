@@ -0,0 +1,41 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A parsed JSON document node. Lookups of missing members or elements return a shared null value,
+// so nested reads such as root["materials"][0]["name"] need no checks in between.
+class JsonValue {
+public:
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    // array elements, or object member values in document order
+    std::vector<JsonValue> elements;
+    // object member names, parallel to elements
+    std::vector<std::string> keys;
+
+    bool IsNull() const { return type == Null; }
+    size_t Size() const { return type == Array || type == Object ? elements.size() : 0; }
+    const JsonValue& operator[](size_t index) const;
+    // literal indices would be ambiguous between size_t and const char*
+    const JsonValue& operator[](int index) const { return (*this)[index < 0 ? elements.size() : (size_t)index]; }
+    const JsonValue& operator[](const char* key) const;
+
+    // the value, or the fallback for a missing value of another type
+    double AsNumber(double fallback = 0.0) const { return type == Number ? number : fallback; }
+    int AsInt(int fallback = 0) const { return type == Number ? (int)number : fallback; }
+    bool AsBool(bool fallback = false) const { return type == Bool ? boolean : fallback; }
+    const std::string& AsString() const;
+};
+
+// Parses RFC 8259 JSON; \u escapes are written as UTF-8. On failure returns false and describes the
+// first error with its byte offset.
+bool ParseJson(const char* text, size_t size, JsonValue& root, std::string& error);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <cstddef>
+
+// The LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so archives
+// stay readable by the reference tools. The compressor is the greedy single-hash variant: fast and
+// simple rather than the best ratio.
+
+// largest compressed size of size bytes, for sizing the destination
+size_t Lz4CompressBound(size_t size);
+// returns the compressed size, or 0 when it does not fit in capacity
+size_t Lz4Compress(const char* source, size_t size, char* destination, size_t capacity);
+// decodes exactly destinationSize bytes; false on corrupt input instead of reading or writing out of bounds
+bool Lz4Decompress(const char* source, size_t sourceSize, char* destination, size_t destinationSize);
+
+#endif
@@ -6,6 +6,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <vector>
+#include "Frustum.h"
+#include "BVH.h"
+#include "Meshlet.h"
 
 class Shader;
 
@@ -23,20 +26,78 @@ struct Texture {
     std::string path;
 };
 
+// One vertex attribute read in place from a GL buffer, such as a glTF accessor inside an uploaded
+// buffer view; buffer 0 leaves the attribute disabled.
+struct VertexStream {
+    unsigned int buffer = 0;
+    int size = 0;
+    GLenum type = GL_FLOAT;
+    bool normalized = false;
+    int stride = 0;
+    size_t offset = 0;
+};
+
+// Attributes of a mesh whose vertices stay in the layout they were stored in. There is no bitangent:
+// the vertex shaders rebuild it from the normal and the tangent's handedness in w.
+struct VertexStreams {
+    VertexStream position;
+    VertexStream normal;
+    VertexStream texCoords;
+    VertexStream tangent;
+};
+
+// Metallic-roughness factors; the defaults shade meshes without PBR parameters as before.
+struct MeshMaterial {
+    glm::vec4 baseColorFactor = glm::vec4(1.0f);
+    float metallicFactor = 0.0f;
+    float roughnessFactor = 1.0f;
+    // texture_roughness1 is a glTF metallic-roughness map: roughness in green, metalness in blue
+    bool metallicRoughness = false;
+};
+
+// One level of detail: a range of the mesh's element buffer over the shared vertices.
+struct MeshLOD {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    // largest deviation from the full resolution mesh, in model units
+    float error;
+};
+
 class Mesh {
 public:
     //mesh data
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
+    // local space bounds of the vertices, used for culling
+    AABB bounds;
+    // triangle BVH for ray queries, filled in by Model
+    MeshBVH bvh;
+    // full resolution first, then coarser and coarser; always holds at least LOD 0
+    std::vector<MeshLOD> lods;
+    // clusters of LOD 0 for culling below the whole mesh, filled in by Model
+    MeshletSet meshlets;
+    MeshMaterial material;
 
     Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
-    void Draw(Shader& shader);
+    // draws from the given buffers instead of uploading the vertices; these stay on the CPU for bounds,
+    // BVH, meshlets and LODs
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+        const VertexStreams& streams, const MeshMaterial& material);
+    void Draw(Shader& shader, int instanceCount = 1, int lod = 0) const;
+    // draw ranges of the element buffer with one multi-draw, e.g. the meshlets that survived culling
+    void DrawRanges(Shader& shader, const IndexRange* ranges, int rangeCount) const;
+    // append simplified index lists after the full mesh in the element buffer, finest first
+    void SetLODs(const std::vector<std::vector<unsigned int>>& lodIndices, const std::vector<float>& errors);
 private:
     //render data
-    unsigned int VAO, VBO, EBO;
+    unsigned int VAO, VBO = 0, EBO;
+    // sampler uniform of each texture ("material.texture_diffuse1", ...), built once instead of per draw
+    std::vector<std::string> samplerNames;
 
-    void SetupMesh();
+    // interleaves the vertices into VBO, or points the attributes at the streams when given
+    void SetupMesh(const VertexStreams* streams = nullptr);
+    void BindTextures(Shader& shader) const;
 };
 
 
@@ -0,0 +1,35 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include "Mesh.h"
+
+// Quadric error metric simplification (Garland & Heckbert) by half-edge collapses onto existing
+// vertices, so every level of detail indexes the original vertex buffer.
+// Vertices with equal position, normal and UV are treated as one. Vertices that share a position but
+// not their attributes (UV and normal seams) only collapse along the seam, together with their twin on
+// the other side; vertices on open borders only collapse along the border.
+// Returns at most targetIndexCount indices unless no collapse below maxError is left; error receives
+// the largest deviation from the original surface that was introduced, in model units.
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    size_t targetIndexCount, float maxError, float& error);
+
+// The simplified levels of one mesh, finest first, each halving the triangles of the one before.
+// Every level is simplified from the full mesh so errors do not accumulate.
+struct MeshLODChain {
+    static const int MAX_LODS = 5;
+
+    std::vector<std::vector<unsigned int>> indices;
+    std::vector<float> errors;
+
+    void Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& meshIndices);
+    // versioned binary cache keyed by a hash of the source geometry, like MeshBVH
+    void Save(std::ostream& out, unsigned long long sourceHash) const;
+    bool Load(std::istream& in, unsigned long long sourceHash);
+    // positions, normals, UVs and indices: everything the simplifier looks at
+    static unsigned long long HashGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& meshIndices);
+};
+
+#endif
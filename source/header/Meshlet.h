@@ -0,0 +1,50 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Frustum.h"
+
+// A contiguous range of a mesh's element buffer.
+struct IndexRange {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+};
+
+// Where clusters are culled from. The frustum rejects clusters outside it; the eye position (or view
+// direction for orthographic views such as the sun's) rejects clusters whose triangles all face away.
+struct MeshletView {
+    Frustum frustum;
+    bool testFrustum = true;
+    bool orthographic = false;
+    glm::vec3 position = glm::vec3(0.0f);
+    // from the eye into the scene, orthographic views only
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+};
+
+// A mesh's full resolution triangles split into small spatially coherent clusters, each a range of the
+// element buffer with a bounding sphere and a cone holding all of its triangle normals. The bounds are
+// stored as SoA arrays padded to a multiple of four so they are tested four at a time with SSE.
+class MeshletSet {
+public:
+    static const int MAX_VERTICES = 64;
+    static const int MAX_TRIANGLES = 124;
+
+    std::vector<IndexRange> meshlets;
+
+    // reorders indices so every meshlet's triangles are contiguous. The vertex limit counts distinct
+    // positions, so meshes imported without shared vertices still get full clusters.
+    void Build(const std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices);
+    int Count() const { return (int)meshlets.size(); }
+
+    // writes the visible meshlets to ranges, merging neighbours in the element buffer, and returns how
+    // many ranges were written; ranges needs room for Count() entries. model maps the mesh to the world.
+    int Cull(const glm::mat4& model, const MeshletView& view, IndexRange* ranges) const;
+
+private:
+    // bounding sphere and normal cone; a cone with cutoff above one never culls
+    std::vector<float> centerX, centerY, centerZ, radius;
+    std::vector<float> axisX, axisY, axisZ, cutoff;
+};
+
+#endif
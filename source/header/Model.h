@@ -4,38 +4,85 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <memory>
 #include <vector>
 #include <iostream>
 
+#include "../header/GltfLoader.h"
+#include "../header/JobSystem.h"
 #include "../header/Mesh.h"
+#include "../header/OcclusionCuller.h"
+#include "../header/SceneGraph.h"
 
 class Shader;
 class Mesh;
 
+// One node of the imported hierarchy; nodes are stored parents first.
+struct ModelNode {
+    int parent;
+    // relative to the parent node
+    glm::mat4 transform;
+    std::vector<unsigned int> meshes;
+};
+
 class Model
 {
 public:
     // model data 
     std::vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     std::vector<Mesh>    meshes;
+    std::vector<ModelNode> nodes;
     std::string directory;
+    // model space bounds enclosing every mesh placed by its node
+    AABB bounds;
+    // coarse copy of all meshes for the software occlusion rasterizer
+    OccluderMesh occluder;
     bool gammaCorrection;
 
     Model(std::string path)
     {
         loadModel(path);
     }
-    void Draw(Shader& shader);
+    // draws every mesh with the caller's model matrix, ignoring node transforms
+    void Draw(Shader& shader, int instanceCount = 1);
+    // add the node hierarchy under parent, rooted at a new node with the given local transform;
+    // appends one MeshInstance per drawn mesh and returns the new root
+    SceneNode Instantiate(SceneGraph& graph, SceneNode parent, const glm::mat4& transform,
+        std::vector<MeshInstance>& instances) const;
 private:
 
     void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
+    // split every mesh into meshlets, reordering its indices, before anything else reads them
+    void buildMeshlets();
+    void buildBVHs(const std::string& cachePath);
+    // simplified levels of detail for every mesh, built by jobs and cached next to the model
+    void buildLODs(const std::string& cachePath);
+    // OBJ files go through the built-in parser, everything else through Assimp
+    bool loadObj(const std::string& path);
+    // glTF and GLB: buffer views go to the GPU as stored and the accessors become the attribute setup
+    bool loadGltf(const std::string& path);
+    // the textures of a glTF material, with 1x1 stand-ins for maps it does not have
+    std::vector<Texture> gltfMaterialTextures(const GltfAsset& asset, const GltfMaterial& material, const std::string& assetPath);
+    Texture gltfImageTexture(const GltfAsset& asset, int image, const std::string& typeName, const std::string& assetPath);
+    // a 1x1 texture of one color, shared by every mesh that asks for the same color
+    Texture solidTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a, const std::string& typeName);
+    void processNode(aiNode* node, const aiScene* scene, int parent);
     Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    // welds the imported vertices, generates tangents and uploads the mesh
+    Mesh finishMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const std::vector<Texture>& textures);
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type,
         std::string typeName);
     std::vector<Texture> manualLoadMaterialTextures(std::string path, std::string typeName);
+    // returns the texture name right away; the image is decoded by a job and uploaded on the main thread
     unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
-    void calculateTangentBitangent(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+    // the same for an encoded image already in memory, such as one stored inside a GLB
+    unsigned int TextureFromMemory(std::shared_ptr<std::vector<unsigned char>> encoded, const std::string& name);
+
+    JobCounter textureDecodes;
+    // vertex welding at import: vertices before and after, and the time it took
+    size_t importedVertices = 0;
+    size_t weldedVertices = 0;
+    double weldSeconds = 0.0;
 };
 
 #endif 
@@ -0,0 +1,46 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <string>
+#include <vector>
+#include "Mesh.h"
+
+// Texture maps of one MTL material, relative to the model's directory; empty where not given.
+struct ObjMaterial {
+    std::string name;
+    std::string diffuseMap;
+    std::string specularMap;
+    // map_Bump, bump or norm
+    std::string normalMap;
+};
+
+// Indexed triangles of one object or group and material. Vertices are unique v/vt/vn combinations,
+// with UVs flipped vertically like aiProcess_FlipUVs; faces without normals get smooth ones.
+struct ObjMesh {
+    std::string name;
+    std::string materialName;
+    // index into ObjScene::materials, -1 without a material
+    int material = -1;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+struct ObjScene {
+    std::vector<ObjMesh> meshes;
+    std::vector<ObjMaterial> materials;
+    // mtllib file names in the order they appear
+    std::vector<std::string> materialLibraries;
+};
+
+// Parses OBJ text; meshes name their materials, which LoadObj resolves. The text is split into
+// line-aligned chunks parsed by parallel jobs: a first pass counts the v, vt and vn lines of every
+// chunk, so the second writes its attributes straight to their final place and resolves relative
+// indices on the spot. Polygons are triangulated as fans; lines, points and smoothing groups are
+// ignored. Returns false on a malformed face or an index out of range.
+bool ParseObj(const char* text, size_t size, ObjScene& scene);
+// appends the materials of one MTL file
+void ParseMtl(const char* text, size_t size, std::vector<ObjMaterial>& materials);
+// maps the file, parses it and its material libraries, and resolves every mesh's material
+bool LoadObj(const std::string& path, ObjScene& scene);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Frustum.h"
+
+// Low polygon stand-in for a mesh, drawn only into the software depth buffer.
+struct OccluderMesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Simplify a mesh into an occluder made of boxes: the mesh is voxelized on a gridResolution^3 grid over
+// bounds, the cells no triangle touches and the outside cannot reach are merged into boxes. The boxes
+// lie strictly inside the closed parts of the mesh, concave or not, so the occluder never hides what
+// the mesh would not. Open meshes and parts thinner than a cell enclose nothing and give no boxes.
+OccluderMesh SimplifyOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+    const AABB& bounds, int gridResolution = 16);
+
+// CPU occlusion culling: occluders are rasterized into a small depth buffer with SSE (AVX2 when the
+// build enables it), with rows of tiles spread over the job system. Every tile also keeps the farthest
+// depth written to it, so most bounds tests finish at tile granularity before touching pixels.
+// Depth is window depth in [0, 1], 1 being the far plane.
+class OcclusionCuller {
+public:
+    static const int TILE_SIZE = 8;
+
+    // statistics of the current frame
+    int occluderTriangles = 0;
+    int objectsTested = 0;
+    int objectsCulled = 0;
+    float rasterizeMs = 0.0f;
+
+    // width must be a multiple of the SIMD width, both dimensions multiples of TILE_SIZE
+    OcclusionCuller(int width = 256, int height = 144);
+
+    // start collecting occluders seen through viewProjection
+    void BeginFrame(const glm::mat4& viewProjection);
+    void AddOccluder(const OccluderMesh& mesh, const glm::mat4& model);
+    // clear the depth buffer, rasterize every occluder of the frame and build the tile depths
+    void Rasterize();
+
+    // false only if the box lies completely behind the rasterized occluders
+    bool IsVisible(const AABB& worldBounds);
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    const std::vector<float>& GetDepthBuffer() const { return depth; }
+
+private:
+    struct ScreenTriangle {
+        // inclusive pixel bounds
+        int minX, minY, maxX, maxY;
+        // edge functions e = a * x + b * y + c, positive inside
+        float edgeA[3], edgeB[3], edgeC[3];
+        // depth plane z = a * x + b * y + c
+        float depthA, depthB, depthC;
+    };
+
+    int width, height;
+    int tilesX, tilesY;
+    std::vector<float> depth;
+    // farthest depth in every tile
+    std::vector<float> tileMaxDepth;
+
+    glm::mat4 viewProjection;
+    // clip space corners of the frame's occluder triangles, three per triangle
+    std::vector<glm::vec4> clipVertices;
+    std::vector<glm::vec4> transformedVertices;
+    // two slots per clip triangle since near plane clipping can split it
+    std::vector<ScreenTriangle> triangles;
+    std::vector<unsigned char> triangleValid;
+
+    // clip triangles [begin, end)
+    void SetupTriangles(int begin, int end);
+    bool SetupTriangle(const glm::vec4 clip[3], ScreenTriangle& triangle) const;
+    // tile rows [tileBegin, tileEnd)
+    void RasterizeRows(int tileBegin, int tileEnd);
+    void RasterizeTriangle(const ScreenTriangle& triangle, int rowBegin, int rowEnd);
+};
+
+#endif
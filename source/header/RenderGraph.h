@@ -0,0 +1,148 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+#include <array>
+#include <map>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+#include "FrameArena.h"
+
+// Handle to a texture declared in the render graph
+typedef int RGResource;
+
+struct RGTextureDesc {
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    GLenum filter = GL_NEAREST;
+
+    bool operator==(const RGTextureDesc& other) const
+    {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat &&
+            format == other.format && type == other.type && filter == other.filter;
+    }
+};
+
+class RenderGraph;
+
+// Handed to a pass's setup function to declare what the pass reads and writes.
+class RGPassBuilder {
+public:
+    // a transient texture owned by the graph, produced by this pass
+    RGResource CreateTexture(const char* name, const RGTextureDesc& desc);
+    RGResource Read(RGResource resource);
+    // written by the pass through its own framebuffers (e.g. imported shadow maps)
+    RGResource Write(RGResource resource);
+    // written as a render target; the graph binds the framebuffer and viewport before the pass runs
+    RGResource ColorAttachment(RGResource resource);
+    RGResource DepthAttachment(RGResource resource);
+
+private:
+    friend class RenderGraph;
+    RGPassBuilder(RenderGraph& graph, int pass) : graph(graph), pass(pass) {}
+    RenderGraph& graph;
+    int pass;
+};
+
+// Frame graph: passes declare their reads and writes up front, then Compile() culls passes whose
+// results never reach an output and lets transient textures with disjoint lifetimes share memory.
+// The graph is rebuilt every frame; physical textures and framebuffers are pooled across frames and
+// the frame's passes and resources live in the graph's frame arena, so building it does not allocate.
+// Names are not copied and must outlive the frame (string literals).
+class RenderGraph {
+public:
+    static const int MAX_COLOR_ATTACHMENTS = 8;
+
+    RenderGraph();
+    ~RenderGraph();
+
+    // start a new frame; keeps pooled textures and framebuffers
+    void Reset();
+
+    RGResource ImportTexture(const char* name, unsigned int texture);
+    // the default framebuffer; anything that contributes to it is kept alive
+    RGResource ImportBackbuffer(const char* name, int width, int height);
+
+    // setup(RGPassBuilder&) runs right away; execute(RenderGraph&) is copied into the frame arena and
+    // runs in Execute(). It is never destroyed, so it should only capture by reference.
+    template <typename Setup, typename Execute>
+    void AddPass(const char* name, const Setup& setup, const Execute& execute)
+    {
+        static_assert(std::is_trivially_destructible<Execute>::value, "pass functions are never destroyed");
+        Execute* stored = new (arena.Allocate(sizeof(Execute), alignof(Execute))) Execute(execute);
+        RGPassBuilder builder = BeginPass(name, stored,
+            [](void* function, RenderGraph& graph) { (*(Execute*)function)(graph); });
+        setup(builder);
+    }
+
+    void Compile();
+    void Execute();
+
+    // physical GL texture behind a resource, valid during Execute
+    unsigned int GetTexture(RGResource resource) const;
+
+    // compiled pass order, culled passes, transient aliasing and memory footprint
+    void Dump(std::ostream& out) const;
+
+private:
+    friend class RGPassBuilder;
+
+    struct Resource {
+        explicit Resource(FrameArena& arena) : producers(ArenaAllocator<int>(arena)) {}
+
+        const char* name = "";
+        RGTextureDesc desc;
+        bool imported = false;
+        bool output = false;
+        unsigned int texture = 0;
+        // transient only
+        int physical = -1;
+        int firstPass = -1;
+        int lastPass = -1;
+        ArenaVector<int> producers;
+        int refCount = 0;
+    };
+    struct Pass {
+        explicit Pass(FrameArena& arena)
+            : reads(ArenaAllocator<RGResource>(arena)), writes(ArenaAllocator<RGResource>(arena)),
+            colorAttachments(ArenaAllocator<RGResource>(arena)) {}
+
+        const char* name;
+        void* execute;
+        void (*invoke)(void* execute, RenderGraph& graph);
+        ArenaVector<RGResource> reads;
+        ArenaVector<RGResource> writes;
+        ArenaVector<RGResource> colorAttachments;
+        RGResource depthAttachment = -1;
+        int refCount = 0;
+        bool culled = false;
+    };
+    struct PhysicalTexture {
+        RGTextureDesc desc;
+        unsigned int texture;
+        // last pass of the resource currently placed in it, -1 when free this frame
+        int busyUntil;
+    };
+
+    // color attachment textures, then zeros, then the depth texture in the last slot
+    typedef std::array<unsigned int, MAX_COLOR_ATTACHMENTS + 1> FramebufferKey;
+
+    FrameArena arena;
+    ArenaVector<Resource> resources;
+    ArenaVector<Pass> passes;
+    std::vector<PhysicalTexture> pool;
+    std::map<FramebufferKey, unsigned int> framebuffers;
+
+    RGPassBuilder BeginPass(const char* name, void* execute, void (*invoke)(void*, RenderGraph&));
+    void AddWrite(int pass, RGResource resource);
+    int AcquirePhysical(const RGTextureDesc& desc, int firstPass, int lastPass);
+    unsigned int GetFramebuffer(const Pass& pass);
+    static size_t BytesPerPixel(GLenum internalFormat);
+};
+
+#endif
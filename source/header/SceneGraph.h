@@ -0,0 +1,57 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Stable handle to a scene graph node; stays valid while nodes are added around it.
+typedef int SceneNode;
+
+class Mesh;
+
+// A mesh drawn with the world transform of a scene graph node.
+struct MeshInstance {
+    SceneNode node;
+    const Mesh* mesh;
+    // index into mesh->lods for the camera and for shadow maps, picked by SelectLODs()
+    int lod = 0;
+    int shadowLod = 0;
+};
+
+// Transform hierarchy kept as SoA arrays in depth-first order: a parent always comes before its
+// children and every subtree is one contiguous range. Update() walks the arrays once and only
+// recomputes the subtrees below nodes whose local transform changed. New nodes are appended at the
+// end, and the depth-first order is rebuilt once by the next Update(), so building a scene is linear.
+class SceneGraph {
+public:
+    // add a node as the last child of parent (-1 for a root)
+    SceneNode CreateNode(SceneNode parent = -1, const glm::mat4& localTransform = glm::mat4(1.0f));
+
+    void SetLocalTransform(SceneNode node, const glm::mat4& localTransform);
+    const glm::mat4& GetLocalTransform(SceneNode node) const;
+    // valid after Update()
+    const glm::mat4& GetWorldTransform(SceneNode node) const;
+    SceneNode GetParent(SceneNode node) const;
+
+    // recompute the world transforms of dirty subtrees; returns how many nodes were recomputed
+    int Update();
+
+    int NodeCount() const { return (int)parents.size(); }
+
+private:
+    // per sorted slot
+    std::vector<int> parents;
+    std::vector<int> subtreeSizes;
+    std::vector<glm::mat4> localTransforms;
+    std::vector<glm::mat4> worldTransforms;
+    std::vector<unsigned char> dirty;
+    std::vector<SceneNode> slotNodes;
+    // per handle
+    std::vector<int> nodeSlots;
+    // nodes were appended out of depth-first order since the last Update()
+    bool orderDirty = false;
+
+    void RebuildOrder();
+};
+
+#endif
@@ -2,36 +2,47 @@
 #define SHADER_H
 
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
+#include <glm/glm.hpp>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
+#include <vector>
 
+// name/value pairs injected as #define lines when a shader is preprocessed
+typedef std::vector<std::pair<std::string, int>> ShaderDefines;
+
+// uniform buffer binding point of the DrawData block (include/drawData.glsl)
+const unsigned int DRAW_DATA_BINDING = 0;
 
 class Shader
 {
 public:
     // the program ID
-    unsigned int ID;
+    unsigned int ID = 0;
 
     // constructor reads and builds the shader
-    Shader(const char* vertexPath, const char* fragmentPath);
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath);
+    Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines = {});
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const ShaderDefines& defines = {});
     // use/activate the shader
     void use();
     // utility uniform functions
-    void setBool(const std::string& name, bool value) const;
-    void setInt(const std::string& name, int value) const;
-    void setFloat(const std::string& name, float value) const;
-    void setVec3(const std::string& name, glm::vec3 value) const;
-    void setVec4(const std::string& name, glm::vec4 value) const;
-    void setMat4(const std::string& name, glm::mat4 value) const;
+    void setBool(const char* name, bool value) const;
+    void setInt(const char* name, int value) const;
+    void setFloat(const char* name, float value) const;
+    void setVec2(const char* name, glm::vec2 value) const;
+    void setVec3(const char* name, glm::vec3 value) const;
+    void setVec4(const char* name, glm::vec4 value) const;
+    void setMat4(const char* name, glm::mat4 value) const;
     void passMVP(glm::mat4 model, glm::mat4 view, glm::mat4 projection);
 
 private:
     // utility function for checking shader compilation/linking errors.
     void checkCompileErrors(unsigned int shader, std::string type);
+    // point the program's uniform blocks at their fixed binding points
+    void bindUniformBlocks();
 };
 
 #endif
\ No newline at end of file
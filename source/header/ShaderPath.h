@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "Shader.h"
 
 enum class ShaderType { Vertex, Fragment, Geometry };
@@ -15,18 +16,61 @@ inline std::string GetShaderPath(const std::string& name, ShaderType type) {
     return base + name + ext.at(type);
 }
 
-inline Shader CreateShader(const std::string& name, bool hasGeometry = false) {
+// Reads a shader file, resolves #include "file" directives (relative to the including file,
+// each file included once) and injects the given defines right after the #version line.
+std::string PreprocessShaderSource(const std::string& path, const ShaderDefines& defines);
+
+// Order independent hash of a define set, used to find the variant cache bucket.
+unsigned long long HashShaderDefines(const ShaderDefines& defines);
+// Whether two define sets hold the same name/value pairs, in any order.
+bool SameShaderDefines(const ShaderDefines& a, const ShaderDefines& b);
+
+inline Shader CreateShader(const std::string& name, bool hasGeometry = false, const ShaderDefines& defines = {}) {
     if (hasGeometry) {
         return Shader(
             GetShaderPath(name, ShaderType::Vertex).c_str(),
             GetShaderPath(name, ShaderType::Fragment).c_str(),
-            GetShaderPath(name, ShaderType::Geometry).c_str()
+            GetShaderPath(name, ShaderType::Geometry).c_str(),
+            defines
         );
     }
     else {
         return Shader(
             GetShaderPath(name, ShaderType::Vertex).c_str(),
-            GetShaderPath(name, ShaderType::Fragment).c_str()
+            GetShaderPath(name, ShaderType::Fragment).c_str(),
+            defines
         );
     }
-}
\ No newline at end of file
+}
+
+// Compile-time permutations of one shader (e.g. SHADOWS=0/1, NORMAL_MAP=0/1).
+// Variants are compiled on first request and kept for the lifetime of the cache,
+// so the draw path binds a fully specialized program instead of branching per fragment.
+class ShaderVariantCache
+{
+public:
+    ShaderVariantCache(const std::string& name, bool hasGeometry = false);
+
+    Shader& Get(const ShaderDefines& defines);
+    // compile a set of variants up front so the first frame does not hitch
+    void Prewarm(const std::vector<ShaderDefines>& variants);
+    // apply one-off setup (sampler units, static uniforms) to every compiled variant
+    template <typename Func>
+    void ForEach(Func func)
+    {
+        for (auto& variant : variants)
+            func(variant.second.shader);
+    }
+    size_t Count() const { return variants.size(); }
+
+private:
+    // the defines are kept next to the program, so a hash collision is told apart on lookup
+    struct Variant {
+        ShaderDefines defines;
+        Shader shader;
+    };
+
+    std::string name;
+    bool hasGeometry;
+    std::unordered_multimap<unsigned long long, Variant> variants;
+};
@@ -0,0 +1,95 @@
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Frustum.h"
+#include "FunctionRef.h"
+
+class Shader;
+
+// A shadow casting object as seen by the shadow passes.
+struct ShadowCaster {
+    AABB worldBounds;
+    glm::mat4 transform;
+    // the level of detail drawn into the shadow maps, or a hash of them for a caster made of several
+    // meshes; it changes with the camera, and faces holding the caster are redrawn when it does
+    unsigned long long shadowLod = 0;
+};
+
+// Omnidirectional shadows for many point lights packed into one depth texture.
+// Every shadowed light owns a block of six face tiles laid out 3x2; the face size of a block is picked
+// from the light's screen coverage. Faces are only redrawn when the light or the casters inside them
+// changed, and at most maxFaceUpdatesPerFrame faces are redrawn per frame, most important first.
+class ShadowAtlas {
+public:
+    static const int MAX_TILES = 32;
+
+    unsigned int depthAtlas;
+    unsigned int atlasFBO;
+    unsigned int atlasSize;
+    unsigned int minFaceSize;
+    unsigned int maxFaceSize;
+    int maxFaceUpdatesPerFrame;
+    float nearPlane;
+
+    int facesRenderedLastFrame = 0;
+    // faces that were out of date but had to wait for a later frame
+    int facesDeferredLastFrame = 0;
+
+    ShadowAtlas(unsigned int atlasSize = 4096, unsigned int maxFaceSize = 512, unsigned int minFaceSize = 64,
+        int maxFaceUpdatesPerFrame = 12, float nearPlane = 0.1f);
+
+    // Rank the lights by screen coverage and (re)assign tiles. radii bound each light's influence
+    // and are used as its shadow far plane.
+    void Allocate(const std::vector<glm::vec3>& positions, const std::vector<float>& radii,
+        const glm::mat4& viewProjection, const glm::vec3& cameraPos, float fov);
+    // Redraw the most important out of date faces. drawCaster(casterIndex, shader) must set the caster's
+    // per-draw data (model matrix) and draw it. Returns the number of faces that were re-rendered.
+    int Render(Shader& depthShader, const std::vector<ShadowCaster>& casters,
+        FunctionRef<void(int, Shader&)> drawCaster);
+    // upload tile rectangles and the tile of every light (-1 when it has no complete tile yet)
+    void SetUniforms(Shader& shader, int numLights) const;
+    // force every face to be redrawn
+    void Invalidate();
+
+    // tile owned by the light, -1 if it is not shadowed
+    int GetTile(int light) const;
+
+private:
+    struct Block {
+        unsigned int x, y;
+        unsigned int faceSize;
+    };
+    struct Tile {
+        int light = -1;
+        Block block;
+        glm::vec3 position;
+        float farPlane;
+        float importance;
+        glm::mat4 faceMatrices[6];
+        Frustum faceFrusta[6];
+        // signature of the light and the casters that touched each face when it was last drawn
+        unsigned long long faceSignatures[6];
+        bool faceValid[6];
+        // frames a dirty face has been waiting for the update budget
+        int faceWait[6];
+    };
+    struct Shelf {
+        unsigned int y, height, cursor;
+    };
+
+    Tile tiles[MAX_TILES];
+    std::vector<int> lightTiles;
+    std::vector<Block> freeBlocks;
+    std::vector<Shelf> shelves;
+    unsigned int shelfTop = 0;
+
+    bool AllocateBlock(unsigned int faceSize, Block& block);
+    void FreeTile(int tile);
+    void SetupTile(int tile, const glm::vec3& position, float farPlane);
+    bool IsTileReady(int tile) const;
+};
+
+#endif
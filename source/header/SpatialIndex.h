@@ -0,0 +1,89 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <vector>
+#include "BVH.h"
+#include "ECS.h"
+#include "Frustum.h"
+#include "FunctionRef.h"
+
+// Dynamic AABB tree over scene entities. Leaves store their box enlarged by a margin, so objects that
+// move a little need no tree update at all; insertion picks the sibling by surface area and AVL
+// rotations keep the tree balanced, so insert, move and remove are O(log n).
+// Nodes live in one pool addressed by index. Traversal only touches the hot part (box, children);
+// the exact leaf boxes and entities are kept in separate arrays.
+// Queries see moves only after Refit().
+class SpatialIndex {
+public:
+    explicit SpatialIndex(float margin = 0.1f);
+
+    // returns the proxy that names the entry in Move() and Remove()
+    int Insert(const AABB& box, Entity entity);
+    void Remove(int proxy);
+    // a box that still fits the stored margin is free. Otherwise a box that overlaps its old one grows
+    // the leaf in place until the next Refit(), and one that jumped away is reinserted.
+    void Move(int proxy, const AABB& box);
+    // refit the ancestors of every leaf grown since the last call, bottom up in one pass
+    void Refit();
+
+    int Count() const { return leafCount; }
+    Entity GetEntity(int proxy) const { return entities[proxy]; }
+    const AABB& GetBounds(int proxy) const { return leafBounds[proxy]; }
+
+    // entities whose boxes intersect the frustum or the sphere, appended to results
+    void Query(const Frustum& frustum, std::vector<Entity>& results) const;
+    void Query(const glm::vec3& center, float radius, std::vector<Entity>& results) const;
+    // func(entity) for every box intersecting the frustum. Subtrees are traversed as parallel jobs, so
+    // func runs on several threads at once.
+    void ParallelQuery(const Frustum& frustum, FunctionRef<void(Entity)> func) const;
+    // the k entities whose boxes are nearest to point, nearest first, replacing results
+    void Nearest(const glm::vec3& point, int k, std::vector<Entity>& results) const;
+    // func(entity, tMax) for every box the ray passes within (ray.tMin, tMax), nearer subtrees first;
+    // func returns the new tMax, e.g. the distance of a hit it found inside the box
+    void RayCast(const Ray& ray, FunctionRef<float(Entity, float)> func) const;
+
+private:
+    static const int NONE = -1;
+    static const int TRAVERSAL_STACK_SIZE = 128;
+
+    struct Node {
+        // enlarged by the margin for leaves, the union of the children for inner nodes
+        AABB box;
+        int parent;
+        // child[0] < 0 for leaves
+        int child[2];
+        // leaves are 0, free nodes -1
+        int height;
+
+        bool IsLeaf() const { return child[0] == NONE; }
+    };
+
+    float margin;
+    int root = NONE;
+    int freeList = NONE;
+    int leafCount = 0;
+    std::vector<Node> nodes;
+    // exact box and entity of every leaf, indexed like nodes
+    std::vector<AABB> leafBounds;
+    std::vector<Entity> entities;
+    // leaves grown in place since the last Refit()
+    std::vector<int> grown;
+    // ancestors to refit, and which nodes are already in that list
+    std::vector<int> dirty;
+    std::vector<bool> marked;
+
+    int AllocateNode();
+    void FreeNode(int node);
+    void InsertLeaf(int leaf);
+    void RemoveLeaf(int leaf);
+    // rotate the subtree at a if it is unbalanced, returning the node now in its place
+    int Balance(int a);
+    // collect the leaves below node
+    template <typename Func>
+    void EachLeaf(int node, const Func& func) const;
+    // frustum traversal below node, treating everything under a fully contained box as visible
+    template <typename Func>
+    void QueryFrustum(int node, const Frustum& frustum, const Func& func) const;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SYSTEMS_H
+#define SYSTEMS_H
+
+#include <vector>
+#include "Components.h"
+#include "ECS.h"
+#include "SceneGraph.h"
+
+class OcclusionCuller;
+class SceneGraph;
+class SpatialIndex;
+struct Ray;
+struct RayHit;
+
+// Per frame systems over the scene's World. Run UpdateTransforms() after SceneGraph::Update(),
+// UpdateBounds() and UpdateSpatialIndex() after that; the culling, picking and light systems read
+// their results.
+
+// copy world matrices from the scene graph
+void UpdateTransforms(World& world, const SceneGraph& graph);
+// transform local bounds by the world matrix
+void UpdateBounds(World& world);
+// move every proxy to its entity's world bounds and refit the index
+void UpdateSpatialIndex(World& world, SpatialIndex& index);
+// set Renderable::visible for the entities the index finds in the frustum, clear it for the rest
+void FrustumCullRenderables(World& world, const SpatialIndex& index, const Frustum& frustum);
+// add the occluder of every visible renderable between BeginFrame() and Rasterize()
+void AddOccluders(World& world, OcclusionCuller& culler);
+// clear Renderable::visible of the visible renderables the culler's depth buffer hides
+void CullRenderables(World& world, OcclusionCuller& culler);
+// nearest mesh hit of the renderables the index finds along the ray; hit.instance is the entity index
+bool PickEntity(World& world, const SpatialIndex& index, const std::vector<MeshInstance>& instances,
+    const SceneGraph& graph, const Ray& ray, RayHit& hit);
+// Where levels of detail are picked from: errors are projected at the distance from position and
+// compared against errorThreshold pixels.
+struct LODView {
+    glm::vec3 position;
+    // screen height / (2 tan(fov / 2)): pixels covered by one unit at distance one
+    float pixelsPerUnit;
+    float errorThreshold;
+};
+// pick MeshInstance::lod for view and MeshInstance::shadowLod for shadowView, the coarsest level whose
+// projected error stays under the threshold; a level is only left once it is clearly too coarse or
+// a coarser one is clearly fine, so objects at the switch distance do not flicker
+void SelectLODs(World& world, std::vector<MeshInstance>& instances, const SceneGraph& graph,
+    const LODView& view, const LODView& shadowView);
+// gather the point lights into one array in creation order, ready for upload
+void PackPointLights(World& world, std::vector<PointLight>& lights);
+
+// the entities each light reached, kept between frames so AssignLights() stops allocating
+struct LightAssignment {
+    std::vector<std::vector<Entity>> reached;
+};
+// fill every LightList with the strongest of the lights (PackPointLights() order) whose radius reaches
+// the entity's world bounds; the lights query the spatial index in parallel
+void AssignLights(World& world, const SpatialIndex& index, const std::vector<PointLight>& lights, LightAssignment& assignment);
+
+// distance at which the light's attenuated contribution drops below 5/256
+float CalculatePointLightRadius(const PointLight& light);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef TANGENT_SPACE_H
+#define TANGENT_SPACE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Mesh.h"
+
+// Vertex attributes split into one array per component, so a component of four triangles' corners
+// loads into one SSE register.
+struct TangentStreams {
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> u, v;
+
+    size_t Size() const { return positionX.size(); }
+};
+
+// Per-vertex tangents following MikkTSpace: every triangle's direction of increasing u is projected
+// into the tangent plane of each corner's normal and summed weighted by the corner angle, and the
+// bitangent's handedness goes to w. Normals are expected to be unit length. Triangles without area or
+// without a UV mapping contribute nothing, and vertices only they touch get any tangent perpendicular
+// to their normal, never a NaN.
+// Unlike MikkTSpace, vertices are not split where mirrored UVs meet (the index buffer stays as it is);
+// such vertices take the handedness of the larger angle.
+// Triangles are evaluated four at a time with SSE, in one chunk per thread. Every chunk sums into its
+// own window of the vertices, which stays small as meshes keep neighbouring triangles on neighbouring
+// vertices, and the windows are then added up per vertex, so no two threads write the same memory.
+void GenerateTangents(const TangentStreams& streams, const std::vector<unsigned int>& indices, std::vector<glm::vec4>& tangents);
+// fills Tangent and Bitangent of the interleaved vertices, the bitangent as w * cross(normal, tangent)
+void GenerateTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// One buffer for the small per-draw data of a frame (model matrices, flat colors), written by the CPU
+// with a bump allocator and bound by range for each draw, instead of one glUniform call per value.
+// With GL_ARB_buffer_storage the buffer is split into `frames` regions and mapped persistently once;
+// a fence at the end of each frame tells when the GPU is done with a region so it can be reused.
+// Without it the writes are staged on the CPU, the buffer is orphaned every frame and Flush() uploads
+// the staged bytes.
+class UploadRing {
+public:
+    struct Stats {
+        // frames that had to wait for the GPU to release their region
+        unsigned int stalls = 0;
+        float stallMs = 0.0f;
+        size_t bytes = 0;
+    };
+
+    UploadRing(GLenum target, size_t frameBytes, int frames = 3);
+    ~UploadRing();
+
+    // wait until the next region is free and start allocating from it
+    void BeginFrame();
+    // size bytes for this frame aligned for binding; returns where to write them, or nullptr when the
+    // frame's region is full. offset receives the byte offset to bind
+    void* Allocate(size_t size, size_t& offset);
+    // make the writes since the last Flush visible to draws issued from here on
+    void Flush();
+    // fence the region; nothing may be allocated until the next BeginFrame
+    void EndFrame();
+
+    unsigned int GetBuffer() const { return buffer; }
+    bool IsPersistent() const { return persistent; }
+
+    Stats frame;
+    Stats lastFrame;
+
+private:
+    GLenum target;
+    unsigned int buffer = 0;
+    bool persistent = false;
+    size_t alignment;
+    size_t frameBytes;
+    int frames;
+    int current;
+    // persistent: base of the mapping, fallback: the staging copy of one frame
+    unsigned char* memory = nullptr;
+    std::vector<unsigned char> staging;
+    std::vector<GLsync> fences;
+    // offsets inside the current frame's region
+    size_t head = 0;
+    size_t flushed = 0;
+    bool overflowReported = false;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef VERTEX_WELD_H
+#define VERTEX_WELD_H
+
+#include <vector>
+#include "Mesh.h"
+
+// How far apart the attributes of vertices that weld may be. Every component is snapped to a grid of
+// this spacing, so values within it usually, but not always, land in the same cell; a tolerance of
+// zero welds only bit identical values.
+struct WeldTolerances {
+    float position = 1e-5f;
+    float normal = 1e-3f;
+    float texCoord = 1e-5f;
+    float tangent = 1e-3f;
+};
+
+// Merges vertices whose position, normal, UV, tangent and bitangent snap to the same cells into the
+// first of them, keeping the order of first use, and remaps indices to match. Lookups go through an
+// open addressing hash table over the snapped keys. Returns how many vertices were removed.
+size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+    const WeldTolerances& tolerances = WeldTolerances());
+
+#endif
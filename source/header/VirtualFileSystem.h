@@ -0,0 +1,46 @@
+#ifndef VIRTUAL_FILE_SYSTEM_H
+#define VIRTUAL_FILE_SYSTEM_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "AssetArchive.h"
+#include "MappedFile.h"
+
+// The bytes of one asset: in place inside a mounted archive when the entry is stored, decompressed
+// into memory the file owns when it is LZ4, or a mapped loose file.
+class AssetFile {
+public:
+    AssetFile() = default;
+    AssetFile(const AssetFile&) = delete;
+    AssetFile& operator=(const AssetFile&) = delete;
+
+    // not null terminated
+    const char* Data() const { return data; }
+    size_t Size() const { return size; }
+    bool FromArchive() const { return fromArchive; }
+
+private:
+    friend class VirtualFileSystem;
+    const char* data = nullptr;
+    size_t size = 0;
+    bool fromArchive = false;
+    std::vector<char> decompressed;
+    MappedFile loose;
+};
+
+// Resolves asset paths ("resources/shaders/gBuffer.vs") against the mounted archives, the last
+// mounted first, and falls back to loose files, so a tree without archives runs as before. Mount
+// from the main thread before loading; opening is safe from any thread afterwards.
+class VirtualFileSystem {
+public:
+    static bool Mount(const std::string& archivePath);
+    static void UnmountAll();
+    static bool Open(const std::string& path, AssetFile& file);
+    static bool Exists(const std::string& path);
+
+private:
+    static std::vector<std::unique_ptr<AssetArchive>> archives;
+};
+
+#endif
@@ -2,33 +2,32 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
-layout (location = 3) in vec3 aTangent;
+layout (location = 3) in vec4 aTangent;
 layout (location = 4) in vec3 aBitangent;
 
 out vec3 WorldPos;
 out vec3 Normal;
 out vec2 TexCoord;
 out mat3 TBN;
-out vec4 FragPosLightSpace;
 
-uniform mat4 model;
+#include "include/drawData.glsl"
+
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
 
 void main()
 {
     //TBN
-    vec3 T = normalize(vec3(model * vec4(aTangent, 0.0)));
-    vec3 B = normalize(vec3(model * vec4(aBitangent, 0.0)));
+    vec3 T = normalize(vec3(model * vec4(aTangent.xyz, 0.0)));
     vec3 N = normalize(vec3(model * vec4(aNormal, 0.0)));
+    // rebuilt from the handedness where the mesh has no bitangent attribute (see gBuffer.vs)
+    vec3 B = dot(aBitangent, aBitangent) > 0.0 ? normalize(vec3(model * vec4(aBitangent, 0.0))) : cross(N, T) * aTangent.w;
     TBN = mat3(T, B, N);
 
     
     WorldPos = vec3(model * vec4(aPos, 1.0f)); 
     Normal =  mat3(transpose(inverse(model))) * aNormal;
     TexCoord = aTexCoord;
-    FragPosLightSpace = lightSpaceMatrix * vec4(WorldPos, 1.0);
 
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 } 
\ No newline at end of file
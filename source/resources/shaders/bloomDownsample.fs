@@ -0,0 +1,70 @@
+#version 330 core
+layout (location = 0) out vec3 downsample;
+
+in vec2 TexCoords;
+
+uniform sampler2D srcTexture;
+uniform vec2 srcResolution;
+// 0 for the first pass out of the HDR scene, which also applies the bright pass
+uniform int mipLevel;
+uniform float threshold;
+uniform float softThreshold;
+
+vec3 BrightPass(vec3 color)
+{
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    return color * clamp((brightness - threshold) / softThreshold, 0.0, 1.0);
+}
+
+// weighted average of a 2x2 group; damps single very bright pixels that would otherwise flicker
+vec3 KarisAverage(vec3 a, vec3 b, vec3 c, vec3 d)
+{
+    float wa = 1.0 / (1.0 + dot(a, vec3(0.2126, 0.7152, 0.0722)));
+    float wb = 1.0 / (1.0 + dot(b, vec3(0.2126, 0.7152, 0.0722)));
+    float wc = 1.0 / (1.0 + dot(c, vec3(0.2126, 0.7152, 0.0722)));
+    float wd = 1.0 / (1.0 + dot(d, vec3(0.2126, 0.7152, 0.0722)));
+    return (a * wa + b * wb + c * wc + d * wd) / (wa + wb + wc + wd);
+}
+
+void main()
+{
+    vec2 texel = 1.0 / srcResolution;
+
+    // 13 bilinear taps around the destination texel:
+    // a - b - c
+    // - j - k -
+    // d - e - f
+    // - l - m -
+    // g - h - i
+    vec3 a = texture(srcTexture, TexCoords + texel * vec2(-2.0,  2.0)).rgb;
+    vec3 b = texture(srcTexture, TexCoords + texel * vec2( 0.0,  2.0)).rgb;
+    vec3 c = texture(srcTexture, TexCoords + texel * vec2( 2.0,  2.0)).rgb;
+    vec3 d = texture(srcTexture, TexCoords + texel * vec2(-2.0,  0.0)).rgb;
+    vec3 e = texture(srcTexture, TexCoords).rgb;
+    vec3 f = texture(srcTexture, TexCoords + texel * vec2( 2.0,  0.0)).rgb;
+    vec3 g = texture(srcTexture, TexCoords + texel * vec2(-2.0, -2.0)).rgb;
+    vec3 h = texture(srcTexture, TexCoords + texel * vec2( 0.0, -2.0)).rgb;
+    vec3 i = texture(srcTexture, TexCoords + texel * vec2( 2.0, -2.0)).rgb;
+    vec3 j = texture(srcTexture, TexCoords + texel * vec2(-1.0,  1.0)).rgb;
+    vec3 k = texture(srcTexture, TexCoords + texel * vec2( 1.0,  1.0)).rgb;
+    vec3 l = texture(srcTexture, TexCoords + texel * vec2(-1.0, -1.0)).rgb;
+    vec3 m = texture(srcTexture, TexCoords + texel * vec2( 1.0, -1.0)).rgb;
+
+    // five overlapping 2x2 boxes: the centre one weighted 0.5, the corner ones 0.125 each
+    if (mipLevel == 0)
+    {
+        downsample  = BrightPass(KarisAverage(j, k, l, m)) * 0.5;
+        downsample += BrightPass(KarisAverage(a, b, d, e)) * 0.125;
+        downsample += BrightPass(KarisAverage(b, c, e, f)) * 0.125;
+        downsample += BrightPass(KarisAverage(d, e, g, h)) * 0.125;
+        downsample += BrightPass(KarisAverage(e, f, h, i)) * 0.125;
+    }
+    else
+    {
+        downsample  = e * 0.125;
+        downsample += (a + c + g + i) * 0.03125;
+        downsample += (b + d + f + h) * 0.0625;
+        downsample += (j + k + l + m) * 0.125;
+    }
+    downsample = max(downsample, 0.0001);
+}
@@ -3,29 +3,60 @@ layout(location = 0) out vec4 FragColor;
 
 in vec2 TexCoords;
 
+// SOURCE_ARRAY: read one layer of a texture array (shadow cascades) instead of a 2D image
+// EVSM_WARP: the source is depth, warped into exponential shadow moments before it is filtered
+#ifndef SOURCE_ARRAY
+#define SOURCE_ARRAY 0
+#endif
+#ifndef EVSM_WARP
+#define EVSM_WARP 0
+#endif
+
+#if SOURCE_ARRAY
+uniform sampler2DArray image;
+uniform int layer;
+#else
 uniform sampler2D image;
+#endif
+#if EVSM_WARP
+uniform float evsmExponent;
+#endif
 
 uniform bool horizontal;
 const float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
 
+vec3 Fetch(vec2 uv)
+{
+#if SOURCE_ARRAY
+    vec3 value = texture(image, vec3(uv, layer)).rgb;
+#else
+    vec3 value = texture(image, uv).rgb;
+#endif
+#if EVSM_WARP
+    float warped = exp(evsmExponent * (value.r * 2.0 - 1.0));
+    value = vec3(warped, warped * warped, 0.0);
+#endif
+    return value;
+}
+
 void main()
 {             
-     vec2 tex_offset = 1.0 / textureSize(image, 0); // gets size of single texel
-     vec3 result = texture(image, TexCoords).rgb * weight[0];
+     vec2 tex_offset = 1.0 / textureSize(image, 0).xy; // gets size of single texel
+     vec3 result = Fetch(TexCoords) * weight[0];
      if(horizontal)
      {
          for(int i = 1; i < 5; ++i)
          {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
+            result += Fetch(TexCoords + vec2(tex_offset.x * i, 0.0)) * weight[i];
+            result += Fetch(TexCoords - vec2(tex_offset.x * i, 0.0)) * weight[i];
          }
      }
      else
      {
          for(int i = 1; i < 5; ++i)
          {
-             result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-             result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
+             result += Fetch(TexCoords + vec2(0.0, tex_offset.y * i)) * weight[i];
+             result += Fetch(TexCoords - vec2(0.0, tex_offset.y * i)) * weight[i];
          }
      }
      FragColor = vec4(result,1.0);
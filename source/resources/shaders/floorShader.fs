@@ -5,73 +5,16 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
 } fs_in;
 
-struct DirLight {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-    float constant;
-    float linear;
-    float quadratic;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
+#include "include/drawData.glsl"
+#include "include/lights.glsl"
+#include "include/shadows.glsl"
 
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;       // for directional light
-
-uniform int NumPointLights;
-#define MAX_POINT_LIGHTS 100
-uniform PointLight pointLights[MAX_POINT_LIGHTS];
-uniform DirLight dirLight;
 
 uniform vec3 viewPos;
 
-uniform float far_plane;
-uniform bool shadows;
-uniform bool usePointLight;
-
-/////////////////////////////////////////////////////
-// Directional Light Shadow Calculation
-float ShadowCalculationDirLight(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
-{
-    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    projCoords = projCoords * 0.5 + 0.5;
-
-    if (projCoords.z > 1.0 || projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0)
-        return 0.0;
-
-    float currentDepth = projCoords.z;
-    float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.01);
-    float shadow = 0.0;
-
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for (int x = -1; x <= 1; ++x)
-    {
-        for (int y = -1; y <= 1; ++y)
-        {
-            vec2 offsetCoord = projCoords.xy + vec2(x, y) * texelSize;
-            if (offsetCoord.x >= 0.0 && offsetCoord.x <= 1.0 &&
-                offsetCoord.y >= 0.0 && offsetCoord.y <= 1.0)
-            {
-                float pcfDepth = texture(shadowMap, offsetCoord).r;
-                shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
-            }
-        }
-    }
-    shadow /= 9.0;
-    return shadow;
-}
-
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
@@ -108,15 +51,17 @@ void main()
     vec3 specular = spec * dirLight.specular;
     vec3 ambient = dirLight.ambient;
 
-    float shadow = 0.0;
-    if (shadows && !usePointLight)
-        shadow = ShadowCalculationDirLight(fs_in.FragPosLightSpace, normal, lightDir);
+    float shadow = ShadowCalculationDirLight(fs_in.FragPos, normal, lightDir);
 
     vec3 result = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;
     // Add all point lights
-    for (int i = 0; i < NumPointLights; ++i)
+    int lightCount = DrawLightCount(NumPointLights);
+    for (int k = 0; k < lightCount; ++k)
     {
-        result += CalcPointLight(pointLights[i], normal, fs_in.FragPos, viewDir);
+        int i = DrawLight(k);
+        vec3 lighting = CalcPointLight(pointLights[i], normal, fs_in.FragPos, viewDir);
+        lighting *= 1.0 - ShadowCalculationPointLight(fs_in.FragPos, pointLights[i].position, pointLights[i].shadowTile);
+        result += lighting;
     }
     
     FragColor = vec4(result, 1);
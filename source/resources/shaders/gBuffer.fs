@@ -13,12 +13,23 @@ struct Material {
     sampler2D texture_specular1;
     sampler2D texture_normal1;
     sampler2D texture_roughness1;
+    // glTF metallic-roughness parameters, set by every mesh (defaults 1, 0, 1, false)
+    vec4 baseColorFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    bool metallicRoughness;
 };
 
+// compile-time permutations selected by the draw path
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 1
+#endif
+#ifndef DIFFUSE_MAP
+#define DIFFUSE_MAP 1
+#endif
+
 uniform Material material;
-uniform bool hasNormalTexture;
-uniform bool hasDiffuseTexture;
-uniform vec3 color;
+#include "include/drawData.glsl"
 
 void main()
 {    
@@ -26,29 +37,38 @@ void main()
     gPosition = FragPos;
     
     // Get normal from normal map if available, otherwise use vertex normal
-    vec3 normal = vec3(1, 0, 0);
-    if (hasNormalTexture) {
-        vec3 normalRGB = normalize(texture(material.texture_normal1, TexCoords).rgb * 2.0 - 1.0);
-        normal = normalize(TBN * normalRGB);
-    } else {
-        normal = normalize(Normal);
-    }
+#if NORMAL_MAP
+    vec3 normalRGB = normalize(texture(material.texture_normal1, TexCoords).rgb * 2.0 - 1.0);
+    vec3 normal = normalize(TBN * normalRGB);
+#else
+    vec3 normal = normalize(Normal);
+#endif
     gNormal = normal;
     
     // Get diffuse color
+#if DIFFUSE_MAP
     vec4 diffuseColor = texture(material.texture_diffuse1, TexCoords);
     if(diffuseColor.a < 0.1) // If no texture or transparent
         diffuseColor = vec4(0.95, 0.95, 0.95, 1.0); // Default white color
-    if(hasDiffuseTexture){
-        gAlbedoSpec.rgb = diffuseColor.rgb;
-    }else{
-        gAlbedoSpec.rgb = color;
-    }
-    
+    gAlbedoSpec.rgb = diffuseColor.rgb * material.baseColorFactor.rgb;
+#else
+    gAlbedoSpec.rgb = drawColor.rgb;
+#endif
 
     
     // Get specular and roughness
-    vec4 specularColor = texture(material.texture_specular1, TexCoords);
-    float roughness = texture(material.texture_roughness1, TexCoords).r;
-    gAlbedoSpec.a = specularColor.r * (1.0 - roughness); // Combine specular and roughness
+    if (material.metallicRoughness)
+    {
+        vec4 packedMap = texture(material.texture_roughness1, TexCoords);
+        float roughness = packedMap.g * material.roughnessFactor;
+        float metallic = packedMap.b * material.metallicFactor;
+        // the lighting has one specular weight: dielectrics reflect about 4%, metals all of it
+        gAlbedoSpec.a = mix(0.04, 1.0, metallic) * (1.0 - roughness);
+    }
+    else
+    {
+        vec4 specularColor = texture(material.texture_specular1, TexCoords);
+        float roughness = texture(material.texture_roughness1, TexCoords).r;
+        gAlbedoSpec.a = specularColor.r * (1.0 - roughness); // Combine specular and roughness
+    }
 }  
\ No newline at end of file
@@ -2,7 +2,9 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
+// w is the bitangent's handedness; the interleaved layout leaves it at the default 1
+layout (location = 3) in vec4 aTangent;
+// zero for meshes drawn from their stored streams, which have no bitangent attribute
 layout (location = 4) in vec3 aBitangent;
 
 out vec3 FragPos;
@@ -10,7 +12,7 @@ out vec2 TexCoords;
 out vec3 Normal;
 out mat3 TBN;
 
-uniform mat4 model;
+#include "include/drawData.glsl"
 uniform mat4 view;
 uniform mat4 projection;
 
@@ -24,9 +26,9 @@ void main()
     Normal = normalMatrix * aNormal;
     
     // Calculate TBN matrix
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 B = normalize(normalMatrix * aBitangent);
+    vec3 T = normalize(normalMatrix * aTangent.xyz);
     vec3 N = normalize(Normal);
+    vec3 B = dot(aBitangent, aBitangent) > 0.0 ? normalize(normalMatrix * aBitangent) : cross(N, T) * aTangent.w;
     TBN = mat3(T, B, N);
 
     gl_Position = projection * view * worldPos;
@@ -0,0 +1,19 @@
+// Per-draw constants, written once per frame into the upload ring and bound by range for each draw.
+// Must match DrawData in main.cpp; bound to DRAW_DATA_BINDING (Shader.h).
+layout (std140) uniform DrawData {
+    mat4 model;
+    vec4 drawColor;     // rgb: flat color of untextured draws
+    ivec4 drawLights[2];    // forward shading: pointLights[] indices of the lights reaching the draw
+    int drawLightCount;     // -1 shades with every point light, for draws too large for a list (the floor)
+};
+
+// number of point lights a forward shaded draw is lit by, and the pointLights[] index of the k-th
+int DrawLightCount(int numPointLights)
+{
+    return drawLightCount < 0 ? numPointLights : drawLightCount;
+}
+
+int DrawLight(int k)
+{
+    return drawLightCount < 0 ? k : drawLights[k / 4][k % 4];
+}
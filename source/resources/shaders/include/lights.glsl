@@ -0,0 +1,36 @@
+// Light types shared by the forward and deferred lighting shaders.
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    int shadowTile;     // tile in the shadow atlas, -1 when the light casts no shadow
+};
+
+#define MAX_POINT_LIGHTS 100
+uniform int NumPointLights;
+uniform PointLight pointLights[MAX_POINT_LIGHTS];
+uniform DirLight dirLight;
+
+vec3 ApplyPBRLighting(vec3 normalWorld, vec3 lightDir, vec3 viewDir, float shininess,
+                      vec3 lightAmbient, vec3 lightDiffuse, vec3 lightSpecular,
+                      vec3 diffuseColor, vec3 specularColor)
+{
+    float diff = max(dot(normalWorld, lightDir), 0.0);
+    vec3 halfVec = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normalWorld, halfVec), 0.0), shininess);
+    vec3 ambient = lightAmbient * diffuseColor;
+    vec3 diffuse = lightDiffuse * diff * diffuseColor;
+    vec3 specular = lightSpecular * spec * specularColor;
+    return ambient + diffuse + specular;
+}
@@ -0,0 +1,136 @@
+// Directional and point light shadow lookups shared by the forward and deferred lighting shaders.
+// Compiled out entirely in the SHADOWS=0 variant.
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+// SHADOW_EVSM: sample pre-filtered exponential variance moments instead of doing PCF on depth
+#ifndef SHADOW_EVSM
+#define SHADOW_EVSM 0
+#endif
+
+#define MAX_CASCADES 4
+
+uniform sampler2DArray shadowMap;          // one layer per cascade
+uniform sampler2DArray shadowMoments;      // blurred, mipmapped EVSM moments, one layer per cascade
+uniform float evsmExponent;
+uniform mat4 lightSpaceMatrices[MAX_CASCADES];
+uniform float cascadePlaneDistances[MAX_CASCADES];
+uniform int cascadeCount;
+uniform mat4 view;
+
+#define MAX_SHADOW_TILES 32
+
+uniform sampler2D shadowAtlas;                      // point light faces, linear light distance / far plane
+uniform vec4 shadowAtlasTiles[MAX_SHADOW_TILES];    // xy: block origin, z: face size (atlas uv), w: far plane
+
+// Pick the first cascade whose slice contains the fragment's view depth
+int SelectCascade(vec3 worldPos)
+{
+    float depth = abs((view * vec4(worldPos, 1.0)).z);
+    for (int i = 0; i < cascadeCount - 1; ++i)
+    {
+        if (depth < cascadePlaneDistances[i])
+            return i;
+    }
+    return cascadeCount - 1;
+}
+
+// Directional light shadow map
+float ShadowCalculationDirLight(vec3 worldPos, vec3 normal, vec3 lightDir)
+{
+#if SHADOWS
+    int layer = SelectCascade(worldPos);
+    vec4 fragPosLightSpace = lightSpaceMatrices[layer] * vec4(worldPos, 1.0);
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    projCoords = projCoords * 0.5 + 0.5;
+
+    if (projCoords.z > 1.0 || projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0)
+        return 0.0;
+
+#if SHADOW_EVSM
+    // one filtered fetch; the Chebyshev bound gives the fraction of light that gets through
+    vec2 moments = texture(shadowMoments, vec3(projCoords.xy, layer)).rg;
+    float warpedDepth = exp(evsmExponent * (projCoords.z * 2.0 - 1.0));
+    float depthScale = 0.0001 * evsmExponent * warpedDepth;
+    float variance = max(moments.y - moments.x * moments.x, depthScale * depthScale);
+    float d = warpedDepth - moments.x;
+    float pMax = warpedDepth <= moments.x ? 1.0 : variance / (variance + d * d);
+    // cut off the tail of the bound to reduce light bleeding
+    pMax = clamp((pMax - 0.2) / 0.8, 0.0, 1.0);
+    return 1.0 - pMax;
+#else
+    float currentDepth = projCoords.z;
+    // normalise the slope bias against the depth range of the selected cascade
+    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+    bias *= 1.0 / (cascadePlaneDistances[layer] * 0.5);
+    float shadow = 0.0;
+
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            vec2 offsetCoord = projCoords.xy + vec2(x, y) * texelSize;
+            if (offsetCoord.x >= 0.0 && offsetCoord.x <= 1.0 &&
+                offsetCoord.y >= 0.0 && offsetCoord.y <= 1.0)
+            {
+                float pcfDepth = texture(shadowMap, vec3(offsetCoord, layer)).r;
+                shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            }
+        }
+    }
+    shadow /= 9.0;
+    return shadow;
+#endif
+#else
+    return 0.0;
+#endif
+}
+
+// Point light shadow from the six face tiles the light owns in the shadow atlas
+float ShadowCalculationPointLight(vec3 fragPos, vec3 lightPos, int tile)
+{
+#if SHADOWS
+    if (tile < 0)
+        return 0.0;
+    vec4 rect = shadowAtlasTiles[tile];
+    vec3 fragToLight = fragPos - lightPos;
+    float currentDepth = length(fragToLight);
+    if (currentDepth >= rect.w)
+        return 0.0;
+
+    // select the face and its coordinates the same way cube map sampling does
+    vec3 a = abs(fragToLight);
+    int face;
+    vec2 sc;
+    float ma;
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        face = fragToLight.x > 0.0 ? 0 : 1;
+        sc = vec2(fragToLight.x > 0.0 ? -fragToLight.z : fragToLight.z, -fragToLight.y);
+        ma = a.x;
+    }
+    else if (a.y >= a.z)
+    {
+        face = fragToLight.y > 0.0 ? 2 : 3;
+        sc = vec2(fragToLight.x, fragToLight.y > 0.0 ? fragToLight.z : -fragToLight.z);
+        ma = a.y;
+    }
+    else
+    {
+        face = fragToLight.z > 0.0 ? 4 : 5;
+        sc = vec2(fragToLight.z > 0.0 ? fragToLight.x : -fragToLight.x, -fragToLight.y);
+        ma = a.z;
+    }
+    vec2 faceUV = sc / ma * 0.5 + 0.5;
+
+    // faces sit 3x2 inside the block; stay half a texel inside so neighbouring tiles never bleed in
+    float halfTexel = 0.5 / float(textureSize(shadowAtlas, 0).x);
+    vec2 uv = rect.xy + vec2(face % 3, face / 3) * rect.z + clamp(faceUV * rect.z, vec2(halfTexel), vec2(rect.z - halfTexel));
+    float closestDepth = texture(shadowAtlas, uv).r * rect.w;
+    float bias = 0.05;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+#else
+    return 0.0;
+#endif
+}
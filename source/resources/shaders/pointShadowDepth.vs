@@ -1,9 +1,13 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
+#include "include/drawData.glsl"
+uniform mat4 shadowMatrix;  // matrix of the cube face being rendered into its atlas tile
+
+out vec4 FragPos;
 
 void main()
 {
-    gl_Position = model * vec4(aPos, 1.0);
-}  
\ No newline at end of file
+    FragPos = model * vec4(aPos, 1.0);
+    gl_Position = shadowMatrix * FragPos;
+}
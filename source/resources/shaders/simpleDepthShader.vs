@@ -2,7 +2,7 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+#include "include/drawData.glsl"
 
 void main()
 {